@@ -18,6 +18,8 @@ fi
 if [ "x${ENABLE_BITCOIND}${ENABLE_UTILS}${ENABLE_WALLET}" = "x111" ]; then
   ${BUILDDIR}/test/wallet.py
   ${BUILDDIR}/test/segwit.py
+  ${BUILDDIR}/test/rest.py
+  ${BUILDDIR}/test/httpserver.py
 else
   echo "No rpc tests to run. Wallet, utils, and bitcoind must all be enabled"
 fi
@@ -0,0 +1,228 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string.h>
+
+//! On-disk format of the -addrindex records; bump when the layout changes
+static const int ADDRINDEX_VERSION = 2;
+
+/**
+ * Height and position fields of the address index keys are stored big endian,
+ * so that LevelDB iterates the entries of one script hash in chain order.
+ */
+template <typename Stream>
+inline void WriteIndexBE32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline uint32_t ReadIndexBE32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ReadBE32(buf);
+}
+
+/**
+ * One credit (output) or debit (spent input) of a script hash, keyed by
+ * (script hash, height, txid, index, spending). The value is the signed amount.
+ */
+struct CAddressIndexKey {
+    uint160 hashScript;
+    int nHeight;
+    uint256 txid;
+    unsigned int nIndex; //! output index for credits, input index for debits
+    bool fSpending;
+
+    CAddressIndexKey(const uint160& hashScriptIn, int nHeightIn, const uint256& txidIn, unsigned int nIndexIn, bool fSpendingIn)
+        : hashScript(hashScriptIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashScript = 0;
+        nHeight = 0;
+        txid = 0;
+        nIndex = 0;
+        fSpending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 20 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        hashScript.Serialize(s, nType, nVersion);
+        WriteIndexBE32(s, nHeight);
+        txid.Serialize(s, nType, nVersion);
+        WriteIndexBE32(s, nIndex);
+        ::Serialize(s, (char)fSpending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        hashScript.Unserialize(s, nType, nVersion);
+        nHeight = ReadIndexBE32(s);
+        txid.Unserialize(s, nType, nVersion);
+        nIndex = ReadIndexBE32(s);
+        char f;
+        ::Unserialize(s, f, nType, nVersion);
+        fSpending = f != 0;
+    }
+
+    friend bool operator==(const CAddressIndexKey& a, const CAddressIndexKey& b)
+    {
+        return a.hashScript == b.hashScript && a.nHeight == b.nHeight && a.txid == b.txid &&
+               a.nIndex == b.nIndex && a.fSpending == b.fSpending;
+    }
+
+    //! Order of the entries across script hashes, used to merge multi-address queries
+    friend bool operator<(const CAddressIndexKey& a, const CAddressIndexKey& b)
+    {
+        if (a.nHeight != b.nHeight) return a.nHeight < b.nHeight;
+        // Byte order of the serialized txid, as the entries come out of the index
+        int nCmp = memcmp(a.txid.begin(), b.txid.begin(), 32);
+        if (nCmp != 0) return nCmp < 0;
+        if (a.nIndex != b.nIndex) return a.nIndex < b.nIndex;
+        return a.fSpending < b.fSpending;
+    }
+};
+
+/** An unspent output of a script hash, keyed by (script hash, height, txid, vout) */
+struct CAddressUnspentKey {
+    uint160 hashScript;
+    int nHeight;
+    uint256 txid;
+    unsigned int nIndex;
+
+    CAddressUnspentKey(const uint160& hashScriptIn, int nHeightIn, const uint256& txidIn, unsigned int nIndexIn)
+        : hashScript(hashScriptIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn) {}
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashScript = 0;
+        nHeight = 0;
+        txid = 0;
+        nIndex = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 20 + 4 + 32 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        hashScript.Serialize(s, nType, nVersion);
+        WriteIndexBE32(s, nHeight);
+        txid.Serialize(s, nType, nVersion);
+        WriteIndexBE32(s, nIndex);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        hashScript.Unserialize(s, nType, nVersion);
+        nHeight = ReadIndexBE32(s);
+        txid.Unserialize(s, nType, nVersion);
+        nIndex = ReadIndexBE32(s);
+    }
+
+    friend bool operator==(const CAddressUnspentKey& a, const CAddressUnspentKey& b)
+    {
+        return a.hashScript == b.hashScript && a.nHeight == b.nHeight && a.txid == b.txid && a.nIndex == b.nIndex;
+    }
+
+    friend bool operator<(const CAddressUnspentKey& a, const CAddressUnspentKey& b)
+    {
+        if (a.nHeight != b.nHeight) return a.nHeight < b.nHeight;
+        int nCmp = memcmp(a.txid.begin(), b.txid.begin(), 32);
+        if (nCmp != 0) return nCmp < 0;
+        return a.nIndex < b.nIndex;
+    }
+};
+
+/** Amount and script of an indexed unspent output; a null value erases the entry */
+struct CAddressUnspentValue {
+    CAmount nValue;
+    CScript script;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nValue);
+        READWRITE(script);
+    }
+
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptIn) : nValue(nValueIn), script(scriptIn) {}
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nValue = -1;
+        script.clear();
+    }
+
+    bool IsNull() const
+    {
+        return nValue == -1;
+    }
+};
+
+/**
+ * Running totals of a script hash, so balance queries don't walk its history.
+ * nHeight is the last height the totals count, so a block written again
+ * after a crash isn't counted twice.
+ */
+struct CAddressBalance {
+    CAmount nBalance;
+    CAmount nReceived;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nBalance);
+        READWRITE(nReceived);
+        READWRITE(nHeight);
+    }
+
+    CAddressBalance() : nBalance(0), nReceived(0), nHeight(-1) {}
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -362,9 +362,12 @@ static const Checkpoints::CCheckpointData dataRegtest = {
 libzerocoin::ZerocoinParams* CChainParams::Zerocoin_Params() const
 {
     assert(this);
-    static CBigNum bnTrustedModulus;
-    bnTrustedModulus.SetDec(zerocoinModulus);
-    static libzerocoin::ZerocoinParams ZCParams = libzerocoin::ZerocoinParams(bnTrustedModulus);
+    // Set up once: the mint pool derives mints from several threads at a time
+    static libzerocoin::ZerocoinParams ZCParams = [this]() {
+        CBigNum bnTrustedModulus;
+        bnTrustedModulus.SetDec(zerocoinModulus);
+        return libzerocoin::ZerocoinParams(bnTrustedModulus);
+    }();
 
     return &ZCParams;
 }
@@ -372,9 +375,12 @@ libzerocoin::ZerocoinParams* CChainParams::Zerocoin_Params() const
 libzerocoin::ZerocoinParams* CChainParams::OldZerocoin_Params() const
 {
     assert(this);
-    static CBigNum bnTrustedModulus;
-    bnTrustedModulus.SetHex(zerocoinModulus);
-    static libzerocoin::ZerocoinParams ZCParams = libzerocoin::ZerocoinParams(bnTrustedModulus);
+    // Set up once: the mint pool derives mints from several threads at a time
+    static libzerocoin::ZerocoinParams ZCParams = [this]() {
+        CBigNum bnTrustedModulus;
+        bnTrustedModulus.SetHex(zerocoinModulus);
+        return libzerocoin::ZerocoinParams(bnTrustedModulus);
+    }();
 
     return &ZCParams;
 }
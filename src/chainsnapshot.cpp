@@ -0,0 +1,69 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainsnapshot.h"
+
+#include "chain.h"
+
+#include <algorithm>
+
+CChainSnapshot::CChainSnapshot(const CChainSnapshot& prev, CBlockIndex* pindexTip) : nHeight(-1)
+{
+    if (pindexTip == NULL)
+        return;
+    nHeight = pindexTip->nHeight;
+
+    // Everything up to the fork point is the same in both chains
+    const CBlockIndex* pindexFork = pindexTip;
+    while (pindexFork && !prev.Contains(pindexFork))
+        pindexFork = pindexFork->pprev;
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+
+    int nChunks = nHeight / CHUNK_SIZE + 1;
+    std::vector<Chunk*> vFill(nChunks, NULL);
+    vChunks.reserve(nChunks);
+    for (int i = 0; i < nChunks; i++) {
+        int nFirst = i * CHUNK_SIZE;
+        int nLast = std::min(nFirst + CHUNK_SIZE - 1, nHeight);
+        if (nLast <= nForkHeight && i < (int)prev.vChunks.size() && (int)prev.vChunks[i]->size() == nLast - nFirst + 1) {
+            vChunks.push_back(prev.vChunks[i]);
+            continue;
+        }
+        std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>(nLast - nFirst + 1, (CBlockIndex*)NULL);
+        for (int h = nFirst; h <= std::min(nLast, nForkHeight); h++)
+            (*chunk)[h - nFirst] = prev[h];
+        vFill[i] = chunk.get();
+        vChunks.push_back(chunk);
+    }
+
+    for (CBlockIndex* pindex = pindexTip; pindex && pindex->nHeight > nForkHeight; pindex = pindex->pprev)
+        (*vFill[pindex->nHeight / CHUNK_SIZE])[pindex->nHeight % CHUNK_SIZE] = pindex;
+}
+
+bool CChainSnapshot::Contains(const CBlockIndex* pindex) const
+{
+    return (*this)[pindex->nHeight] == pindex;
+}
+
+CBlockIndex* CChainSnapshot::Next(const CBlockIndex* pindex) const
+{
+    if (Contains(pindex))
+        return (*this)[pindex->nHeight + 1];
+    return NULL;
+}
+
+static CChainSnapshotRef snapshotActive = std::make_shared<const CChainSnapshot>();
+
+CChainSnapshotRef GetChainSnapshot()
+{
+    return std::atomic_load(&snapshotActive);
+}
+
+void PublishChainSnapshot(CBlockIndex* pindexTip)
+{
+    CChainSnapshotRef prev = std::atomic_load(&snapshotActive);
+    if (prev->Tip() == pindexTip)
+        return;
+    std::atomic_store(&snapshotActive, std::make_shared<const CChainSnapshot>(*prev, pindexTip));
+}
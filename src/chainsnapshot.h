@@ -0,0 +1,73 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAINSNAPSHOT_H
+#define BITCOIN_CHAINSNAPSHOT_H
+
+#include <memory>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * Immutable copy of the active chain. A new one is published every time
+ * chainActive moves (always under cs_main), and readers such as the RPC
+ * server take a reference to the current one without locking anything.
+ *
+ * The height index is split in fixed size chunks, and a snapshot shares the
+ * chunks below the fork point with the one it replaces, so publishing a new
+ * tip only copies the chunk the tip is in.
+ */
+class CChainSnapshot
+{
+private:
+    typedef std::vector<CBlockIndex*> Chunk;
+    std::vector<std::shared_ptr<const Chunk> > vChunks;
+    int nHeight;
+
+public:
+    static const int CHUNK_SIZE = 4096;
+
+    CChainSnapshot() : nHeight(-1) {}
+    //! Chain ending at pindexTip, sharing what it can with prev
+    CChainSnapshot(const CChainSnapshot& prev, CBlockIndex* pindexTip);
+
+    CBlockIndex* Genesis() const
+    {
+        return (*this)[0];
+    }
+
+    CBlockIndex* Tip() const
+    {
+        return (*this)[nHeight];
+    }
+
+    CBlockIndex* operator[](int nHeightIn) const
+    {
+        if (nHeightIn < 0 || nHeightIn > nHeight)
+            return NULL;
+        return (*vChunks[nHeightIn / CHUNK_SIZE])[nHeightIn % CHUNK_SIZE];
+    }
+
+    bool Contains(const CBlockIndex* pindex) const;
+
+    /** Successor of a block in this chain, or NULL if it is the tip or not in the chain */
+    CBlockIndex* Next(const CBlockIndex* pindex) const;
+
+    /** Height of the tip, -1 for an empty chain */
+    int Height() const
+    {
+        return nHeight;
+    }
+};
+
+typedef std::shared_ptr<const CChainSnapshot> CChainSnapshotRef;
+
+/** The active chain as last published; never NULL. Safe to call without cs_main. */
+CChainSnapshotRef GetChainSnapshot();
+
+/** Publish pindexTip as the new tip of the active chain. Requires cs_main. */
+void PublishChainSnapshot(CBlockIndex* pindexTip);
+
+#endif // BITCOIN_CHAINSNAPSHOT_H
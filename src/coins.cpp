@@ -150,6 +150,11 @@ bool CCoinsViewCache::HaveCoins(const uint256& txid) const
     return (it != cacheCoins.end() && !it->second.coins.vout.empty());
 }
 
+bool CCoinsViewCache::HaveCoinsInCache(const uint256& txid) const
+{
+    return cacheCoins.count(txid) != 0;
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const
 {
     if (hashBlock == uint256(0))
@@ -431,6 +431,13 @@ public:
     void SetBestBlock(const uint256& hashBlock);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
 
+    /**
+     * Check whether this cache holds an entry for txid, without fetching it
+     * from the backing view. If it doesn't, the backing view is up to date
+     * for that txid.
+     */
+    bool HaveCoinsInCache(const uint256& txid) const;
+
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
      * more efficient than GetCoins. Modifications to other cache entries are
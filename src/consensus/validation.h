@@ -25,6 +25,8 @@ static const unsigned char REJECT_CHECKPOINT = 0x43;
 static const unsigned int REJECT_INTERNAL = 0x100;
 /** Too high fee. Can not be triggered by P2P transactions */
 static const unsigned int REJECT_HIGHFEE = 0x100;
+/** Transaction is already known (either in the mempool or blockchain) */
+static const unsigned int REJECT_ALREADY_KNOWN = 0x101;
 
 
 /** Capture information about block/transaction validation */
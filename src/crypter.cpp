@@ -279,6 +279,7 @@ bool CCryptoKeyStore::Lock()
 
 bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 {
+    bool fNewSeed = false;
     {
         LOCK(cs_KeyStore);
         if (!SetCrypted())
@@ -334,9 +335,12 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
             uint256 seed = key.GetPrivKey_256();
             LogPrintf("%s: first run of zOHMC wallet detected, new seed generated. Seedhash=%s\n", __func__, Hash(seed.begin(), seed.end()).GetHex());
             pwalletMain->zwalletMain->SetMasterSeed(seed, true);
-            pwalletMain->zwalletMain->GenerateMintPool();
+            fNewSeed = true;
         }
     }
+    // Outside cs_KeyStore, as the fill takes cs_wallet
+    if (fNewSeed)
+        pwalletMain->zwalletMain->GenerateMintPoolInBackground();
     NotifyStatusChanged(this);
     return true;
 }
@@ -12,6 +12,7 @@
 #include "ui_interface.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/bind/bind.hpp>
 
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wellet.
@@ -72,6 +73,29 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/** Sink of the JSON reply writer: the reply turns into a chunked one when its first chunk is full */
+static void JSONReplyChunk(HTTPRequest* req, bool* pfChunked, const std::string& strChunk)
+{
+    if (!*pfChunked) {
+        req->WriteReplyStart(HTTP_OK);
+        *pfChunked = true;
+    }
+    req->WriteReplyChunk(strChunk);
+}
+
+/** Send what is left in the writer; replies that never filled a chunk go out in one piece */
+static void JSONReplyFinish(HTTPRequest* req, bool fChunked, JSONStreamWriter& writer)
+{
+    std::string strRest = writer.Finish();
+    if (!fChunked) {
+        req->WriteReply(HTTP_OK, strRest);
+        return;
+    }
+    if (!strRest.empty())
+        req->WriteReplyChunk(strRest);
+    req->WriteReplyEnd();
+}
+
 static bool RPCAuthorized(const std::string& strAuth)
 {
     if (strRPCUserColonPass.empty()) // Belt-and-suspenders measure if InitRPCAuthentication was not called
@@ -117,7 +141,11 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-        std::string strReply;
+        // Replies are serialized straight into the connection, so a large
+        // result never exists as one string next to its UniValue tree
+        bool fChunked = false;
+        JSONStreamWriter writer(boost::bind(&JSONReplyChunk, req, &fChunked, boost::placeholders::_1));
+
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
@@ -125,16 +153,19 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
-
-        // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
-        else
+            req->WriteHeader("Content-Type", "application/json");
+            JSONRPCReplyStream(writer, result, NullUniValue, jreq.id);
+            writer.WriteRaw("\n");
+
+        // array of requests; read-only batches are spread over the other HTTP worker threads
+        } else if (valRequest.isArray()) {
+            int nHelpers = GetArg("-rpcthreads", DEFAULT_HTTP_THREADS) - 1;
+            req->WriteHeader("Content-Type", "application/json");
+            JSONRPCExecBatch(valRequest.get_array(), writer, &QueueHTTPWork, nHelpers);
+        } else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+        JSONReplyFinish(req, fChunked, writer);
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
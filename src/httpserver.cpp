@@ -11,6 +11,8 @@
 #include "rpc/protocol.h" // For HTTP status codes
 #include "sync.h"
 #include "ui_interface.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,28 +38,51 @@
 
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/tss.hpp>
 
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+static void RecordEndpointRequest(const std::string& prefix, int64_t nQueueTime, int64_t nRunTime);
+
 /** HTTP request work item */
 class HTTPWorkItem : public HTTPClosure
 {
 public:
-    HTTPWorkItem(HTTPRequest* req, const std::string &path, const HTTPRequestHandler& func):
-        req(req), path(path), func(func)
+    HTTPWorkItem(HTTPRequest* req, const std::string &path, const std::string &prefix, const HTTPRequestHandler& func):
+        req(req), path(path), prefix(prefix), func(func), nTimeQueued(GetTimeMicros())
     {
     }
     void operator()()
     {
+        int64_t nTimeStart = GetTimeMicros();
         func(req.get(), path);
+        RecordEndpointRequest(prefix, nTimeStart - nTimeQueued, GetTimeMicros() - nTimeStart);
     }
 
     boost::scoped_ptr<HTTPRequest> req;
 
 private:
     std::string path;
+    std::string prefix; //! of the handler, for the endpoint statistics
     HTTPRequestHandler func;
+    int64_t nTimeQueued;
+};
+
+/** Work item running an arbitrary function, see QueueHTTPWork */
+class HTTPWorkFunction : public HTTPClosure
+{
+public:
+    HTTPWorkFunction(const boost::function<void(void)>& func) : func(func)
+    {
+    }
+    void operator()()
+    {
+        func();
+    }
+
+private:
+    boost::function<void(void)> func;
 };
 
 /** Simple work queue for distributing work over multiple threads.
@@ -75,6 +100,9 @@ private:
     bool running;
     size_t maxDepth;
     int numThreads;
+    size_t peakDepth;
+    uint64_t nProcessed;
+    uint64_t nRejected;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -97,7 +125,10 @@ private:
 public:
     WorkQueue(size_t maxDepth) : running(true),
                                  maxDepth(maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 peakDepth(0),
+                                 nProcessed(0),
+                                 nRejected(0)
     {
     }
     /*( Precondition: worker threads have all stopped
@@ -115,9 +146,11 @@ public:
     {
         boost::unique_lock<boost::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
+            nRejected++;
             return false;
         }
         queue.push_back(item);
+        peakDepth = std::max(peakDepth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -138,6 +171,8 @@ public:
             }
             (*i)();
             delete i;
+            boost::unique_lock<boost::mutex> lock(cs);
+            nProcessed++;
         }
     }
     /** Interrupt and exit loops */
@@ -161,6 +196,37 @@ public:
         boost::unique_lock<boost::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Fill in the queue part of stats */
+    void GetStats(HTTPPoolStats& stats)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nDepth = queue.size();
+        stats.nMaxDepth = maxDepth;
+        stats.nPeakDepth = peakDepth;
+        stats.nProcessed = nProcessed;
+        stats.nRejected = nRejected;
+    }
+};
+
+/** Work queue and the threads serving it, see -rpcpool */
+struct HTTPWorkerPool
+{
+    HTTPWorkerPool(const std::string& prefix, int nThreads, size_t nDepth):
+        prefix(prefix), nThreads(nThreads), queue(nDepth)
+    {
+    }
+    std::string prefix; //! handlers it serves start with this; empty for the default pool
+    int nThreads;
+    WorkQueue<HTTPClosure> queue;
+};
+
+/** State of an open connection, only touched on the main http thread */
+struct HTTPConnectionState
+{
+    HTTPConnectionState() : nRequests(0), stream(NULL) {}
+    int nRequests;
+    HTTPReplyStream* stream; //! chunked reply in progress, if any
 };
 
 struct HTTPPathHandler
@@ -183,12 +249,86 @@ static struct event_base* eventBase = 0;
 struct evhttp* eventHTTP = 0;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queues for handling longer requests off the event loop thread, the default pool first
+static std::vector<HTTPWorkerPool*> workerPools;
+//! Pool of the current thread, if it is an HTTP worker
+static void NoPoolCleanup(HTTPWorkerPool*) {}
+static boost::thread_specific_ptr<HTTPWorkerPool> currentPool(&NoPoolCleanup);
+//! Open connections; requests on one are counted for -rpcmaxrequestsperconnection
+static std::map<struct evhttp_connection*, HTTPConnectionState> mapConnections;
+static int maxRequestsPerConnection = 0;
+//! Statistics of the registered handlers, by prefix
+static boost::mutex csEndpointStats;
+static std::map<std::string, HTTPEndpointStats> mapEndpointStats;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 std::vector<evhttp_bound_socket *> boundSockets;
 
+/** Pool serving the handler registered for prefix: the one with the longest matching prefix */
+static HTTPWorkerPool* SelectWorkerPool(const std::string& prefix)
+{
+    HTTPWorkerPool* pool = workerPools.front();
+    for (HTTPWorkerPool* p : workerPools) {
+        if (p->prefix.size() > pool->prefix.size() && prefix.compare(0, p->prefix.size(), p->prefix) == 0)
+            pool = p;
+    }
+    return pool;
+}
+
+static HTTPEndpointStats& GetEndpointStats(const std::string& prefix)
+{
+    std::map<std::string, HTTPEndpointStats>::iterator it = mapEndpointStats.find(prefix);
+    if (it == mapEndpointStats.end()) {
+        it = mapEndpointStats.insert(std::make_pair(prefix, HTTPEndpointStats())).first;
+        it->second.prefix = prefix;
+        it->second.pool = SelectWorkerPool(prefix)->prefix;
+    }
+    return it->second;
+}
+
+static void RecordEndpointRequest(const std::string& prefix, int64_t nQueueTime, int64_t nRunTime)
+{
+    boost::lock_guard<boost::mutex> lock(csEndpointStats);
+    HTTPEndpointStats& stats = GetEndpointStats(prefix);
+    stats.nRequests++;
+    stats.nQueueTimeTotal += nQueueTime;
+    stats.nRunTimeTotal += nRunTime;
+    stats.nRunTimeMax = std::max(stats.nRunTimeMax, nRunTime);
+}
+
+static void RecordEndpointRejected(const std::string& prefix)
+{
+    boost::lock_guard<boost::mutex> lock(csEndpointStats);
+    GetEndpointStats(prefix).nRejected++;
+}
+
+static void MarkReplyStreamClosed(HTTPReplyStream* stream);
+
+/** Connection close callback, set on the first request of every connection */
+static void http_connection_closed(struct evhttp_connection* con, void*)
+{
+    std::map<struct evhttp_connection*, HTTPConnectionState>::iterator it = mapConnections.find(con);
+    if (it == mapConnections.end())
+        return;
+    if (it->second.stream)
+        MarkReplyStreamClosed(it->second.stream);
+    mapConnections.erase(it);
+}
+
+/** Count a request on its connection, asking the client to reconnect once it has had its share */
+static void CountConnectionRequest(struct evhttp_request* req)
+{
+    struct evhttp_connection* con = evhttp_request_get_connection(req);
+    if (!con)
+        return;
+    std::pair<std::map<struct evhttp_connection*, HTTPConnectionState>::iterator, bool> ins =
+        mapConnections.insert(std::make_pair(con, HTTPConnectionState()));
+    if (ins.second)
+        evhttp_connection_set_closecb(con, http_connection_closed, NULL);
+    if (++ins.first->second.nRequests == maxRequestsPerConnection)
+        evhttp_add_header(evhttp_request_get_output_headers(req), "Connection", "close");
+}
+
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
 {
@@ -250,6 +390,7 @@ static std::string RequestMethodString(HTTPRequest::RequestMethod m)
 /** HTTP request callback */
 static void http_request_cb(struct evhttp_request* req, void* arg)
 {
+    CountConnectionRequest(req);
     std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
 
     LogPrint("http", "Received a %s request for %s from %s\n",
@@ -286,12 +427,14 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
-        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
-        assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->prefix, i->handler));
+        assert(!workerPools.empty());
+        if (SelectWorkerPool(i->prefix)->queue.Enqueue(item.get())) {
             item.release(); /* if true, queue took ownership */
-        else
+        } else {
+            RecordEndpointRejected(i->prefix);
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
+        }
     } else {
         hreq->WriteReply(HTTP_NOTFOUND);
     }
@@ -353,10 +496,40 @@ static bool HTTPBindAddresses(struct evhttp* http)
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
+static void HTTPWorkQueueRun(HTTPWorkerPool* pool)
 {
     RenameThread("bitcoin-httpworker");
-    queue->Run();
+    currentPool.reset(pool);
+    pool->queue.Run();
+}
+
+/** Parse the -rpcpool options, <prefix>:<threads>:<depth> each */
+static bool InitHTTPWorkerPools()
+{
+    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    workerPools.push_back(new HTTPWorkerPool("", rpcThreads, workQueueDepth));
+
+    for (const std::string& strPool : mapMultiArgs["-rpcpool"]) {
+        size_t nDepthSep = strPool.rfind(':');
+        size_t nThreadsSep = nDepthSep == std::string::npos || nDepthSep == 0 ? std::string::npos : strPool.rfind(':', nDepthSep - 1);
+        int32_t nThreads = 0, nDepth = 0;
+        if (nThreadsSep == std::string::npos || strPool[0] != '/' ||
+            !ParseInt32(strPool.substr(nThreadsSep + 1, nDepthSep - nThreadsSep - 1), &nThreads) || nThreads < 1 ||
+            !ParseInt32(strPool.substr(nDepthSep + 1), &nDepth) || nDepth < 1) {
+            uiInterface.ThreadSafeMessageBox(
+                strprintf("Invalid -rpcpool specification: %s. Use <prefix>:<threads>:<depth>, e.g. /rest/:2:16.", strPool),
+                "", CClientUIInterface::MSG_ERROR);
+            return false;
+        }
+        std::string prefix = strPool.substr(0, nThreadsSep);
+        LogPrintf("HTTP: creating work queue of depth %d for %s\n", nDepth, prefix);
+        workerPools.push_back(new HTTPWorkerPool(prefix, nThreads, nDepth));
+    }
+
+    maxRequestsPerConnection = std::max((long)GetArg("-rpcmaxrequestsperconnection", DEFAULT_HTTP_MAX_REQUESTS_PER_CONNECTION), 0L);
+    return true;
 }
 
 /** libevent event log callback */
@@ -430,10 +603,12 @@ bool InitHTTPServer()
     }
 
     LogPrint("http", "Initialized HTTP server\n");
-    int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    if (!InitHTTPWorkerPools()) {
+        evhttp_free(http);
+        event_base_free(base);
+        return false;
+    }
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -444,12 +619,13 @@ boost::thread threadHTTP;
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
 
-    for (int i = 0; i < rpcThreads; i++)
-        boost::thread(boost::bind(&HTTPWorkQueueRun, workQueue));
+    for (HTTPWorkerPool* pool : workerPools) {
+        LogPrintf("HTTP: starting %d worker threads%s\n", pool->nThreads, pool->prefix.empty() ? "" : " for " + pool->prefix);
+        for (int i = 0; i < pool->nThreads; i++)
+            boost::thread(boost::bind(&HTTPWorkQueueRun, pool));
+    }
     return true;
 }
 
@@ -462,18 +638,20 @@ void InterruptHTTPServer()
         }
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (HTTPWorkerPool* pool : workerPools)
+        pool->queue.Interrupt();
 }
 
 void StopHTTPServer()
 {
     LogPrint("http", "Stopping HTTP server\n");
-    if (workQueue) {
+    if (!workerPools.empty()) {
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        workQueue->WaitExit();
-        delete workQueue;
-        workQueue = nullptr;
+        for (HTTPWorkerPool* pool : workerPools) {
+            pool->queue.WaitExit();
+            delete pool;
+        }
+        workerPools.clear();
     }
     MilliSleep(500); // Avoid race condition while the last HTTP-thread is exiting
     if (eventBase) {
@@ -510,6 +688,43 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+bool QueueHTTPWork(const boost::function<void(void)>& func)
+{
+    HTTPWorkerPool* pool = currentPool.get();
+    if (!pool) {
+        if (workerPools.empty())
+            return false;
+        pool = workerPools.front();
+    }
+    std::unique_ptr<HTTPWorkFunction> item(new HTTPWorkFunction(func));
+    if (!pool->queue.Enqueue(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
+std::vector<HTTPPoolStats> GetHTTPPoolStats()
+{
+    std::vector<HTTPPoolStats> vStats;
+    for (HTTPWorkerPool* pool : workerPools) {
+        HTTPPoolStats stats;
+        stats.prefix = pool->prefix;
+        stats.nThreads = pool->nThreads;
+        pool->queue.GetStats(stats);
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
+
+std::vector<HTTPEndpointStats> GetHTTPEndpointStats()
+{
+    boost::lock_guard<boost::mutex> lock(csEndpointStats);
+    std::vector<HTTPEndpointStats> vStats;
+    for (const auto& entry : mapEndpointStats)
+        vStats.push_back(entry.second);
+    return vStats;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -537,12 +752,16 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       stream(NULL)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (stream) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -607,6 +826,132 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+/** Chunked reply in progress. The worker writing it waits while more than
+ * MAX_REPLY_QUEUED bytes have not been written to the connection yet, so a
+ * slow client can't make the reply pile up in memory. libevent reports on the
+ * main http thread when the connection is gone, after which the request must
+ * not be touched any more.
+ */
+struct HTTPReplyStream
+{
+    boost::mutex cs;
+    boost::condition_variable cond;
+    bool fClosed;
+    size_t nQueued;       //! bytes written by the worker and not yet sent out
+    size_t nInConnection; //! part of nQueued handed to the connection
+
+    HTTPReplyStream() : fClosed(false), nQueued(0), nInConnection(0) {}
+};
+
+static const size_t MAX_REPLY_QUEUED = 4 * 1024 * 1024;
+
+static void MarkReplyStreamClosed(HTTPReplyStream* stream)
+{
+    boost::lock_guard<boost::mutex> lock(stream->cs);
+    stream->fClosed = true;
+    stream->cond.notify_all();
+}
+
+/** Called when the connection has written out everything it was given */
+static void http_reply_stream_sent(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyStream* stream = (HTTPReplyStream*)arg;
+    boost::lock_guard<boost::mutex> lock(stream->cs);
+    stream->nQueued -= stream->nInConnection;
+    stream->nInConnection = 0;
+    stream->cond.notify_all();
+}
+
+static void http_reply_stream_start(struct evhttp_request* req, int nStatus, HTTPReplyStream* stream)
+{
+    std::map<struct evhttp_connection*, HTTPConnectionState>::iterator it = mapConnections.find(evhttp_request_get_connection(req));
+    if (it != mapConnections.end())
+        it->second.stream = stream;
+    evhttp_send_reply_start(req, nStatus, NULL);
+}
+
+static void http_reply_stream_chunk(struct evhttp_request* req, struct evbuffer* evb, HTTPReplyStream* stream)
+{
+    size_t nSize = evbuffer_get_length(evb);
+    bool fClosed;
+    {
+        boost::lock_guard<boost::mutex> lock(stream->cs);
+        fClosed = stream->fClosed;
+        stream->nInConnection += nSize;
+    }
+    if (!fClosed) {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        evhttp_send_reply_chunk_with_cb(req, evb, http_reply_stream_sent, stream);
+#else
+        evhttp_send_reply_chunk(req, evb);
+        http_reply_stream_sent(NULL, stream);
+#endif
+    }
+    evbuffer_free(evb);
+}
+
+static void http_reply_stream_end(struct evhttp_request* req, HTTPReplyStream* stream)
+{
+    if (!stream->fClosed) {
+        std::map<struct evhttp_connection*, HTTPConnectionState>::iterator it = mapConnections.find(evhttp_request_get_connection(req));
+        if (it != mapConnections.end())
+            it->second.stream = NULL;
+        evhttp_send_reply_end(req);
+    }
+    delete stream;
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req);
+    stream = new HTTPReplyStream();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(&http_reply_stream_start, req, nStatus, stream));
+    ev->trigger(0);
+    replySent = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    WriteReplyChunk(strChunk.data(), strChunk.size());
+}
+
+void HTTPRequest::WriteReplyChunk(const char* pch, size_t nSize)
+{
+    assert(stream && req);
+    {
+        boost::unique_lock<boost::mutex> lock(stream->cs);
+        while (!stream->fClosed && stream->nQueued > MAX_REPLY_QUEUED)
+            stream->cond.wait(lock);
+        if (stream->fClosed)
+            return;
+        stream->nQueued += nSize;
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, pch, nSize);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(&http_reply_stream_chunk, req, evb, stream));
+    ev->trigger(0);
+}
+
+bool HTTPRequest::ReplyStreamClosed()
+{
+    assert(stream);
+    boost::lock_guard<boost::mutex> lock(stream->cs);
+    return stream->fClosed;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(stream && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(&http_reply_stream_end, req, stream));
+    ev->trigger(0);
+    stream = NULL;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -6,6 +6,7 @@
 #define BITCOIN_HTTPSERVER_H
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -15,6 +16,7 @@ static const int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+static const int DEFAULT_HTTP_MAX_REQUESTS_PER_CONNECTION=0;
 
 struct evhttp_request;
 struct event_base;
@@ -50,14 +52,51 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Run func on one of the HTTP worker threads, of the caller's pool when
+ * called from a worker and of the default pool otherwise.
+ * Returns false if the work queue is full, in which case func is not run.
+ */
+bool QueueHTTPWork(const boost::function<void(void)>& func);
+
+/** Load of one worker pool; the default pool has an empty prefix */
+struct HTTPPoolStats
+{
+    std::string prefix;
+    int nThreads;
+    size_t nDepth;     //! requests waiting now
+    size_t nMaxDepth;  //! requests waiting before new ones are rejected
+    size_t nPeakDepth; //! most requests ever waiting at once
+    uint64_t nProcessed;
+    uint64_t nRejected;
+};
+
+/** Requests served by the handler registered for prefix */
+struct HTTPEndpointStats
+{
+    HTTPEndpointStats() : nRequests(0), nRejected(0), nQueueTimeTotal(0), nRunTimeTotal(0), nRunTimeMax(0) {}
+    std::string prefix;
+    std::string pool;        //! prefix of the pool serving it
+    uint64_t nRequests;
+    uint64_t nRejected;      //! turned away because the pool's queue was full
+    int64_t nQueueTimeTotal; //! microseconds spent waiting for a worker
+    int64_t nRunTimeTotal;   //! microseconds spent in the handler
+    int64_t nRunTimeMax;
+};
+
+std::vector<HTTPPoolStats> GetHTTPPoolStats();
+std::vector<HTTPEndpointStats> GetHTTPEndpointStats();
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
+struct HTTPReplyStream;
+
 class HTTPRequest
 {
 private:
     struct evhttp_request* req;
     bool replySent;
+    HTTPReplyStream* stream;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -113,6 +152,21 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply whose body is sent in pieces, with chunked transfer
+     * encoding, by WriteReplyChunk and finished by WriteReplyEnd.
+     *
+     * @note Call this instead of WriteReply, after the headers are written.
+     */
+    void WriteReplyStart(int nStatus);
+    /** Queue a piece of a chunked reply; waits while the client is far behind */
+    void WriteReplyChunk(const std::string& strChunk);
+    void WriteReplyChunk(const char* pch, size_t nSize);
+    /** Whether the client of a chunked reply went away, so the rest can be skipped */
+    bool ReplyStreamClosed();
+    /** Finish a chunked reply; the request is given back to the main thread */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
@@ -0,0 +1,373 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+
+#include "main.h"
+#include "sync.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <set>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+enum IndexState {
+    INDEX_DISABLED,
+    INDEX_SYNCED,
+    INDEX_BUILDING,
+    INDEX_DROPPING
+};
+
+struct CBlockTreeIndex {
+    const char* name;        //! option and database flag
+    bool fDefault;
+    bool* pfEnabled;         //! only set once the index is complete
+    const char* pszPrefixes; //! key prefixes of the index records
+
+    IndexState state;
+    const CBlockIndex* pindexBest; //! last block indexed while building
+};
+
+/**
+ * Records of -addrindex are keyed 'A', 'U' and 'V'; 'h' holds transaction
+ * heights while it is being built, and 'a' and 'S' are its previous format.
+ */
+CBlockTreeIndex vIndexes[] = {
+    {"txindex", true, &fTxIndex, "t", INDEX_DISABLED, NULL},
+    {"addrindex", true, &fAddrIndex, "AUVhaS", INDEX_DISABLED, NULL},
+    {"spentindex", DEFAULT_SPENTINDEX, &fSpentIndex, "p", INDEX_DISABLED, NULL},
+    {"timestampindex", DEFAULT_TIMESTAMPINDEX, &fTimestampIndex, "Tz", INDEX_DISABLED, NULL},
+};
+
+//! Guards state and pindexBest of vIndexes, taken after cs_main
+CCriticalSection cs_indexbuilder;
+
+int BestHeight(const CBlockTreeIndex& index)
+{
+    return index.pindexBest ? index.pindexBest->nHeight : -1;
+}
+} // anon namespace
+
+bool InitIndexBuilder(std::string& strError)
+{
+    LOCK2(cs_main, cs_indexbuilder);
+    for (CBlockTreeIndex& index : vIndexes) {
+        bool fWanted = GetBoolArg(std::string("-") + index.name, index.fDefault);
+        bool fLive = *index.pfEnabled;
+
+        int nVersion = 0;
+        if (fLive && index.pfEnabled == &fAddrIndex && (!pblocktree->ReadInt("addrindex", nVersion) || nVersion != ADDRINDEX_VERSION)) {
+            LogPrintf("%s : the address index format has changed, rebuilding it\n", __func__);
+            fLive = false;
+        }
+
+        index.pindexBest = NULL;
+        if (fWanted && fLive) {
+            index.state = INDEX_SYNCED;
+            continue;
+        }
+
+        // Queries fall back to their slow paths until the index is complete
+        *index.pfEnabled = false;
+        if (!pblocktree->WriteFlag(index.name, false)) {
+            strError = strprintf("Failed to write the %s flag", index.name);
+            return false;
+        }
+
+        if (!fWanted) {
+            index.state = INDEX_DROPPING;
+            continue;
+        }
+
+        uint256 hashCursor;
+        if (pblocktree->ReadIndexCursor(index.name, hashCursor)) {
+            BlockMap::const_iterator mi = mapBlockIndex.find(hashCursor);
+            if (mi != mapBlockIndex.end())
+                index.pindexBest = mi->second;
+        }
+        index.state = INDEX_BUILDING;
+        LogPrintf("%s : building %s from height %d\n", __func__, index.name, BestHeight(index) + 1);
+    }
+    return true;
+}
+
+bool IndexBuilderPending()
+{
+    LOCK(cs_indexbuilder);
+    for (const CBlockTreeIndex& index : vIndexes) {
+        if (index.state == INDEX_BUILDING || index.state == INDEX_DROPPING)
+            return true;
+    }
+    return false;
+}
+
+std::vector<CIndexBuilderStatus> GetIndexBuilderStatus()
+{
+    std::vector<CIndexBuilderStatus> vStatus;
+    LOCK2(cs_main, cs_indexbuilder);
+    for (const CBlockTreeIndex& index : vIndexes) {
+        CIndexBuilderStatus status;
+        status.name = index.name;
+        status.fSynced = index.state == INDEX_SYNCED;
+        status.nHeight = -1;
+        switch (index.state) {
+        case INDEX_SYNCED:
+            status.state = "synced";
+            status.nHeight = chainActive.Height();
+            break;
+        case INDEX_BUILDING:
+            status.state = "building";
+            status.nHeight = BestHeight(index);
+            break;
+        case INDEX_DROPPING:
+            status.state = "dropping";
+            break;
+        case INDEX_DISABLED:
+            status.state = "disabled";
+            break;
+        }
+        vStatus.push_back(status);
+    }
+    return vStatus;
+}
+
+/** Erase all records of an index, along with its build progress */
+static bool DropIndex(const CBlockTreeIndex& index)
+{
+    LogPrintf("%s : dropping %s\n", __func__, index.name);
+    for (const char* pch = index.pszPrefixes; *pch; pch++) {
+        if (!pblocktree->EraseIndexPrefix(*pch))
+            return false;
+    }
+    return pblocktree->EraseIndexCursor(index.name);
+}
+
+/** Hand an index that caught up with the tip over to ConnectBlock, cs_main must be held */
+static bool FinishIndex(CBlockTreeIndex& index)
+{
+    AssertLockHeld(cs_main);
+    if (index.pfEnabled == &fAddrIndex && !pblocktree->WriteInt("addrindex", ADDRINDEX_VERSION))
+        return false;
+    if (!pblocktree->WriteFlag(index.name, true) || !pblocktree->EraseIndexCursor(index.name))
+        return false;
+
+    *index.pfEnabled = true;
+    index.state = INDEX_SYNCED;
+    index.pindexBest = NULL;
+    LogPrintf("%s : %s is complete at height %d\n", __func__, index.name, chainActive.Height());
+    return true;
+}
+
+/**
+ * Collect the records of one block for the indexes in vBatch, or the records
+ * to erase when the block left the active chain while they were being built.
+ */
+static bool GetBlockEntries(const std::vector<CBlockTreeIndex*>& vBatch, const CBlock& block, const CBlockUndo& blockUndo,
+    const CBlockIndex* pindex, const CDiskBlockPos& posBlock, bool fDisconnect, CIndexBuilderEntries& entries)
+{
+    bool fTx = false, fAddr = false, fSpent = false, fTimestamp = false;
+    for (const CBlockTreeIndex* pindexBuild : vBatch) {
+        fTx |= pindexBuild->pfEnabled == &fTxIndex;
+        fAddr |= pindexBuild->pfEnabled == &fAddrIndex;
+        fSpent |= pindexBuild->pfEnabled == &fSpentIndex;
+        fTimestamp |= pindexBuild->pfEnabled == &fTimestampIndex;
+    }
+    entries.fAddressErase = fDisconnect;
+
+    // Like ConnectBlock and DisconnectBlock, only the spent and address
+    // indexes are unwound; stale transaction and timestamp records are harmless
+    if (fTimestamp && !fDisconnect)
+        entries.vTimestamps.push_back(std::make_pair(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()), GetLogicalTimestamp(pindex)));
+
+    // The transactions of the genesis block are never connected
+    if (pindex->pprev == NULL)
+        return true;
+
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s : block and undo data inconsistent", __func__);
+
+    std::set<uint256> setBlockTx;
+    for (const CTransaction& tx : block.vtx)
+        setBlockTx.insert(tx.GetHash());
+
+    CDiskTxPos pos(posBlock, GetSizeOfCompactSize(block.vtx.size()));
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        if (fTx && !fDisconnect)
+            entries.vTxPos.push_back(std::make_pair(tx.GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        if (fAddr && !fDisconnect)
+            entries.vTxHeights.push_back(std::make_pair(tx.GetHash(), pindex->nHeight));
+    }
+
+    // Unwinding goes through the transactions in reverse, as DisconnectBlock does
+    for (unsigned int n = 0; n < block.vtx.size(); n++) {
+        unsigned int i = fDisconnect ? block.vtx.size() - 1 - n : n;
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txid = tx.GetHash();
+
+        std::vector<std::pair<CTxOut, int> > vPrevOuts;
+        if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s : transaction and undo data inconsistent", __func__);
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const CTxInUndo& undo = txundo.vprevout[j];
+                if (fSpent)
+                    entries.vSpent.push_back(std::make_pair(prevout, fDisconnect ? CSpentIndexValue() : CSpentIndexValue(txid, j, pindex->nHeight)));
+                if (!fAddr)
+                    continue;
+
+                // Undo data only has the height when the last output of a transaction is spent
+                int nPrevHeight = undo.nHeight;
+                if (nPrevHeight == 0) {
+                    if (setBlockTx.count(prevout.hash))
+                        nPrevHeight = pindex->nHeight;
+                    else if (!pblocktree->ReadIndexTxHeight(prevout.hash, nPrevHeight))
+                        return error("%s : height of transaction %s not found", __func__, prevout.hash.ToString());
+                }
+                vPrevOuts.push_back(std::make_pair(undo.txout, nPrevHeight));
+            }
+        }
+        if (fAddr)
+            GetAddressIndexEntries(tx, pindex->nHeight, vPrevOuts, fDisconnect, entries.vAddressDeltas, entries.vAddressUnspent);
+    }
+    return true;
+}
+
+/**
+ * Advance the indexes being built by one block. Indexes whose last block left
+ * the active chain are unwound first; of the others, the ones furthest behind
+ * move on together. Returns false once there is nothing left to build.
+ */
+static bool IndexNextBlock(bool& fError)
+{
+    std::vector<CBlockTreeIndex*> vBatch;
+    const CBlockIndex* pindex = NULL;
+    bool fDisconnect = false;
+    CDiskBlockPos posBlock, posUndo;
+    bool fAddrComplete = false;
+    {
+        LOCK2(cs_main, cs_indexbuilder);
+        CBlockTreeIndex* pindexFirst = NULL;
+        for (CBlockTreeIndex& index : vIndexes) {
+            if (index.state != INDEX_BUILDING)
+                continue;
+            if (index.pindexBest && !chainActive.Contains(index.pindexBest)) {
+                vBatch.assign(1, &index);
+                pindex = index.pindexBest;
+                fDisconnect = true;
+                break;
+            }
+            if (!pindexFirst || BestHeight(index) < BestHeight(*pindexFirst))
+                pindexFirst = &index;
+        }
+
+        if (!fDisconnect) {
+            if (!pindexFirst)
+                return false;
+            for (CBlockTreeIndex& index : vIndexes) {
+                if (index.state == INDEX_BUILDING && index.pindexBest == pindexFirst->pindexBest)
+                    vBatch.push_back(&index);
+            }
+            pindex = pindexFirst->pindexBest ? chainActive.Next(pindexFirst->pindexBest) : chainActive.Genesis();
+            if (!pindex) {
+                for (CBlockTreeIndex* pindexBuild : vBatch) {
+                    if (!FinishIndex(*pindexBuild)) {
+                        fError = true;
+                        return false;
+                    }
+                    fAddrComplete |= pindexBuild->pfEnabled == &fAddrIndex;
+                }
+            }
+        }
+        if (pindex) {
+            posBlock = pindex->GetBlockPos();
+            posUndo = pindex->GetUndoPos();
+        }
+    }
+
+    if (fAddrComplete) {
+        // Transaction heights were only needed while building
+        if (!pblocktree->EraseIndexPrefix('h'))
+            LogPrintf("%s : failed to erase the address index build data\n", __func__);
+    }
+    if (!pindex)
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, posBlock) || block.GetHash() != pindex->GetBlockHash()) {
+        fError = error("%s : failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        return false;
+    }
+    CBlockUndo blockUndo;
+    if (pindex->pprev && (posUndo.IsNull() || !blockUndo.ReadFromDisk(posUndo, pindex->pprev->GetBlockHash()))) {
+        fError = error("%s : failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        return false;
+    }
+
+    CIndexBuilderEntries entries;
+    if (!GetBlockEntries(vBatch, block, blockUndo, pindex, posBlock, fDisconnect, entries)) {
+        fError = true;
+        return false;
+    }
+
+    // The index records and the progress are written in one batch, so a
+    // restart resumes exactly after the last block indexed
+    const CBlockIndex* pindexCursor = fDisconnect ? pindex->pprev : pindex;
+    std::vector<std::string> vNames;
+    for (const CBlockTreeIndex* pindexBuild : vBatch)
+        vNames.push_back(pindexBuild->name);
+    if (!pblocktree->WriteIndexBuilderEntries(entries, vNames, pindexCursor->GetBlockHash())) {
+        fError = error("%s : failed to write index records of block %s", __func__, pindex->GetBlockHash().ToString());
+        return false;
+    }
+
+    LOCK(cs_indexbuilder);
+    for (CBlockTreeIndex* pindexBuild : vBatch)
+        pindexBuild->pindexBest = pindexCursor;
+    if (fDisconnect)
+        LogPrintf("%s : unwound %s from block %s\n", __func__, vNames[0], pindex->GetBlockHash().ToString());
+    else if (pindex->nHeight % 10000 == 0)
+        LogPrintf("%s : %s at height %d\n", __func__, boost::algorithm::join(vNames, ", "), pindex->nHeight);
+    return true;
+}
+
+void ThreadIndexBuilder()
+{
+    // Clear out dropped indexes, and indexes built from scratch
+    for (CBlockTreeIndex& index : vIndexes) {
+        IndexState state;
+        const CBlockIndex* pindexBest;
+        {
+            LOCK(cs_indexbuilder);
+            state = index.state;
+            pindexBest = index.pindexBest;
+        }
+        if (state == INDEX_DROPPING || (state == INDEX_BUILDING && pindexBest == NULL)) {
+            if (!DropIndex(index)) {
+                LogPrintf("%s : failed to drop %s\n", __func__, index.name);
+                return;
+            }
+        }
+        if (state == INDEX_DROPPING) {
+            LOCK(cs_indexbuilder);
+            index.state = INDEX_DISABLED;
+        }
+    }
+
+    bool fError = false;
+    while (true) {
+        boost::this_thread::interruption_point();
+        if (!IndexNextBlock(fError))
+            break;
+    }
+    if (fError)
+        LogPrintf("%s : stopped on an error, the indexes being built stay disabled\n", __func__);
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEXBUILDER_H
+#define BITCOIN_INDEXBUILDER_H
+
+#include <string>
+#include <vector>
+
+/** Progress of one of the optional block tree indexes */
+struct CIndexBuilderStatus {
+    std::string name;
+    std::string state; //! "synced", "building", "dropping" or "disabled"
+    bool fSynced;
+    int nHeight; //! last block indexed, -1 if none
+};
+
+/**
+ * Compare -txindex, -addrindex, -spentindex and -timestampindex with the
+ * indexes found in the block tree database. Indexes that were switched on are
+ * built from the block files, and the ones switched off are dropped, by
+ * ThreadIndexBuilder while the node keeps running. An index only answers
+ * queries once it has caught up with the tip; from then on ConnectBlock and
+ * DisconnectBlock keep it up to date.
+ */
+bool InitIndexBuilder(std::string& strError);
+/** Whether InitIndexBuilder left any index to build or drop */
+bool IndexBuilderPending();
+void ThreadIndexBuilder();
+std::vector<CIndexBuilderStatus> GetIndexBuilderStatus();
+
+#endif // BITCOIN_INDEXBUILDER_H
@@ -22,6 +22,7 @@
 #include "consensus/validation.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexbuilder.h"
 #include "key.h"
 #include "main.h"
 #include "karmanode-budget.h"
@@ -44,6 +45,7 @@
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
 #include "wallet/db.h"
+#include "wallet/logdb.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #include "accumulators.h"
@@ -69,6 +71,7 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
 #endif
 
@@ -170,11 +173,35 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB* pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher* pcoinscatcher = NULL;
 
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
+
+/** Interval between periodic writes of fee_estimates.dat, in seconds */
+static const int64_t FEE_ESTIMATES_FLUSH_INTERVAL = 60 * 60;
+
+/**
+ * Write the fee estimator state to a temporary file and move it over
+ * fee_estimates.dat, so an unclean shutdown never leaves a truncated file.
+ */
+static void FlushFeeEstimates()
+{
+    boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+    boost::filesystem::path est_path_new = GetDataDir() / (std::string(FEE_ESTIMATES_FILENAME) + ".new");
+    {
+        CAutoFile est_fileout(fopen(est_path_new.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (est_fileout.IsNull()) {
+            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path_new.string());
+            return;
+        }
+        if (!mempool.WriteFeeEstimates(est_fileout))
+            return;
+        FileCommit(est_fileout.Get());
+    }
+    if (!RenameOver(est_path_new, est_path))
+        LogPrintf("%s: Failed to rename %s to %s\n", __func__, est_path_new.string(), est_path.string());
+}
 void Interrupt()
 {
     InterruptHTTPServer();
@@ -206,8 +233,13 @@ void PrepareShutdown()
     StopRPC();
     StopHTTPServer();
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
+    if (pwalletMain) {
+        pwalletMain->StopKeyPoolFill();
+        if (zwalletMain)
+            zwalletMain->StopMintPoolFill();
         bitdb.Flush(false);
+        logdb.Flush(false);
+    }
     GenerateBitcoins(false, NULL, 0);
 #endif
     StopNode();
@@ -222,12 +254,7 @@ void PrepareShutdown()
     threadGroup.join_all();
 
     if (fFeeEstimatesInitialized) {
-        boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-        CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
-        if (!est_fileout.IsNull())
-            mempool.WriteFeeEstimates(est_fileout);
-        else
-            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+        FlushFeeEstimates();
         fFeeEstimatesInitialized = false;
     }
 
@@ -253,8 +280,10 @@ void PrepareShutdown()
         pSporkDB = NULL;
     }
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
+    if (pwalletMain) {
         bitdb.Flush(true);
+        logdb.Flush(true);
+    }
 #endif
 
 #if ENABLE_ZMQ
@@ -272,6 +301,7 @@ void PrepareShutdown()
         LogPrintf("%s: Unable to remove pidfile: %s\n", __func__, e.what());
     }
 #endif
+    GetMainSignals().UnregisterWithMempoolSignals(mempool);
     UnregisterAllValidationInterfaces();
 }
 
@@ -394,6 +424,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphantxsize=<n>", strprintf(_("Keep at most <n> kilobytes of unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE));
+    strUsage += HelpMessageOpt("-maxorphantxperpeer=<n>", strprintf(_("Keep at most <n> unconnectable transactions per peer in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "ohmcoind.pid"));
@@ -406,7 +438,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
-    strUsage += HelpMessageOpt("-addrindex", strprintf(_("Maintain a full address index, used by the searchrawtransactions rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-addrindex", strprintf(_("Maintain a full address index, used by the searchrawtransactions and getaddress* rpc calls (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain an index of the inputs spending each output, used by getrawtransaction and the REST interface (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain an index of blocks by timestamp, used by the getblockhashes rpc call (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -419,6 +453,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
     strUsage += HelpMessageOpt("-dnsseed", _("Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect)"));
     strUsage += HelpMessageOpt("-externalip=<ip>", _("Specify your own public address"));
+    strUsage += HelpMessageOpt("-feefilter", strprintf(_("Tell other nodes to filter invs to us by our minimum relay fee (default: %u)"), DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-forcednsseed", strprintf(_("Always query for peer addresses via DNS lookup (default: %u)"), 0));
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
@@ -457,12 +492,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-custombackupthreshold=<n>", strprintf(_("Number of custom location backups to retain (default: %d)"), DEFAULT_CUSTOMBACKUPTHRESHOLD));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), 100));
+    strUsage += HelpMessageOpt("-keypoolthreads=<n>", strprintf(_("Number of threads generating key pool keys and zOHMC mint pool entries (1 to %d, default: %d)"), MAX_KEYPOOL_THREADS, DEFAULT_KEYPOOL_THREADS));
+    strUsage += HelpMessageOpt("-lazywallet", strprintf(_("Load wallet transactions without their input scripts, reading those back when a transaction is written, relayed or shown in full (default: %u)"), DEFAULT_LAZY_WALLET));
     if (GetBoolArg("-help-debug", false))
         strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in OHMC/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"),
             FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in OHMC/kB) to add to transactions you send (default: %s)"), FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Number of threads reading blocks during a wallet rescan (1 to %d, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet.dat") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-bnbselection", strprintf(_("Select coins by their value net of the fee to spend them, looking for a match that needs no change first (default: %u)"), DEFAULT_COIN_SELECTION_BNB));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), 0));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), 1));
     strUsage += HelpMessageOpt("-disablesystemnotifications", strprintf(_("Disable OS notifications for incoming transactions (default: %u)"), 0));
@@ -471,6 +510,7 @@ std::string HelpMessage(HelpMessageMode mode)
         FormatMoney(maxTxFee)));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), "wallet.dat"));
+    strUsage += HelpMessageOpt("-walletbackend=<backend>", strprintf(_("Storage for a wallet file that doesn't exist yet: bdb (Berkeley DB) or log (append-only record log); existing wallets keep theirs (default: %s)"), DEFAULT_WALLET_BACKEND));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     if (mode == HMM_BITCOIN_QT)
         strUsage += HelpMessageOpt("-windowtitle=<name>", _("Wallet window title"));
@@ -486,6 +526,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via SwiftX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", _("Enable publish hash block and tx sequence in <address>"));
+    strUsage += HelpMessageOpt("-zmqpub<topic>hwm=<n>", strprintf(_("Set the outbound message high water mark of the <topic> notifier (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqpub<topic>batch=<n>", strprintf(_("Send up to <n> <topic> notifications as one multipart message, at least every %d seconds (default: %d)"), ZMQ_BATCH_FLUSH_INTERVAL, DEFAULT_ZMQ_BATCH_SIZE));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -590,10 +633,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 11772, 11774));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcserialversion=<n>", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
+    strUsage += HelpMessageOpt("-rpcpool=<prefix>:<threads>:<depth>", _("Serve the HTTP handlers under <prefix> (e.g. /rest/) with their own threads and work queue, so they keep answering while the other calls are busy. This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
-        strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests, and for idle keep-alive connections (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-rpcmaxrequestsperconnection=<n>", strprintf("Close keep-alive connections after <n> requests, so clients reconnect and get rebalanced; 0 = unlimited (default: %d)", DEFAULT_HTTP_MAX_REQUESTS_PER_CONNECTION));
     }
     return strUsage;
 }
@@ -1052,8 +1097,12 @@ bool AppInit2()
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", false);
     bdisableSystemnotifications = GetBoolArg("-disablesystemnotifications", false);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", false);
+    fCoinSelectionBnB = GetBoolArg("-bnbselection", DEFAULT_COIN_SELECTION_BNB);
 
     std::string strWalletFile = GetArg("-wallet", "wallet.dat");
+    std::string strWalletBackend = GetArg("-walletbackend", DEFAULT_WALLET_BACKEND);
+    if (strWalletBackend != "bdb" && strWalletBackend != "log")
+        return InitError(strprintf(_("Unknown -walletbackend: '%s'"), strWalletBackend));
 #endif // ENABLE_WALLET
 
     fIsBareMultisigStd = GetBoolArg("-permitbaremultisig", true) != 0;
@@ -1269,13 +1318,16 @@ bool AppInit2()
             }
         }
 
-        if (GetBoolArg("-salvagewallet", false)) {
+        // A log database drops what a crash left unfinished as it opens;
+        // verification and salvage are for Berkeley DB files
+        bool fLogDB = logdb.IsLogDB(strWalletFile);
+        if (GetBoolArg("-salvagewallet", false) && !fLogDB) {
             // Recover readable keypairs:
             if (!CWalletDB::Recover(bitdb, strWalletFile, true))
                 return false;
         }
 
-        if (filesystem::exists(GetDataDir() / strWalletFile)) {
+        if (filesystem::exists(GetDataDir() / strWalletFile) && !fLogDB) {
             CDBEnv::VerifyResult r = bitdb.Verify(strWalletFile, CWalletDB::Recover);
             if (r == CDBEnv::RECOVER_OK) {
                 string msg = strprintf(_("Warning: wallet.dat corrupt, data salvaged!"
@@ -1413,11 +1465,14 @@ bool AppInit2()
     for (string strDest : mapMultiArgs["-seednode"])
     AddOneShot(strDest);
 
+    GetMainSignals().RegisterWithMempoolSignals(mempool);
+
 #if ENABLE_ZMQ
     pzmqNotificationInterface = CZMQNotificationInterface::CreateWithArguments(mapArgs);
 
     if (pzmqNotificationInterface) {
         RegisterValidationInterface(pzmqNotificationInterface);
+        scheduler.scheduleEvery(boost::bind(&CZMQNotificationInterface::FlushBatches, pzmqNotificationInterface), ZMQ_BATCH_FLUSH_INTERVAL);
     }
 #endif
 
@@ -1509,6 +1564,11 @@ bool AppInit2()
                     break;
                 }
 
+                if (!LoadUTXOStats()) {
+                    strLoadError = _("Error loading the UTXO set statistics");
+                    break;
+                }
+
                 // If the loaded chain has a wrong genesis, bail out immediately
                 // (we're likely using a testnet datadir, or the other way around).
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(Params().HashGenesisBlock()) == 0)
@@ -1520,14 +1580,10 @@ bool AppInit2()
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", true)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
-                    break;
-                }
-
-                if (fAddrIndex != GetBoolArg("-addrindex", true)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -addrindex");
+                // Indexes switched on or off since the last run are built or dropped in the background
+                std::string strIndexError;
+                if (!InitIndexBuilder(strIndexError)) {
+                    strLoadError = strIndexError;
                     break;
                 }
 
@@ -1679,6 +1735,8 @@ bool AppInit2()
     if (!est_filein.IsNull())
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
+    // Persist the estimates periodically so a crash loses at most one interval of data
+    scheduler.scheduleEvery(&FlushFeeEstimates, FEE_ESTIMATES_FLUSH_INTERVAL);
 
 // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
@@ -1772,6 +1830,13 @@ bool AppInit2()
                 pindexRescan = FindForkInGlobalIndex(chainActive, locator);
             else
                 pindexRescan = chainActive.Genesis();
+
+            // Resume a rescan that was stopped by abortrescan or a shutdown
+            if (walletdb.ReadRescanProgress(locator)) {
+                CBlockIndex* pindexProgress = FindForkInGlobalIndex(chainActive, locator);
+                if (pindexProgress && pindexRescan && pindexProgress->nHeight < pindexRescan->nHeight)
+                    pindexRescan = pindexProgress;
+            }
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
             uiInterface.InitMessage(_("Rescanning..."));
@@ -1861,6 +1926,8 @@ bool AppInit2()
         vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (IndexBuilderPending())
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "indexbuilder", &ThreadIndexBuilder));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -1920,9 +1987,10 @@ bool AppInit2()
 
     fMasterNode = GetBoolArg("-karmanode", false);
 
-    if ((fMasterNode || karmanodeConfig.getCount() > -1) && fTxIndex == false) {
+    // A transaction index that is still being built in the background will do
+    if ((fMasterNode || karmanodeConfig.getCount() > -1) && !GetBoolArg("-txindex", true)) {
         return InitError("Enabling Karmanode support requires turning on transaction indexing."
-                         "Please add txindex=1 to your configuration and start with -reindex");
+                         "Please add txindex=1 to your configuration");
     }
 
     if (fMasterNode) {
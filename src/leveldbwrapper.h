@@ -59,6 +59,12 @@ public:
 
         batch.Delete(slKey);
     }
+
+    //! Erase a key in its serialized form, as returned by an iterator
+    void EraseRaw(const leveldb::Slice& slKey)
+    {
+        batch.Delete(slKey);
+    }
 };
 
 class CLevelDBWrapper
@@ -89,16 +95,19 @@ public:
     CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
+    //! Read from the live database, or from a snapshot of it if psnapshot is not NULL
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const leveldb::Snapshot* psnapshot = NULL) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = psnapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -168,6 +177,24 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Pin the current state of the database, for iterating it while it keeps changing
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* psnapshot)
+    {
+        pdb->ReleaseSnapshot(psnapshot);
+    }
+
+    leveldb::Iterator* NewIterator(const leveldb::Snapshot* psnapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = psnapshot;
+        return pdb->NewIterator(options);
+    }
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
@@ -14,6 +14,7 @@
 #include "alert.h"
 #include "base58.h"
 #include "chainparams.h"
+#include "chainsnapshot.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/params.h"
@@ -50,6 +51,7 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace boost;
@@ -71,6 +73,7 @@ using namespace libzerocoin;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+CCriticalSection cs_mapBlockIndex;
 map<uint256, uint256> mapProofOfStake;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 
@@ -92,6 +95,8 @@ bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
 bool fAddrIndex = true;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
+bool fTimestampIndex = DEFAULT_TIMESTAMPINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
@@ -113,12 +118,49 @@ CTxMemPool mempool(::minRelayTxFee);
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
+};
+struct COrphanPeer {
+    std::set<uint256> setOrphans;
+    size_t nBytes;
+    COrphanPeer() : nBytes(0) {}
+};
+struct IteratorComparator
+{
+    template<typename I>
+    bool operator()(const I& a, const I& b) const
+    {
+        return &(*a) < &(*b);
+    }
 };
 map<uint256, COrphanTx> mapOrphanTransactions;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+map<COutPoint, set<map<uint256, COrphanTx>::iterator, IteratorComparator> > mapOrphanTransactionsByPrev;
+map<NodeId, COrphanPeer> mapOrphanTransactionsByPeer;
+size_t nOrphanTransactionsSize = 0;
 map<uint256, int64_t> mapRejectedBlocks;
 map<uint256, int64_t> mapZerocoinspends; //txid, time received
 
+/**
+ * Filter for transactions that were recently rejected by
+ * AcceptToMemoryPool. These are not rerequested until the chain tip
+ * changes, at which point the entire filter is reset. Protected by
+ * cs_main.
+ *
+ * Without this filter we'd be re-requesting and re-validating txs,
+ * zerocoin spend proofs included, each time another peer announces
+ * them. A flooding attacker attempting to roll-over the filter using
+ * minimum-sized transactions might manage to send 1000/sec if we have
+ * fast peers, so we pick 120,000 to give our peers a two minute window
+ * to send invs to us.
+ *
+ * Memory used: about 1.3MB
+ */
+boost::scoped_ptr<CRollingBloomFilter> recentRejects;
+uint256 hashRecentRejectsChainTip;
+/** Rejection counters for getmempoolinfo. Protected by cs_main. */
+CRejectStats rejectStats;
+
 
 void EraseOrphansFor(NodeId peer);
 
@@ -504,6 +546,26 @@ namespace
 
 } // anon namespace
 
+/** Remember a transaction that failed validation so it isn't requested again until the next tip. */
+void static AddRecentReject(const uint256& hash, const CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+    // A witness-stripped copy may have failed where the full
+    // transaction would pass, so only remember real rejections.
+    if (state.CorruptionPossible())
+        return;
+    assert(recentRejects);
+    recentRejects->insert(hash);
+    const std::string& strReason = state.GetRejectReason();
+    rejectStats.mapReasons[strReason.empty() ? "unknown" : strReason]++;
+}
+
+void GetRejectStats(CRejectStats& stats)
+{
+    LOCK(cs_main);
+    stats = rejectStats;
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
 {
     LOCK(cs_main);
@@ -555,7 +617,34 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    LOCK(cs_mapBlockIndex);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it == mapBlockIndex.end() ? NULL : it->second;
+}
+
+BlockIndexState::BlockIndexState(const CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    hashBlock = pindex->GetBlockHash();
+    nHeight = pindex->nHeight;
+    nChainWork = pindex->nChainWork;
+    nStatus = pindex->nStatus;
+    nTx = pindex->nTx;
+    blockPos = pindex->GetBlockPos();
+    nFlags = pindex->nFlags;
+    nStakeModifier = pindex->nStakeModifier;
+    nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
+    nMint = pindex->nMint;
+    nMoneySupply = pindex->nMoneySupply;
+    nZerocoinSupply = pindex->GetZerocoinSupply();
+    mapZerocoinSupply = pindex->mapZerocoinSupply;
+}
+
+CCoinsViewDB* pcoinsdbview = NULL;
 CCoinsViewCache* pcoinsTip = NULL;
+CUTXOStats utxoStats;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -576,65 +665,122 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer)
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
+    // The total amount of memory used is additionally bounded by
+    // -maxorphantxsize, see LimitOrphanTxSize().
     unsigned int sz = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
-    if (sz > 5000) {
+    if (sz > MAX_ORPHAN_TX_SIZE) {
         LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
+    // A single peer may only hold a bounded share of the orphan pool, so it
+    // cannot push out the orphans of every other peer on its own.
+    COrphanPeer& orphanPeer = mapOrphanTransactionsByPeer[peer];
+    unsigned int nMaxPerPeer = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantxperpeer", DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER));
+    if (orphanPeer.setOrphans.size() >= nMaxPerPeer) {
+        LogPrint("mempool", "ignoring orphan tx %s, peer=%d exceeds its orphan quota (%u)\n", hash.ToString(), peer, nMaxPerPeer);
+        if (orphanPeer.setOrphans.empty())
+            mapOrphanTransactionsByPeer.erase(peer);
+        return false;
+    }
+
+    std::pair<map<uint256, COrphanTx>::iterator, bool> ret = mapOrphanTransactions.insert(std::make_pair(hash, COrphanTx()));
+    assert(ret.second);
+    COrphanTx& orphan = ret.first->second;
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nTxSize = sz;
     for (const CTxIn& txin : tx.vin)
-    mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    orphanPeer.setOrphans.insert(hash);
+    orphanPeer.nBytes += sz;
+    nOrphanTransactionsSize += sz;
+
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u bytes %u)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), nOrphanTransactionsSize);
     return true;
 }
 
-void static EraseOrphanTx(uint256 hash)
+int static EraseOrphanTx(uint256 hash)
 {
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
-        return;
+        return 0;
     for (const CTxIn& txin : it->second.tx.vin) {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
+        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
-        itPrev->second.erase(hash);
+        itPrev->second.erase(it);
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+
+    map<NodeId, COrphanPeer>::iterator itPeer = mapOrphanTransactionsByPeer.find(it->second.fromPeer);
+    if (itPeer != mapOrphanTransactionsByPeer.end()) {
+        itPeer->second.setOrphans.erase(hash);
+        itPeer->second.nBytes -= it->second.nTxSize;
+        if (itPeer->second.setOrphans.empty())
+            mapOrphanTransactionsByPeer.erase(itPeer);
+    }
+    nOrphanTransactionsSize -= it->second.nTxSize;
+
     mapOrphanTransactions.erase(it);
+    return 1;
 }
 
 void EraseOrphansFor(NodeId peer)
 {
+    map<NodeId, COrphanPeer>::iterator itPeer = mapOrphanTransactionsByPeer.find(peer);
+    if (itPeer == mapOrphanTransactionsByPeer.end())
+        return;
+
+    // Copy the hashes: erasing the last orphan of a peer removes its entry
+    const std::set<uint256> setErase = itPeer->second.setOrphans;
     int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer) {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
-            ++nErased;
-        }
-    }
+    for (const uint256& hash : setErase)
+        nErased += EraseOrphanTx(hash);
     if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphansSize)
 {
     unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+    static int64_t nNextSweep;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+        while (iter != mapOrphanTransactions.end()) {
+            map<uint256, COrphanTx>::iterator maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow) {
+                nErased += EraseOrphanTx(maybeErase->first);
+            } else {
+                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+            }
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx due to expiration\n", nErased);
+    }
+    while (!mapOrphanTransactions.empty() &&
+           (mapOrphanTransactions.size() > nMaxOrphans || nOrphanTransactionsSize > nMaxOrphansSize)) {
+        // Evict a random orphan of the peer using the most orphan memory,
+        // so a single flooding peer pays for the overflow it causes:
+        map<NodeId, COrphanPeer>::iterator itPeer = mapOrphanTransactionsByPeer.begin();
+        for (map<NodeId, COrphanPeer>::iterator mi = mapOrphanTransactionsByPeer.begin(); mi != mapOrphanTransactionsByPeer.end(); ++mi) {
+            if (mi->second.nBytes > itPeer->second.nBytes)
+                itPeer = mi;
+        }
+        const std::set<uint256>& setOrphans = itPeer->second.setOrphans;
+        std::set<uint256>::const_iterator it = setOrphans.lower_bound(GetRandHash());
+        if (it == setOrphans.end())
+            it = setOrphans.begin();
+        EraseOrphanTx(*it);
         ++nEvicted;
     }
     return nEvicted;
@@ -730,12 +876,13 @@ bool IsStandardTx(const CTransaction& tx, string& reason)
 
 bool IsFinalTx(const CTransaction& tx, int nBlockHeight, int64_t nBlockTime)
 {
-    AssertLockHeld(cs_main);
     // Time based nLockTime implemented in 0.1.6
     if (tx.nLockTime == 0)
         return true;
-    if (nBlockHeight == 0)
+    if (nBlockHeight == 0) {
+        AssertLockHeld(cs_main);
         nBlockHeight = chainActive.Height();
+    }
     if (nBlockTime == 0)
         nBlockTime = GetAdjustedTime();
     if ((int64_t)tx.nLockTime < ((int64_t)tx.nLockTime < LOCKTIME_THRESHOLD ? (int64_t)nBlockHeight : nBlockTime))
@@ -1537,7 +1684,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     uint256 hash = tx.GetHash();
     if (pool.exists(hash)) {
         LogPrintf("%s tx already in mempool\n", __func__);
-        return false;
+        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-in-mempool");
     }
 
     // ----------- swiftTX transaction scanning -----------
@@ -1605,7 +1752,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
             // do we already have it?
             if (view.HaveCoins(hash))
-                return false;
+                return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
 
             // do all inputs exist?
             // Note that this does not check for the presence of actual outputs (see the next check for that),
@@ -1791,30 +1938,111 @@ bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock
     return true;
 }
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos) {
-    uint160 addrid;
-    const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
-    if (pkeyid) {
-        addrid = static_cast<uint160>(*pkeyid);
-    } else {
-        const CScriptID *pscriptid = boost::get<CScriptID>(&dest);
-        if (pscriptid) {
-            addrid = static_cast<uint160>(*pscriptid);
-        } else {
-            return false;
+uint160 GetScriptHashForDestination(const CTxDestination& dest)
+{
+    CScript script = GetScriptForDestination(dest);
+    return Hash160(script.begin(), script.end());
+}
+
+bool GetAddressIndexScriptHash(const CScript& scriptPubKey, uint160& hashScript)
+{
+    // P2PK outputs are indexed together with the P2PKH address of their key
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    hashScript = GetScriptHashForDestination(dest);
+    return true;
+}
+
+void GetAddressIndexEntries(const CTransaction& tx, int nHeight, const std::vector<std::pair<CTxOut, int> >& vPrevOuts, bool fDisconnect,
+    std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent)
+{
+    const uint256 txid = tx.GetHash();
+    uint160 hashScript;
+
+    // Disconnecting erases the outputs before restoring the spent ones, so a
+    // transaction spending an output of the same block ends up consistent
+    if (fDisconnect) {
+        for (unsigned int k = tx.vout.size(); k-- > 0;) {
+            const CTxOut& out = tx.vout[k];
+            if (!GetAddressIndexScriptHash(out.scriptPubKey, hashScript))
+                continue;
+            vDeltas.push_back(std::make_pair(CAddressIndexKey(hashScript, nHeight, txid, k, false), out.nValue));
+            vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashScript, nHeight, txid, k), CAddressUnspentValue()));
         }
     }
 
-    LOCK(cs_main);
-    if (!fAddrIndex)
+    for (unsigned int j = 0; j < vPrevOuts.size() && j < tx.vin.size(); j++) {
+        const CTxOut& prev = vPrevOuts[j].first;
+        if (prev.IsNull() || !GetAddressIndexScriptHash(prev.scriptPubKey, hashScript))
+            continue;
+        const COutPoint& prevout = tx.vin[j].prevout;
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(hashScript, nHeight, txid, j, true), -prev.nValue));
+        CAddressUnspentValue value;
+        if (fDisconnect)
+            value = CAddressUnspentValue(prev.nValue, prev.scriptPubKey);
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashScript, vPrevOuts[j].second, prevout.hash, prevout.n), value));
+    }
+
+    if (!fDisconnect) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            if (!GetAddressIndexScriptHash(out.scriptPubKey, hashScript))
+                continue;
+            vDeltas.push_back(std::make_pair(CAddressIndexKey(hashScript, nHeight, txid, k, false), out.nValue));
+            vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashScript, nHeight, txid, k), CAddressUnspentValue(out.nValue, out.scriptPubKey)));
+        }
+    }
+}
+
+bool GetSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(outpoint, value);
+}
+
+bool GetTimestampIndex(unsigned int nLow, unsigned int nHigh, bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& vHashes)
+{
+    if (!fTimestampIndex)
         return false;
-    std::vector<CExtDiskTxPos> vPos;
-    if (!pblocktree->ReadAddrIndex(addrid, vPos))
+
+    std::vector<std::pair<CTimestampIndexKey, unsigned int> > vBlocks;
+    if (!pblocktree->ReadTimestampIndex(nLow, nHigh, vBlocks))
         return false;
-    setpos.insert(vPos.begin(), vPos.end());
+
+    // Entries of disconnected blocks stay in the index
+    LOCK(cs_main);
+    for (const std::pair<CTimestampIndexKey, unsigned int>& block : vBlocks) {
+        if (fActiveOnly) {
+            BlockMap::const_iterator mi = mapBlockIndex.find(block.first.hashBlock);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+                continue;
+        }
+        vHashes.push_back(std::make_pair(block.first.hashBlock, block.second));
+    }
     return true;
 }
 
+/**
+ * Block times may go backwards under PoS, so each block in -timestampindex
+ * also gets a logical time one past its parent's.
+ */
+unsigned int GetLogicalTimestamp(const CBlockIndex* pindex)
+{
+    unsigned int nLogicalTime = pindex->nTime;
+    unsigned int nPrevLogicalTime;
+    if (pindex->pprev && pblocktree->ReadLogicalTimestamp(pindex->pprev->GetBlockHash(), nPrevLogicalTime) && nPrevLogicalTime >= nLogicalTime)
+        nLogicalTime = nPrevLogicalTime + 1;
+    return nLogicalTime;
+}
+
+/** Record a connected block in -timestampindex */
+static bool WriteTimestampIndex(const CBlockIndex* pindex)
+{
+    return pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()), GetLogicalTimestamp(pindex));
+}
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool isDSTX)
 {
     AssertLockHeld(cs_main);
@@ -2138,17 +2366,80 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+static bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
+    if (!ReadBlockFromDisk(block, pos))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash()) {
-        LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
+    if (block.GetHash() != hashBlock) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().ToString().c_str(), hashBlock.ToString().c_str());
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
     }
     return true;
 }
 
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+{
+    return ReadBlockFromDisk(block, pindex->GetBlockPos(), pindex->GetBlockHash());
+}
+
+bool ReadBlockFromDisk(CBlock& block, const BlockIndexState& state)
+{
+    return ReadBlockFromDisk(block, state.blockPos, state.hashBlock);
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos)
+{
+    // Step back over the message start and size that precede the block
+    CDiskBlockPos hpos = pos;
+    if (hpos.nPos < 8)
+        return error("%s : invalid block position %d:%u", __func__, pos.nFile, pos.nPos);
+    hpos.nPos -= 8;
+
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed for %d:%u", __func__, pos.nFile, pos.nPos);
+
+    try {
+        MessageStartChars blk_start;
+        unsigned int nSize;
+        filein >> FLATDATA(blk_start) >> nSize;
+        if (memcmp(blk_start, Params().MessageStart(), MESSAGE_START_SIZE))
+            return error("%s : block magic mismatch for %d:%u", __func__, pos.nFile, pos.nPos);
+        if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+            return error("%s : block data too large for %d:%u (%u bytes)", __func__, pos.nFile, pos.nPos, nSize);
+        vchBlock.resize(nSize);
+        filein.read((char*)vchBlock.data(), nSize);
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+static bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hashBlock)
+{
+    if (!ReadRawBlockFromDisk(vchBlock, pos))
+        return false;
+    CBlockHeader header;
+    try {
+        CDataStream ssBlock(vchBlock, SER_DISK, CLIENT_VERSION);
+        ssBlock >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != hashBlock)
+        return error("%s : GetHash() doesn't match index for %s", __func__, hashBlock.ToString());
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex)
+{
+    return ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), pindex->GetBlockHash());
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const BlockIndexState& state)
+{
+    return ReadRawBlockFromDisk(vchBlock, state.blockPos, state.hashBlock);
+}
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2762,6 +3053,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpentIndex;
+    CUTXOStats statsDelta;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -2821,12 +3117,16 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             // remove outputs
             outs->Clear();
         }
+        statsDelta.RemoveTransaction(tx, pindex->nHeight);
 
         // restore inputs
+        std::vector<std::pair<CTxOut, int> > vPrevOuts;
         if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) { // not coinbases or zerocoinspend because they dont have traditional inputs
             const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(), transaction and undo data inconsistent - txundo.vprevout.siz=%d tx.vin.siz=%d", txundo.vprevout.size(), tx.vin.size());
+            if (fAddrIndex)
+                vPrevOuts.resize(tx.vin.size());
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
@@ -2849,15 +3149,36 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
 
+                if (fAddrIndex)
+                    vPrevOuts[j] = std::make_pair(undo.txout, coins->nHeight);
+                statsDelta.AddCoin(out, undo.txout, coins->nHeight, coins->fCoinBase);
+                if (undo.nHeight != 0)
+                    statsDelta.nTransactions++;
+                if (fSpentIndex)
+                    vSpentIndex.push_back(std::make_pair(out, CSpentIndexValue()));
+
                 // erase the spent input
                 mapStakeSpent.erase(out);
             }
         }
+
+        if (fAddrIndex)
+            GetAddressIndexEntries(tx, pindex->nHeight, vPrevOuts, true, vAddressDeltas, vAddressUnspent);
     }
 
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
+    if (fAddrIndex && !fVerifyingBlocks) {
+        if (!pblocktree->UpdateAddressIndex(vAddressDeltas, vAddressUnspent, true))
+            return error("DisconnectBlock() : failed to erase address index");
+    }
+
+    if (fSpentIndex && !fVerifyingBlocks) {
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return error("DisconnectBlock() : failed to erase spent index");
+    }
+
     if (!fVerifyingBlocks) {
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
@@ -2865,6 +3186,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+
+        // Only once nothing can fail any more, so the stats never run ahead of the view
+        utxoStats.Apply(statsDelta);
+        utxoStats.hashBlock = pindex->pprev->GetBlockHash();
     }
 
     if (pfClean) {
@@ -3145,33 +3470,6 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-// Index either: a) every data push >=8 bytes,  b) if no such pushes, the entire script
-void static BuildAddrIndex(const CScript &script, const CExtDiskTxPos &pos, std::vector<std::pair<uint160, CExtDiskTxPos> > &out)
-{
-    CScript::const_iterator pc = script.begin();
-    CScript::const_iterator pend = script.end();
-    std::vector<unsigned char> data;
-    opcodetype opcode;
-    bool fHaveData = false;
-    while (pc < pend) {
-        script.GetOp(pc, opcode, data);
-        if (0 <= opcode && opcode <= OP_PUSHDATA4 && data.size() >= 8) { // data element
-            uint160 addrid;
-            if (data.size() <= 20) {
-                memcpy(&addrid, &data[0], data.size());
-            } else {
-                addrid = Hash160(data);
-            }
-            out.push_back(std::make_pair(addrid, pos));
-            fHaveData = true;
-        }
-    }
-    if (!fHaveData) {
-        uint160 addrid = Hash160(script);
-        out.push_back(std::make_pair(addrid, pos));
-    }
-}
-
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
 {
     AssertLockHeld(cs_main);
@@ -3188,7 +3486,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == Params().HashGenesisBlock()) {
+        if (fTimestampIndex && !fJustCheck && !WriteTimestampIndex(pindex))
+            return state.Error("Failed to write timestamp index");
         view.SetBestBlock(pindex->GetBlockHash());
+        if (!fJustCheck && !fVerifyingBlocks)
+            utxoStats.hashBlock = pindex->GetBlockHash();
         return true;
     }
 
@@ -3253,13 +3555,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nSigOpsCost = 0;
     CExtDiskTxPos pos(CDiskTxPos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())), pindex->nHeight);
     std::vector<std::pair<uint256, CDiskTxPos> > vPosTxid;
-    std::vector<std::pair<uint160, CExtDiskTxPos> > vPosAddrid;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpentIndex;
+    CUTXOStats statsDelta;
     std::vector<pair<CoinSpend, uint256> > vSpends;
     vector<pair<PublicCoin, uint256> > vMints;
     if (fTxIndex)
         vPosTxid.reserve(block.vtx.size());
-    if (fAddrIndex)
-        vPosAddrid.reserve(block.vtx.size() * 4);
     vPosTxid.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
@@ -3374,21 +3677,42 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (fTxIndex)
             vPosTxid.push_back(std::make_pair(tx.GetHash(), pos));
         if (fAddrIndex) {
-            if (!tx.IsCoinBase()) {
-                for(const CTxIn &txin : tx.vin) {
-                    CCoins coins;
-                    view.GetCoins(txin.prevout.hash, coins);
-                    if (coins.IsAvailable(txin.prevout.n)) {
-                        BuildAddrIndex(coins.vout[txin.prevout.n].scriptPubKey, pos, vPosAddrid);
-                    }
+            std::vector<std::pair<CTxOut, int> > vPrevOuts;
+            if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+                for (const CTxIn& txin : tx.vin) {
+                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                    if (coins && coins->IsAvailable(txin.prevout.n))
+                        vPrevOuts.push_back(std::make_pair(coins->vout[txin.prevout.n], coins->nHeight));
+                    else
+                        vPrevOuts.push_back(std::make_pair(CTxOut(), 0));
                 }
             }
-            for(const CTxOut &txout : tx.vout)
-            BuildAddrIndex(txout.scriptPubKey, pos, vPosAddrid);
+            GetAddressIndexEntries(tx, pindex->nHeight, vPrevOuts, false, vAddressDeltas, vAddressUnspent);
+        }
+        if (fSpentIndex && !tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+            for (unsigned int j = 0; j < tx.vin.size(); j++)
+                vSpentIndex.push_back(std::make_pair(tx.vin[j].prevout, CSpentIndexValue(tx.GetHash(), j, pindex->nHeight)));
+        }
+
+        if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+            for (const CTxIn& txin : tx.vin) {
+                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                if (coins && coins->IsAvailable(txin.prevout.n))
+                    statsDelta.RemoveCoin(txin.prevout, coins->vout[txin.prevout.n], coins->nHeight, coins->fCoinBase);
+            }
         }
 
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+
+        // Undo data carries the height when the last output of a transaction was spent
+        statsDelta.AddTransaction(tx, pindex->nHeight);
+        if (i > 0) {
+            for (const CTxInUndo& undo : blockundo.vtxundo.back().vprevout) {
+                if (undo.nHeight != 0)
+                    statsDelta.nTransactions--;
+            }
+        }
     }
 
     UpdateZOHMCSupply(block, pindex);
@@ -3495,10 +3819,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPosTxid))
             return state.Error("Failed to write transaction index");
 
-    if (fAddrIndex)
-        if (!pblocktree->AddAddrIndex(vPosAddrid))
+    // Running balances would be counted twice when VerifyDB reconnects blocks
+    if (fAddrIndex && !fVerifyingBlocks)
+        if (!pblocktree->UpdateAddressIndex(vAddressDeltas, vAddressUnspent, false))
             return state.Error("Failed to write address index");
 
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return state.Error("Failed to write spent index");
+
+    if (fTimestampIndex)
+        if (!WriteTimestampIndex(pindex))
+            return state.Error("Failed to write timestamp index");
+
+    // Blocks reconnected by VerifyDB never reach the coin database
+    if (!fVerifyingBlocks) {
+        utxoStats.Apply(statsDelta);
+        utxoStats.hashBlock = pindex->GetBlockHash();
+    }
+
     // add new entries
     for (const CTransaction tx: block.vtx) {
         if (tx.IsCoinBase() || tx.IsZerocoinSpend())
@@ -3613,6 +3952,7 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot(pindexNew);
 
     // If turned on AutoZeromint will automatically convert OHMC to zOHMC
     if (pwalletMain->isZeromintEnabled ())
@@ -3672,6 +4012,7 @@ bool static DisconnectTip(CValidationState& state, bool fBare)
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
         return false;
+    GetMainSignals().BlockDisconnected(block, pindexDelete);
 
     if (!fBare) {
         // Resurrect mempool transactions from the disconnected block.
@@ -3680,7 +4021,7 @@ bool static DisconnectTip(CValidationState& state, bool fBare)
             list<CTransaction> removed;
             CValidationState stateDummy;
             if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
-                mempool.remove(tx, removed, true);
+                mempool.remove(tx, removed, true, MemPoolRemovalReason::REORG);
         }
         mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
         mempool.check(pcoinsTip);
@@ -3772,6 +4113,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     for (const CTransaction& tx : pblock->vtx) {
         SyncWithWallets(tx, pblock);
     }
+    GetMainSignals().BlockConnected(*pblock, pindexNew);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
@@ -4163,6 +4505,8 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
+    // Lock-free readers must not find the entry before it is filled in
+    LOCK(cs_mapBlockIndex);
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
     //mark as PoS seen
@@ -5213,6 +5557,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    LOCK(cs_mapBlockIndex);
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
 
     //mark as PoS seen
@@ -5317,6 +5662,12 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("addrindex", fAddrIndex);
     LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddrIndex ? "enabled" : "disabled");
 
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
+    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
+    LogPrintf("LoadBlockIndexDB(): timestamp index %s\n", fTimestampIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -5325,6 +5676,7 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -5495,9 +5847,14 @@ bool RewindBlockIndex(const CChainParams& params)
 
 void UnloadBlockIndex()
 {
-    mapBlockIndex.clear();
-    setBlockIndexCandidates.clear();
+    recentRejects.reset();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot(NULL);
+    {
+        LOCK(cs_mapBlockIndex);
+        mapBlockIndex.clear();
+    }
+    setBlockIndexCandidates.clear();
     pindexBestInvalid = NULL;
 }
 
@@ -5510,9 +5867,28 @@ bool LoadBlockIndex(string& strError)
 }
 
 
+bool LoadUTXOStats()
+{
+    LOCK(cs_main);
+    if (pcoinsdbview->ReadUTXOStats(utxoStats) && utxoStats.hashBlock == pcoinsdbview->GetBestBlock())
+        return true;
+
+    // Coin databases written before the statistics were kept are walked once
+    LogPrintf("%s: computing the UTXO set statistics...\n", __func__);
+    int64_t nStart = GetTimeMillis();
+    if (!pcoinsdbview->ComputeUTXOStats(utxoStats) || !pcoinsdbview->WriteUTXOStats(utxoStats))
+        return false;
+    LogPrintf("%s: %d unspent outputs in %dms\n", __func__, utxoStats.nTransactionOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
 bool InitBlockIndex()
 {
     LOCK(cs_main);
+
+    // Initialize global variables that cannot be constructed at startup.
+    recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+
     // Check whether we're already initialized
     if (chainActive.Genesis() != NULL)
         return true;
@@ -5522,6 +5898,12 @@ bool InitBlockIndex()
     pblocktree->WriteFlag("txindex", fTxIndex);
     fAddrIndex = GetBoolArg("-addrindex", true);
     pblocktree->WriteFlag("addrindex", fAddrIndex);
+    if (fAddrIndex)
+        pblocktree->WriteInt("addrindex", ADDRINDEX_VERSION);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    pblocktree->WriteFlag("timestampindex", fTimestampIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5858,6 +6240,22 @@ bool static AlreadyHave(const CInv& inv)
     switch (inv.type) {
         case MSG_WITNESS_TX:
         case MSG_TX: {
+            assert(recentRejects);
+            if (chainActive.Tip()->GetBlockHash() != hashRecentRejectsChainTip) {
+                // If the chain tip has changed previously rejected transactions
+                // might be now valid, e.g. due to a nLockTime'd tx becoming valid,
+                // or a double-spend. Reset the rejects filter and give those
+                // txs a second chance.
+                hashRecentRejectsChainTip = chainActive.Tip()->GetBlockHash();
+                recentRejects->reset();
+                rejectStats.nResets++;
+            }
+
+            if (recentRejects->contains(inv.hash)) {
+                rejectStats.nFiltered++;
+                return true;
+            }
+
             bool txInMap = false;
             txInMap = mempool.exists(inv.hash);
             return txInMap || mapOrphanTransactions.count(inv.hash) ||
@@ -5977,7 +6375,7 @@ void static ProcessGetData(CNode* pfrom)
                             // however we MUST always provide at least what the remote peer needs
                             typedef std::pair<unsigned int, uint256> PairType;
                             for (PairType& pair : merkleBlock.vMatchedTxn)
-                            if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                            if (!pfrom->filterInventoryKnown.contains(CInv(MSG_TX, pair.second).GetKey()))
                                 pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
                         }
                         // else
@@ -6344,7 +6742,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 {
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
-                    // at a time so the setAddrKnowns of the chosen nodes prevent repeats
+                    // at a time so the addrKnowns of the chosen nodes prevent repeats
                     static uint256 hashSalt;
                     if (hashSalt == 0)
                         hashSalt = GetRandHash();
@@ -6533,7 +6931,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
 
     else if (strCommand == NetMsgType::TX || strCommand == NetMsgType::DSTX) {
-        vector<uint256> vWorkQueue;
+        std::deque<COutPoint> vWorkQueue;
         vector<uint256> vEraseQueue;
         CTransaction tx;
 
@@ -6597,7 +6995,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (!tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
+            for (unsigned int i = 0; i < tx.vout.size(); i++)
+                vWorkQueue.emplace_back(inv.hash, i);
 
             LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s : accepted %s (poolsz %u)\n",
                      pfrom->id, pfrom->cleanSubVer,
@@ -6608,16 +7007,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             // Recursively process any orphan transactions that depended on this one
             set<NodeId> setMisbehaving;
-            for(unsigned int i = 0; i < vWorkQueue.size(); i++) {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if(itByPrev == mapOrphanTransactionsByPrev.end())
+            while (!vWorkQueue.empty()) {
+                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+                vWorkQueue.pop_front();
+                if (itByPrev == mapOrphanTransactionsByPrev.end())
                     continue;
-                for(set<uint256>::iterator mi = itByPrev->second.begin();
-                    mi != itByPrev->second.end();
-                    ++mi) {
-                    const uint256 &orphanHash = *mi;
-                    const CTransaction &orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
+                for (auto mi = itByPrev->second.begin();
+                     mi != itByPrev->second.end();
+                     ++mi) {
+                    const CTransaction& orphanTx = (*mi)->second.tx;
+                    const uint256& orphanHash = orphanTx.GetHash();
+                    NodeId fromPeer = (*mi)->second.fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
                     // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
@@ -6630,7 +7030,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     if(AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
                         RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
+                        for (unsigned int i = 0; i < orphanTx.vout.size(); i++)
+                            vWorkQueue.emplace_back(orphanHash, i);
                         vEraseQueue.push_back(orphanHash);
                     } else if(!fMissingInputs2) {
                         int nDos = 0;
@@ -6645,6 +7046,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                         // Probably non-standard or insufficient fee/priority
                         LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
                         vEraseQueue.push_back(orphanHash);
+                        AddRecentReject(orphanHash, stateDummy);
                     }
                     mempool.check(pcoinsTip);
                 }
@@ -6660,14 +7062,32 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                      tx.GetHash().ToString(),
                      mempool.mapTx.size());
         } else if (fMissingInputs) {
-            AddOrphanTx(tx, pfrom->GetId());
+            // There is no point keeping an orphan whose parent we just rejected
+            bool fRejectedParents = false;
+            for (const CTxIn& txin : tx.vin) {
+                if (recentRejects->contains(txin.prevout.hash)) {
+                    fRejectedParents = true;
+                    break;
+                }
+            }
+            if (!fRejectedParents) {
+                AddOrphanTx(tx, pfrom->GetId());
 
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+                size_t nMaxOrphanTxSize = (size_t)std::max((int64_t)0, GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) * 1000;
+                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanTxSize);
+                if (nEvicted > 0)
+                    LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+            } else {
+                LogPrint("mempool", "not keeping orphan with rejected parents %s\n", tx.GetHash().ToString());
+                CValidationState stateParents;
+                stateParents.Invalid(false, REJECT_INVALID, "rejected-parents");
+                AddRecentReject(tx.GetHash(), stateParents);
+            }
         } else {
+            AddRecentReject(tx.GetHash(), state);
+
             if (pfrom->fWhitelisted) {
                 // Always relay transactions received from whitelisted peers, even
                 // if they were already in the mempool or rejected from it due
@@ -7026,6 +7446,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 LogPrint("net", "Unparseable reject message received\n");
             }
         }
+    }
+
+
+    else if (strCommand == NetMsgType::FEEFILTER) {
+        CAmount newFeeFilter = 0;
+        vRecv >> newFeeFilter;
+        if (MoneyRange(newFeeFilter)) {
+            {
+                LOCK(pfrom->cs_feeFilter);
+                pfrom->minFeeFilter = newFeeFilter;
+            }
+            LogPrint("net", "received: feefilter of %s from peer=%d\n", CFeeRate(newFeeFilter).ToString(), pfrom->id);
+        }
     } else {
         //probably one the extensions
         obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
@@ -7227,9 +7660,9 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
             LOCK(cs_vNodes);
             for (CNode* pnode : vNodes) {
-                // Periodically clear setAddrKnown to allow refresh broadcasts
+                // Periodically clear addrKnown to allow refresh broadcasts
                 if (nLastRebroadcast)
-                    pnode->setAddrKnown.clear();
+                    pnode->addrKnown.reset();
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
@@ -7245,8 +7678,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend) {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
+                if (!pto->addrKnown.contains(addr.GetKey())) {
+                    pto->addrKnown.insert(addr.GetKey());
                     vAddr.push_back(addr);
                     // receiver rejects addr messages larger than 1000
                     if (vAddr.size() >= 1000) {
@@ -7305,48 +7738,93 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         // Message: inventory
         //
+        int64_t nNow = GetTimeMicros();
+
+        // Pick up transactions relayed since the last pass
+        vector<std::shared_ptr<const CTransaction> > vRelayed;
+        GetRelayedTransactions(pto->nRelayQueueNext, vRelayed);
+
+        // Transaction invs are trickled out in batches at Poisson-distributed
+        // intervals, independently per peer, to protect privacy
+        bool fSendTxTrickle = pto->fWhitelisted;
+        if (pto->nNextInvSend < nNow) {
+            fSendTxTrickle = true;
+            pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
+        }
+
         vector<CInv> vInv;
-        vector<CInv> vInvWait;
         {
-            LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
+            LOCK2(pto->cs_inventory, pto->cs_filter);
+            if (pto->fRelayTxes) {
+                for (const std::shared_ptr<const CTransaction>& ptx : vRelayed) {
+                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*ptx))
+                        continue;
+                    if (!pto->filterInventoryKnown.contains(CInv(MSG_TX, ptx->GetHash()).GetKey()))
+                        pto->setInventoryTxToSend.insert(ptx->GetHash());
+                }
+            }
+
+            vInv.reserve(std::max<size_t>(pto->vInventoryToSend.size(), INVENTORY_BROADCAST_MAX));
             for (const CInv& inv : pto->vInventoryToSend) {
-                if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && pto->setInventoryKnown.count(inv))
+                std::vector<unsigned char> vKey = inv.GetKey();
+                if (pto->filterInventoryKnown.contains(vKey))
                     continue;
+                pto->filterInventoryKnown.insert(vKey);
+                vInv.push_back(inv);
+                if (vInv.size() == MAX_INV_SZ) {
+                    pto->PushMessage(NetMsgType::INV, vInv);
+                    vInv.clear();
+                }
+            }
+            pto->vInventoryToSend.clear();
 
-                // trickle out tx inv to protect privacy
-                if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && !fSendTrickle) {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
+            if (fSendTxTrickle && !pto->setInventoryTxToSend.empty()) {
+                CAmount filterrate = 0;
+                {
+                    LOCK(pto->cs_feeFilter);
+                    filterrate = pto->minFeeFilter;
+                }
 
-                    if (fTrickleWait) {
-                        vInvWait.push_back(inv);
+                // Announce in mempool arrival order, so parents go out before
+                // their children. Transactions that left the pool or pay less
+                // than the peer's fee filter are dropped from the queue.
+                vector<pair<int64_t, uint256> > vTxSorted;
+                vTxSorted.reserve(pto->setInventoryTxToSend.size());
+                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end();) {
+                    CFeeRate feeRate;
+                    int64_t nTime;
+                    if (!mempool.lookupFeeRate(*it, feeRate, nTime) || (filterrate && feeRate.GetFeePerK() < filterrate)) {
+                        pto->setInventoryTxToSend.erase(it++);
                         continue;
                     }
+                    vTxSorted.push_back(std::make_pair(nTime, *it));
+                    ++it;
                 }
+                std::sort(vTxSorted.begin(), vTxSorted.end());
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second) {
+                unsigned int nRelayedTransactions = 0;
+                for (const pair<int64_t, uint256>& item : vTxSorted) {
+                    if (nRelayedTransactions >= INVENTORY_BROADCAST_MAX)
+                        break;
+                    CInv inv(MSG_TX, item.second);
+                    pto->setInventoryTxToSend.erase(item.second);
+                    std::vector<unsigned char> vKey = inv.GetKey();
+                    if (pto->filterInventoryKnown.contains(vKey))
+                        continue;
+                    pto->filterInventoryKnown.insert(vKey);
                     vInv.push_back(inv);
-                    if (vInv.size() >= 1000) {
+                    nRelayedTransactions++;
+                    if (vInv.size() == MAX_INV_SZ) {
                         pto->PushMessage(NetMsgType::INV, vInv);
                         vInv.clear();
                     }
                 }
             }
-            pto->vInventoryToSend = vInvWait;
         }
         if (!vInv.empty())
             pto->PushMessage(NetMsgType::INV, vInv);
 
         // Detect whether we're stalling
-        int64_t nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
@@ -7406,6 +7884,20 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         }
         if (!vGetData.empty())
             pto->PushMessage(NetMsgType::GETDATA, vGetData);
+
+        //
+        // Message: feefilter
+        //
+        if (pto->nVersion >= FEEFILTER_VERSION && GetBoolArg("-feefilter", DEFAULT_FEEFILTER)) {
+            CAmount currentFilter = ::minRelayTxFee.GetFeePerK();
+            if (nNow > pto->nextSendTimeFeeFilter) {
+                if (currentFilter != pto->lastSentFeeFilter) {
+                    pto->PushMessage(NetMsgType::FEEFILTER, currentFilter);
+                    pto->lastSentFeeFilter = currentFilter;
+                }
+                pto->nextSendTimeFeeFilter = PoissonNextSend(nNow, AVG_FEEFILTER_BROADCAST_INTERVAL);
+            }
+        }
     }
     return true;
 }
@@ -7485,5 +7977,6 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        mapOrphanTransactionsByPeer.clear();
     }
 } instance_of_cmaincleanup;
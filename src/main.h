@@ -48,6 +48,8 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
+class CUTXOStats;
 class CZerocoinDB;
 class CSporkDB;
 class CBloomFilter;
@@ -55,8 +57,14 @@ class CInv;
 class CScriptCheck;
 class CValidationInterface;
 
+struct BlockIndexState;
+struct CAddressIndexKey;
+struct CAddressUnspentKey;
+struct CAddressUnspentValue;
 struct CBlockTemplate;
 struct CNodeStateStats;
+struct CRejectStats;
+struct CSpentIndexValue;
 
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
 static const unsigned int DEFAULT_BLOCK_MAX_SIZE = 750000;
@@ -85,6 +93,16 @@ static const int64_t MAX_BLOCK_COST = 4000000;
 static const unsigned int MAX_BLOCK_BASE_SIZE = 1000000;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphantxsize, maximum total size (in kB) of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 500;
+/** Default for -maxorphantxperpeer, maximum number of orphan transactions a single peer may hold */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER = 25;
+/** Largest orphan transaction (in bytes) we are willing to keep */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** Expiration time for orphan transactions in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum time between orphan transactions expire time checks in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -124,6 +142,20 @@ static const unsigned int MAX_STANDARD_P2WSH_SCRIPT_SIZE = 3600;
 
 /** Enable bloom filter */
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+/** Average delay between trickled transaction inventory transmissions in seconds.
+ *  Whitelisted receivers bypass this, outbound peers get half this delay. */
+static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
+/** Maximum number of transaction inventory items to send per transmission.
+ *  Limits the impact of low-fee transaction floods. */
+static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Average delay between feefilter broadcasts in seconds. */
+static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
+/** Default for -feefilter */
+static const bool DEFAULT_FEEFILTER = true;
+/** Default for -spentindex */
+static const bool DEFAULT_SPENTINDEX = false;
+/** Default for -timestampindex */
+static const bool DEFAULT_TIMESTAMPINDEX = false;
 
 struct BlockHasher {
     size_t operator()(const uint256& hash) const { return hash.GetLow64(); }
@@ -134,6 +166,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Held together with cs_main when inserting into mapBlockIndex, so lookups can do without cs_main */
+extern CCriticalSection cs_mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockCost;
 extern const std::string strMessageMagic;
@@ -145,6 +179,8 @@ extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fAddrIndex;
+extern bool fSpentIndex;
+extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -255,6 +291,8 @@ CBlockIndex* InsertBlockIndex(uint256 hash);
 bool AbortNode(const std::string& msg, const std::string& userMessage = "");
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
+/** Get counters of transactions rejected from the memory pool */
+void GetRejectStats(CRejectStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
@@ -278,6 +316,14 @@ struct CNodeStateStats {
     std::vector<int> vHeightInFlight;
 };
 
+struct CRejectStats {
+    std::map<std::string, uint64_t> mapReasons; //! Rejected transactions by reject reason
+    uint64_t nFiltered;                          //! Announcements skipped because the tx was recently rejected
+    uint64_t nResets;                            //! Times the recently rejected filter was reset by a new tip
+
+    CRejectStats() : nFiltered(0), nResets(0) {}
+};
+
 struct CDiskTxPos : public CDiskBlockPos {
     unsigned int nTxOffset; // after header
 
@@ -515,8 +561,28 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+bool ReadBlockFromDisk(CBlock& block, const BlockIndexState& state);
+/** Read the serialized bytes of a block as stored in the block files, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const BlockIndexState& state);
 bool ReadTransaction(CTransaction& tx, const CDiskTxPos &pos, uint256 &hashBlock);
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos);
+/** Hash under which -addrindex files the outputs paying to a destination */
+uint160 GetScriptHashForDestination(const CTxDestination& dest);
+bool GetAddressIndexScriptHash(const CScript& scriptPubKey, uint160& hashScript);
+/**
+ * Append the -addrindex entries of a transaction. vPrevOuts holds the outputs
+ * it spends and the heights they were created at, empty for coinbases and
+ * zerocoin spends; disconnecting erases the outputs and restores the spent ones.
+ */
+void GetAddressIndexEntries(const CTransaction& tx, int nHeight, const std::vector<std::pair<CTxOut, int> >& vPrevOuts, bool fDisconnect,
+    std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent);
+/** Find the input that spent an outpoint in the active chain, requires -spentindex */
+bool GetSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value);
+/** Blocks with a timestamp in [nLow, nHigh) and their logical time, requires -timestampindex */
+bool GetTimestampIndex(unsigned int nLow, unsigned int nHigh, bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& vHashes);
+/** Logical time of a block in -timestampindex, one past its parent's if the block time went backwards */
+unsigned int GetLogicalTimestamp(const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -627,6 +693,35 @@ public:
 
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
+/** Find a block index entry by hash, or NULL; only takes cs_mapBlockIndex */
+CBlockIndex* LookupBlockIndex(const uint256& hash);
+
+/**
+ * Fields of a CBlockIndex that are rewritten under cs_main: by ConnectBlock
+ * and DisconnectBlock, and when the block data is stored. Code that runs
+ * without cs_main, like the RPC and REST handlers, copies these under a short
+ * lock instead of reading the shared index.
+ */
+struct BlockIndexState {
+    uint256 hashBlock;
+    int nHeight;
+    uint256 nChainWork;
+    unsigned int nStatus;
+    unsigned int nTx;
+    CDiskBlockPos blockPos;
+    unsigned int nFlags;
+    uint64_t nStakeModifier;
+    unsigned int nStakeModifierChecksum;
+    int64_t nMint;
+    int64_t nMoneySupply;
+    int64_t nZerocoinSupply;
+    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+
+    explicit BlockIndexState(const CBlockIndex* pindex);
+
+    /** Whether the block is known but its data was never stored or is gone */
+    bool IsMissingData() const { return !(nStatus & BLOCK_HAVE_DATA) && nTx > 0; }
+};
 
 /** Mark a block as invalid. */
 bool InvalidateBlock(CValidationState& state, CBlockIndex* pindex);
@@ -637,9 +732,17 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex);
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 
+/** Global variable that points to the coin database (protected by cs_main) */
+extern CCoinsViewDB* pcoinsdbview;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Statistics of the UTXO set at the tip of chainActive (protected by cs_main) */
+extern CUTXOStats utxoStats;
+/** Load the UTXO set statistics stored with the coin database, computing them if missing */
+bool LoadUTXOStats();
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
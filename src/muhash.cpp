@@ -0,0 +1,58 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/sha256.h"
+
+static const unsigned int MUHASH_BYTES = 384;
+
+const CBigNum& CMuHash3072::Modulus()
+{
+    static const CBigNum bnModulus = (CBigNum(1) << 3072) - CBigNum(1103717);
+    return bnModulus;
+}
+
+CBigNum CMuHash3072::ToNum3072(const std::vector<unsigned char>& vch)
+{
+    // Expand the element with a counter, one SHA256 block of output at a time
+    std::vector<unsigned char> vchNum(MUHASH_BYTES + 1, 0);
+    for (unsigned char i = 0; i < MUHASH_BYTES / CSHA256::OUTPUT_SIZE; i++) {
+        CSHA256 hasher;
+        if (!vch.empty())
+            hasher.Write(&vch[0], vch.size());
+        hasher.Write(&i, 1);
+        hasher.Finalize(&vchNum[i * CSHA256::OUTPUT_SIZE]);
+    }
+    // The extra zero byte keeps the little endian value positive
+    return CBigNum(vchNum);
+}
+
+void CMuHash3072::Insert(const std::vector<unsigned char>& vch)
+{
+    bnNumerator = bnNumerator.mul_mod(ToNum3072(vch), Modulus());
+}
+
+void CMuHash3072::Remove(const std::vector<unsigned char>& vch)
+{
+    bnDenominator = bnDenominator.mul_mod(ToNum3072(vch), Modulus());
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072& other)
+{
+    bnNumerator = bnNumerator.mul_mod(other.bnNumerator, Modulus());
+    bnDenominator = bnDenominator.mul_mod(other.bnDenominator, Modulus());
+    return *this;
+}
+
+uint256 CMuHash3072::Finalize() const
+{
+    CBigNum bnValue = bnNumerator.mul_mod(bnDenominator.inverse(Modulus()), Modulus());
+    std::vector<unsigned char> vch = bnValue.getvch();
+    vch.resize(MUHASH_BYTES, 0);
+
+    uint256 hash;
+    CSHA256().Write(&vch[0], vch.size()).Finalize((unsigned char*)&hash);
+    return hash;
+}
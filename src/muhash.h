@@ -0,0 +1,53 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MUHASH_H
+#define BITCOIN_MUHASH_H
+
+#include "libzerocoin/bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+/**
+ * Rolling hash of a multiset of byte strings. Each element is expanded to a
+ * 3072 bit number and multiplied into (or, when removed, divided out of) a
+ * running product modulo the prime 2^3072 - 1103717, so the hash of a set is
+ * independent of the order in which it was built and can be updated with
+ * each change instead of being recomputed. Divisions are collected in a
+ * separate denominator and only resolved when the digest is taken.
+ */
+class CMuHash3072
+{
+private:
+    CBigNum bnNumerator;
+    CBigNum bnDenominator;
+
+    static const CBigNum& Modulus();
+    static CBigNum ToNum3072(const std::vector<unsigned char>& vch);
+
+public:
+    CMuHash3072() : bnNumerator(1), bnDenominator(1) {}
+
+    void Insert(const std::vector<unsigned char>& vch);
+    void Remove(const std::vector<unsigned char>& vch);
+
+    //! Combine with the changes collected in another object
+    CMuHash3072& operator*=(const CMuHash3072& other);
+
+    //! SHA256 of the 384 byte little endian value of the set
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(bnNumerator);
+        READWRITE(bnDenominator);
+    }
+};
+
+#endif // BITCOIN_MUHASH_H
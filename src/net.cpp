@@ -37,6 +37,8 @@
 #include <miniupnpc/upnperrors.h>
 #endif
 
+#include <math.h>
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -97,6 +99,10 @@ CCriticalSection cs_vNodes;
 map<CInv, CDataStream> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
+// Transactions waiting to be picked up by each peer's SendMessages, guarded by
+// cs_mapRelay. The front entry has sequence number nRelayQueueFront.
+static deque<pair<int64_t, std::shared_ptr<const CTransaction> > > vRelayQueue;
+static uint64_t nRelayQueueFront = 0;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
 static deque<string> vOneShots;
@@ -1836,29 +1842,36 @@ void RelayTransaction(const CTransaction& tx)
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime()) {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
+    std::shared_ptr<const CTransaction> ptx = std::make_shared<const CTransaction>(tx);
+    int64_t nNow = GetTime();
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+    // Peers pick the transaction up from the relay queue in SendMessages, so
+    // the caller does not have to lock and visit every node.
+    LOCK(cs_mapRelay);
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow) {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
     }
-    LOCK(cs_vNodes);
-    for (CNode* pnode : vNodes) {
-        if (!pnode->fRelayTxes)
-            continue;
-        LOCK(pnode->cs_filter);
-        if (pnode->pfilter) {
-            if (pnode->pfilter->IsRelevantAndUpdate(tx))
-                pnode->PushInventory(inv);
-        } else
-            pnode->PushInventory(inv);
+    while (!vRelayQueue.empty() && vRelayQueue.front().first < nNow) {
+        vRelayQueue.pop_front();
+        nRelayQueueFront++;
     }
+
+    // Save original serialized message so newer versions are preserved
+    mapRelay.insert(std::make_pair(inv, ss));
+    vRelayExpiration.push_back(std::make_pair(nNow + RELAY_EXPIRY_INTERVAL, inv));
+    vRelayQueue.push_back(std::make_pair(nNow + RELAY_EXPIRY_INTERVAL, ptx));
+}
+
+void GetRelayedTransactions(uint64_t& nNext, std::vector<std::shared_ptr<const CTransaction> >& vRelayed)
+{
+    LOCK(cs_mapRelay);
+    uint64_t nEnd = nRelayQueueFront + vRelayQueue.size();
+    if (nNext < nRelayQueueFront)
+        nNext = nRelayQueueFront;
+    for (; nNext < nEnd; nNext++)
+        vRelayed.push_back(vRelayQueue[nNext - nRelayQueueFront].second);
 }
 
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
@@ -2040,7 +2053,13 @@ bool CAddrDB::Read(CAddrMan& addr)
 unsigned int ReceiveFloodSize() { return 1000 * GetArg("-maxreceivebuffer", 5 * 1000); }
 unsigned int SendBufferSize() { return 1000 * GetArg("-maxsendbuffer", 1 * 1000); }
 
-CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), setAddrKnown(5000)
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds)
+{
+    return nNow + (int64_t)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
+}
+
+CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fInboundIn) : ssSend(SER_NETWORK, INIT_PROTO_VERSION), addrKnown(5000, 0.001),
+                                                                                           filterInventoryKnown(MAX_INVENTORY_KNOWN, 0.000001)
 {
     nServices = 0;
     nServicesExpected = 0;
@@ -2070,7 +2089,15 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nStartingHeight = -1;
     fGetAddr = false;
     fRelayTxes = false;
-    setInventoryKnown.max_size(SendBufferSize() / 1000);
+    nNextInvSend = 0;
+    {
+        // Only transactions relayed from now on are announced to this peer
+        LOCK(cs_mapRelay);
+        nRelayQueueNext = nRelayQueueFront + vRelayQueue.size();
+    }
+    minFeeFilter = 0;
+    lastSentFeeFilter = 0;
+    nextSendTimeFeeFilter = 0;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
     nPingUsecStart = 0;
@@ -7,11 +7,11 @@
 #ifndef BITCOIN_NET_H
 #define BITCOIN_NET_H
 
+#include "amount.h"
 #include "bloom.h"
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -21,6 +21,7 @@
 #include "utilstrencodings.h"
 
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -56,10 +57,17 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Number of recently announced inventory items remembered per peer. */
+static const unsigned int MAX_INVENTORY_KNOWN = 10000;
+/** Seconds a relayed transaction stays in the relay queue and mapRelay. */
+static const int64_t RELAY_EXPIRY_INTERVAL = 15 * 60;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
 
+/** Return a timestamp in the future (in microseconds) for exponentially distributed events. */
+int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds);
+
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
 void AddressCurrentlyConnected(const CService& addr);
@@ -353,13 +361,20 @@ public:
 
     // flood relay
     std::vector<CAddress> vAddrToSend;
-    mruset<CAddress> setAddrKnown;
+    CRollingBloomFilter addrKnown;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
+    // Non-transaction inventory, sent on the next SendMessages pass.
     std::vector<CInv> vInventoryToSend;
+    // Transaction ids to announce on the next trickle. They are put in
+    // mempool arrival order before sending, so the set's order is irrelevant.
+    std::set<uint256> setInventoryTxToSend;
+    // Sequence number of the next global relay queue entry to pick up.
+    uint64_t nRelayQueueNext;
+    int64_t nNextInvSend;
     CCriticalSection cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
     std::vector<uint256> vBlockRequested;
@@ -374,6 +389,12 @@ public:
     // Whether a ping is requested.
     bool fPingQueued;
 
+    // Minimum fee rate (per kB) the peer asked us to announce, from its feefilter message.
+    CCriticalSection cs_feeFilter;
+    CAmount minFeeFilter;
+    CAmount lastSentFeeFilter;
+    int64_t nextSendTimeFeeFilter;
+
     CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn = false);
     ~CNode();
 
@@ -433,7 +454,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
-        setAddrKnown.insert(addr);
+        addrKnown.insert(addr.GetKey());
     }
 
     void PushAddress(const CAddress& addr)
@@ -441,7 +462,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
-        if (addr.IsValid() && !setAddrKnown.count(addr)) {
+        if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
             } else {
@@ -455,7 +476,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.GetKey());
         }
     }
 
@@ -463,8 +484,14 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if ((inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) && setInventoryKnown.count(inv))
-                return;
+            if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) {
+                if (filterInventoryKnown.contains(inv.GetKey()))
+                    return;
+                if (inv.type == MSG_TX) {
+                    setInventoryTxToSend.insert(inv.hash);
+                    return;
+                }
+            }
             vInventoryToSend.push_back(inv);
         }
     }
@@ -752,6 +779,11 @@ public:
 class CTransaction;
 void RelayTransaction(const CTransaction& tx);
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+/**
+ * Copy the transactions relayed since sequence number nNext into vRelayed and
+ * advance nNext. Entries that expired before they were picked up are skipped.
+ */
+void GetRelayedTransactions(uint64_t& nNext, std::vector<std::shared_ptr<const CTransaction> >& vRelayed);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll = false);
 void RelayInv(CInv& inv);
 
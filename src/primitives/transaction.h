@@ -495,6 +495,13 @@ public:
     bool GetCoinAge(uint64_t& nCoinAge) const;  // ppcoin: get transaction coin age
     
     void UpdateHash() const;
+
+protected:
+    /** Set the cached hash of a transaction held without all of its data (see CWalletTx::IsCompact()) */
+    void SetHash(const uint256& hashIn)
+    {
+        *const_cast<uint256*>(&hash) = hashIn;
+    }
 };
 
 /** A mutable version of CTransaction. */
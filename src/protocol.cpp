@@ -269,6 +269,16 @@ const char* CInv::GetCommand() const
         return "unknown";
 }
 
+std::vector<unsigned char> CInv::GetKey() const
+{
+    std::vector<unsigned char> vKey(hash.begin(), hash.end());
+    vKey.push_back(type & 0xff);
+    vKey.push_back((type >> 8) & 0xff);
+    vKey.push_back((type >> 16) & 0xff);
+    vKey.push_back((type >> 24) & 0xff);
+    return vKey;
+}
+
 std::string CInv::ToString() const
 {
     return strprintf("%s %s", GetCommand(), hash.ToString());
@@ -389,6 +389,8 @@ public:
     bool IsKnownType() const;
     bool IsMasterNodeType() const;
     const char* GetCommand() const;
+    //! Key for the known-inventory filters; types sharing a hash get distinct keys
+    std::vector<unsigned char> GetKey() const;
     std::string ToString() const;
 
     // TODO: make private (improves encapsulation)
@@ -229,6 +229,15 @@ void Bip38ToolDialog::on_importAddressButton_DEC_clicked()
     if (!key.IsValid() || EncodeDestination(pubkey.GetID()) != EncodeDestination(address))
     {
         CKeyID vchAddress = pubkey.GetID();
+
+        // Don't import what the rescan can't look for
+        CRescanReserver reserver(*pwalletMain);
+        if (!reserver.Reserve()) {
+            ui->statusLabel_DEC->setStyleSheet("QLabel { color: red; }");
+            ui->statusLabel_DEC->setText(tr("Wallet is currently rescanning, please try again later."));
+            return;
+        }
+
         ui->statusLabel_DEC->setStyleSheet("QLabel { color: red; }");
         ui->statusLabel_DEC->setText(tr("Please wait while key is imported"));
 
@@ -252,7 +261,7 @@ void Bip38ToolDialog::on_importAddressButton_DEC_clicked()
 
         // whenever a key is imported, we need to scan the whole chain
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
-        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), reserver, true);
     }
 
     ui->statusLabel_DEC->setStyleSheet("QLabel { color: green; }");
@@ -238,10 +238,18 @@ void MultisigDialog::on_importAddressButton_clicked(){
 
     vector<string> keys(vRedeem.begin()+1, vRedeem.end()-1);
 
+    // Don't import what the rescan can't look for
+    CRescanReserver reserver(*pwalletMain);
+    if (!reserver.Reserve()) {
+        ui->addMultisigStatus->setStyleSheet("QLabel { color: red; }");
+        ui->addMultisigStatus->setText(tr("Wallet is currently rescanning, please try again later."));
+        return;
+    }
+
     addMultisig(stoi(vRedeem[0]), keys);
 
     // rescan to find txs associated with imported address
-    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), reserver, true);
     pwalletMain->ReacceptWalletTransactions();
 }
 
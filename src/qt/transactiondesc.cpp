@@ -292,6 +292,7 @@ QString TransactionDesc::toHTML(CWallet* wallet, CWalletTx& wtx, TransactionReco
                 strHTML += "<b>" + tr("Credit") + ":</b> " + BitcoinUnits::formatHtmlWithUnit(unit, wallet->GetCredit(txout, ISMINE_ALL)) + "<br>";
 
         strHTML += "<br><b>" + tr("Transaction") + ":</b><br>";
+        wtx.LoadFull();
         strHTML += GUIUtil::HtmlEscape(wtx.ToString(), true);
 
         strHTML += "<br><b>" + tr("Inputs") + ":</b>";
@@ -4,11 +4,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "chainsnapshot.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
 #include "rpc/server.h"
+#include "spentindex.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -23,6 +25,8 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const int MAX_REST_BLOCKRANGE = 1000; //allow a max of 1000 blocks to be streamed at once
+static const size_t MAX_REST_TXS = 100; //allow a max of 100 transactions to be queried at once
 
 enum RetFormat {
     RF_UNDEF,
@@ -60,7 +64,7 @@ struct CCoin {
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, bool include_hex, int serialize_flags);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern UniValue mempoolToJSON(bool fVerbose = false, bool fIncludeMempoolSequence = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -193,6 +197,25 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * A block serialized the way the binary and hex formats return it. Unless
+ * -rpcserialversion asks for a different encoding, those are the bytes in the
+ * block files, which are sent without deserializing the block.
+ */
+static bool ReadRESTBlock(const BlockIndexState& state, std::vector<unsigned char>& vchBlock)
+{
+    if (RPCSerializationFlags() == 0)
+        return ReadRawBlockFromDisk(vchBlock, state);
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, state))
+        return false;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ssBlock << block;
+    vchBlock.assign(ssBlock.begin(), ssBlock.end());
+    return true;
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -207,41 +230,37 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
-    CBlockIndex* pblockindex = NULL;
-    {
-        LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-
-        pblockindex = mapBlockIndex[hash];
-        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-    }
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (pblockindex == NULL)
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    BlockIndexState state(pblockindex);
+    if (state.IsMissingData())
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
     switch (rf) {
     case RF_BINARY: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        string binaryBlock = ssBlock.str();
+        std::vector<unsigned char> vchBlock;
+        if (!ReadRESTBlock(state, vchBlock))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryBlock);
+        req->WriteReply(HTTP_OK, string(vchBlock.begin(), vchBlock.end()));
         return true;
     }
 
     case RF_HEX: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::vector<unsigned char> vchBlock;
+        if (!ReadRESTBlock(state, vchBlock))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        string strHex = HexStr(vchBlock.begin(), vchBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, state))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
         UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
         string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
@@ -268,6 +287,56 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+static bool rest_blockrange(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/blockrange/<height>/<count>.<ext>.");
+
+    int32_t nStart, nCount;
+    if (!ParseInt32(path[0], &nStart) || nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[0]);
+    if (!ParseInt32(path[1], &nCount) || nCount < 1 || nCount > MAX_REST_BLOCKRANGE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    // All blocks come from one snapshot of the chain, so a reorg while the
+    // reply is being sent can't mix blocks of two branches
+    CChainSnapshotRef chain = GetChainSnapshot();
+    if (nStart > chain->Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+    int nEnd = std::min(nStart + nCount - 1, chain->Height());
+
+    // Read the first block before the status goes out, so that a block that
+    // can't be read is still reported as an error
+    std::vector<unsigned char> vchBlock;
+    if (!ReadRESTBlock(BlockIndexState((*chain)[nStart]), vchBlock))
+        return RESTERR(req, HTTP_NOT_FOUND, "Block at height " + path[0] + " not available");
+
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+    for (int nHeight = nStart; nHeight <= nEnd && !req->ReplyStreamClosed(); nHeight++) {
+        if (nHeight > nStart && !ReadRESTBlock(BlockIndexState((*chain)[nHeight]), vchBlock)) {
+            // Too late for an error status, the reply just ends before this block
+            LogPrint("http", "%s: cannot read block at height %d, reply cut short\n", __func__, nHeight);
+            break;
+        }
+        if (rf == RF_BINARY)
+            req->WriteReplyChunk((const char*)vchBlock.data(), vchBlock.size());
+        else
+            req->WriteReplyChunk(HexStr(vchBlock.begin(), vchBlock.end()) + "\n");
+    }
+    req->WriteReplyEnd();
+    return true;
+}
+
 static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -397,6 +466,177 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_txs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> vHashStr;
+    boost::split(vHashStr, params[0], boost::is_any_of(","));
+
+    if (vHashStr.size() > MAX_REST_TXS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: maximum number of transactions (%d) exceeded", MAX_REST_TXS));
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    std::vector<string> vHex;
+    for (const string& hashStr : vHashStr) {
+        uint256 hash;
+        if (!ParseHashStr(hashStr, hash))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+        CTransaction tx;
+        uint256 hashBlock;
+        if (!GetTransaction(hash, tx, hashBlock, true))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (rf == RF_BINARY) {
+            ssTxs << tx;
+        } else {
+            CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssTx << tx;
+            vHex.push_back(HexStr(ssTx.begin(), ssTx.end()));
+        }
+    }
+
+    if (rf == RF_BINARY) {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ssTxs.str());
+    } else {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, boost::algorithm::join(vHex, "\n") + "\n");
+    }
+    return true;
+}
+
+static bool rest_spent(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/spent/<txid>/<n>.<ext>.");
+
+    uint256 hash;
+    if (!ParseHashStr(path[0], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[0]);
+
+    int32_t n;
+    if (!ParseInt32(path[1], &n) || n < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid output index: " + path[1]);
+
+    if (!fSpentIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled, restart with -spentindex");
+
+    CSpentIndexValue spent;
+    if (!GetSpentIndex(COutPoint(hash, n), spent))
+        return RESTERR(req, HTTP_NOT_FOUND, path[0] + "/" + path[1] + " not spent in the active chain");
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssSpent(SER_NETWORK, PROTOCOL_VERSION);
+        ssSpent << spent;
+        string binarySpent = ssSpent.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binarySpent);
+        return true;
+    }
+
+    case RF_HEX: {
+        CDataStream ssSpent(SER_NETWORK, PROTOCOL_VERSION);
+        ssSpent << spent;
+        string strHex = HexStr(ssSpent.begin(), ssSpent.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue objSpent(UniValue::VOBJ);
+        objSpent.push_back(Pair("txid", spent.txid.GetHex()));
+        objSpent.push_back(Pair("index", (int)spent.nInputIndex));
+        objSpent.push_back(Pair("height", spent.nHeight));
+        string strJSON = objSpent.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockhashes(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() < 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/blockhashes/<high>/<low>[/noorphans][/logicaltimes].json.");
+
+    int64_t nHigh, nLow;
+    if (!ParseInt64(path[0], &nHigh) || !ParseInt64(path[1], &nLow) || nLow < 0 || nHigh < nLow || nHigh > std::numeric_limits<unsigned int>::max())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid time range: " + path[0] + "/" + path[1]);
+
+    bool fActiveOnly = false;
+    bool fLogicalTimes = false;
+    for (unsigned int i = 2; i < path.size(); i++) {
+        if (path[i] == "noorphans")
+            fActiveOnly = true;
+        else if (path[i] == "logicaltimes")
+            fLogicalTimes = true;
+        else
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid option: " + path[i]);
+    }
+
+    if (!fTimestampIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Timestamp index not enabled, restart with -timestampindex");
+
+    std::vector<std::pair<uint256, unsigned int> > vHashes;
+    if (!GetTimestampIndex(nLow, nHigh, fActiveOnly, vHashes))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Cannot read timestamp index");
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue jsonHashes(UniValue::VARR);
+        for (const std::pair<uint256, unsigned int>& hash : vHashes) {
+            if (fLogicalTimes) {
+                UniValue item(UniValue::VOBJ);
+                item.push_back(Pair("blockhash", hash.first.GetHex()));
+                item.push_back(Pair("logicalts", (int64_t)hash.second));
+                jsonHashes.push_back(item);
+            } else {
+                jsonHashes.push_back(hash.first.GetHex());
+            }
+        }
+        string strJSON = jsonHashes.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -598,13 +838,17 @@ static const struct {
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
 } uri_prefixes[] = {
       {"/rest/tx/", rest_tx},
+      {"/rest/txs/", rest_txs},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
+      {"/rest/blockrange/", rest_blockrange},
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/spent/", rest_spent},
+      {"/rest/blockhashes/", rest_blockhashes},
 };
 
 bool StartREST()
@@ -6,10 +6,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "chainsnapshot.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "consensus/validation.h"
 #include "consensus/upgrades.h"
+#include "indexbuilder.h"
 #include "main.h"
 #include "rpc/server.h"
 #include "sync.h"
@@ -23,6 +25,8 @@
 #include <stdint.h>
 #include <univalue.h>
 
+#include <boost/scoped_ptr.hpp>
+
 #include "karmanodeman.h"
 
 using namespace std;
@@ -35,10 +39,9 @@ double GetDifficulty(const CBlockIndex* blockindex)
     // Floating point number that is a multiple of the minimum difficulty,
     // minimum difficulty = 1.0.
     if (blockindex == NULL) {
-        if (chainActive.Tip() == NULL)
+        blockindex = GetChainSnapshot()->Tip();
+        if (blockindex == NULL)
             return 1.0;
-        else
-            blockindex = chainActive.Tip();
     }
 
     int nShift = (blockindex->nBits >> 24) & 0xff;
@@ -60,26 +63,28 @@ double GetDifficulty(const CBlockIndex* blockindex)
 
 UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 {
+    CChainSnapshotRef chain = GetChainSnapshot();
+    BlockIndexState state(blockindex);
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain->Contains(blockindex))
+        confirmations = chain->Height() - state.nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("height", blockindex->nHeight));
+    result.push_back(Pair("height", state.nHeight));
     result.push_back(Pair("version", blockindex->nVersion));
     result.push_back(Pair("merkleroot", blockindex->hashMerkleRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
     result.push_back(Pair("nonce", (uint64_t)blockindex->nNonce));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    result.push_back(Pair("chainwork", state.nChainWork.GetHex()));
     result.push_back(Pair("acc_checkpoint", blockindex->nAccumulatorCheckpoint.GetHex()));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    CBlockIndex* pnext = chain->Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
@@ -88,20 +93,22 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
 {
     UniValue result(UniValue::VOBJ);
-    int64_t KNPayment = GetKarmanodePayment(blockindex->nHeight, GetBlockValue(blockindex->nHeight));
-    int64_t StakerPayment = blockindex->nMint - KNPayment;
-    double KNRewardPercent = floor(((double)KNPayment / (double)blockindex->nMint) * 100);
+    BlockIndexState state(blockindex);
+    int64_t KNPayment = GetKarmanodePayment(state.nHeight, GetBlockValue(state.nHeight));
+    int64_t StakerPayment = state.nMint - KNPayment;
+    double KNRewardPercent = floor(((double)KNPayment / (double)state.nMint) * 100);
+    CChainSnapshotRef chain = GetChainSnapshot();
 
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain->Contains(blockindex))
+        confirmations = chain->Height() - state.nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("cost", (int)::GetBlockCost(block)));
-    result.push_back(Pair("height", blockindex->nHeight));
+    result.push_back(Pair("height", state.nHeight));
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("acc_checkpoint", block.nAccumulatorCheckpoint.GetHex()));
@@ -119,31 +126,31 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
     result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    result.push_back(Pair("chainwork", state.nChainWork.GetHex()));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex* pnext = chainActive.Next(blockindex);
+    CBlockIndex* pnext = chain->Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
 
     result.push_back(Pair("flags", strprintf("%s", blockindex->IsProofOfStake() ? "proof-of-stake" : "proof-of-work")));
-    result.push_back(Pair("nflags:", strprintf("%i", blockindex->nFlags)));
-    result.push_back(Pair("mint", ValueFromAmount(GetBlockValue(blockindex->nHeight))));
+    result.push_back(Pair("nflags:", strprintf("%i", state.nFlags)));
+    result.push_back(Pair("mint", ValueFromAmount(GetBlockValue(state.nHeight))));
 
     result.push_back(Pair("knReward", ValueFromAmount(KNPayment)));
     result.push_back(Pair("knRewardPercent", KNRewardPercent));
     result.push_back(Pair("stakerPayment", ValueFromAmount(StakerPayment)));
-    result.push_back(Pair("modifier", strprintf("%16x", blockindex->nStakeModifier)));
-    result.push_back(Pair("modifierchecksum", strprintf("%08x", GetStakeModifierChecksum(blockindex))));
+    result.push_back(Pair("modifier", strprintf("%16x", state.nStakeModifier)));
+    result.push_back(Pair("modifierchecksum", strprintf("%08x", state.nStakeModifierChecksum)));
 
-    result.push_back(Pair("moneysupply",ValueFromAmount(blockindex->nMoneySupply)));
+    result.push_back(Pair("moneysupply",ValueFromAmount(state.nMoneySupply)));
 
     UniValue zohmcObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zohmcObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zohmcObj.push_back(Pair(to_string(denom), ValueFromAmount(state.mapZerocoinSupply.at(denom) * (denom*COIN))));
     }
-    zohmcObj.push_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
+    zohmcObj.push_back(Pair("total", ValueFromAmount(state.nZerocoinSupply)));
     result.push_back(Pair("zOHMCsupply", zohmcObj));
 
     return result;
@@ -160,8 +167,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainSnapshot()->Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -175,8 +181,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainSnapshot()->Tip()->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -190,12 +195,11 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getdifficulty", "") + HelpExampleRpc("getdifficulty", ""));
 
-    LOCK(cs_main);
     return GetDifficulty();
 }
 
 
-UniValue mempoolToJSON(bool fVerbose = false)
+UniValue mempoolToJSON(bool fVerbose = false, bool fIncludeMempoolSequence = false)
 {
     if (fVerbose) {
         LOCK(mempool.cs);
@@ -228,29 +232,49 @@ UniValue mempoolToJSON(bool fVerbose = false)
         return o;
     } else {
         vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
+        uint64_t nMempoolSequence;
+        {
+            LOCK(mempool.cs);
+            mempool.queryHashes(vtxid);
+            nMempoolSequence = mempool.GetSequence();
+        }
 
         UniValue a(UniValue::VARR);
         for (const uint256& hash : vtxid)
             a.push_back(hash.ToString());
 
-        return a;
+        if (!fIncludeMempoolSequence)
+            return a;
+
+        UniValue o(UniValue::VOBJ);
+        o.push_back(Pair("txids", a));
+        o.push_back(Pair("mempool_sequence", nMempoolSequence));
+        return o;
     }
 }
 
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 1)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
             "\nArguments:\n"
             "1. verbose           (boolean, optional, default=false) true for a json object, false for array of transaction ids\n"
+            "2. mempool_sequence  (boolean, optional, default=false) If verbose=false, returns a json object with transaction list and mempool sequence number attached.\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{                           (json object)\n"
+            "  \"txids\" : [               (json array of string)\n"
+            "    \"transactionid\"         (string) The transaction id\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"mempool_sequence\" : n    (numeric) The mempool sequence number the next change will carry, see -zmqpubsequence\n"
+            "}\n"
             "\nResult: (for verbose = true):\n"
             "{                           (json object)\n"
             "  \"transactionid\" : {       (json object)\n"
@@ -274,7 +298,13 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    bool fIncludeMempoolSequence = false;
+    if (params.size() > 1)
+        fIncludeMempoolSequence = params[1].get_bool();
+    if (fVerbose && fIncludeMempoolSequence)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+
+    return mempoolToJSON(fVerbose, fIncludeMempoolSequence);
 }
 
 UniValue getblockhash(const UniValue& params, bool fHelp)
@@ -290,27 +320,97 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
-    LOCK(cs_main);
+    CChainSnapshotRef chain = GetChainSnapshot();
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > chain->Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    CBlockIndex* pblockindex = (*chain)[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw runtime_error(
+            "getblockhashes high low ( options )\n"
+            "\nReturns the hashes of the blocks with a timestamp in [low, high), in timestamp order.\n"
+            "Requires -timestampindex.\n"
+            "\nArguments:\n"
+            "1. high          (numeric, required) The end of the time range, exclusive\n"
+            "2. low           (numeric, required) The start of the time range, inclusive\n"
+            "3. options       (object, optional)\n"
+            "    {\n"
+            "      \"noOrphans\" : true|false     (boolean, default=false) Only return blocks in the active chain\n"
+            "      \"logicalTimes\" : true|false  (boolean, default=false) Also return the logical time of each block\n"
+            "    }\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"         (string) The block hash\n"
+            "  ,...\n"
+            "]\n"
+            "\nResult (with logicalTimes):\n"
+            "[\n"
+            "  {\n"
+            "    \"blockhash\" : \"hash\",  (string) The block hash\n"
+            "    \"logicalts\" : n        (numeric) The block time, raised to one past its parent's when it went backwards\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockhashes", "1559347200 1559260800") + HelpExampleCli("getblockhashes", "1559347200 1559260800 '{\"noOrphans\":true}'") +
+            HelpExampleRpc("getblockhashes", "1559347200, 1559260800"));
+
+    if (!fTimestampIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Timestamp index not enabled");
+
+    int64_t nHigh = params[0].get_int64();
+    int64_t nLow = params[1].get_int64();
+    if (nLow < 0 || nHigh < nLow || nHigh > std::numeric_limits<unsigned int>::max())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid time range");
+
+    bool fActiveOnly = false;
+    bool fLogicalTimes = false;
+    if (params.size() > 2) {
+        const UniValue& options = params[2].get_obj();
+        if (options.exists("noOrphans"))
+            fActiveOnly = options["noOrphans"].get_bool();
+        if (options.exists("logicalTimes"))
+            fLogicalTimes = options["logicalTimes"].get_bool();
+    }
+
+    std::vector<std::pair<uint256, unsigned int> > vHashes;
+    if (!GetTimestampIndex(nLow, nHigh, fActiveOnly, vHashes))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read timestamp index");
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<uint256, unsigned int>& hash : vHashes) {
+        if (fLogicalTimes) {
+            UniValue item(UniValue::VOBJ);
+            item.push_back(Pair("blockhash", hash.first.GetHex()));
+            item.push_back(Pair("logicalts", (int64_t)hash.second));
+            result.push_back(item);
+        } else {
+            result.push_back(hash.first.GetHex());
+        }
+    }
+    return result;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "getblock \"hash\" ( verbose )\n"
-            "\nIf verbose is false, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
-            "If verbose is true, returns an Object with information about block <hash>.\n"
+            "getblock \"hash\" ( verbosity )\n"
+            "\nIf verbosity is 0, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
+            "If verbosity is 1, returns an Object with information about block <hash>.\n"
+            "If verbosity is 2, returns an Object with information about block <hash> and information about each transaction.\n"
             "\nArguments:\n"
             "1. \"hash\"          (string, required) The block hash\n"
-            "2. verbose           (boolean, optional, default=true) true for a json object, false for the hex encoded data\n"
-            "\nResult (for verbose = true):\n"
+            "2. verbosity         (numeric, optional, default=1) 0 for hex encoded data, 1 for a json object, and 2 for json object with transaction data;\n"
+            "                     true and false are accepted for 1 and 0\n"
+            "\nResult (for verbosity = 1):\n"
             "{\n"
             "  \"hash\" : \"hash\",     (string) the block hash (same as provided)\n"
             "  \"confirmations\" : n,   (numeric) The number of confirmations, or -1 if the block is not on the main chain\n"
@@ -342,37 +442,46 @@ UniValue getblock(const UniValue& params, bool fHelp)
             "     \"total\" : n,        (numeric) The total supply of all zOHMC denominations\n"
             "  }\n"
             "}\n"
-            "\nResult (for verbose=false):\n"
+            "\nResult (for verbosity = 2):\n"
+            "{\n"
+            "  ...,                 Same output as verbosity = 1\n"
+            "  \"tx\" : [               (array of Objects) The transactions in the format of the getrawtransaction RPC\n"
+            "         ,...\n"
+            "  ],\n"
+            "  ,...                 Same output as verbosity = 1\n"
+            "}\n"
+            "\nResult (for verbosity = 0):\n"
             "\"data\"             (string) A string that is serialized, hex-encoded data for block 'hash'.\n"
             "\nExamples:\n" +
             HelpExampleCli("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") + HelpExampleRpc("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
-    bool fVerbose = true;
-    if (params.size() > 1)
-        fVerbose = params[1].get_bool();
+    int nVerbosity = 1;
+    if (params.size() > 1) {
+        if (params[1].isNum())
+            nVerbosity = params[1].get_int();
+        else
+            nVerbosity = params[1].get_bool() ? 1 : 0;
+    }
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (pblockindex == NULL)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
+    if (!ReadBlockFromDisk(block, BlockIndexState(pblockindex)))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    if (!fVerbose) {
+    if (nVerbosity <= 0) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex);
+    return blockToJSON(block, pblockindex, nVerbosity >= 2);
 }
 
 UniValue getblockheader(const UniValue& params, bool fHelp)
@@ -412,11 +521,10 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (pblockindex == NULL)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << pblockindex->GetBlockHeader();
@@ -429,28 +537,53 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=muhash) \"muhash\" returns the statistics kept up to date\n"
+            "                  with every block, \"legacy\" walks the whole set to compute hash_serialized,\n"
+            "                  which may take some time\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"muhash\": \"hash\",       (string) Rolling hash of the unspent outputs (muhash only)\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (legacy only)\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (legacy only)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
-
-    LOCK(cs_main);
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "legacy") +
+            HelpExampleRpc("gettxoutsetinfo", ""));
 
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "muhash";
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash") {
+        CUTXOStats stats;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            stats = utxoStats;
+            nHeight = chainActive.Height();
+        }
+        ret.push_back(Pair("height", nHeight));
+        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+        ret.push_back(Pair("transactions", stats.nTransactions));
+        ret.push_back(Pair("txouts", stats.nTransactionOutputs));
+        ret.push_back(Pair("muhash", stats.muhash.Finalize().GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    }
+    if (strHashType != "legacy")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+
+    LOCK(cs_main);
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (pcoinsTip->GetStats(stats)) {
@@ -465,6 +598,78 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set at the current tip to a file.\n"
+            "The coin database is read from a snapshot, so blocks keep being processed meanwhile.\n"
+            "\nArguments:\n"
+            "1. \"path\"   (string, required) Path of the output file, relative to the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,      (numeric) Number of transactions with unspent outputs written\n"
+            "  \"base_hash\": \"hash\",     (string) Block the snapshot was taken at\n"
+            "  \"base_height\": n,        (numeric) Height of that block\n"
+            "  \"path\": \"path\",          (string) Absolute path of the file written\n"
+            "  \"muhash\": \"hash\"         (string) Rolling hash of the unspent outputs, as in gettxoutsetinfo\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[0].get_str(), GetDataDir());
+    boost::filesystem::path pathTemp = path.string() + ".incomplete";
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CAutoFile file(fopen(pathTemp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        throw JSONRPCError(RPC_MISC_ERROR, "Couldn't open " + pathTemp.string() + " for writing");
+
+    // Only pinning the flushed coin database needs the lock
+    CUTXOStats stats;
+    int nHeight;
+    const leveldb::Snapshot* psnapshot;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        psnapshot = pcoinsdbview->GetSnapshot();
+        stats = utxoStats;
+        nHeight = chainActive.Height();
+    }
+
+    uint64_t nWritten = 0;
+    bool fOk = true;
+    try {
+        file << stats.hashBlock << nHeight << (uint64_t)stats.nTransactions;
+        fOk = pcoinsdbview->ForEachCoins(psnapshot, [&file, &nWritten](const uint256& txid, const CCoins& coins) {
+            file << txid << coins;
+            nWritten++;
+            return true;
+        });
+    } catch (const std::exception& e) {
+        fOk = error("%s : %s", __func__, e.what());
+    }
+    pcoinsdbview->ReleaseSnapshot(psnapshot);
+    file.fclose();
+
+    if (!fOk || nWritten != (uint64_t)stats.nTransactions) {
+        boost::filesystem::remove(pathTemp);
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to write the UTXO set snapshot");
+    }
+    if (!RenameOver(pathTemp, path))
+        throw JSONRPCError(RPC_MISC_ERROR, "Couldn't rename " + pathTemp.string());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", nWritten));
+    ret.push_back(Pair("base_hash", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", nHeight));
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("muhash", stats.muhash.Finalize().GetHex()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -500,8 +705,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             "\nView the details\n" + HelpExampleCli("gettxout", "\"txid\" 1") +
             "\nAs a json rpc call\n" + HelpExampleRpc("gettxout", "\"txid\", 1"));
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = params[0].get_str();
@@ -511,22 +714,38 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
+    // cs_main is only held to look at the mempool and the coins cache; coins
+    // the cache doesn't have are read from a snapshot of the database after it
+    // is released.
     CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
+    bool fFound = false;
+    const CBlockIndex* pindex;
+    boost::scoped_ptr<CCoinsViewDBSnapshot> pcoinsdb;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(pcoinsTip->GetBestBlock());
+        if (fMempool) {
+            LOCK(mempool.cs);
+            if (mempool.mapNextTx.count(COutPoint(hash, n)))
+                return NullUniValue;
+            CTransaction tx;
+            if (mempool.lookup(hash, tx)) {
+                coins = CCoins(tx, MEMPOOL_HEIGHT);
+                fFound = true;
+            }
+        }
+        if (!fFound) {
+            if (pcoinsTip->HaveCoinsInCache(hash))
+                fFound = pcoinsTip->GetCoins(hash, coins);
+            else
+                pcoinsdb.reset(new CCoinsViewDBSnapshot(*pcoinsdbview));
+        }
     }
-    if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
+    if (pcoinsdb)
+        fFound = pcoinsdb->GetCoins(hash, coins);
+    if (!fFound || n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
         return NullUniValue;
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex* pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
     if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
@@ -795,6 +1014,36 @@ UniValue getchaintips(const UniValue& params, bool fHelp)
     return res;
 }
 
+UniValue getindexinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getindexinfo\n"
+            "Returns the status of the optional block indexes. Indexes switched on or off\n"
+            "since the last start are built or dropped in the background while the node runs.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                 (json object) the index, e.g. \"txindex\"\n"
+            "    \"synced\": true|false,    (boolean) whether the index is complete and used\n"
+            "    \"state\": \"xxxx\",         (string) synced, building, dropping or disabled\n"
+            "    \"best_block_height\": n   (numeric) last block indexed, -1 if none\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getindexinfo", "") + HelpExampleRpc("getindexinfo", ""));
+
+    UniValue result(UniValue::VOBJ);
+    for (const CIndexBuilderStatus& status : GetIndexBuilderStatus()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("synced", status.fSynced));
+        obj.push_back(Pair("state", status.state));
+        obj.push_back(Pair("best_block_height", status.nHeight));
+        result.push_back(Pair(status.name, obj));
+    }
+    return result;
+}
+
 UniValue getfeeinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -883,6 +1132,17 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     //ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
 
+    CRejectStats rejectStats;
+    GetRejectStats(rejectStats);
+    UniValue rejects(UniValue::VOBJ);
+    rejects.push_back(Pair("filtered", (int64_t) rejectStats.nFiltered));
+    rejects.push_back(Pair("resets", (int64_t) rejectStats.nResets));
+    UniValue reasons(UniValue::VOBJ);
+    for (const auto& reason : rejectStats.mapReasons)
+        reasons.push_back(Pair(reason.first, (int64_t) reason.second));
+    rejects.push_back(Pair("reasons", reasons));
+    ret.push_back(Pair("rejects", rejects));
+
     return ret;
 }
 
@@ -896,6 +1156,14 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"rejects\": {                 (json object) Transactions relayed to us that failed validation\n"
+            "    \"filtered\": xxxxx          (numeric) Announcements not requested because the tx was recently rejected\n"
+            "    \"resets\": xxxxx            (numeric) Times the recently rejected filter was cleared by a new tip\n"
+            "    \"reasons\": {               (json object) Rejection counts by reject reason\n"
+            "      \"reason\": n,             (numeric) Number of transactions rejected for this reason\n"
+            "      ...\n"
+            "    }\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", ""));
@@ -75,6 +75,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"listunspent", 3},
         {"getblock", 1},
         {"getblockheader", 1},
+        {"getblockhashes", 0},
+        {"getblockhashes", 1},
+        {"getblockhashes", 2},
         {"gettransaction", 1},
         {"getrawtransaction", 1},
         {"createrawtransaction", 0},
@@ -85,6 +88,13 @@ static const CRPCConvertParam vRPCConvertParams[] =
         { "searchrawtransactions", 2 },
         { "searchrawtransactions", 3 },
         { "searchrawtransactions", 4 },
+        { "getaddressbalance", 0 },
+        { "getaddressdeltas", 0 },
+        { "getaddressdeltas", 1 },
+        { "getaddressdeltas", 2 },
+        { "getaddressdeltas", 3 },
+        { "getaddressutxos", 0 },
+        { "getaddressutxos", 1 },
         {"sendrawtransaction", 2},
         {"gettxout", 1},
         {"gettxout", 2},
@@ -97,7 +107,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"verifychain", 1},
         {"keypoolrefill", 0},
         {"getrawmempool", 0},
+        {"getrawmempool", 1},
         {"estimatefee", 0},
+        {"estimatefee", 1},
         {"estimatepriority", 0},
         {"prioritisetransaction", 1},
         {"prioritisetransaction", 2},
@@ -690,33 +690,60 @@ UniValue submitblock(const UniValue& params, bool fHelp)
 
 UniValue estimatefee(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 1)
+    if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "estimatefee nblocks\n"
+            "estimatefee nblocks ( verbose )\n"
             "\nEstimates the approximate fee per kilobyte\n"
             "needed for a transaction to begin confirmation\n"
             "within nblocks blocks.\n"
             "\nArguments:\n"
             "1. nblocks     (numeric)\n"
+            "2. verbose     (boolean, optional, default=false) Return estimates for several confidence levels\n"
             "\nResult:\n"
             "n :    (numeric) estimated fee-per-kilobyte\n"
             "\n"
             "-1.0 is returned if not enough transactions and\n"
             "blocks have been observed to make an estimate.\n"
+            "\nResult (for verbose = true):\n"
+            "{\n"
+            "  \"nblocks\" : n,          (numeric) the confirmation target\n"
+            "  \"feerate\" : x.xxx,      (numeric) estimated fee-per-kilobyte at the default confidence\n"
+            "  \"confidence\" : {\n"
+            "     \"p\" : x.xxx,         (numeric) estimated fee-per-kilobyte for a confirmation probability p, or -1.0\n"
+            "     ,...\n"
+            "  }\n"
+            "}\n"
             "\nExample:\n" +
-            HelpExampleCli("estimatefee", "6"));
+            HelpExampleCli("estimatefee", "6") + HelpExampleCli("estimatefee", "6 true"));
 
-    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM));
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM)(UniValue::VBOOL));
 
     int nBlocks = params[0].get_int();
     if (nBlocks < 1)
         nBlocks = 1;
 
+    bool fVerbose = false;
+    if (params.size() > 1)
+        fVerbose = params[1].get_bool();
+
     CFeeRate feeRate = mempool.estimateFee(nBlocks);
-    if (feeRate == CFeeRate(0))
-        return -1.0;
+    UniValue feeValue = feeRate == CFeeRate(0) ? UniValue(-1.0) : ValueFromAmount(feeRate.GetFeePerK());
+    if (!fVerbose)
+        return feeValue;
+
+    static const double confidenceLevels[] = {.5, .8, .95};
+    UniValue confidence(UniValue::VOBJ);
+    for (double dConfidence : confidenceLevels) {
+        CFeeRate levelRate = mempool.estimateFee(nBlocks, dConfidence);
+        confidence.push_back(Pair(strprintf("%.2f", dConfidence),
+            levelRate == CFeeRate(0) ? UniValue(-1.0) : ValueFromAmount(levelRate.GetFeePerK())));
+    }
 
-    return ValueFromAmount(feeRate.GetFeePerK());
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("nblocks", nBlocks));
+    result.push_back(Pair("feerate", feeValue));
+    result.push_back(Pair("confidence", confidence));
+    return result;
 }
 
 UniValue estimatepriority(const UniValue& params, bool fHelp)
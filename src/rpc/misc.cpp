@@ -8,6 +8,7 @@
 #include "base58.h"
 #include "clientversion.h"
 #include "crypto/ripemd160.h"
+#include "httpserver.h"
 #include "init.h"
 #include "main.h"
 #include "karmanode-sync.h"
@@ -148,6 +149,72 @@ UniValue getinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue gethttpserverinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gethttpserverinfo\n"
+            "Returns the load of the HTTP worker pools and the requests served per endpoint.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"pools\": [                  (array) the default pool first, then those set with -rpcpool\n"
+            "    {\n"
+            "      \"prefix\": \"xxx\",          (string) handlers served start with this, empty for the default pool\n"
+            "      \"threads\": n,             (numeric) worker threads\n"
+            "      \"queue_depth\": n,         (numeric) requests waiting for a worker now\n"
+            "      \"max_queue_depth\": n,     (numeric) requests waiting before new ones are rejected\n"
+            "      \"peak_queue_depth\": n,    (numeric) most requests ever waiting at once\n"
+            "      \"processed\": n,           (numeric) requests served\n"
+            "      \"rejected\": n             (numeric) requests rejected with \"Work queue depth exceeded\"\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"endpoints\": [              (array) every handler that received requests\n"
+            "    {\n"
+            "      \"prefix\": \"xxx\",          (string) the handler's path\n"
+            "      \"pool\": \"xxx\",            (string) prefix of the pool serving it\n"
+            "      \"requests\": n,            (numeric) requests served\n"
+            "      \"rejected\": n,            (numeric) requests rejected because the pool was full\n"
+            "      \"avg_queue_ms\": x.xxx,    (numeric) average time waiting for a worker\n"
+            "      \"avg_run_ms\": x.xxx,      (numeric) average time in the handler\n"
+            "      \"max_run_ms\": x.xxx       (numeric) longest time in the handler\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("gethttpserverinfo", "") + HelpExampleRpc("gethttpserverinfo", ""));
+
+    UniValue pools(UniValue::VARR);
+    for (const HTTPPoolStats& stats : GetHTTPPoolStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("prefix", stats.prefix));
+        obj.push_back(Pair("threads", stats.nThreads));
+        obj.push_back(Pair("queue_depth", (uint64_t)stats.nDepth));
+        obj.push_back(Pair("max_queue_depth", (uint64_t)stats.nMaxDepth));
+        obj.push_back(Pair("peak_queue_depth", (uint64_t)stats.nPeakDepth));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        pools.push_back(obj);
+    }
+
+    UniValue endpoints(UniValue::VARR);
+    for (const HTTPEndpointStats& stats : GetHTTPEndpointStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("prefix", stats.prefix));
+        obj.push_back(Pair("pool", stats.pool));
+        obj.push_back(Pair("requests", stats.nRequests));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("avg_queue_ms", stats.nRequests ? stats.nQueueTimeTotal * 0.001 / stats.nRequests : 0.0));
+        obj.push_back(Pair("avg_run_ms", stats.nRequests ? stats.nRunTimeTotal * 0.001 / stats.nRequests : 0.0));
+        obj.push_back(Pair("max_run_ms", stats.nRunTimeMax * 0.001));
+        endpoints.push_back(obj);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("pools", pools));
+    result.push_back(Pair("endpoints", endpoints));
+    return result;
+}
+
 UniValue knsync(const UniValue& params, bool fHelp)
 {
     std::string strMode;
@@ -58,6 +58,60 @@ string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValu
     return reply.write() + "\n";
 }
 
+void JSONStreamWriter::Write(const UniValue& value)
+{
+    if (value.isObject()) {
+        const std::vector<std::string>& keys = value.getKeys();
+        const std::vector<UniValue>& values = value.getValues();
+        WriteRaw("{");
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            if (i > 0)
+                WriteRaw(",");
+            WriteRaw(UniValue(keys[i]).write() + ":");
+            Write(values[i]);
+        }
+        WriteRaw("}");
+    } else if (value.isArray()) {
+        const std::vector<UniValue>& values = value.getValues();
+        WriteRaw("[");
+        for (unsigned int i = 0; i < values.size(); i++) {
+            if (i > 0)
+                WriteRaw(",");
+            Write(values[i]);
+        }
+        WriteRaw("]");
+    } else {
+        WriteRaw(value.write());
+    }
+}
+
+void JSONStreamWriter::WriteRaw(const std::string& str)
+{
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize) {
+        sink(strBuffer);
+        strBuffer.clear();
+    }
+}
+
+std::string JSONStreamWriter::Finish()
+{
+    std::string strRest;
+    strRest.swap(strBuffer);
+    return strRest;
+}
+
+void JSONRPCReplyStream(JSONStreamWriter& writer, const UniValue& result, const UniValue& error, const UniValue& id)
+{
+    writer.WriteRaw("{\"result\":");
+    writer.Write(error.isNull() ? result : NullUniValue);
+    writer.WriteRaw(",\"error\":");
+    writer.Write(error);
+    writer.WriteRaw(",\"id\":");
+    writer.Write(id);
+    writer.WriteRaw("}");
+}
+
 UniValue JSONRPCError(int code, const string& message)
 {
     UniValue error(UniValue::VOBJ);
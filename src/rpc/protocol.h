@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <string>
 #include <boost/filesystem.hpp>
+#include <boost/function.hpp>
 
 #include <univalue.h>
 
@@ -79,6 +80,34 @@ UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const Un
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
+/**
+ * Writes UniValues as the same compact JSON as UniValue::write(), but hands
+ * the text to a sink every nChunkSize bytes instead of building one string.
+ * Only the serialized text is bounded this way: the UniValue being written
+ * (e.g. the result of one RPC call) is still built in memory as a whole.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef boost::function<void(const std::string&)> Sink;
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    JSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn = DEFAULT_CHUNK_SIZE) : sink(sinkIn), nChunkSize(nChunkSizeIn) {}
+
+    void Write(const UniValue& value);
+    void WriteRaw(const std::string& str);
+    //! Text written since the sink was last called; the writer is empty afterwards
+    std::string Finish();
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+};
+
+/** Stream the object JSONRPCReplyObj would build, without copying result into it */
+void JSONRPCReplyStream(JSONStreamWriter& writer, const UniValue& result, const UniValue& error, const UniValue& id);
+
 /** Get name of RPC authentication cookie file */
 boost::filesystem::path GetAuthCookieFile();
 /** Generate a new RPC authentication cookie and write it to disk */
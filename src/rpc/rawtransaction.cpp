@@ -7,6 +7,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "chainsnapshot.h"
 #include "core_io.h"
 #include "consensus/validation.h"
 #include "init.h"
@@ -19,7 +20,9 @@
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "spentindex.h"
 #include "swifttx.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "utilmoneystr.h"
 #ifdef ENABLE_WALLET
@@ -107,6 +110,14 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry,
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
         out.push_back(Pair("scriptPubKey", o));
+
+        // Spending input of confirmed outputs, when -spentindex is enabled
+        CSpentIndexValue spent;
+        if (!hashBlock.IsNull() && GetSpentIndex(COutPoint(tx.GetHash(), i), spent)) {
+            out.push_back(Pair("spentTxId", spent.txid.GetHex()));
+            out.push_back(Pair("spentIndex", (int)spent.nInputIndex));
+            out.push_back(Pair("spentHeight", spent.nHeight));
+        }
         vout.push_back(out);
     }
     entry.push_back(Pair("vout", vout));
@@ -130,6 +141,297 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry,
     }
 }
 
+/** Default and maximum number of entries returned per page by the address index calls */
+static const unsigned int DEFAULT_ADDRINDEX_PAGE = 1000;
+static const unsigned int MAX_ADDRINDEX_PAGE = 50000;
+
+typedef std::map<uint160, std::string> AddressIndexQuery;
+
+static AddressIndexQuery ParseAddressIndexQuery(const UniValue& param)
+{
+    if (!fAddrIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled");
+
+    std::vector<UniValue> vAddresses;
+    if (param.isArray())
+        vAddresses = param.getValues();
+    else
+        vAddresses.push_back(param);
+    if (vAddresses.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No addresses given");
+
+    AddressIndexQuery query;
+    for (const UniValue& address : vAddresses) {
+        if (!address.isStr() || !IsValidDestinationString(address.get_str()))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        query[GetScriptHashForDestination(DecodeDestination(address.get_str()))] = address.get_str();
+    }
+    return query;
+}
+
+static unsigned int ParseAddressIndexPage(const UniValue& param)
+{
+    if (param.isNull())
+        return DEFAULT_ADDRINDEX_PAGE;
+    int nCount = param.get_int();
+    if (nCount <= 0 || nCount > (int)MAX_ADDRINDEX_PAGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %u", MAX_ADDRINDEX_PAGE));
+    return nCount;
+}
+
+/**
+ * Cursors are the hex serialized key of the last entry returned, without its
+ * script hash, so the same cursor resumes a query over several addresses.
+ */
+template <typename K>
+static std::string EncodeAddressIndexCursor(K key)
+{
+    key.hashScript = 0;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template <typename K>
+static K DecodeAddressIndexCursor(const UniValue& param)
+{
+    std::string strCursor = param.get_str();
+    if (!IsHex(strCursor))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    std::vector<unsigned char> data(ParseHex(strCursor));
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    K key;
+    try {
+        ss >> key;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!ss.empty() || key.hashScript != 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    return key;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance [\"address\",...]\n"
+            "\nReturns the confirmed balance of one or more addresses. Requires -addrindex.\n"
+
+            "\nArguments:\n"
+            "1. \"addresses\"    (array of strings, required) The ohmcoin addresses; a single address string is accepted too\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,    (numeric) The current balance in ohmcoin\n"
+            "  \"received\" : x.xxx,   (numeric) The total amount ever received in ohmcoin\n"
+            "  \"height\" : n          (numeric) The height of the chain the balance refers to\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'[\"address1\",\"address2\"]'") + HelpExampleRpc("getaddressbalance", "[\"address1\",\"address2\"]"));
+
+    AddressIndexQuery query = ParseAddressIndexQuery(params[0]);
+
+    LOCK(cs_main);
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (AddressIndexQuery::const_iterator it = query.begin(); it != query.end(); it++) {
+        CAddressBalance balance;
+        pblocktree->ReadAddressBalance(it->first, balance);
+        nBalance += balance.nBalance;
+        nReceived += balance.nReceived;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("received", ValueFromAmount(nReceived)));
+    result.push_back(Pair("height", chainActive.Height()));
+    return result;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 5)
+        throw runtime_error(
+            "getaddressdeltas [\"address\",...] ( start end count \"cursor\" )\n"
+            "\nReturns the credits and debits of one or more addresses in chain order, one page at a time.\n"
+            "Requires -addrindex.\n"
+
+            "\nArguments:\n"
+            "1. \"addresses\"    (array of strings, required) The ohmcoin addresses; a single address string is accepted too\n"
+            "2. start          (numeric, optional, default=0) The first block height to include\n"
+            "3. end            (numeric, optional, default=-1) The last block height to include, -1 for the tip\n"
+            "4. count          (numeric, optional, default=" + std::to_string(DEFAULT_ADDRINDEX_PAGE) + ") The maximum number of deltas to return\n"
+            "5. \"cursor\"       (string, optional) The \"next\" value of the previous page; overrides start\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"deltas\" : [\n"
+            "    {\n"
+            "      \"address\" : \"address\",  (string) The address\n"
+            "      \"height\" : n,           (numeric) The block height\n"
+            "      \"txid\" : \"id\",          (string) The transaction id\n"
+            "      \"index\" : n,            (numeric) The output index, or the input index when spending\n"
+            "      \"spending\" : true|false,(boolean) Whether this is a debit\n"
+            "      \"amount\" : x.xxx        (numeric) The signed amount in ohmcoin\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"         (string) Cursor for the next page, null on the last page\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressdeltas", "'[\"address\"]'") + HelpExampleCli("getaddressdeltas", "'[\"address\"]' 100000 200000 500") + HelpExampleRpc("getaddressdeltas", "[\"address\"], 100000, 200000, 500"));
+
+    AddressIndexQuery query = ParseAddressIndexQuery(params[0]);
+    int nStart = params.size() > 1 ? params[1].get_int() : 0;
+    int nEnd = params.size() > 2 ? params[2].get_int() : -1;
+    unsigned int nCount = ParseAddressIndexPage(params.size() > 3 ? params[3] : NullUniValue);
+    if (nStart < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "start must not be negative");
+
+    CAddressIndexKey keyStart(0, nStart, 0, 0, false);
+    bool fCursor = params.size() > 4 && !params[4].isNull();
+    if (fCursor)
+        keyStart = DecodeAddressIndexCursor<CAddressIndexKey>(params[4]);
+
+    LOCK(cs_main);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+    for (AddressIndexQuery::const_iterator it = query.begin(); it != query.end(); it++) {
+        // Read one entry past the page so we know whether another one follows
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressDeltas;
+        keyStart.hashScript = it->first;
+        if (!pblocktree->ReadAddressIndex(keyStart, nEnd, nCount + 1 + fCursor, vAddressDeltas))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read address index");
+        for (const std::pair<CAddressIndexKey, CAmount>& delta : vAddressDeltas) {
+            if (!fCursor || !(delta.first == keyStart))
+                vDeltas.push_back(delta);
+        }
+    }
+    std::sort(vDeltas.begin(), vDeltas.end());
+
+    UniValue deltas(UniValue::VARR);
+    for (unsigned int i = 0; i < vDeltas.size() && i < nCount; i++) {
+        const CAddressIndexKey& key = vDeltas[i].first;
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("address", query[key.hashScript]));
+        delta.push_back(Pair("height", key.nHeight));
+        delta.push_back(Pair("txid", key.txid.GetHex()));
+        delta.push_back(Pair("index", (int)key.nIndex));
+        delta.push_back(Pair("spending", key.fSpending));
+        delta.push_back(Pair("amount", ValueFromAmount(vDeltas[i].second)));
+        deltas.push_back(delta);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("deltas", deltas));
+    if (vDeltas.size() > nCount)
+        result.push_back(Pair("next", EncodeAddressIndexCursor(vDeltas[nCount - 1].first)));
+    else
+        result.push_back(Pair("next", NullUniValue));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddressutxos [\"address\",...] ( count \"cursor\" )\n"
+            "\nReturns the unspent outputs of one or more addresses ordered by height, one page at a time.\n"
+            "Requires -addrindex.\n"
+
+            "\nArguments:\n"
+            "1. \"addresses\"    (array of strings, required) The ohmcoin addresses; a single address string is accepted too\n"
+            "2. count          (numeric, optional, default=" + std::to_string(DEFAULT_ADDRINDEX_PAGE) + ") The maximum number of outputs to return\n"
+            "3. \"cursor\"       (string, optional) The \"next\" value of the previous page\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"utxos\" : [\n"
+            "    {\n"
+            "      \"address\" : \"address\",  (string) The address\n"
+            "      \"height\" : n,           (numeric) The height of the block containing the output\n"
+            "      \"txid\" : \"id\",          (string) The transaction id\n"
+            "      \"vout\" : n,             (numeric) The output index\n"
+            "      \"scriptPubKey\" : \"hex\", (string) The output script\n"
+            "      \"amount\" : x.xxx        (numeric) The output value in ohmcoin\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"         (string) Cursor for the next page, null on the last page\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'[\"address\"]'") + HelpExampleCli("getaddressutxos", "'[\"address\"]' 500") + HelpExampleRpc("getaddressutxos", "[\"address\"], 500"));
+
+    AddressIndexQuery query = ParseAddressIndexQuery(params[0]);
+    unsigned int nCount = ParseAddressIndexPage(params.size() > 1 ? params[1] : NullUniValue);
+
+    CAddressUnspentKey keyStart;
+    bool fCursor = params.size() > 2 && !params[2].isNull();
+    if (fCursor)
+        keyStart = DecodeAddressIndexCursor<CAddressUnspentKey>(params[2]);
+
+    LOCK(cs_main);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (AddressIndexQuery::const_iterator it = query.begin(); it != query.end(); it++) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+        keyStart.hashScript = it->first;
+        if (!pblocktree->ReadAddressUnspentIndex(keyStart, nCount + 1 + fCursor, vAddressUnspent))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot read address index");
+        for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& unspent : vAddressUnspent) {
+            if (!fCursor || !(unspent.first == keyStart))
+                vUnspent.push_back(unspent);
+        }
+    }
+    std::sort(vUnspent.begin(), vUnspent.end(), [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+        return a.first < b.first;
+    });
+
+    UniValue utxos(UniValue::VARR);
+    for (unsigned int i = 0; i < vUnspent.size() && i < nCount; i++) {
+        const CAddressUnspentKey& key = vUnspent[i].first;
+        const CAddressUnspentValue& value = vUnspent[i].second;
+        UniValue utxo(UniValue::VOBJ);
+        utxo.push_back(Pair("address", query[key.hashScript]));
+        utxo.push_back(Pair("height", key.nHeight));
+        utxo.push_back(Pair("txid", key.txid.GetHex()));
+        utxo.push_back(Pair("vout", (int)key.nIndex));
+        utxo.push_back(Pair("scriptPubKey", HexStr(value.script.begin(), value.script.end())));
+        utxo.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+        utxos.push_back(utxo);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("utxos", utxos));
+    if (vUnspent.size() > nCount)
+        result.push_back(Pair("next", EncodeAddressIndexCursor(vUnspent[nCount - 1].first)));
+    else
+        result.push_back(Pair("next", NullUniValue));
+    return result;
+}
+
+/** Look up a transaction found through the address index, without -txindex if need be */
+static bool ReadAddressIndexTransaction(const CChainSnapshot& chain, const uint256& txid, int nHeight, CTransaction& tx, uint256& hashBlock)
+{
+    if (GetTransaction(txid, tx, hashBlock, false))
+        return true;
+
+    CBlockIndex* pindex = chain[nHeight];
+    CBlock block;
+    if (!pindex || !ReadBlockFromDisk(block, BlockIndexState(pindex)))
+        return false;
+    for (const CTransaction& txBlock : block.vtx) {
+        if (txBlock.GetHash() == txid) {
+            tx = txBlock;
+            hashBlock = pindex->GetBlockHash();
+            return true;
+        }
+    }
+    return false;
+}
+
 UniValue searchrawtransactions(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 4)
@@ -143,10 +445,6 @@ UniValue searchrawtransactions(const UniValue& params, bool fHelp)
 
     CTxDestination dest = DecodeDestination(params[0].get_str());
 
-    std::set<CExtDiskTxPos> setpos;
-    if (!FindTransactionsByDestination(dest, setpos))
-        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
-
     int nSkip = 0;
     int nCount = 100;
     bool fVerbose = true;
@@ -157,25 +455,41 @@ UniValue searchrawtransactions(const UniValue& params, bool fHelp)
     if (params.size() > 3)
         nCount = params[3].get_int();
 
+    // The index and the block files are read without cs_main; blocks are looked
+    // up in a snapshot of the chain, and the lock is only taken for each entry's JSON
+    CChainSnapshotRef chain = GetChainSnapshot();
+
+    // Only the keys are read here; transactions are loaded for the requested page alone
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+    if (!pblocktree->ReadAddressIndex(CAddressIndexKey(GetScriptHashForDestination(dest), 0, 0, 0, false), -1, 0, vDeltas))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
+
+    // Entries of one transaction are adjacent, as keys sort by height and then txid
+    std::vector<std::pair<uint256, int> > vTxids;
+    for (const std::pair<CAddressIndexKey, CAmount>& delta : vDeltas) {
+        if (vTxids.empty() || vTxids.back().first != delta.first.txid)
+            vTxids.push_back(std::make_pair(delta.first.txid, delta.first.nHeight));
+    }
+
     if (nSkip < 0)
-        nSkip += setpos.size();
+        nSkip += vTxids.size();
     if (nSkip < 0)
         nSkip = 0;
     if (nCount < 0)
         nCount = 0;
 
-    std::set<CExtDiskTxPos>::const_iterator it = setpos.begin();
-    while (it != setpos.end() && nSkip--) it++;
-
     UniValue result(UniValue::VARR);
-    while (it != setpos.end() && nCount--) {
+    for (unsigned int i = nSkip; i < vTxids.size() && nCount--; i++) {
         CTransaction tx;
         uint256 hashBlock;
-        if (!ReadTransaction(tx, *it, hashBlock))
+        if (!ReadAddressIndexTransaction(*chain, vTxids[i].first, vTxids[i].second, tx, hashBlock))
             throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Cannot read transaction from disk");
         if (fVerbose) {
             UniValue object(UniValue::VOBJ);
-            TxToJSON(tx, hashBlock, object, true, RPCSerializationFlags());
+            {
+                LOCK(cs_main);
+                TxToJSON(tx, hashBlock, object, true, RPCSerializationFlags());
+            }
             result.push_back(object);
         } else {
             CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
@@ -183,7 +497,6 @@ UniValue searchrawtransactions(const UniValue& params, bool fHelp)
             string strHex = HexStr(ssTx.begin(), ssTx.end());
             result.push_back(strHex);
         }
-        it++;
     }
     return result;
 }
@@ -242,7 +555,10 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             "           \"ohmcoinaddress\"        (string) ohmcoin address\n"
             "           ,...\n"
             "         ]\n"
-            "       }\n"
+            "       },\n"
+            "       \"spentTxId\" : \"id\",        (string, -spentindex only) The transaction spending this output\n"
+            "       \"spentIndex\" : n,           (numeric, -spentindex only) The input index in the spending transaction\n"
+            "       \"spentHeight\" : n           (numeric, -spentindex only) The height of the block containing the spend\n"
             "     }\n"
             "     ,...\n"
             "  ],\n"
@@ -347,34 +663,53 @@ UniValue listunspent(const UniValue& params, bool fHelp)
             nWatchonlyConfig = 1;
     }
 
-    UniValue results(UniValue::VARR);
-    vector<COutput> vecOutputs;
+    // Copy the outputs out under cs_wallet and build the reply without it
+    struct UnspentOutput {
+        uint256 txid;
+        int nOut;
+        CTxOut txout;
+        int nDepth;
+        bool fSpendable;
+        bool fHasAccount;
+        std::string strAccount;
+    };
+    vector<UnspentOutput> vUnspent;
     assert(pwalletMain != NULL);
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-    pwalletMain->AvailableCoins(vecOutputs, false, NULL, false, ALL_COINS, false, nWatchonlyConfig);
-    for (const COutput& out : vecOutputs) {
-        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
-            continue;
+    CWalletChainView view(*pwalletMain);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        vector<COutput> vecOutputs;
+        pwalletMain->AvailableCoins(vecOutputs, false, NULL, false, ALL_COINS, false, nWatchonlyConfig);
+        for (const COutput& out : vecOutputs) {
+            if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
+                continue;
 
-        if (setAddress.size()) {
+            const CTxOut& txout = out.tx->vout[out.i];
             CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
+            bool fHasAddress = ExtractDestination(txout.scriptPubKey, address);
+            if (setAddress.size() && (!fHasAddress || !setAddress.count(address)))
                 continue;
 
-            if (!setAddress.count(address))
-                continue;
+            UnspentOutput unspent = {out.tx->GetHash(), out.i, txout, out.nDepth, out.fSpendable, false, ""};
+            if (fHasAddress && pwalletMain->mapAddressBook.count(address)) {
+                unspent.fHasAccount = true;
+                unspent.strAccount = pwalletMain->mapAddressBook[address].name;
+            }
+            vUnspent.push_back(unspent);
         }
+    }
 
-        CAmount nValue = out.tx->vout[out.i].nValue;
-        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
+    UniValue results(UniValue::VARR);
+    for (const UnspentOutput& unspent : vUnspent) {
+        const CScript& pk = unspent.txout.scriptPubKey;
         UniValue entry(UniValue::VOBJ);
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
+        entry.push_back(Pair("txid", unspent.txid.GetHex()));
+        entry.push_back(Pair("vout", unspent.nOut));
         CTxDestination address;
-        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
+        if (ExtractDestination(pk, address)) {
             entry.push_back(Pair("address", EncodeDestination(address)));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+            if (unspent.fHasAccount)
+                entry.push_back(Pair("account", unspent.strAccount));
         }
         entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
         if (pk.IsPayToScriptHash()) {
@@ -386,9 +721,9 @@ UniValue listunspent(const UniValue& params, bool fHelp)
                     entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
             }
         }
-        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations", out.nDepth));
-        entry.push_back(Pair("spendable", out.fSpendable));
+        entry.push_back(Pair("amount", ValueFromAmount(unspent.txout.nValue)));
+        entry.push_back(Pair("confirmations", unspent.nDepth));
+        entry.push_back(Pair("spendable", unspent.fSpendable));
         results.push_back(entry);
     }
 
@@ -26,6 +26,9 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <memory>
+#include <set>
+
 #include <univalue.h>
 
 using namespace RPCServer;
@@ -280,6 +283,7 @@ static const CRPCCommand vRPCCommands[] =
                 //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
                 /* Overall control/query calls */
                 {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
+                {"control", "gethttpserverinfo", &gethttpserverinfo, true, true, false},
                 {"control", "help", &help, true, true, false},
                 {"control", "stop", &stop, true, true, false},
 
@@ -297,6 +301,7 @@ static const CRPCCommand vRPCCommands[] =
                 {"network", "clearbanned", &clearbanned, true, false, false},
 
                 /* Block chain and UTXO */
+                {"blockchain", "dumptxoutset", &dumptxoutset, true, false, false},
                 {"blockchain", "findserial", &findserial, true, false, false},
                 {"blockchain", "getaccumulatorvalues", &getaccumulatorvalues, true, false, false},
                 {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
@@ -304,8 +309,10 @@ static const CRPCCommand vRPCCommands[] =
                 {"blockchain", "getblockcount", &getblockcount, true, false, false},
                 {"blockchain", "getblock", &getblock, true, false, false},
                 {"blockchain", "getblockhash", &getblockhash, true, false, false},
+                {"blockchain", "getblockhashes", &getblockhashes, true, false, false},
                 {"blockchain", "getblockheader", &getblockheader, false, false, false},
                 {"blockchain", "getchaintips", &getchaintips, true, false, false},
+                {"blockchain", "getindexinfo", &getindexinfo, true, false, false},
                 {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
                 {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
                 {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
@@ -339,6 +346,11 @@ static const CRPCCommand vRPCCommands[] =
                 {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
                 {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
+                /* Address index */
+                {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+                {"addressindex", "getaddressdeltas", &getaddressdeltas, true, false, false},
+                {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+
                 /* Utility functions */
                 {"util", "createmultisig", &createmultisig, true, true, false},
                 {"util", "createwitnessaddress", &createwitnessaddress, true, true, false},
@@ -386,6 +398,7 @@ static const CRPCCommand vRPCCommands[] =
                 {"ohmcoin", "makekeypair", &makekeypair, true, true, false},
 #ifdef ENABLE_WALLET
         /* Wallet */
+        {"wallet", "abortrescan", &abortrescan, true, true, true},
         {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
         {"wallet", "addwitnessaddress", &addwitnessaddress, true, false, true},
         {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
@@ -554,33 +567,118 @@ void JSONRequest::parse(const UniValue& valRequest)
 }
 
 
-static UniValue JSONRPCExecOne(const UniValue& req)
-{
-    UniValue rpc_result(UniValue::VOBJ);
+/** Reply to one element of a batch request */
+struct JSONRPCBatchReply {
+    std::unique_ptr<UniValue> result; //! NULL on error
+    UniValue error;
+    UniValue id;
+};
 
+static void JSONRPCExecOne(const UniValue& req, JSONRPCBatchReply& reply)
+{
     JSONRequest jreq;
     try {
         jreq.parse(req);
 
-        UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
+        reply.result.reset(new UniValue(tableRPC.execute(jreq.strMethod, jreq.params)));
     } catch (const UniValue& objError) {
-        rpc_result = JSONRPCReplyObj(NullUniValue, objError, jreq.id);
+        reply.error = objError;
     } catch (std::exception& e) {
-        rpc_result = JSONRPCReplyObj(NullUniValue,
-                                     JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        reply.error = JSONRPCError(RPC_PARSE_ERROR, e.what());
+    }
+    reply.id = jreq.id;
+}
+
+/** Batch request, shared by the thread that received it and the helpers it queued */
+struct JSONRPCBatch {
+    UniValue vReq;
+    std::vector<JSONRPCBatchReply> vReply;
+    boost::mutex cs;
+    boost::condition_variable cond;
+    unsigned int nNext; //! first element nobody has taken yet
+    unsigned int nDone;
+
+    JSONRPCBatch(const UniValue& vReqIn) : vReq(vReqIn), vReply(vReqIn.size()), nNext(0), nDone(0) {}
+};
+
+/** Execute elements of a batch until there are none left to take */
+static void JSONRPCWorkBatch(std::shared_ptr<JSONRPCBatch> batch)
+{
+    while (true) {
+        unsigned int nIdx;
+        {
+            boost::lock_guard<boost::mutex> lock(batch->cs);
+            if (batch->nNext == batch->vReq.size())
+                return;
+            nIdx = batch->nNext++;
+        }
+        JSONRPCExecOne(batch->vReq[nIdx], batch->vReply[nIdx]);
+        {
+            boost::lock_guard<boost::mutex> lock(batch->cs);
+            batch->nDone++;
+        }
+        batch->cond.notify_all();
     }
+}
 
-    return rpc_result;
+/**
+ * Methods that only read node state. A batch made of nothing else gives the
+ * same replies whatever order its elements run in, so it may be spread over
+ * helper threads; any other batch runs in request order.
+ */
+static const char* const vBatchReadOnlyMethods[] = {
+    "getaddressbalance", "getaddressdeltas", "getaddressutxos",
+    "getbestblockhash", "getblock", "getblockchaininfo", "getblockcount",
+    "getblockhash", "getblockhashes", "getblockheader", "getchaintips",
+    "getconnectioncount", "getdifficulty", "getinfo", "getmempoolinfo",
+    "getnettotals", "getnetworkinfo", "getpeerinfo", "getrawmempool",
+    "getrawtransaction", "gettxout", "searchrawtransactions",
+    "decoderawtransaction", "decodescript", "estimatefee", "estimatepriority",
+    "validateaddress", "verifymessage",
+};
+
+static bool JSONRPCBatchIsReadOnly(const UniValue& vReq)
+{
+    static const std::set<std::string> setReadOnly(vBatchReadOnlyMethods,
+        vBatchReadOnlyMethods + ARRAYLEN(vBatchReadOnlyMethods));
+
+    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
+        if (!vReq[reqIdx].isObject())
+            return false;
+        const UniValue& valMethod = find_value(vReq[reqIdx].get_obj(), "method");
+        if (!valMethod.isStr() || !setReadOnly.count(valMethod.get_str()))
+            return false;
+    }
+    return true;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+void JSONRPCExecBatch(const UniValue& vReq, JSONStreamWriter& writer, const RPCTaskRunner& runner, int nHelpers)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    std::shared_ptr<JSONRPCBatch> batch(new JSONRPCBatch(vReq));
+
+    // This thread works on the batch too and only waits for elements that were
+    // already taken, so helpers the runner gets to late simply find it done.
+    // Without helpers it takes the elements one after another, in order.
+    if (runner && JSONRPCBatchIsReadOnly(vReq)) {
+        for (int i = 0; i < nHelpers && i + 1 < (int)vReq.size(); i++)
+            if (!runner(boost::bind(&JSONRPCWorkBatch, batch)))
+                break;
+    }
+    JSONRPCWorkBatch(batch);
+    {
+        boost::unique_lock<boost::mutex> lock(batch->cs);
+        while (batch->nDone < vReq.size())
+            batch->cond.wait(lock);
+    }
 
-    return ret.write() + "\n";
+    writer.WriteRaw("[");
+    for (unsigned int reqIdx = 0; reqIdx < batch->vReply.size(); reqIdx++) {
+        const JSONRPCBatchReply& reply = batch->vReply[reqIdx];
+        if (reqIdx > 0)
+            writer.WriteRaw(",");
+        JSONRPCReplyStream(writer, reply.result ? *reply.result : NullUniValue, reply.error, reply.id);
+    }
+    writer.WriteRaw("]\n");
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
@@ -0,0 +1,48 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEX_H
+#define BITCOIN_SPENTINDEX_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+/** The input spending an outpoint, as recorded by -spentindex; a null value erases the entry */
+struct CSpentIndexValue {
+    uint256 txid;
+    unsigned int nInputIndex;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(VARINT(nInputIndex));
+        READWRITE(VARINT(nHeight));
+    }
+
+    CSpentIndexValue(const uint256& txidIn, unsigned int nInputIndexIn, int nHeightIn)
+        : txid(txidIn), nInputIndex(nInputIndexIn), nHeight(nHeightIn) {}
+
+    CSpentIndexValue()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        txid = 0;
+        nInputIndex = 0;
+        nHeight = -1;
+    }
+
+    bool IsNull() const
+    {
+        return nHeight == -1;
+    }
+};
+
+#endif // BITCOIN_SPENTINDEX_H
@@ -12,6 +12,7 @@
 #include "main.h"
 #include "net.h"
 #include "pow.h"
+#include "protocol.h"
 #include "script/sign.h"
 #include "serialize.h"
 #include "util.h"
@@ -25,13 +26,30 @@
 // Tests this internal-to-main.cpp method:
 extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphansSize);
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
+};
+struct COrphanPeer {
+    std::set<uint256> setOrphans;
+    size_t nBytes;
+    COrphanPeer() : nBytes(0) {}
+};
+struct IteratorComparator
+{
+    template<typename I>
+    bool operator()(const I& a, const I& b) const
+    {
+        return &(*a) < &(*b);
+    }
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator> > mapOrphanTransactionsByPrev;
+extern std::map<NodeId, COrphanPeer> mapOrphanTransactionsByPeer;
+extern size_t nOrphanTransactionsSize;
 
 CService ip(uint32_t i)
 {
@@ -40,6 +58,21 @@ CService ip(uint32_t i)
     return CService(CNetAddr(s), Params().GetDefaultPort());
 }
 
+// Feed a framed network message into a peer and let main process it.
+static void ReceiveMessage(CNode& node, const char* pszCommand, const CDataStream& ssPayload)
+{
+    CMessageHeader hdr(pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg << hdr;
+    ssMsg += ssPayload;
+
+    LOCK(node.cs_vRecvMsg);
+    BOOST_CHECK(node.ReceiveMsgBytes(&ssMsg[0], ssMsg.size()));
+    ProcessMessages(&node);
+}
+
 BOOST_AUTO_TEST_SUITE(DoS_tests)
 
 BOOST_AUTO_TEST_CASE(DoS_banning)
@@ -186,13 +219,99 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    LimitOrphanTxSize(40, std::numeric_limits<size_t>::max());
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, std::numeric_limits<size_t>::max());
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+    LimitOrphanTxSize(std::numeric_limits<unsigned int>::max(), 1000);
+    BOOST_CHECK(nOrphanTransactionsSize <= 1000);
+    LimitOrphanTxSize(0, std::numeric_limits<size_t>::max());
     BOOST_CHECK(mapOrphanTransactions.empty());
     BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPeer.empty());
+    BOOST_CHECK_EQUAL(nOrphanTransactionsSize, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_limits)
+{
+    // A single peer may only hold its quota of orphans:
+    for (unsigned int i = 0; i < DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER + 10; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+
+        BOOST_CHECK_EQUAL(AddOrphanTx(tx, 1), i < DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER);
+    }
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER);
+
+    // ... while other peers are unaffected:
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].prevout.hash = GetRandHash();
+    txOther.vout.resize(1);
+    BOOST_CHECK(AddOrphanTx(txOther, 2));
+
+    // Overflow evicts from the peer holding the most orphan memory:
+    LimitOrphanTxSize(DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(mapOrphanTransactions.count(txOther.GetHash()));
+    BOOST_CHECK_EQUAL(mapOrphanTransactionsByPeer[1].setOrphans.size(), DEFAULT_MAX_ORPHAN_TRANSACTIONS_PER_PEER - 1);
+
+    // Orphans expire after ORPHAN_TX_EXPIRE_TIME, checked at most every ORPHAN_TX_EXPIRE_INTERVAL:
+    SetMockTime(GetTime() + ORPHAN_TX_EXPIRE_TIME + ORPHAN_TX_EXPIRE_INTERVAL + 1);
+    LimitOrphanTxSize(DEFAULT_MAX_ORPHAN_TRANSACTIONS, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_rejectStats)
+{
+    CAddress addr1(ip(0xa0b0c001));
+    CNode dummyNode1(INVALID_SOCKET, addr1, "", true);
+    dummyNode1.nVersion = PROTOCOL_VERSION;
+
+    // A loose coinbase is always rejected with reason "coinbase"
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.SetNull();
+    tx.vin[0].scriptSig << OP_1 << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey << OP_1;
+    CInv inv(MSG_TX, CTransaction(tx).GetHash());
+
+    // Announce an unrelated tx first so a pending filter reset happens before the reject
+    CDataStream ssInv(SER_NETWORK, PROTOCOL_VERSION);
+    ssInv << std::vector<CInv>(1, CInv(MSG_TX, GetRandHash()));
+    ReceiveMessage(dummyNode1, NetMsgType::INV, ssInv);
+
+    CRejectStats statsBefore;
+    GetRejectStats(statsBefore);
+
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+    ReceiveMessage(dummyNode1, NetMsgType::TX, ssTx);
+
+    CRejectStats stats;
+    GetRejectStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapReasons["coinbase"], statsBefore.mapReasons["coinbase"] + 1);
+    BOOST_CHECK_EQUAL(stats.nFiltered, statsBefore.nFiltered);
+    BOOST_CHECK_EQUAL(stats.nResets, statsBefore.nResets);
+
+    // Announcing the rejected tx again is filtered rather than requested
+    ssInv.clear();
+    ssInv << std::vector<CInv>(1, inv);
+    ReceiveMessage(dummyNode1, NetMsgType::INV, ssInv);
+
+    GetRejectStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapReasons["coinbase"], statsBefore.mapReasons["coinbase"] + 1);
+    BOOST_CHECK_EQUAL(stats.nFiltered, statsBefore.nFiltered + 1);
+    BOOST_CHECK_EQUAL(stats.nResets, statsBefore.nResets);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,265 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "main.h"
+#include "txdb.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_AUTO_TEST_CASE(addressindex_height_order)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hashScript = GetScriptHashForDestination(CKeyID(uint160(1)));
+    uint160 hashOther = GetScriptHashForDestination(CScriptID(uint160(1)));
+    BOOST_CHECK(hashScript != hashOther);
+
+    // Heights that would sort wrongly as little endian integers
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    int heights[] = {70000, 1, 256, 300};
+    for (int nHeight : heights) {
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(hashScript, nHeight, uint256(nHeight), 0, false), 10 * COIN));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashScript, nHeight, uint256(nHeight), 0), CAddressUnspentValue(10 * COIN, CScript())));
+    }
+    vDeltas.push_back(std::make_pair(CAddressIndexKey(hashOther, 5, uint256(5), 0, false), COIN));
+    BOOST_CHECK(db.UpdateAddressIndex(vDeltas, vUnspent, false));
+
+    // A spend of the output at height 1 in block 70001
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vSpend;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vSpent;
+    vSpend.push_back(std::make_pair(CAddressIndexKey(hashScript, 70001, uint256(70001), 0, true), -10 * COIN));
+    vSpent.push_back(std::make_pair(CAddressUnspentKey(hashScript, 1, uint256(1), 0), CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressIndex(vSpend, vSpent, false));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead;
+    BOOST_CHECK(db.ReadAddressIndex(CAddressIndexKey(hashScript, 0, 0, 0, false), -1, 0, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 5U);
+    int expected[] = {1, 256, 300, 70000, 70001};
+    for (unsigned int i = 0; i < vRead.size(); i++)
+        BOOST_CHECK_EQUAL(vRead[i].first.nHeight, expected[i]);
+    BOOST_CHECK(vRead[4].first.fSpending);
+
+    // Height range and page size
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(CAddressIndexKey(hashScript, 2, 0, 0, false), 400, 2, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+    BOOST_CHECK_EQUAL(vRead[0].first.nHeight, 256);
+    BOOST_CHECK_EQUAL(vRead[1].first.nHeight, 300);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentRead;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(CAddressUnspentKey(hashScript, 0, 0, 0), 0, vUnspentRead));
+    BOOST_CHECK_EQUAL(vUnspentRead.size(), 3U);
+    BOOST_CHECK_EQUAL(vUnspentRead[0].first.nHeight, 256);
+    BOOST_CHECK_EQUAL(vUnspentRead[2].first.nHeight, 70000);
+
+    CAddressBalance balance;
+    BOOST_CHECK(db.ReadAddressBalance(hashScript, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 30 * COIN);
+    BOOST_CHECK_EQUAL(balance.nReceived, 40 * COIN);
+
+    // Disconnecting the spend restores the output and the balance
+    vSpent[0].second = CAddressUnspentValue(10 * COIN, CScript());
+    BOOST_CHECK(db.UpdateAddressIndex(vSpend, vSpent, true));
+    BOOST_CHECK(db.ReadAddressBalance(hashScript, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 40 * COIN);
+    vUnspentRead.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(CAddressUnspentKey(hashScript, 0, 0, 0), 0, vUnspentRead));
+    BOOST_CHECK_EQUAL(vUnspentRead.size(), 4U);
+
+    BOOST_CHECK(db.UpdateAddressIndex(vDeltas, vUnspent, true));
+    BOOST_CHECK(!db.ReadAddressBalance(hashOther, balance));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_paging_same_height)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hashScript = GetScriptHashForDestination(CKeyID(uint160(2)));
+
+    // Several transactions in one block, with txids whose byte order differs
+    // from their numeric order
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    uint64_t txids[] = {1, 2, 3, 256, 512, 0x10000, 0x10001};
+    for (uint64_t n : txids) {
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(hashScript, 100, uint256(n), 0, false), COIN));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(hashScript, 100, uint256(n), 0), CAddressUnspentValue(COIN, CScript())));
+    }
+    BOOST_CHECK(db.UpdateAddressIndex(vDeltas, vUnspent, false));
+
+    // The index returns the entries in the order the keys sort in
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAll;
+    BOOST_CHECK(db.ReadAddressIndex(CAddressIndexKey(hashScript, 0, 0, 0, false), -1, 0, vAll));
+    BOOST_CHECK_EQUAL(vAll.size(), 7U);
+    for (unsigned int i = 1; i < vAll.size(); i++)
+        BOOST_CHECK(vAll[i - 1].first < vAll[i].first);
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAllUnspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(CAddressUnspentKey(hashScript, 0, 0, 0), 0, vAllUnspent));
+    BOOST_CHECK_EQUAL(vAllUnspent.size(), 7U);
+    for (unsigned int i = 1; i < vAllUnspent.size(); i++)
+        BOOST_CHECK(vAllUnspent[i - 1].first < vAllUnspent[i].first);
+
+    // Paging as getaddressdeltas does: read one past the page from the
+    // cursor, sort, and carry on from the last key of the page
+    const unsigned int nCount = 2;
+    std::vector<CAddressIndexKey> vPaged;
+    CAddressIndexKey keyStart(hashScript, 0, 0, 0, false);
+    bool fCursor = false;
+    while (true) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vRead, vPage;
+        BOOST_CHECK(db.ReadAddressIndex(keyStart, -1, nCount + 1 + fCursor, vRead));
+        for (const std::pair<CAddressIndexKey, CAmount>& delta : vRead) {
+            if (!fCursor || !(delta.first == keyStart))
+                vPage.push_back(delta);
+        }
+        std::sort(vPage.begin(), vPage.end());
+        for (unsigned int i = 0; i < vPage.size() && i < nCount; i++)
+            vPaged.push_back(vPage[i].first);
+        if (vPage.size() <= nCount)
+            break;
+        keyStart = vPage[nCount - 1].first;
+        fCursor = true;
+    }
+    BOOST_CHECK_EQUAL(vPaged.size(), vAll.size());
+    for (unsigned int i = 0; i < vPaged.size() && i < vAll.size(); i++)
+        BOOST_CHECK(vPaged[i] == vAll[i].first);
+
+    BOOST_CHECK(db.UpdateAddressIndex(vDeltas, vUnspent, true));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_balance_replay)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hashScript = GetScriptHashForDestination(CKeyID(uint160(3)));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock10, vBlock11;
+    vBlock10.push_back(std::make_pair(CAddressIndexKey(hashScript, 10, uint256(10), 0, false), 5 * COIN));
+    vBlock10.push_back(std::make_pair(CAddressIndexKey(hashScript, 10, uint256(11), 0, false), 1 * COIN));
+    vBlock11.push_back(std::make_pair(CAddressIndexKey(hashScript, 11, uint256(12), 0, true), -5 * COIN));
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock10, vUnspent, false));
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock11, vUnspent, false));
+
+    // After a crash the blocks past the flushed coins are connected again
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock10, vUnspent, false));
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock11, vUnspent, false));
+    CAddressBalance balance;
+    BOOST_CHECK(db.ReadAddressBalance(hashScript, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 1 * COIN);
+    BOOST_CHECK_EQUAL(balance.nReceived, 6 * COIN);
+    BOOST_CHECK_EQUAL(balance.nHeight, 11);
+
+    // And disconnected again
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock11, vUnspent, true));
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock11, vUnspent, true));
+    BOOST_CHECK(db.ReadAddressBalance(hashScript, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 6 * COIN);
+    BOOST_CHECK_EQUAL(balance.nReceived, 6 * COIN);
+    BOOST_CHECK_EQUAL(balance.nHeight, 10);
+
+    // A block connected in its place at the same height counts
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock11, vUnspent, false));
+    BOOST_CHECK(db.ReadAddressBalance(hashScript, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 1 * COIN);
+
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock11, vUnspent, true));
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock10, vUnspent, true));
+    BOOST_CHECK(db.UpdateAddressIndex(vBlock10, vUnspent, true));
+    BOOST_CHECK(!db.ReadAddressBalance(hashScript, balance));
+}
+
+BOOST_AUTO_TEST_CASE(timestampindex_range)
+{
+    CBlockTreeDB db(1 << 20, true);
+    unsigned int times[] = {1000, 999, 1256, 70000};
+    for (unsigned int i = 0; i < 4; i++)
+        BOOST_CHECK(db.WriteTimestampIndex(CTimestampIndexKey(times[i], uint256(i + 1)), times[i]));
+
+    std::vector<std::pair<CTimestampIndexKey, unsigned int> > vBlocks;
+    BOOST_CHECK(db.ReadTimestampIndex(999, 1257, vBlocks));
+    BOOST_CHECK_EQUAL(vBlocks.size(), 3U);
+    BOOST_CHECK_EQUAL(vBlocks[0].first.nTime, 999U);
+    BOOST_CHECK(vBlocks[0].first.hashBlock == uint256(2));
+    BOOST_CHECK_EQUAL(vBlocks[2].first.nTime, 1256U);
+
+    unsigned int nLogicalTime;
+    BOOST_CHECK(db.ReadLogicalTimestamp(uint256(4), nLogicalTime));
+    BOOST_CHECK_EQUAL(nLogicalTime, 70000U);
+}
+
+BOOST_AUTO_TEST_CASE(indexbuilder_block_batch)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CScript script = GetScriptForDestination(CKeyID(uint160(1)));
+    uint160 hashScript = GetScriptHashForDestination(CKeyID(uint160(1)));
+
+    // A block where the second transaction spends an output of the first
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(uint256(7), 0);
+    txFund.vout.push_back(CTxOut(5 * COIN, script));
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(CTransaction(txFund).GetHash(), 0);
+    txSpend.vout.push_back(CTxOut(4 * COIN, script));
+    std::vector<CTransaction> vtx;
+    vtx.push_back(txFund);
+    vtx.push_back(txSpend);
+    std::vector<std::vector<std::pair<CTxOut, int> > > vPrevOuts(2);
+    vPrevOuts[0].push_back(std::make_pair(CTxOut(2 * COIN, script), 90));
+    vPrevOuts[1].push_back(std::make_pair(txFund.vout[0], 100));
+
+    CIndexBuilderEntries entries;
+    for (unsigned int i = 0; i < vtx.size(); i++)
+        GetAddressIndexEntries(vtx[i], 100, vPrevOuts[i], false, entries.vAddressDeltas, entries.vAddressUnspent);
+    entries.vTxHeights.push_back(std::make_pair(vtx[0].GetHash(), 100));
+    std::vector<std::string> vNames(1, "addrindex");
+    BOOST_CHECK(db.WriteIndexBuilderEntries(entries, vNames, uint256(100)));
+
+    uint256 hashCursor;
+    BOOST_CHECK(db.ReadIndexCursor("addrindex", hashCursor));
+    BOOST_CHECK(hashCursor == uint256(100));
+    int nHeight;
+    BOOST_CHECK(db.ReadIndexTxHeight(vtx[0].GetHash(), nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 100);
+
+    // Only the output of the spending transaction is left unspent
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentRead;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(CAddressUnspentKey(hashScript, 0, 0, 0), 0, vUnspentRead));
+    BOOST_CHECK_EQUAL(vUnspentRead.size(), 1U);
+    BOOST_CHECK(vUnspentRead[0].first.txid == vtx[1].GetHash());
+    CAddressBalance balance;
+    BOOST_CHECK(db.ReadAddressBalance(hashScript, balance));
+    BOOST_CHECK_EQUAL(balance.nBalance, 2 * COIN);
+
+    // Unwinding in reverse order restores the output spent from outside the block
+    CIndexBuilderEntries undo;
+    undo.fAddressErase = true;
+    for (unsigned int i = vtx.size(); i-- > 0;)
+        GetAddressIndexEntries(vtx[i], 100, vPrevOuts[i], true, undo.vAddressDeltas, undo.vAddressUnspent);
+    BOOST_CHECK(db.WriteIndexBuilderEntries(undo, vNames, uint256(99)));
+    vUnspentRead.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(CAddressUnspentKey(hashScript, 0, 0, 0), 0, vUnspentRead));
+    BOOST_CHECK_EQUAL(vUnspentRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vUnspentRead[0].first.nHeight, 90);
+    BOOST_CHECK(!db.ReadAddressBalance(hashScript, balance));
+
+    // Dropping the index leaves nothing behind
+    BOOST_CHECK(db.EraseIndexPrefix('U'));
+    BOOST_CHECK(db.EraseIndexPrefix('h'));
+    BOOST_CHECK(db.EraseIndexCursor("addrindex"));
+    vUnspentRead.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(CAddressUnspentKey(hashScript, 0, 0, 0), 0, vUnspentRead));
+    BOOST_CHECK(vUnspentRead.empty());
+    BOOST_CHECK(!db.ReadIndexTxHeight(vtx[0].GetHash(), nHeight));
+    BOOST_CHECK(!db.ReadIndexCursor("addrindex", hashCursor));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,170 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include "amount.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinselection_tests)
+
+static void AddCoin(std::vector<CSelectionCoin>& vCoins, CAmount nValue, CAmount nInputFee)
+{
+    vCoins.push_back(CSelectionCoin(nValue, nValue - nInputFee, NULL, vCoins.size()));
+}
+
+static CAmount SumEffective(const std::vector<CSelectionCoin>& vCoins, const std::vector<size_t>& vSelected)
+{
+    CAmount nTotal = 0;
+    for (size_t i : vSelected)
+        nTotal += vCoins[i].nEffectiveValue;
+    return nTotal;
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_bnb)
+{
+    std::vector<CSelectionCoin> vCoins;
+    std::vector<size_t> vSelected;
+    CAmount nValueRet;
+    for (int i = 1; i <= 4; i++)
+        AddCoin(vCoins, i * COIN, 0);
+
+    // Exact matches, with as few coins as there are
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 1 * COIN, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 1 * COIN);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 7 * COIN, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * COIN);
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 10 * COIN, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(vSelected.size(), 4U);
+
+    // Nothing within the cost of change, or not enough at all
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 0.5 * COIN, 0.1 * COIN, vSelected, nValueRet));
+    BOOST_CHECK(vSelected.empty());
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 0.5 * COIN, 0.5 * COIN, vSelected, nValueRet));
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 11 * COIN, 0, vSelected, nValueRet));
+
+    // Selection is on effective value; what is returned is the real value
+    vCoins.clear();
+    AddCoin(vCoins, 3 * COIN, 1000);
+    AddCoin(vCoins, 2 * COIN, 1000);
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 5 * COIN - 2000, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 5 * COIN, 0, vSelected, nValueRet));
+
+    // Coins costing more to spend than they are worth are left out
+    vCoins.clear();
+    AddCoin(vCoins, 1000, 2000);
+    AddCoin(vCoins, 1 * COIN, 0);
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 1 * COIN + 1000, 0, vSelected, nValueRet));
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_effective_value)
+{
+    std::vector<CSelectionCoin> vCoins;
+    std::vector<size_t> vSelected;
+    CAmount nValueRet;
+    AddCoin(vCoins, 1 * COIN, 1000);
+    AddCoin(vCoins, 2 * COIN, 1000);
+    AddCoin(vCoins, 5 * COIN, 1000);
+    AddCoin(vCoins, 20 * COIN, 1000);
+
+    // The smallest coin covering target and change on its own
+    BOOST_CHECK(SelectCoinsEffectiveValue(vCoins, 3 * COIN, 0.1 * COIN, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+    BOOST_CHECK_EQUAL(vSelected.size(), 1U);
+
+    // Largest first, then the smallest coin that reaches the target
+    BOOST_CHECK(SelectCoinsEffectiveValue(vCoins, 21 * COIN, 0.1 * COIN, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 22 * COIN);
+    BOOST_CHECK_EQUAL(vSelected.size(), 2U);
+    BOOST_CHECK(SumEffective(vCoins, vSelected) >= 21 * COIN);
+
+    BOOST_CHECK(!SelectCoinsEffectiveValue(vCoins, 28 * COIN, 0, vSelected, nValueRet));
+    BOOST_CHECK(vSelected.empty());
+}
+
+/**
+ * A wallet full of staking rewards plus a few larger coins: for a range of
+ * payment sizes both the effective value selection and the legacy knapsack
+ * must find inputs that pay for it and report what they picked, and both
+ * must fail when the wallet holds too little.
+ */
+BOOST_AUTO_TEST_CASE(coinselection_large)
+{
+    const int nCoins = 5000;
+    const CFeeRate feeRate(10000);
+    const CAmount nInputFee = feeRate.GetFee(148);
+    const CAmount nCostOfChange = GetCostOfChange(feeRate);
+
+    // Fixed linear congruential generator, so every run sees the same coins
+    uint64_t nSeed = 0x5eed;
+    std::vector<CSelectionCoin> vCoins;
+    for (int i = 0; i < nCoins; i++) {
+        nSeed = nSeed * 6364136223846793005ULL + 1442695040888963407ULL;
+        CAmount nValue = (i % 100 == 0) ? (CAmount)(nSeed >> 20) % (500 * COIN) + COIN : 5 * COIN + (CAmount)(nSeed >> 33) % COIN;
+        AddCoin(vCoins, nValue, nInputFee);
+    }
+
+    const CAmount vTargets[] = {3 * COIN, 37 * COIN + 12345, 250 * COIN, 1234 * COIN + 5678};
+    for (CAmount nTarget : vTargets) {
+        std::vector<size_t> vSelected;
+        CAmount nValueRet;
+        bool fChangeless = SelectCoinsBnB(vCoins, nTarget, nCostOfChange, vSelected, nValueRet);
+        if (!fChangeless)
+            BOOST_CHECK(SelectCoinsEffectiveValue(vCoins, nTarget, nCostOfChange, vSelected, nValueRet));
+        BOOST_CHECK(SumEffective(vCoins, vSelected) >= nTarget);
+        if (fChangeless)
+            BOOST_CHECK(SumEffective(vCoins, vSelected) <= nTarget + nCostOfChange);
+        std::set<size_t> setSelected(vSelected.begin(), vSelected.end());
+        BOOST_CHECK_EQUAL(setSelected.size(), vSelected.size());
+        CAmount nSelected = 0;
+        for (size_t i : vSelected)
+            nSelected += vCoins[i].nValue;
+        BOOST_CHECK_EQUAL(nValueRet, nSelected);
+
+        // The knapsack over the coins below the target, the way SelectCoinsMinConf() feeds it
+        std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > vValue;
+        CAmount nTotalLower = 0;
+        for (const CSelectionCoin& coin : vCoins) {
+            if (coin.nValue < nTarget + CENT) {
+                vValue.push_back(std::make_pair(coin.nValue, coin.coin));
+                nTotalLower += coin.nValue;
+            }
+        }
+        std::vector<char> vfBest;
+        CAmount nBest;
+        ApproximateBestSubset(vValue, nTotalLower, nTarget, vfBest, nBest, 1000);
+        BOOST_CHECK(nBest >= nTarget);
+        CAmount nKnapsack = 0;
+        for (size_t i = 0; i < vfBest.size(); i++) {
+            if (vfBest[i])
+                nKnapsack += vValue[i].first;
+        }
+        BOOST_CHECK_EQUAL(nBest, nKnapsack);
+    }
+
+    // And both come up short when the wallet can't pay
+    CAmount nTotal = 0;
+    std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > vValue;
+    for (const CSelectionCoin& coin : vCoins) {
+        vValue.push_back(std::make_pair(coin.nValue, coin.coin));
+        nTotal += coin.nValue;
+    }
+    std::vector<size_t> vSelected;
+    CAmount nValueRet;
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, nTotal + 1, nCostOfChange, vSelected, nValueRet));
+    BOOST_CHECK(!SelectCoinsEffectiveValue(vCoins, nTotal + 1, nCostOfChange, vSelected, nValueRet));
+    std::vector<char> vfBest;
+    CAmount nBest;
+    ApproximateBestSubset(vValue, nTotal, nTotal + 1, vfBest, nBest, 1000);
+    BOOST_CHECK(nBest < nTotal + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/wallet.h"
+
+#include "util.h"
+#include "utiltime.h"
+#include "wallet/walletdb.h"
+
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(keypool_tests)
+
+static unsigned int KeyPoolSize(CWallet& wallet)
+{
+    LOCK(wallet.cs_wallet);
+    return wallet.GetKeyPoolSize();
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup)
+{
+    mapArgs["-walletbackend"] = "log";
+    CWalletDB("wallet_keypool.dat", "cr+");
+    mapArgs.erase("-walletbackend");
+
+    CWallet wallet("wallet_keypool.dat");
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_COMPRPUBKEY);
+    }
+
+    // More than a batch, made on several threads, each a key of the wallet
+    mapArgs["-keypoolthreads"] = "3";
+    BOOST_CHECK(wallet.TopUpKeyPool(250));
+    BOOST_CHECK_EQUAL(KeyPoolSize(wallet), 251U);
+    std::set<CKeyID> setKeyIDs;
+    CWalletDB walletdb(wallet.strWalletFile);
+    for (int64_t nIndex = 1; nIndex <= 251; nIndex++) {
+        CKeyPool keypool;
+        BOOST_CHECK(walletdb.ReadPool(nIndex, keypool));
+        BOOST_CHECK(keypool.vchPubKey.IsCompressed());
+        BOOST_CHECK(wallet.HaveKey(keypool.vchPubKey.GetID()));
+        setKeyIDs.insert(keypool.vchPubKey.GetID());
+    }
+    BOOST_CHECK_EQUAL(setKeyIDs.size(), 251U);
+
+    // Nothing to do once full
+    BOOST_CHECK(wallet.TopUpKeyPool(250));
+    BOOST_CHECK_EQUAL(KeyPoolSize(wallet), 251U);
+
+    // Keys can be taken while a background fill is running
+    mapArgs["-keypool"] = "600";
+    wallet.TopUpKeyPoolInBackground();
+    CPubKey pubkey;
+    BOOST_CHECK(wallet.GetKeyFromPool(pubkey));
+    BOOST_CHECK(wallet.HaveKey(pubkey.GetID()));
+    for (int i = 0; i < 1000 && KeyPoolSize(wallet) < 601; i++)
+        MilliSleep(10);
+    BOOST_CHECK_EQUAL(KeyPoolSize(wallet), 601U);
+
+    // Above half the target, taking a key doesn't start another fill
+    BOOST_CHECK(wallet.GetKeyFromPool(pubkey));
+    MilliSleep(100);
+    BOOST_CHECK_EQUAL(KeyPoolSize(wallet), 600U);
+    mapArgs.erase("-keypool");
+    mapArgs.erase("-keypoolthreads");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
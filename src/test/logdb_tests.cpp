@@ -0,0 +1,197 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "util.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(logdb_tests)
+
+static std::vector<unsigned char> Key(const std::string& strKey)
+{
+    return std::vector<unsigned char>(strKey.begin(), strKey.end());
+}
+
+static void Put(LogDBUpdates& updates, const std::string& strKey, const std::string& strValue)
+{
+    CLogDBUpdate& update = updates[Key(strKey)];
+    update.fErase = false;
+    update.vchValue.assign(strValue.begin(), strValue.end());
+}
+
+static std::string Get(const CLogDB& db, const std::string& strKey)
+{
+    CSerializeData vchValue;
+    if (!db.Read(Key(strKey), vchValue))
+        return "<none>";
+    return std::string(vchValue.begin(), vchValue.end());
+}
+
+BOOST_AUTO_TEST_CASE(logdb_commit_reopen)
+{
+    boost::filesystem::path path = GetDataDir() / "logdb_commit.dat";
+    {
+        CLogDB db(path);
+        BOOST_CHECK(!db.Open(false));
+        BOOST_CHECK(db.Open(true));
+
+        LogDBUpdates updates;
+        Put(updates, "b", "2");
+        Put(updates, "a", "1");
+        Put(updates, "c", "3");
+        BOOST_CHECK(db.Commit(updates));
+
+        updates.clear();
+        Put(updates, "a", "one");
+        updates[Key("c")].fErase = true;
+        BOOST_CHECK(db.Commit(updates));
+        BOOST_CHECK_EQUAL(Get(db, "a"), "one");
+        BOOST_CHECK(!db.Exists(Key("c")));
+    }
+
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK_EQUAL(Get(db, "a"), "one");
+    BOOST_CHECK_EQUAL(Get(db, "b"), "2");
+    BOOST_CHECK_EQUAL(Get(db, "c"), "<none>");
+
+    // Key order, from a given key on
+    std::vector<unsigned char> vchKey;
+    CSerializeData vchValue;
+    BOOST_CHECK(db.ReadNext(std::vector<unsigned char>(), false, vchKey, vchValue));
+    BOOST_CHECK(vchKey == Key("a"));
+    BOOST_CHECK(db.ReadNext(vchKey, true, vchKey, vchValue));
+    BOOST_CHECK(vchKey == Key("b"));
+    BOOST_CHECK(!db.ReadNext(vchKey, true, vchKey, vchValue));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_torn_tail)
+{
+    boost::filesystem::path path = GetDataDir() / "logdb_torn.dat";
+    uint64_t nGoodSize;
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(true));
+        LogDBUpdates updates;
+        Put(updates, "key", "value");
+        BOOST_CHECK(db.Commit(updates));
+        nGoodSize = db.GetFileSize();
+    }
+
+    // A commit cut short: a whole record, and half of the next
+    FILE* file = fopen(path.string().c_str(), "ab");
+    const unsigned char vchTail[] = {1, 3, 'n', 'e', 'w', 1, 'x', 1, 4, 'h', 'a'};
+    BOOST_CHECK_EQUAL(fwrite(vchTail, 1, sizeof(vchTail), file), sizeof(vchTail));
+    fclose(file);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nGoodSize + sizeof(vchTail));
+
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK_EQUAL(Get(db, "key"), "value");
+    BOOST_CHECK_EQUAL(Get(db, "new"), "<none>");
+    BOOST_CHECK_EQUAL(db.GetFileSize(), nGoodSize);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nGoodSize);
+
+    // And appending carries on from there
+    LogDBUpdates updates;
+    Put(updates, "new", "y");
+    BOOST_CHECK(db.Commit(updates));
+    db.Close();
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK_EQUAL(Get(db, "new"), "y");
+}
+
+BOOST_AUTO_TEST_CASE(logdb_compact)
+{
+    boost::filesystem::path path = GetDataDir() / "logdb_compact.dat";
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(true));
+
+    std::string strValue(1000, 'v');
+    LogDBUpdates updates;
+    Put(updates, "keep", "kept");
+    Put(updates, "\x04pool", "dropped");
+    BOOST_CHECK(db.Commit(updates));
+    for (int i = 0; !db.ShouldCompact(); i++) {
+        BOOST_CHECK(i < 2000);
+        updates.clear();
+        Put(updates, "overwritten", strValue + std::to_string(i));
+        BOOST_CHECK(db.Commit(updates));
+    }
+    uint64_t nSizeBefore = db.GetFileSize();
+
+    BOOST_CHECK(db.Compact("\x04pool"));
+    BOOST_CHECK(db.GetFileSize() < nSizeBefore / 100);
+    BOOST_CHECK(!db.ShouldCompact());
+    BOOST_CHECK_EQUAL(Get(db, "keep"), "kept");
+    BOOST_CHECK_EQUAL(Get(db, "\x04pool"), "<none>");
+    std::string strLast = Get(db, "overwritten");
+
+    db.Close();
+    BOOST_CHECK(db.Open(false));
+    BOOST_CHECK_EQUAL(Get(db, "overwritten"), strLast);
+    BOOST_CHECK_EQUAL(db.GetLiveSize() + 12 + 5, db.GetFileSize());
+}
+
+BOOST_AUTO_TEST_CASE(logdb_walletdb)
+{
+    mapArgs["-walletbackend"] = "log";
+    std::string strFile = "wallet_logdb.dat";
+    {
+        CWalletDB walletdb(strFile, "cr+");
+        BOOST_CHECK(logdb.IsLogDB(strFile));
+        int nVersion;
+        BOOST_CHECK(walletdb.ReadVersion(nVersion));
+        BOOST_CHECK_EQUAL(nVersion, CLIENT_VERSION);
+    }
+    mapArgs.erase("-walletbackend");
+
+    CKey key;
+    key.MakeNewKey(true);
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << std::make_pair(std::string("pool"), (int64_t)1);
+    std::vector<unsigned char> vchPoolKey(ssKey.begin(), ssKey.end());
+    CLogDB* pdb = logdb.Open(strFile, false);
+    {
+        // Handles opened during a batch write through it and see its writes,
+        // which are committed as the batch ends
+        CDBBatch batch(strFile);
+        CWalletDB(strFile).WritePool(1, CKeyPool(key.GetPubKey()));
+        CKeyPool keypool;
+        BOOST_CHECK(CWalletDB(strFile).ReadPool(1, keypool));
+        BOOST_CHECK(keypool.vchPubKey == key.GetPubKey());
+        BOOST_CHECK(!pdb->Exists(vchPoolKey));
+    }
+    BOOST_CHECK(pdb->Exists(vchPoolKey));
+    logdb.Release(pdb);
+    {
+        CWalletDB walletdb(strFile);
+        CKeyPool keypool;
+        BOOST_CHECK(walletdb.ReadPool(1, keypool));
+
+        // An aborted transaction leaves nothing behind
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.ErasePool(1));
+        BOOST_CHECK(!walletdb.ReadPool(1, keypool));
+        BOOST_CHECK(walletdb.TxnAbort());
+        BOOST_CHECK(walletdb.ReadPool(1, keypool));
+    }
+
+    // Rewriting leaves out what it's told to skip
+    BOOST_CHECK(CDB::Rewrite(strFile, "\x04pool"));
+    CKeyPool keypool;
+    BOOST_CHECK(!CWalletDB(strFile).ReadPool(1, keypool));
+    logdb.Flush(true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
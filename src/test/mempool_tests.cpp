@@ -2,10 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "main.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "util.h"
 
+#include <boost/bind/bind.hpp>
 #include <boost/test/unit_test.hpp>
 #include <list>
 
@@ -99,4 +102,123 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolFeeEstimates)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    CAmount baseFee(2000);
+    std::vector<uint256> vPending[10];
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0;
+    CFeeRate baseRate(baseFee, GetVirtualTransactionSize(tx));
+
+    // Fee levels 5..9 always make it into the next block, level 4 only into every
+    // other block and levels 0..3 never confirm.
+    std::list<CTransaction> dummyConflicted;
+    for (int blocknum = 0; blocknum < 200; blocknum++) {
+        for (int j = 0; j < 10; j++) {
+            for (int k = 0; k < 4; k++) {
+                tx.vin[0].prevout.n = 10000 * blocknum + 100 * j + k;
+                pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, baseFee * (j + 1), 0, 0.0, blocknum));
+                vPending[j].push_back(tx.GetHash());
+            }
+        }
+        std::vector<CTransaction> block;
+        for (int j = 4; j < 10; j++) {
+            if (j == 4 && blocknum % 2)
+                continue;
+            for (const uint256& hash : vPending[j]) {
+                CTransaction btx;
+                BOOST_CHECK(pool.lookup(hash, btx));
+                block.push_back(btx);
+            }
+            vPending[j].clear();
+        }
+        pool.removeForBlock(block, blocknum + 1, dummyConflicted);
+    }
+
+    CAmount delta = baseRate.GetFeePerK() / 10;
+    BOOST_CHECK(std::abs(pool.estimateFee(1).GetFeePerK() - 6 * baseRate.GetFeePerK()) < delta);
+    BOOST_CHECK(std::abs(pool.estimateFee(2).GetFeePerK() - 5 * baseRate.GetFeePerK()) < delta);
+    // Accepting a lower confirmation probability lowers the estimate
+    BOOST_CHECK(std::abs(pool.estimateFee(1, .4).GetFeePerK() - 5 * baseRate.GetFeePerK()) < delta);
+    // Targets beyond the tracked range have no estimate
+    BOOST_CHECK(pool.estimateFee(26) == CFeeRate(0));
+
+    // The estimates survive a write/read round trip
+    CAutoFile fileout(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(pool.WriteFeeEstimates(fileout));
+    rewind(fileout.Get());
+    CTxMemPool poolRead(CFeeRate(1000));
+    BOOST_CHECK(poolRead.ReadFeeEstimates(fileout));
+    for (int i = 1; i <= 3; i++)
+        BOOST_CHECK(poolRead.estimateFee(i) == pool.estimateFee(i));
+}
+
+struct MempoolEventRecorder {
+    std::vector<std::pair<uint256, uint64_t> > vAdded;
+    std::vector<std::pair<uint256, uint64_t> > vRemoved;
+    std::vector<MemPoolRemovalReason> vReasons;
+
+    void Added(const CTransaction& tx, uint64_t nSequence)
+    {
+        vAdded.push_back(std::make_pair(tx.GetHash(), nSequence));
+    }
+
+    void Removed(const CTransaction& tx, MemPoolRemovalReason reason, uint64_t nSequence)
+    {
+        vRemoved.push_back(std::make_pair(tx.GetHash(), nSequence));
+        vReasons.push_back(reason);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(MempoolSequenceTest)
+{
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+    // Spends the same output as the child
+    CMutableTransaction txConflict = txChild;
+    txConflict.vout[0].nValue = 10000LL;
+
+    CTxMemPool pool(CFeeRate(0));
+    MempoolEventRecorder recorder;
+    pool.NotifyEntryAdded.connect(boost::bind(&MempoolEventRecorder::Added, &recorder, boost::placeholders::_1, boost::placeholders::_2));
+    pool.NotifyEntryRemoved.connect(boost::bind(&MempoolEventRecorder::Removed, &recorder, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3));
+
+    BOOST_CHECK_EQUAL(pool.GetSequence(), 1);
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 0, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(recorder.vAdded.size(), 2);
+    BOOST_CHECK(recorder.vAdded[0] == std::make_pair(txParent.GetHash(), (uint64_t)1));
+    BOOST_CHECK(recorder.vAdded[1] == std::make_pair(txChild.GetHash(), (uint64_t)2));
+
+    // A block with the parent and the conflicting spend confirms the one and evicts the child
+    std::vector<CTransaction> block;
+    block.push_back(txParent);
+    block.push_back(txConflict);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(block, 2, conflicts);
+    BOOST_CHECK_EQUAL(conflicts.size(), 1);
+    BOOST_CHECK_EQUAL(recorder.vRemoved.size(), 2);
+    BOOST_CHECK(recorder.vRemoved[0] == std::make_pair(txParent.GetHash(), (uint64_t)3));
+    BOOST_CHECK(recorder.vReasons[0] == MemPoolRemovalReason::BLOCK);
+    BOOST_CHECK(recorder.vRemoved[1] == std::make_pair(txChild.GetHash(), (uint64_t)4));
+    BOOST_CHECK(recorder.vReasons[1] == MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK_EQUAL(pool.GetSequence(), 5);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
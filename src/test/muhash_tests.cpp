@@ -0,0 +1,86 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "muhash.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "utxostats.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(muhash_tests)
+
+static std::vector<unsigned char> Element(unsigned char n)
+{
+    return std::vector<unsigned char>(32, n);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_semantics)
+{
+    CMuHash3072 empty, a, b;
+    a.Insert(Element(1));
+    a.Insert(Element(2));
+    b.Insert(Element(2));
+    b.Insert(Element(1));
+    BOOST_CHECK(a.Finalize() == b.Finalize());
+    BOOST_CHECK(a.Finalize() != empty.Finalize());
+
+    // Removing an element that was added elsewhere cancels out once combined
+    CMuHash3072 delta;
+    delta.Insert(Element(3));
+    delta.Remove(Element(1));
+    a *= delta;
+    CMuHash3072 c;
+    c.Insert(Element(3));
+    c.Insert(Element(2));
+    BOOST_CHECK(a.Finalize() == c.Finalize());
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << a;
+    CMuHash3072 d;
+    ss >> d;
+    BOOST_CHECK(d.Finalize() == c.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_connect_disconnect)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(uint256(1), 0);
+    tx.vout.resize(3);
+    tx.vout[0].nValue = 5 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1].nValue = 0;
+    tx.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    tx.vout[2].nValue = 2 * COIN;
+    tx.vout[2].scriptPubKey = CScript() << OP_TRUE;
+    CTxOut prev(7 * COIN, CScript() << OP_TRUE);
+
+    CUTXOStats stats;
+    stats.AddCoin(tx.vin[0].prevout, prev, 10, true);
+    stats.nTransactions++;
+    uint256 hashBefore = stats.muhash.Finalize();
+
+    // Connecting spends the coin and adds the two spendable outputs
+    CUTXOStats delta;
+    delta.RemoveCoin(tx.vin[0].prevout, prev, 10, true);
+    delta.nTransactions--;
+    delta.AddTransaction(tx, 11);
+    stats.Apply(delta);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 2);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 7 * COIN);
+
+    CUTXOStats undo;
+    undo.RemoveTransaction(tx, 11);
+    undo.AddCoin(tx.vin[0].prevout, prev, 10, true);
+    undo.nTransactions++;
+    stats.Apply(undo);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 1);
+    BOOST_CHECK(stats.muhash.Finalize() == hashBefore);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,8 @@
 #include "util.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <univalue.h>
@@ -181,6 +183,80 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+static void AppendChunk(std::vector<std::string>* pvChunks, const std::string& strChunk)
+{
+    pvChunks->push_back(strChunk);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_stream_writer)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("string", "quote\" backslash\\ newline\n"));
+    obj.push_back(Pair("number", 1.5));
+    obj.push_back(Pair("bool", true));
+    obj.push_back(Pair("null", NullUniValue));
+    obj.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    UniValue arr(UniValue::VARR);
+    for (int i = 0; i < 100; i++)
+        arr.push_back(obj);
+    obj.push_back(Pair("key \"escaped\"", arr));
+
+    // The chunks put together are exactly what UniValue::write gives
+    std::vector<std::string> vChunks;
+    JSONStreamWriter writer(boost::bind(&AppendChunk, &vChunks, boost::placeholders::_1), 100);
+    writer.Write(obj);
+    std::string strRest = writer.Finish();
+    BOOST_CHECK(vChunks.size() > 1);
+    BOOST_CHECK(strRest.size() < 100);
+    BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, "") + strRest, obj.write());
+    BOOST_CHECK(writer.Finish().empty());
+
+    JSONStreamWriter replyWriter(boost::bind(&AppendChunk, &vChunks, boost::placeholders::_1));
+    JSONRPCReplyStream(replyWriter, obj, NullUniValue, 1);
+    BOOST_CHECK_EQUAL(replyWriter.Finish(), JSONRPCReplyObj(obj, NullUniValue, 1).write());
+    JSONRPCReplyStream(replyWriter, obj, JSONRPCError(RPC_MISC_ERROR, "error"), "id");
+    BOOST_CHECK_EQUAL(replyWriter.Finish(), JSONRPCReplyObj(obj, JSONRPCError(RPC_MISC_ERROR, "error"), "id").write());
+}
+
+static bool RunOnThread(boost::thread_group* pthreads, const boost::function<void(void)>& func)
+{
+    pthreads->create_thread(func);
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch)
+{
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("method", i % 2 ? "help" : "nosuchmethod"));
+        req.push_back(Pair("params", UniValue(UniValue::VARR)));
+        req.push_back(Pair("id", i));
+        vReq.push_back(req);
+    }
+    vReq.push_back("not an object");
+
+    std::vector<std::string> vChunks;
+    JSONStreamWriter writer(boost::bind(&AppendChunk, &vChunks, boost::placeholders::_1));
+    JSONRPCExecBatch(vReq, writer);
+    std::string strSerial = boost::algorithm::join(vChunks, "") + writer.Finish();
+
+    // Run on helper threads, the replies are the same and in request order
+    vChunks.clear();
+    boost::thread_group threads;
+    JSONRPCExecBatch(vReq, writer, boost::bind(&RunOnThread, &threads, boost::placeholders::_1), 4);
+    threads.join_all();
+    std::string strParallel = boost::algorithm::join(vChunks, "") + writer.Finish();
+    BOOST_CHECK_EQUAL(strParallel, strSerial);
+
+    UniValue vReply;
+    BOOST_CHECK(vReply.read(strParallel));
+    BOOST_CHECK_EQUAL(vReply.size(), vReq.size());
+    for (int i = 0; i < 20; i++)
+        BOOST_CHECK_EQUAL(find_value(vReply[i], "id").get_int(), i);
+    BOOST_CHECK_EQUAL(find_value(find_value(vReply[20], "error"), "code").get_int(), (int)RPC_INVALID_REQUEST);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(string("clearbanned")));
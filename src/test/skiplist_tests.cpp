@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainsnapshot.h"
 #include "main.h"
 #include "random.h"
 #include "util.h"
@@ -99,4 +100,60 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chainsnapshot_test)
+{
+    // A main chain and a branch that splits off at block 9999, both ending in the same chunk
+    std::vector<CBlockIndex> vBlocksMain(12000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+    }
+    std::vector<CBlockIndex> vBlocksSide(3000);
+    for (unsigned int i=0; i<vBlocksSide.size(); i++) {
+        vBlocksSide[i].nHeight = i + 10000;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[9999];
+    }
+
+    // Move the tip around like connecting, disconnecting and reorganizing blocks
+    // does, and check every snapshot against a CChain with the same tip.
+    CChainSnapshot snapshot;
+    CChain chainPrev;
+    BOOST_CHECK(snapshot.Tip() == NULL);
+    BOOST_CHECK_EQUAL(snapshot.Height(), -1);
+    for (int n=0; n<200; n++) {
+        int r = insecure_rand() % 15000;
+        CBlockIndex* tip = (r < 12000) ? &vBlocksMain[r] : &vBlocksSide[r - 12000];
+        CChainSnapshot next(snapshot, tip);
+        CChain chain;
+        chain.SetTip(tip);
+
+        BOOST_CHECK(next.Tip() == tip);
+        BOOST_CHECK(next.Genesis() == &vBlocksMain[0]);
+        BOOST_CHECK_EQUAL(next.Height(), chain.Height());
+        BOOST_CHECK(next[-1] == NULL);
+        BOOST_CHECK(next[next.Height() + 1] == NULL);
+        bool fSame = true;
+        for (int h = 0; h <= chain.Height(); h++)
+            fSame &= next[h] == chain[h];
+        BOOST_CHECK(fSame);
+        BOOST_CHECK(next.Contains(&vBlocksMain[9999]) == chain.Contains(&vBlocksMain[9999]));
+        BOOST_CHECK(next.Next(tip) == NULL);
+        BOOST_CHECK(next.Contains(&vBlocksSide[0]) == chain.Contains(&vBlocksSide[0]));
+        BOOST_CHECK(next.Next(&vBlocksMain[9999]) == chain.Next(&vBlocksMain[9999]));
+
+        // The snapshot it replaced still shows the old chain
+        bool fUnchanged = snapshot.Height() == chainPrev.Height();
+        for (int h = 0; fUnchanged && h <= chainPrev.Height(); h++)
+            fUnchanged &= snapshot[h] == chainPrev[h];
+        BOOST_CHECK(fUnchanged);
+
+        snapshot = next;
+        chainPrev.SetTip(tip);
+    }
+
+    CChainSnapshot empty(snapshot, NULL);
+    BOOST_CHECK(empty.Tip() == NULL);
+    BOOST_CHECK(empty.Genesis() == NULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -424,4 +424,19 @@ BOOST_AUTO_TEST_CASE(test_FormatSubVersion)
     BOOST_CHECK_EQUAL(FormatSubVersion("Test", 99900, comments),std::string("/Test:0.9.99(comment1)/"));
     BOOST_CHECK_EQUAL(FormatSubVersion("Test", 99900, comments2),std::string("/Test:0.9.99(comment1; comment2)/"));
 }
+
+BOOST_AUTO_TEST_CASE(test_ParallelFor)
+{
+    std::vector<int> vCalls(1000, 0);
+    ParallelFor(vCalls.size(), 4, [&](size_t i) { vCalls[i]++; });
+    for (int nCalls : vCalls)
+        BOOST_CHECK_EQUAL(nCalls, 1);
+
+    ParallelFor(0, 4, [](size_t i) { BOOST_ERROR("called with nothing to do"); });
+
+    BOOST_CHECK_THROW(ParallelFor(100, 3, [](size_t i) {
+        if (i == 42)
+            throw std::runtime_error("42");
+    }), std::runtime_error);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,180 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/wallet.h"
+
+#include "chainparams.h"
+#include "chainsnapshot.h"
+#include "main.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <list>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(walletbalance_tests)
+
+// The cached balances must match what recomputing every transaction gives
+static CWalletBalances CheckBalances(CWallet& wallet)
+{
+    CWalletBalances cached = wallet.GetBalances();
+    wallet.MarkDirty();
+    CWalletBalances full = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(cached.nTrusted, full.nTrusted);
+    BOOST_CHECK_EQUAL(cached.nUntrustedPending, full.nUntrustedPending);
+    BOOST_CHECK_EQUAL(cached.nImmature, full.nImmature);
+    BOOST_CHECK_EQUAL(cached.nLocked, full.nLocked);
+    BOOST_CHECK_EQUAL(cached.nUnlocked, full.nUnlocked);
+    BOOST_CHECK_EQUAL(cached.nAnonymizable, full.nAnonymizable);
+    BOOST_CHECK_EQUAL(cached.nWatchTrusted, full.nWatchTrusted);
+    BOOST_CHECK_EQUAL(cached.nWatchUntrustedPending, full.nWatchUntrustedPending);
+    BOOST_CHECK_EQUAL(cached.nWatchImmature, full.nWatchImmature);
+    BOOST_CHECK_EQUAL(cached.nWatchLocked, full.nWatchLocked);
+    return cached;
+}
+
+static void SetWalletTip(CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    chainActive.SetTip(pindex);
+    PublishChainSnapshot(pindex);
+}
+
+BOOST_AUTO_TEST_CASE(walletbalance_cache)
+{
+    CWallet wallet("wallet_balance.dat");
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    }
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction mtxFund;
+    mtxFund.vin.resize(1);
+    mtxFund.vin[0].prevout = COutPoint(uint256(1), 0);
+    mtxFund.vout.resize(2);
+    mtxFund.vout[0].nValue = 10 * COIN;
+    mtxFund.vout[0].scriptPubKey = scriptMine;
+    mtxFund.vout[1].nValue = 5 * COIN;
+    mtxFund.vout[1].scriptPubKey = scriptMine;
+    CTransaction txFund(mtxFund);
+
+    // Nothing yet, which also primes the cache
+    BOOST_CHECK_EQUAL(CheckBalances(wallet).nTrusted, 0);
+
+    // Receive: in the mempool from someone else, so pending
+    {
+        LOCK(cs_main);
+        mempool.addUnchecked(txFund.GetHash(), CTxMemPoolEntry(txFund, 0, GetTime(), 0, 1));
+        wallet.SyncTransaction(txFund, NULL);
+    }
+    CWalletBalances balances = CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(balances.nTrusted, 0);
+    BOOST_CHECK_EQUAL(balances.nUntrustedPending, 15 * COIN);
+
+    // Confirm, the way ConnectTip tells the wallet
+    CBlockIndex* pindexGenesis;
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Tip();
+    }
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = pindexGenesis->GetBlockHash();
+    block.nTime = pindexGenesis->nTime + 60;
+    block.vtx.push_back(txFund);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hashBlock;
+    index.pprev = pindexGenesis;
+    index.nHeight = pindexGenesis->nHeight + 1;
+    {
+        LOCK(cs_main);
+        {
+            LOCK(cs_mapBlockIndex);
+            mapBlockIndex.insert(std::make_pair(hashBlock, &index));
+        }
+        std::list<CTransaction> removed;
+        mempool.remove(txFund, removed, false, MemPoolRemovalReason::BLOCK);
+    }
+    SetWalletTip(&index);
+    {
+        LOCK(cs_main);
+        wallet.SyncTransaction(txFund, &block);
+        wallet.BlockConnected(block, &index);
+    }
+    balances = CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(balances.nTrusted, 15 * COIN);
+    BOOST_CHECK_EQUAL(balances.nUntrustedPending, 0);
+    BOOST_CHECK_EQUAL(balances.nLocked, 0);
+
+    // Lock and unlock a coin
+    COutPoint outpointLocked(txFund.GetHash(), 1);
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.LockCoin(outpointLocked);
+    }
+    BOOST_CHECK_EQUAL(CheckBalances(wallet).nLocked, 5 * COIN);
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.UnlockCoin(outpointLocked);
+    }
+    BOOST_CHECK_EQUAL(CheckBalances(wallet).nLocked, 0);
+
+    // Spend the other output, with change back to the wallet
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.resize(1);
+    mtxSpend.vin[0].prevout = COutPoint(txFund.GetHash(), 0);
+    mtxSpend.vout.resize(2);
+    mtxSpend.vout[0].nValue = 4 * COIN;
+    mtxSpend.vout[0].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    mtxSpend.vout[1].nValue = 5 * COIN;
+    mtxSpend.vout[1].scriptPubKey = scriptMine;
+    CTransaction txSpend(mtxSpend);
+    {
+        LOCK(cs_main);
+        mempool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, GetTime(), 0, 1));
+        wallet.SyncTransaction(txSpend, NULL);
+    }
+    CheckBalances(wallet);
+
+    // A conflicting block drops the spend from the mempool, which frees the
+    // output it spent again
+    {
+        LOCK(cs_main);
+        std::list<CTransaction> removed;
+        mempool.remove(txSpend, removed, false, MemPoolRemovalReason::CONFLICT);
+        wallet.SyncTransaction(txSpend, NULL);
+    }
+    BOOST_CHECK_EQUAL(CheckBalances(wallet).nTrusted, 15 * COIN);
+
+    // Disconnecting the confirming block puts the funding back in the
+    // mempool before the tip moves
+    {
+        LOCK(cs_main);
+        mempool.addUnchecked(txFund.GetHash(), CTxMemPoolEntry(txFund, 0, GetTime(), 0, 1));
+        wallet.SyncTransaction(txFund, NULL);
+    }
+    SetWalletTip(pindexGenesis);
+    balances = CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(balances.nTrusted, 0);
+    BOOST_CHECK_EQUAL(balances.nUntrustedPending, 15 * COIN);
+    BOOST_CHECK_EQUAL(balances.nLocked, 0);
+
+    {
+        LOCK(cs_main);
+        std::list<CTransaction> removed;
+        mempool.remove(txFund, removed);
+        LOCK(cs_mapBlockIndex);
+        mapBlockIndex.erase(hashBlock);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
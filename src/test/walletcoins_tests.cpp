@@ -0,0 +1,74 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/walletcoins.h"
+
+#include "key.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(walletcoins_tests)
+
+BOOST_AUTO_TEST_CASE(walletcoins_index)
+{
+    CWalletCoinIndex index;
+    CKey key;
+    key.MakeNewKey(true);
+    CTxDestination dest = key.GetPubKey().GetID();
+
+    uint256 hashA = GetRandHash();
+    uint256 hashB = GetRandHash();
+    index.Add(CWalletCoin(COutPoint(hashA, 0), 5 * COIN, 100, ISMINE_SPENDABLE, dest));
+    index.Add(CWalletCoin(COutPoint(hashA, 1), 1 * COIN, 100, ISMINE_SPENDABLE, CNoDestination()));
+    index.Add(CWalletCoin(COutPoint(hashB, 0), 3 * COIN, 200, ISMINE_WATCH_ONLY, dest));
+    index.Add(CWalletCoin(COutPoint(hashB, 1), 2 * COIN, -1, ISMINE_SPENDABLE, dest));
+    BOOST_CHECK_EQUAL(index.Size(), 4U);
+
+    std::vector<const CWalletCoin*> vCoins;
+    index.GetByValue(2 * COIN, 4 * COIN, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+    BOOST_CHECK_EQUAL(vCoins[0]->nValue, 2 * COIN);
+    BOOST_CHECK_EQUAL(vCoins[1]->nValue, 3 * COIN);
+
+    // Unconfirmed coins are never returned by height
+    vCoins.clear();
+    index.GetByHeight(150, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+    vCoins.clear();
+    index.GetByHeight(200, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 3U);
+
+    vCoins.clear();
+    index.GetByDestination(dest, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 3U);
+
+    // Re-adding an outpoint replaces the coin in every index
+    index.Add(CWalletCoin(COutPoint(hashB, 1), 2 * COIN, 250, ISMINE_SPENDABLE, CNoDestination()));
+    BOOST_CHECK_EQUAL(index.Size(), 4U);
+    BOOST_CHECK_EQUAL(index.Get(COutPoint(hashB, 1))->nHeight, 250);
+    vCoins.clear();
+    index.GetByDestination(dest, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+
+    index.RemoveTx(hashA);
+    BOOST_CHECK_EQUAL(index.Size(), 2U);
+    BOOST_CHECK(index.Get(COutPoint(hashA, 0)) == NULL);
+    vCoins.clear();
+    index.GetByValue(0, 10 * COIN, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+
+    BOOST_CHECK(index.Remove(COutPoint(hashB, 0)));
+    BOOST_CHECK(!index.Remove(COutPoint(hashB, 0)));
+    vCoins.clear();
+    index.GetByDestination(dest, vCoins);
+    BOOST_CHECK(vCoins.empty());
+
+    index.Clear();
+    BOOST_CHECK_EQUAL(index.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
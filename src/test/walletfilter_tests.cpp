@@ -0,0 +1,111 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/walletfilter.h"
+
+#include "key.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/standard.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(walletfilter_tests)
+
+BOOST_AUTO_TEST_CASE(walletfilter_keys_and_scripts)
+{
+    CWalletFilter filter;
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CScript scriptP2PKH = GetScriptForDestination(pubkey.GetID());
+
+    BOOST_CHECK(!filter.MatchesScript(scriptP2PKH));
+    filter.Insert(pubkey);
+    BOOST_CHECK(filter.MatchesScript(scriptP2PKH));
+    BOOST_CHECK(filter.MatchesScript(GetScriptForRawPubKey(pubkey)));
+    BOOST_CHECK(filter.MatchesScript(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()))));
+
+    // Bare multisig matches on any of its keys
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    std::vector<CPubKey> vKeys;
+    vKeys.push_back(keyOther.GetPubKey());
+    vKeys.push_back(pubkey);
+    BOOST_CHECK(filter.MatchesScript(GetScriptForMultisig(1, vKeys)));
+    BOOST_CHECK(!filter.MatchesScript(GetScriptForDestination(keyOther.GetPubKey().GetID())));
+
+    // P2SH and P2WSH of a redeem script
+    CScript redeemScript = GetScriptForMultisig(2, vKeys);
+    CScript scriptP2SH = GetScriptForDestination(CScriptID(redeemScript));
+    CScript scriptP2WSH = GetScriptForWitness(redeemScript);
+    filter.Clear();
+    BOOST_CHECK(!filter.MatchesScript(scriptP2SH));
+    BOOST_CHECK(!filter.MatchesScript(scriptP2WSH));
+    filter.InsertScript(redeemScript);
+    BOOST_CHECK(filter.MatchesScript(scriptP2SH));
+    BOOST_CHECK(filter.MatchesScript(scriptP2WSH));
+
+    // Watch-only scripts match as a whole
+    CScript scriptWatch = CScript() << OP_RETURN << std::vector<unsigned char>(10, 0x42);
+    BOOST_CHECK(!filter.MatchesScript(scriptWatch));
+    filter.InsertWatchOnly(scriptWatch);
+    BOOST_CHECK(filter.MatchesScript(scriptWatch));
+}
+
+BOOST_AUTO_TEST_CASE(walletfilter_transactions)
+{
+    CWalletFilter filter;
+    CKey key;
+    key.MakeNewKey(true);
+    filter.Insert(key.GetPubKey());
+
+    CMutableTransaction txPay;
+    txPay.vin.resize(1);
+    txPay.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txPay.vout.resize(2);
+    txPay.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    txPay.vout[1].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    BOOST_CHECK(filter.IsRelevant(txPay));
+    BOOST_CHECK(filter.MatchesOutputs(txPay));
+
+    // A transaction spending one of the wallet's outputs
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(CTransaction(txPay).GetHash(), 1);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    BOOST_CHECK(!filter.IsRelevant(txSpend));
+    filter.InsertOutputs(txPay);
+    BOOST_CHECK(filter.IsRelevant(txSpend));
+    BOOST_CHECK(!filter.MatchesOutputs(txSpend));
+    BOOST_CHECK(filter.Contains(txSpend.vin[0].prevout));
+}
+
+BOOST_AUTO_TEST_CASE(walletfilter_growth)
+{
+    // Everything inserted keeps matching while the bloom filter grows,
+    // and the element set turns away what gets past the bloom filter
+    CWalletFilter filter;
+    std::vector<uint256> vInserted;
+    for (int i = 0; i < 5000; i++) {
+        vInserted.push_back(GetRandHash());
+        filter.Insert(std::vector<unsigned char>(vInserted.back().begin(), vInserted.back().end()));
+    }
+    BOOST_CHECK_EQUAL(filter.Size(), 5000U);
+    for (const uint256& hash : vInserted)
+        BOOST_CHECK(filter.Contains(std::vector<unsigned char>(hash.begin(), hash.end())));
+
+    int nFalsePositives = 0;
+    for (int i = 0; i < 5000; i++) {
+        uint256 hash = GetRandHash();
+        if (filter.Contains(std::vector<unsigned char>(hash.begin(), hash.end())))
+            nFalsePositives++;
+    }
+    BOOST_CHECK_EQUAL(nFalsePositives, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/wallet.h"
+
+#include "key.h"
+#include "random.h"
+#include "wallet/walletdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(walletload_tests)
+
+static CWalletTx MakeWalletTx(const CWallet* pwallet, const CScript& scriptSig)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(GetRandHash(), 1, scriptSig, 7));
+    tx.vin.push_back(CTxIn(GetRandHash(), 0, CScript() << std::vector<unsigned char>(72, 1)));
+    tx.vout.push_back(CTxOut(5 * COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    tx.vout.push_back(CTxOut(1 * COIN, GetScriptForRawPubKey(key.GetPubKey())));
+    tx.nLockTime = 1234;
+
+    CWalletTx wtx(pwallet, tx);
+    wtx.hashBlock = GetRandHash();
+    wtx.vMerkleBranch.push_back(GetRandHash());
+    wtx.nIndex = 1;
+    wtx.mapValue["comment"] = "lazy";
+    wtx.nTimeReceived = 1500000000;
+    wtx.nTimeSmart = 1500000001;
+    wtx.nOrderPos = 3;
+    return wtx;
+}
+
+BOOST_AUTO_TEST_CASE(walletload_compact)
+{
+    CWallet wallet("wallet_lazy.dat");
+    CWalletTx wtx = MakeWalletTx(&wallet, CScript() << std::vector<unsigned char>(71, 2) << std::vector<unsigned char>(33, 3));
+    uint256 hash = wtx.GetHash();
+    mapArgs["-walletbackend"] = "log";
+    BOOST_CHECK(CWalletDB(wallet.strWalletFile, "cr+").WriteTx(hash, wtx));
+    mapArgs.erase("-walletbackend");
+
+    CDataStream ssFull(SER_DISK, CLIENT_VERSION);
+    ssFull << wtx;
+    CDataStream ss(ssFull);
+    CWalletTx wtxCompact;
+    BOOST_CHECK(wtxCompact.UnserializeCompact(ss, hash));
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(wtxCompact.IsCompact());
+
+    // Everything but the input scripts
+    BOOST_CHECK(wtxCompact.GetHash() == hash);
+    BOOST_CHECK_EQUAL(wtxCompact.vin.size(), 2U);
+    for (unsigned int i = 0; i < wtx.vin.size(); i++) {
+        BOOST_CHECK(wtxCompact.vin[i].prevout == wtx.vin[i].prevout);
+        BOOST_CHECK_EQUAL(wtxCompact.vin[i].nSequence, wtx.vin[i].nSequence);
+        BOOST_CHECK(wtxCompact.vin[i].scriptSig.empty());
+    }
+    BOOST_CHECK(wtxCompact.vout == wtx.vout);
+    BOOST_CHECK_EQUAL(wtxCompact.nLockTime, 1234U);
+    BOOST_CHECK(wtxCompact.hashBlock == wtx.hashBlock);
+    BOOST_CHECK(wtxCompact.vMerkleBranch == wtx.vMerkleBranch);
+    BOOST_CHECK_EQUAL(wtxCompact.mapValue["comment"], "lazy");
+    BOOST_CHECK_EQUAL(wtxCompact.nTimeSmart, wtx.nTimeSmart);
+    BOOST_CHECK_EQUAL(wtxCompact.nOrderPos, 3);
+
+    // Read in full from the wallet file when it is needed
+    BOOST_CHECK(!wtxCompact.LoadFull());
+    wtxCompact.BindWallet(&wallet);
+    BOOST_CHECK(wtxCompact.LoadFull());
+    BOOST_CHECK(!wtxCompact.IsCompact());
+    CDataStream ssLoaded(SER_DISK, CLIENT_VERSION);
+    ssLoaded << wtxCompact;
+    BOOST_CHECK(ssLoaded.str() == ssFull.str());
+
+    // Writing a compact transaction writes all of it
+    CDataStream ssAgain(ssFull);
+    BOOST_CHECK(wtxCompact.UnserializeCompact(ssAgain, hash));
+    wtxCompact.BindWallet(&wallet);
+    wtxCompact.nTimeReceived = 1600000000;
+    BOOST_CHECK(CWalletDB(wallet.strWalletFile).WriteTx(hash, wtxCompact));
+    CWalletTx wtxRead;
+    BOOST_CHECK(CWalletDB(wallet.strWalletFile).ReadTx(hash, wtxRead));
+    BOOST_CHECK(wtxRead.GetHash() == hash);
+    BOOST_CHECK(wtxRead.vin[0].scriptSig == wtx.vin[0].scriptSig);
+    BOOST_CHECK_EQUAL(wtxRead.nTimeReceived, 1600000000U);
+}
+
+BOOST_AUTO_TEST_CASE(walletload_zerocoin_spend)
+{
+    CWallet wallet("wallet_lazy_zc.dat");
+    CMutableTransaction tx;
+    CScript scriptSpend = CScript() << OP_ZEROCOINSPEND << 3;
+    scriptSpend.insert(scriptSpend.end(), 3, 0x55);
+    tx.vin.push_back(CTxIn(COutPoint(), scriptSpend));
+    tx.vout.push_back(CTxOut(1 * COIN, CScript() << OP_TRUE));
+    CWalletTx wtx(&wallet, tx);
+
+    // Zerocoin spends are known by their scriptSig, so they are read in full
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << wtx;
+    unsigned int nSize = ss.size();
+    CWalletTx wtxRead;
+    BOOST_CHECK(!wtxRead.UnserializeCompact(ss, wtx.GetHash()));
+    BOOST_CHECK_EQUAL(ss.size(), nSize);
+    ss >> wtxRead;
+    BOOST_CHECK(wtxRead.IsZerocoinSpend());
+    BOOST_CHECK(!wtxRead.IsCompact());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,199 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/wallet.h"
+
+#include "chainparams.h"
+#include "chainsnapshot.h"
+#include "main.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(walletview_tests)
+
+BOOST_AUTO_TEST_CASE(walletview_depth)
+{
+    CWallet wallet("wallet_view.dat");
+    CBlock block = Params().GenesisBlock();
+    CBlockIndex* pindexGenesis;
+    CWalletTx wtx(&wallet, block.vtx[0]);
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Genesis();
+        BOOST_CHECK_EQUAL(wtx.SetMerkleBranch(block), 1);
+    }
+    BOOST_CHECK(wallet.AddToWallet(wtx, true));
+    const CWalletTx* pwtx = wallet.GetWalletTx(wtx.GetHash());
+    BOOST_CHECK(pwtx != NULL);
+
+    int nBlocksToMaturity;
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 1);
+        nBlocksToMaturity = pwtx->GetBlocksToMaturity();
+    }
+    BOOST_CHECK(nBlocksToMaturity > 0);
+
+    // The same answers from the view
+    BOOST_CHECK(CWalletChainView::Current() == NULL);
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK(CWalletChainView::Current() == &view);
+        BOOST_CHECK(view.Chain().Tip() == pindexGenesis);
+        const CBlockIndex* pindex = NULL;
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(pindex, false), 1);
+        BOOST_CHECK(pindex == pindexGenesis);
+        BOOST_CHECK_EQUAL(pwtx->GetBlocksToMaturity(), nBlocksToMaturity);
+        BOOST_CHECK(pwtx->IsFinal());
+        {
+            CWalletChainView viewInner(wallet);
+            BOOST_CHECK(CWalletChainView::Current() == &viewInner);
+        }
+        BOOST_CHECK(CWalletChainView::Current() == &view);
+    }
+    BOOST_CHECK(CWalletChainView::Current() == NULL);
+
+    // From then on reads go ahead while another thread holds cs_main
+    std::atomic<bool> fHeld(false), fDone(false);
+    boost::thread thread([&] {
+        LOCK(cs_main);
+        fHeld = true;
+        while (!fDone)
+            MilliSleep(1);
+    });
+    while (!fHeld)
+        MilliSleep(1);
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 1);
+        BOOST_CHECK_EQUAL(pwtx->GetBlocksToMaturity(), nBlocksToMaturity);
+    }
+    fDone = true;
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(walletview_block_sync)
+{
+    CWallet wallet("wallet_view_sync.dat");
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    }
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(uint256(1), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1 * COIN;
+    mtx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CTransaction tx(mtx);
+
+    // The transaction enters the mempool, and the wallet hears of it
+    {
+        LOCK(cs_main);
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, 1));
+        wallet.SyncTransaction(tx, NULL);
+    }
+    const CWalletTx* pwtx = wallet.GetWalletTx(tx.GetHash());
+    BOOST_REQUIRE(pwtx != NULL);
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 0);
+    }
+
+    CBlockIndex* pindexGenesis;
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Tip();
+    }
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = pindexGenesis->GetBlockHash();
+    block.nTime = pindexGenesis->nTime + 60;
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hashBlock;
+    index.pprev = pindexGenesis;
+    index.nHeight = pindexGenesis->nHeight + 1;
+
+    // ConnectTip takes it out of the mempool and publishes the new tip before
+    // it tells the wallet about the block
+    {
+        LOCK(cs_main);
+        {
+            LOCK(cs_mapBlockIndex);
+            mapBlockIndex.insert(std::make_pair(hashBlock, &index));
+        }
+        std::list<CTransaction> removed;
+        mempool.remove(tx, removed, false, MemPoolRemovalReason::BLOCK);
+        BOOST_CHECK(!mempool.exists(tx.GetHash()));
+        PublishChainSnapshot(&index);
+    }
+
+    // A view opened now goes by the chain the wallet has synced, on which
+    // the transaction is still waiting in the mempool
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK(view.Chain().Tip() == pindexGenesis);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 0);
+    }
+
+    // So it does once the wallet has seen the transaction in the block, but
+    // not yet the end of the block
+    {
+        LOCK(cs_main);
+        wallet.SyncTransaction(tx, &block);
+    }
+    BOOST_CHECK(pwtx->hashBlock == hashBlock);
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK(view.Chain().Tip() == pindexGenesis);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 0);
+    }
+
+    // And moves to the block when the wallet has synced all of it
+    {
+        LOCK(cs_main);
+        wallet.BlockConnected(block, &index);
+    }
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK(view.Chain().Tip() == &index);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 1);
+    }
+
+    // Disconnecting the block shows at once, the transaction being back in
+    // the mempool before the tip moves
+    {
+        LOCK(cs_main);
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, GetTime(), 0, 1));
+        wallet.SyncTransaction(tx, NULL);
+        PublishChainSnapshot(pindexGenesis);
+    }
+    {
+        CWalletChainView view(wallet);
+        BOOST_CHECK(view.Chain().Tip() == pindexGenesis);
+        BOOST_CHECK_EQUAL(pwtx->GetDepthInMainChain(false), 0);
+    }
+
+    {
+        LOCK(cs_main);
+        std::list<CTransaction> removed;
+        mempool.remove(tx, removed);
+        LOCK(cs_mapBlockIndex);
+        mapBlockIndex.erase(hashBlock);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
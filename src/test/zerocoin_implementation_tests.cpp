@@ -525,5 +525,59 @@ BOOST_AUTO_TEST_CASE(deterministic_tests)
     BOOST_CHECK_MESSAGE(hash == uint256("c90c225f2cbdee5ef053b1f9f70053dd83724c58126d0e1b8425b88091d1f73f"), "minting determinism isn't as expected");
 }
 
+BOOST_AUTO_TEST_CASE(zerocoindb_batch_read)
+{
+    CZerocoinDB db(1 << 20, true);
+
+    // Mints and spends recorded for every other hash
+    std::vector<uint256> vHashPubcoin;
+    std::vector<uint256> vHashSerial;
+    for (int i = 0; i < 40; i++) {
+        CBigNum bnPubcoin(1000 + i);
+        CBigNum bnSerial(5000 + i);
+        vHashPubcoin.push_back(GetPubCoinHash(bnPubcoin));
+        vHashSerial.push_back(GetSerialHash(bnSerial));
+        if (i % 2 == 0) {
+            BOOST_CHECK(db.Write(make_pair('m', vHashPubcoin.back()), uint256(i + 1)));
+            BOOST_CHECK(db.WriteCoinSpend(bnSerial, uint256(100 + i)));
+        }
+    }
+
+    std::map<uint256, uint256> mapMintTx;
+    BOOST_CHECK(db.ReadCoinMints(vHashPubcoin, mapMintTx));
+    BOOST_CHECK_EQUAL(mapMintTx.size(), 20U);
+    std::map<uint256, uint256> mapSpendTx;
+    BOOST_CHECK(db.ReadCoinSpends(vHashSerial, mapSpendTx));
+    BOOST_CHECK_EQUAL(mapSpendTx.size(), 20U);
+    for (int i = 0; i < 40; i++) {
+        uint256 hashTx;
+        BOOST_CHECK_EQUAL(mapMintTx.count(vHashPubcoin[i]) > 0, db.ReadCoinMint(vHashPubcoin[i], hashTx));
+        if (i % 2 == 0) {
+            BOOST_CHECK(mapMintTx[vHashPubcoin[i]] == uint256(i + 1));
+            BOOST_CHECK(mapSpendTx[vHashSerial[i]] == uint256(100 + i));
+        }
+    }
+
+    // Mints and spends are kept apart
+    mapMintTx.clear();
+    BOOST_CHECK(db.ReadCoinMints(vHashSerial, mapMintTx));
+    BOOST_CHECK(mapMintTx.empty());
+}
+
+BOOST_AUTO_TEST_CASE(zohmctracker_pubcoin_index)
+{
+    CzOHMCTracker tracker("wallet_tracker.dat");
+    CDeterministicMint dMint(PrivateCoin::CURRENT_VERSION, 7, uint256(1), uint256(2), uint256(3), uint256(4));
+    dMint.SetDenomination(CoinDenomination::ZQ_TEN);
+    tracker.Add(dMint);
+    BOOST_CHECK(tracker.HasPubcoinHash(uint256(3)));
+    BOOST_CHECK(!tracker.HasPubcoinHash(uint256(2)));
+    BOOST_CHECK(tracker.GetMetaFromPubcoin(uint256(3)).hashSerial == uint256(2));
+    BOOST_CHECK(tracker.GetMetaFromPubcoin(uint256(2)).hashSerial == 0);
+
+    tracker.Clear();
+    BOOST_CHECK(!tracker.HasPubcoinHash(uint256(3)));
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,49 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TIMESTAMPINDEX_H
+#define BITCOIN_TIMESTAMPINDEX_H
+
+#include "addressindex.h"
+#include "uint256.h"
+
+/** Key of a -timestampindex entry; the time is big endian so entries iterate in time order */
+struct CTimestampIndexKey {
+    unsigned int nTime;
+    uint256 hashBlock;
+
+    CTimestampIndexKey(unsigned int nTimeIn, const uint256& hashBlockIn) : nTime(nTimeIn), hashBlock(hashBlockIn) {}
+
+    CTimestampIndexKey()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nTime = 0;
+        hashBlock = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 4 + 32;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteIndexBE32(s, nTime);
+        hashBlock.Serialize(s, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        nTime = ReadIndexBE32(s);
+        hashBlock.Unserialize(s, nType, nVersion);
+    }
+};
+
+#endif // BITCOIN_TIMESTAMPINDEX_H
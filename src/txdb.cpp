@@ -13,6 +13,7 @@
 #include "uint256.h"
 #include "accumulators.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -42,6 +43,11 @@ bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
     return db.Read(make_pair('c', txid), coins);
 }
 
+bool CCoinsViewDB::GetCoins(const leveldb::Snapshot* psnapshot, const uint256& txid, CCoins& coins) const
+{
+    return db.Read(make_pair('c', txid), coins, psnapshot);
+}
+
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
     return db.Exists(make_pair('c', txid));
@@ -55,6 +61,20 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
+uint256 CCoinsViewDB::GetBestBlock(const leveldb::Snapshot* psnapshot) const
+{
+    uint256 hashBestChain;
+    if (!db.Read('B', hashBestChain, psnapshot))
+        return uint256(0);
+    return hashBestChain;
+}
+
+bool CCoinsViewDBSnapshot::HaveCoins(const uint256& txid) const
+{
+    CCoins coins;
+    return GetCoins(txid, coins);
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
 {
     CLevelDBBatch batch;
@@ -69,19 +89,22 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
-    if (hashBlock != uint256(0))
+    if (hashBlock != uint256(0)) {
         BatchWriteHashBestChain(batch, hashBlock);
 
+        // The UTXO set statistics are only stored together with the coins they describe
+        if (utxoStats.hashBlock == hashBlock)
+            batch.Write('M', utxoStats);
+        else
+            batch.Erase('M');
+    }
+
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
-    if (!Read('S', salt)) {
-        salt = GetRandHash();
-        Write('S', salt);
-    }
 }
 
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
@@ -177,6 +200,72 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     return true;
 }
 
+bool CCoinsViewDB::ReadUTXOStats(CUTXOStats& stats) const
+{
+    return db.Read('M', stats);
+}
+
+bool CCoinsViewDB::WriteUTXOStats(const CUTXOStats& stats)
+{
+    return db.Write('M', stats);
+}
+
+bool CCoinsViewDB::ComputeUTXOStats(CUTXOStats& stats) const
+{
+    stats = CUTXOStats();
+    stats.hashBlock = GetBestBlock();
+    return ForEachCoins(NULL, [&stats](const uint256& txid, const CCoins& coins) {
+        stats.nTransactions++;
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull())
+                stats.AddCoin(COutPoint(txid, i), coins.vout[i], coins.nHeight, coins.fCoinBase);
+        }
+        return true;
+    });
+}
+
+const leveldb::Snapshot* CCoinsViewDB::GetSnapshot()
+{
+    return db.GetSnapshot();
+}
+
+void CCoinsViewDB::ReleaseSnapshot(const leveldb::Snapshot* psnapshot)
+{
+    db.ReleaseSnapshot(psnapshot);
+}
+
+bool CCoinsViewDB::ForEachCoins(const leveldb::Snapshot* psnapshot, std::function<bool(const uint256&, const CCoins&)> fn) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator(psnapshot));
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('c', uint256(0));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'c')
+                break;
+            uint256 txid;
+            ssKey >> txid;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            if (!fn(txid, coins))
+                break;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return pcursor->status().ok();
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
 {
     return Read(make_pair('t', txid), pos);
@@ -190,53 +279,258 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list) {
+void CBlockTreeDB::BatchAddressIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent, bool fErase)
+{
+    // Running totals are read-modify-write; blocks are indexed one at a time,
+    // either under cs_main or by the index builder before the index goes live.
+    // The block tree is flushed apart from the coins, so after a crash blocks
+    // past the coins' best block are connected (or disconnected) again: deltas
+    // at or below the height a total counts are skipped when connecting, and
+    // those above it when disconnecting.
+    std::map<uint160, std::pair<int, CAddressBalance> > mapBalance; // height counted on disk, new totals
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vDeltas.begin(); it != vDeltas.end(); it++) {
+        if (fErase)
+            batch.Erase(make_pair('A', it->first));
+        else
+            batch.Write(make_pair('A', it->first), it->second);
+
+        std::map<uint160, std::pair<int, CAddressBalance> >::iterator itBalance = mapBalance.find(it->first.hashScript);
+        if (itBalance == mapBalance.end()) {
+            CAddressBalance balance;
+            ReadAddressBalance(it->first.hashScript, balance);
+            itBalance = mapBalance.insert(make_pair(it->first.hashScript, make_pair(balance.nHeight, balance))).first;
+        }
+        int nHeightCounted = itBalance->second.first;
+        if (fErase ? it->first.nHeight > nHeightCounted : it->first.nHeight <= nHeightCounted)
+            continue;
+
+        CAmount nDelta = fErase ? -it->second : it->second;
+        CAddressBalance& balance = itBalance->second.second;
+        balance.nBalance += nDelta;
+        if (!it->first.fSpending)
+            balance.nReceived += nDelta;
+        balance.nHeight = fErase ? std::min(balance.nHeight, it->first.nHeight - 1) : std::max(balance.nHeight, it->first.nHeight);
+    }
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vUnspent.begin(); it != vUnspent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('U', it->first));
+        else
+            batch.Write(make_pair('U', it->first), it->second);
+    }
+
+    for (std::map<uint160, std::pair<int, CAddressBalance> >::const_iterator it = mapBalance.begin(); it != mapBalance.end(); it++) {
+        const CAddressBalance& balance = it->second.second;
+        if (balance.nBalance == 0 && balance.nReceived == 0)
+            batch.Erase(make_pair('V', it->first));
+        else
+            batch.Write(make_pair('V', it->first), balance);
+    }
+}
+
+bool CBlockTreeDB::UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent, bool fErase)
+{
+    CLevelDBBatch batch;
+    BatchAddressIndex(batch, vDeltas, vUnspent, fErase);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const CAddressIndexKey& keyStart, int nEndHeight, size_t nLimit, std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas)
+{
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
-    uint64_t lookupid;
-    {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << addrid;
-        lookupid = (ss.GetHash()).GetLow64();
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('A', keyStart);
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid() && (nLimit == 0 || vDeltas.size() < nLimit); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey key;
+            ssKey >> chType;
+            if (chType != 'A')
+                break;
+            ssKey >> key;
+            if (key.hashScript != keyStart.hashScript || (nEndHeight >= 0 && key.nHeight > nEndHeight))
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vDeltas.push_back(std::make_pair(key, nValue));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
+    return true;
+}
 
-    CDataStream firstKey(SER_DISK, CLIENT_VERSION);
-    firstKey << make_pair('a', lookupid);
-    pcursor->Seek(firstKey.str());
-
-    for(pcursor->Seek(firstKey.str()); pcursor->Valid(); pcursor->Next()) {
-        leveldb::Slice key = pcursor->key();
-        CDataStream ssKey(key.data(), key.data() + key.size(), SER_DISK, CLIENT_VERSION);
-        char id;
-        ssKey >> id;
-        if(id == 'a') {
-            uint64_t lid;
-            ssKey >> lid;
-            if(lid == lookupid) {
-                CExtDiskTxPos position;
-                ssKey >> position;
-                list.push_back(position);
-            } else {
+bool CBlockTreeDB::ReadAddressUnspentIndex(const CAddressUnspentKey& keyStart, size_t nLimit, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('U', keyStart);
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid() && (nLimit == 0 || vUnspent.size() < nLimit); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey key;
+            ssKey >> chType;
+            if (chType != 'U')
                 break;
-            }
-        } else {
-            break;
+            ssKey >> key;
+            if (key.hashScript != keyStart.hashScript)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vUnspent.push_back(std::make_pair(key, value));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressBalance(const uint160& hashScript, CAddressBalance& balance)
+{
+    return Read(make_pair('V', hashScript), balance);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >& vSpent)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<COutPoint, CSpentIndexValue> >::const_iterator it = vSpent.begin(); it != vSpent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', outpoint), value);
+}
+
+bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey& key, unsigned int nLogicalTime)
+{
+    CLevelDBBatch batch;
+    batch.Write(make_pair('T', key), nLogicalTime);
+    batch.Write(make_pair('z', key.hashBlock), nLogicalTime);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(unsigned int nLow, unsigned int nHigh, std::vector<std::pair<CTimestampIndexKey, unsigned int> >& vBlocks)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('T', CTimestampIndexKey(nLow, 0));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CTimestampIndexKey key;
+            ssKey >> chType;
+            if (chType != 'T')
+                break;
+            ssKey >> key;
+            if (key.nTime >= nHigh)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            unsigned int nLogicalTime;
+            ssValue >> nLogicalTime;
+            vBlocks.push_back(std::make_pair(key, nLogicalTime));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
     return true;
 }
 
-bool CBlockTreeDB::AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list) {
-    unsigned char foo[0];
+bool CBlockTreeDB::ReadLogicalTimestamp(const uint256& hashBlock, unsigned int& nLogicalTime)
+{
+    return Read(make_pair('z', hashBlock), nLogicalTime);
+}
+
+bool CBlockTreeDB::WriteIndexBuilderEntries(const CIndexBuilderEntries& entries, const std::vector<std::string>& vIndexes, const uint256& hashCursor)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = entries.vTxPos.begin(); it != entries.vTxPos.end(); it++)
+        batch.Write(make_pair('t', it->first), it->second);
+    BatchAddressIndex(batch, entries.vAddressDeltas, entries.vAddressUnspent, entries.fAddressErase);
+    for (std::vector<std::pair<COutPoint, CSpentIndexValue> >::const_iterator it = entries.vSpent.begin(); it != entries.vSpent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    for (std::vector<std::pair<CTimestampIndexKey, unsigned int> >::const_iterator it = entries.vTimestamps.begin(); it != entries.vTimestamps.end(); it++) {
+        batch.Write(make_pair('T', it->first), it->second);
+        batch.Write(make_pair('z', it->first.hashBlock), it->second);
+    }
+    for (std::vector<std::pair<uint256, int> >::const_iterator it = entries.vTxHeights.begin(); it != entries.vTxHeights.end(); it++)
+        batch.Write(make_pair('h', it->first), it->second);
+    for (std::vector<std::string>::const_iterator it = vIndexes.begin(); it != vIndexes.end(); it++)
+        batch.Write(make_pair('X', *it), hashCursor);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadIndexCursor(const std::string& name, uint256& hashBlock)
+{
+    return Read(make_pair('X', name), hashBlock);
+}
+
+bool CBlockTreeDB::EraseIndexCursor(const std::string& name)
+{
+    return Erase(make_pair('X', name));
+}
+
+bool CBlockTreeDB::ReadIndexTxHeight(const uint256& txid, int& nHeight)
+{
+    return Read(make_pair('h', txid), nHeight);
+}
+
+bool CBlockTreeDB::EraseIndexPrefix(char chPrefix)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    std::string strPrefix(1, chPrefix);
+    pcursor->Seek(strPrefix);
+
+    // Keys are erased in chunks so dropping a large index doesn't build one huge batch
     CLevelDBBatch batch;
-    for (std::vector<std::pair<uint160, CExtDiskTxPos> >::const_iterator it=list.begin(); it!=list.end(); it++) {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << it->first;
-        batch.Write(make_pair(make_pair('a', (ss.GetHash()).GetLow64()), it->second), FLATDATA(foo));
+    size_t nBatch = 0;
+    for (; pcursor->Valid() && pcursor->key().starts_with(strPrefix); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        batch.EraseRaw(pcursor->key());
+        if (++nBatch == 10000) {
+            if (!WriteBatch(batch))
+                return false;
+            batch = CLevelDBBatch();
+            nBatch = 0;
+        }
     }
-    return WriteBatch(batch, true);
+    if (!pcursor->status().ok())
+        return error("%s : LevelDB iterator error - %s", __func__, pcursor->status().ToString());
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
@@ -365,6 +659,51 @@ bool CZerocoinDB::ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx)
     return Read(make_pair('m', hashPubcoin), hashTx);
 }
 
+bool CZerocoinDB::ReadHashes(char chType, const std::vector<uint256>& vHashes, std::map<uint256, uint256>& mapTxHashes)
+{
+    // The keys in the order the database keeps them, so the cursor only moves forward
+    std::vector<std::pair<std::string, uint256> > vKeys;
+    vKeys.reserve(vHashes.size());
+    for (const uint256& hash : vHashes) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << make_pair(chType, hash);
+        vKeys.push_back(make_pair(ssKey.str(), hash));
+    }
+    std::sort(vKeys.begin(), vKeys.end());
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for (const std::pair<std::string, uint256>& key : vKeys) {
+        if (!pcursor->Valid() || pcursor->key().compare(key.first) < 0)
+            pcursor->Seek(key.first);
+        if (!pcursor->Valid())
+            break;
+        if (pcursor->key() != key.first)
+            continue;
+
+        try {
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            uint256 hashTx;
+            ssValue >> hashTx;
+            mapTxHashes[key.second] = hashTx;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return pcursor->status().ok();
+}
+
+bool CZerocoinDB::ReadCoinMints(const std::vector<uint256>& vHashPubcoin, std::map<uint256, uint256>& mapTxHashes)
+{
+    return ReadHashes('m', vHashPubcoin, mapTxHashes);
+}
+
+bool CZerocoinDB::ReadCoinSpends(const std::vector<uint256>& vHashSerial, std::map<uint256, uint256>& mapTxHashes)
+{
+    return ReadHashes('s', vHashSerial, mapTxHashes);
+}
+
 bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
 {
     uint256 hash = GetPubCoinHash(bnPubcoin);
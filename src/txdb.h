@@ -8,10 +8,15 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
+#include "spentindex.h"
+#include "timestampindex.h"
 #include "main.h"
+#include "utxostats.h"
 #include "primitives/zerocoin.h"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
@@ -41,6 +46,60 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    bool ReadUTXOStats(CUTXOStats& stats) const;
+    bool WriteUTXOStats(const CUTXOStats& stats);
+    //! Recompute the rolling UTXO set statistics from scratch
+    bool ComputeUTXOStats(CUTXOStats& stats) const;
+
+    const leveldb::Snapshot* GetSnapshot();
+    void ReleaseSnapshot(const leveldb::Snapshot* psnapshot);
+    //! Visit the coins of a snapshot (or of the live database if NULL) until fn returns false
+    bool ForEachCoins(const leveldb::Snapshot* psnapshot, std::function<bool(const uint256&, const CCoins&)> fn) const;
+    bool GetCoins(const leveldb::Snapshot* psnapshot, const uint256& txid, CCoins& coins) const;
+    uint256 GetBestBlock(const leveldb::Snapshot* psnapshot) const;
+};
+
+/**
+ * Read-only view of the coin database as it was when the view was created,
+ * for readers that don't hold cs_main. The database lags the chain tip by
+ * whatever pcoinsTip has not flushed yet, so it only answers for the txids
+ * pcoinsTip->HaveCoinsInCache() said no to while cs_main was still held.
+ */
+class CCoinsViewDBSnapshot : public CCoinsView
+{
+private:
+    CCoinsViewDB& base;
+    const leveldb::Snapshot* psnapshot;
+
+    CCoinsViewDBSnapshot(const CCoinsViewDBSnapshot&);
+    CCoinsViewDBSnapshot& operator=(const CCoinsViewDBSnapshot&);
+
+public:
+    CCoinsViewDBSnapshot(CCoinsViewDB& baseIn) : base(baseIn), psnapshot(baseIn.GetSnapshot()) {}
+    ~CCoinsViewDBSnapshot() { base.ReleaseSnapshot(psnapshot); }
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const { return base.GetCoins(psnapshot, txid, coins); }
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const { return base.GetBestBlock(psnapshot); }
+};
+
+/**
+ * Records of one block for the indexes being built in the background. They are
+ * written in one batch together with the builder's progress, so an index that
+ * is resumed after a restart never sees a block twice.
+ */
+struct CIndexBuilderEntries {
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxPos;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    bool fAddressErase;
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+    std::vector<std::pair<CTimestampIndexKey, unsigned int> > vTimestamps;
+    //! Heights of the indexed transactions, only kept while -addrindex is being built
+    std::vector<std::pair<uint256, int> > vTxHeights;
+
+    CIndexBuilderEntries() : fAddressErase(false) {}
 };
 
 /** Access to the block database (blocks/index/) */
@@ -50,10 +109,11 @@ public:
     CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
 private:
-    uint256 salt;
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
 
+    void BatchAddressIndex(CLevelDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent, bool fErase);
+
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
@@ -64,8 +124,20 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
-    bool ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list);
-    bool AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list);
+    bool UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent, bool fErase);
+    bool ReadAddressIndex(const CAddressIndexKey& keyStart, int nEndHeight, size_t nLimit, std::vector<std::pair<CAddressIndexKey, CAmount> >& vDeltas);
+    bool ReadAddressUnspentIndex(const CAddressUnspentKey& keyStart, size_t nLimit, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent);
+    bool ReadAddressBalance(const uint160& hashScript, CAddressBalance& balance);
+    bool UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> >& vSpent);
+    bool ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value);
+    bool WriteTimestampIndex(const CTimestampIndexKey& key, unsigned int nLogicalTime);
+    bool ReadTimestampIndex(unsigned int nLow, unsigned int nHigh, std::vector<std::pair<CTimestampIndexKey, unsigned int> >& vBlocks);
+    bool ReadLogicalTimestamp(const uint256& hashBlock, unsigned int& nLogicalTime);
+    bool WriteIndexBuilderEntries(const CIndexBuilderEntries& entries, const std::vector<std::string>& vIndexes, const uint256& hashCursor);
+    bool ReadIndexCursor(const std::string& name, uint256& hashBlock);
+    bool EraseIndexCursor(const std::string& name);
+    bool ReadIndexTxHeight(const uint256& txid, int& nHeight);
+    bool EraseIndexPrefix(char chPrefix);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -81,14 +153,19 @@ public:
 private:
     CZerocoinDB(const CZerocoinDB&);
     void operator=(const CZerocoinDB&);
+    bool ReadHashes(char chType, const std::vector<uint256>& vHashes, std::map<uint256, uint256>& mapTxHashes);
 
 public:
     bool WriteCoinMint(const libzerocoin::PublicCoin& pubCoin, const uint256& txHash);
     bool ReadCoinMint(const CBigNum& bnPubcoin, uint256& txHash);
     bool ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx);
+    /** The mint txids of the pubcoins found, looked up in one pass over the database in key order */
+    bool ReadCoinMints(const std::vector<uint256>& vHashPubcoin, std::map<uint256, uint256>& mapTxHashes);
     bool WriteCoinSpend(const CBigNum& bnSerial, const uint256& txHash);
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
     bool ReadCoinSpend(const uint256& hashSerial, uint256 &txHash);
+    /** The spend txids of the serials found, looked up in one pass over the database in key order */
+    bool ReadCoinSpends(const std::vector<uint256>& vHashSerial, std::map<uint256, uint256>& mapTxHashes);
     bool EraseCoinMint(const CBigNum& bnPubcoin);
     bool EraseCoinSpend(const CBigNum& bnSerial);
     bool WipeCoins(std::string strType);
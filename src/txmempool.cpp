@@ -15,8 +15,6 @@
 #include "utilmoneystr.h"
 #include "version.h"
 
-#include <boost/circular_buffer.hpp>
-
 using namespace std;
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
@@ -26,12 +24,14 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     sigOpCost(_sigOpsCost)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = tx.CalculateModifiedSize(nTxSize);
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
     nTxCost = GetTransactionCost(_tx);
+    nModSize = tx.CalculateModifiedSize(nTxSize);
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -56,160 +56,437 @@ double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 }
 
 /**
- * Keep track of fee/priority for transactions confirmed within N blocks
+ * Exponentially decaying statistics of how many blocks transactions took to
+ * confirm, grouped in buckets by fee rate (or priority).
+ *
+ * Recording a transaction and removing it again only touches its own bucket,
+ * so the work done per transaction does not depend on the size of the
+ * mempool or on how many samples have been collected. The decay is applied
+ * once per block over the fixed number of buckets.
  */
-class CBlockAverage
+class TxConfirmStats
 {
 private:
-    boost::circular_buffer<CFeeRate> feeSamples;
-    boost::circular_buffer<double> prioritySamples;
+    //! Upper bound of each bucket, the last one is the catch-all
+    std::vector<double> buckets;
+    std::map<double, unsigned int> bucketMap;
 
-    template <typename T>
-    std::vector<T> buf2vec(boost::circular_buffer<T> buf) const
-    {
-        std::vector<T> vec(buf.begin(), buf.end());
-        return vec;
-    }
+    //! Decayed count of transactions per bucket that confirmed at all
+    std::vector<double> txCtAvg;
+    std::vector<int> curBlockTxCt;
 
-public:
-    CBlockAverage() : feeSamples(100), prioritySamples(100) {}
+    //! confAvg[Y][X]: decayed count of transactions in bucket X that confirmed within Y+1 blocks
+    std::vector<std::vector<double> > confAvg;
+    std::vector<std::vector<int> > curBlockConf;
+
+    //! Decayed sum of the values (fee rates or priorities) recorded in each bucket
+    std::vector<double> avg;
+    std::vector<double> curBlockVal;
+
+    double decay;
+
+    //! Mempool transactions that are not confirmed yet, by entry height modulo the number of tracked blocks
+    std::vector<std::vector<int> > unconfTxs;
+    //! ... and those that have been in the mempool for longer than that
+    std::vector<int> oldUnconfTxs;
+
+    std::string dataTypeString;
 
-    void RecordFee(const CFeeRate& feeRate)
+public:
+    void Initialize(std::vector<double>& defaultBuckets, unsigned int maxConfirms, double _decay, std::string _dataTypeString)
     {
-        feeSamples.push_back(feeRate);
+        decay = _decay;
+        dataTypeString = _dataTypeString;
+        buckets.clear();
+        bucketMap.clear();
+        for (unsigned int i = 0; i < defaultBuckets.size(); i++) {
+            buckets.push_back(defaultBuckets[i]);
+            bucketMap[defaultBuckets[i]] = i;
+        }
+        confAvg.assign(maxConfirms, std::vector<double>(buckets.size(), 0));
+        curBlockConf.assign(maxConfirms, std::vector<int>(buckets.size(), 0));
+        unconfTxs.assign(maxConfirms, std::vector<int>(buckets.size(), 0));
+        oldUnconfTxs.assign(buckets.size(), 0);
+        curBlockTxCt.assign(buckets.size(), 0);
+        txCtAvg.assign(buckets.size(), 0);
+        curBlockVal.assign(buckets.size(), 0);
+        avg.assign(buckets.size(), 0);
     }
 
-    void RecordPriority(double priority)
+    unsigned int GetMaxConfirms() const { return confAvg.size(); }
+
+    /** Roll the circular unconfirmed buffer and reset the per-block counters for a new block */
+    void ClearCurrent(unsigned int nBlockHeight)
     {
-        prioritySamples.push_back(priority);
+        for (unsigned int j = 0; j < buckets.size(); j++) {
+            oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
+            unconfTxs[nBlockHeight % unconfTxs.size()][j] = 0;
+            for (unsigned int i = 0; i < curBlockConf.size(); i++)
+                curBlockConf[i][j] = 0;
+            curBlockTxCt[j] = 0;
+            curBlockVal[j] = 0;
+        }
     }
 
-    size_t FeeSamples() const { return feeSamples.size(); }
-    size_t GetFeeSamples(std::vector<CFeeRate>& insertInto) const
+    /** Record a transaction with the given value that took blocksToConfirm blocks to confirm */
+    void Record(int blocksToConfirm, double val)
     {
-        for (const CFeeRate& f : feeSamples)
-            insertInto.push_back(f);
-        return feeSamples.size();
+        if (blocksToConfirm < 1)
+            return;
+        unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+        for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++)
+            curBlockConf[i - 1][bucketindex]++;
+        curBlockTxCt[bucketindex]++;
+        curBlockVal[bucketindex] += val;
     }
-    size_t PrioritySamples() const { return prioritySamples.size(); }
-    size_t GetPrioritySamples(std::vector<double>& insertInto) const
+
+    /** Fold the counters of the current block into the moving averages */
+    void UpdateMovingAverages()
     {
-        for (double d : prioritySamples)
-            insertInto.push_back(d);
-        return prioritySamples.size();
+        for (unsigned int j = 0; j < buckets.size(); j++) {
+            for (unsigned int i = 0; i < confAvg.size(); i++)
+                confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
+            avg[j] = avg[j] * decay + curBlockVal[j];
+            txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
+        }
     }
 
-    /**
-     * Used as belt-and-suspenders check when reading to detect
-     * file corruption
-     */
-    static bool AreSane(const CFeeRate fee, const CFeeRate& minRelayFee)
+    /** Track a new unconfirmed mempool transaction, returns the bucket it was put in */
+    unsigned int NewTx(unsigned int nBlockHeight, double val)
     {
-        if (fee < CFeeRate(0))
-            return false;
-        if (fee.GetFeePerK() > minRelayFee.GetFeePerK() * 10000)
-            return false;
-        return true;
+        unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+        unsigned int blockIndex = nBlockHeight % unconfTxs.size();
+        unconfTxs[blockIndex][bucketindex]++;
+        return bucketindex;
     }
-    static bool AreSane(const std::vector<CFeeRate>& vecFee, const CFeeRate& minRelayFee)
+
+    /** Stop tracking an unconfirmed mempool transaction */
+    void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight, unsigned int bucketindex)
     {
-        for (CFeeRate fee : vecFee) {
-            if (!AreSane(fee, minRelayFee))
-                return false;
+        // nBestSeenHeight is not updated yet for the new block
+        int blocksAgo = nBestSeenHeight - entryHeight;
+        if (nBestSeenHeight == 0) // the BlockPolicyEstimator hasn't seen any blocks yet
+            blocksAgo = 0;
+        if (blocksAgo < 0) {
+            LogPrint("estimatefee", "Blockpolicy error, blocks ago is negative for mempool tx\n");
+            return;
+        }
+
+        if (blocksAgo >= (int)unconfTxs.size()) {
+            if (oldUnconfTxs[bucketindex] > 0)
+                oldUnconfTxs[bucketindex]--;
+        } else {
+            unsigned int blockIndex = entryHeight % unconfTxs.size();
+            if (unconfTxs[blockIndex][bucketindex] > 0)
+                unconfTxs[blockIndex][bucketindex]--;
         }
-        return true;
-    }
-    static bool AreSane(const double priority)
-    {
-        return priority >= 0;
     }
-    static bool AreSane(const std::vector<double> vecPriority)
+
+    /**
+     * Find the lowest value (highest when requireGreater is false) such that
+     * the transactions in all buckets beyond it confirmed within confTarget
+     * blocks at least successBreakPoint of the time. Buckets are combined until
+     * they hold at least sufficientTxVal decayed samples. Returns -1 when no
+     * range of buckets qualifies.
+     */
+    double EstimateMedianVal(int confTarget, double sufficientTxVal, double successBreakPoint,
+                             bool requireGreater, unsigned int nBlockHeight) const
     {
-        for (double priority : vecPriority) {
-            if (!AreSane(priority))
-                return false;
+        double nConf = 0;    // Number of tx's confirmed within the confTarget
+        double totalNum = 0; // Total number of tx's that were ever confirmed
+        int extraNum = 0;    // Number of tx's still in mempool for confTarget or longer
+
+        int maxbucketindex = buckets.size() - 1;
+
+        // requireGreater means we are looking for the lowest fee/priority such that all higher
+        // values pass, so we start at maxbucketindex (highest fee) and look at successively
+        // smaller buckets until we reach failure. Otherwise, we are looking for the highest
+        // fee/priority such that all lower values fail, and we go in the opposite direction.
+        unsigned int startbucket = requireGreater ? maxbucketindex : 0;
+        int step = requireGreater ? -1 : 1;
+
+        // The cur variables are the range of buckets we are currently combining,
+        // the best variables the last range that still had a high enough confirmation rate.
+        unsigned int curNearBucket = startbucket;
+        unsigned int bestNearBucket = startbucket;
+        unsigned int curFarBucket = startbucket;
+        unsigned int bestFarBucket = startbucket;
+
+        bool foundAnswer = false;
+        unsigned int bins = unconfTxs.size();
+
+        for (int bucket = startbucket; bucket >= 0 && bucket <= maxbucketindex; bucket += step) {
+            curFarBucket = bucket;
+            nConf += confAvg[confTarget - 1][bucket];
+            totalNum += txCtAvg[bucket];
+            for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
+                extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
+            extraNum += oldUnconfTxs[bucket];
+            // Only count the confirmed data points when deciding whether there is enough
+            // data, so every confirmation target looks at the same bucket breaks
+            if (totalNum >= sufficientTxVal / (1 - decay)) {
+                double curPct = nConf / (totalNum + extraNum);
+
+                if (requireGreater && curPct < successBreakPoint)
+                    break;
+                if (!requireGreater && curPct > successBreakPoint)
+                    break;
+
+                foundAnswer = true;
+                nConf = 0;
+                totalNum = 0;
+                extraNum = 0;
+                bestNearBucket = curNearBucket;
+                bestFarBucket = curFarBucket;
+                curNearBucket = bucket + step;
+            }
         }
-        return true;
+
+        // We don't keep individual samples, so report the average value of the
+        // bucket holding the median transaction of the best range.
+        double median = -1;
+        double txSum = 0;
+        unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
+        unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
+        for (unsigned int j = minBucket; j <= maxBucket; j++)
+            txSum += txCtAvg[j];
+        if (foundAnswer && txSum != 0) {
+            txSum = txSum / 2;
+            for (unsigned int j = minBucket; j <= maxBucket; j++) {
+                if (txCtAvg[j] < txSum) {
+                    txSum -= txCtAvg[j];
+                } else {
+                    median = avg[j] / txCtAvg[j];
+                    break;
+                }
+            }
+        }
+
+        LogPrint("estimatefee", "%3d: For conf success %s %4.2f need %s %s: %12.5g from buckets %8g - %8g\n",
+                 confTarget, requireGreater ? ">" : "<", successBreakPoint, dataTypeString,
+                 requireGreater ? ">" : "<", median, buckets[minBucket], buckets[maxBucket]);
+
+        return median;
     }
 
     void Write(CAutoFile& fileout) const
     {
-        std::vector<CFeeRate> vecFee = buf2vec(feeSamples);
-        fileout << vecFee;
-        std::vector<double> vecPriority = buf2vec(prioritySamples);
-        fileout << vecPriority;
+        fileout << decay;
+        fileout << buckets;
+        fileout << avg;
+        fileout << txCtAvg;
+        fileout << confAvg;
     }
 
-    void Read(CAutoFile& filein, const CFeeRate& minRelayFee)
+    /**
+     * Read saved state. The buckets are part of the file so they can change
+     * between versions; unconfirmed counts are not saved since the mempool is not.
+     */
+    void Read(CAutoFile& filein)
     {
-        std::vector<CFeeRate> vecFee;
-        filein >> vecFee;
-        if (AreSane(vecFee, minRelayFee))
-            feeSamples.insert(feeSamples.end(), vecFee.begin(), vecFee.end());
-        else
-            throw runtime_error("Corrupt fee value in estimates file.");
-        std::vector<double> vecPriority;
-        filein >> vecPriority;
-        if (AreSane(vecPriority))
-            prioritySamples.insert(prioritySamples.end(), vecPriority.begin(), vecPriority.end());
-        else
-            throw runtime_error("Corrupt priority value in estimates file.");
-        if (feeSamples.size() + prioritySamples.size() > 0)
-            LogPrint("estimatefee", "Read %d fee samples and %d priority samples\n",
-                feeSamples.size(), prioritySamples.size());
+        double fileDecay;
+        size_t maxConfirms;
+        size_t numBuckets;
+        std::vector<double> fileBuckets;
+        std::vector<double> fileAvg;
+        std::vector<std::vector<double> > fileConfAvg;
+        std::vector<double> fileTxCtAvg;
+
+        filein >> fileDecay;
+        if (fileDecay <= 0 || fileDecay >= 1)
+            throw runtime_error("Corrupt estimates file. Decay must be between 0 and 1 (non-inclusive)");
+        filein >> fileBuckets;
+        numBuckets = fileBuckets.size();
+        if (numBuckets <= 1 || numBuckets > 1000)
+            throw runtime_error("Corrupt estimates file. Must have between 2 and 1000 fee/pri buckets");
+        filein >> fileAvg;
+        if (fileAvg.size() != numBuckets)
+            throw runtime_error("Corrupt estimates file. Mismatch in fee/pri average bucket count");
+        filein >> fileTxCtAvg;
+        if (fileTxCtAvg.size() != numBuckets)
+            throw runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
+        filein >> fileConfAvg;
+        maxConfirms = fileConfAvg.size();
+        if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) // one week
+            throw runtime_error("Corrupt estimates file. Must maintain estimates for between 1 and 1008 (one week) confirms");
+        for (unsigned int i = 0; i < maxConfirms; i++) {
+            if (fileConfAvg[i].size() != numBuckets)
+                throw runtime_error("Corrupt estimates file. Mismatch in fee/pri conf average bucket count");
+        }
+
+        // Now that we've processed the entire data and not thrown any errors,
+        // we can copy it to our data structures
+        Initialize(fileBuckets, maxConfirms, fileDecay, dataTypeString);
+        avg = fileAvg;
+        confAvg = fileConfAvg;
+        txCtAvg = fileTxCtAvg;
+
+        LogPrint("estimatefee", "Reading estimates: %u %s buckets counting confirms up to %u blocks\n",
+                 numBuckets, dataTypeString, maxConfirms);
     }
 };
 
+/** Decay of 0.998 is a half-life of 346 blocks or about 2.4 days */
+static const double DEFAULT_DECAY = .998;
+/** Require greater than 95% of X feerate transactions to be confirmed within Y blocks for X to be big enough */
+static const double MIN_SUCCESS_PCT = .95;
+/** Require an avg of 1 tx in the combined feerate bucket per block to have stat significance */
+static const double SUFFICIENT_FEETXS = 1;
+/** Require only an avg of 1 tx every 5 blocks in the combined pri bucket (way less pri txs) */
+static const double SUFFICIENT_PRITXS = .2;
+
+// Minimum and maximum values for tracking feerates
+static const double MIN_FEERATE = 10;
+static const double MAX_FEERATE = 1e9;
+static const double INF_FEERATE = 1e99;
+static const double INF_PRIORITY = 1e99;
+// Minimum and maximum values for tracking priorities
+static const double MIN_PRIORITY = 10;
+static const double MAX_PRIORITY = 1e16;
+// We have to lump transactions into buckets based on feerate or priority, but we want to be able
+// to give accurate estimates over a large range of potential feerates and priorities.
+// Therefore it makes sense to exponentially space the buckets
+static const double FEE_SPACING = 1.1;
+static const double PRI_SPACING = 2;
+
+/**
+ * Estimates the fee rate and priority needed for a transaction to confirm
+ * within a number of blocks, from the transactions this node saw enter the
+ * mempool and later confirm. Has its own lock so estimates can be served
+ * without holding the mempool lock.
+ */
 class CMinerPolicyEstimator
 {
 private:
-    /**
-     * Records observed averages transactions that confirmed within one block, two blocks,
-     * three blocks etc.
-     */
-    std::vector<CBlockAverage> history;
-    std::vector<CFeeRate> sortedFeeSamples;
-    std::vector<double> sortedPrioritySamples;
+    struct TxStatsInfo {
+        TxConfirmStats* stats;
+        unsigned int blockHeight;
+        unsigned int bucketIndex;
+        TxStatsInfo() : stats(NULL), blockHeight(0), bucketIndex(0) {}
+    };
+
+    mutable CCriticalSection cs;
+    unsigned int nBestSeenHeight;
+    CFeeRate minTrackedFee;
+    double minTrackedPriority;
+    std::map<uint256, TxStatsInfo> mapMemPoolTxs;
+    TxConfirmStats feeStats;
+    TxConfirmStats priStats;
+
+    bool isFeeDataPoint(const CFeeRate& fee, double pri) const
+    {
+        return (pri < minTrackedPriority && fee >= minTrackedFee);
+    }
 
-    int nBestSeenHeight;
+    bool isPriDataPoint(const CFeeRate& fee, double pri) const
+    {
+        return (fee < minTrackedFee && pri >= minTrackedPriority);
+    }
 
-    /**
-     * nBlocksAgo is 0 based, i.e. transactions that confirmed in the highest seen block are
-     * nBlocksAgo == 0, transactions in the block before that are nBlocksAgo == 1 etc.
-     */
-    void seenTxConfirm(const CFeeRate& feeRate, const CFeeRate& minRelayFee, double dPriority, int nBlocksAgo)
+    bool removeTxInternal(const uint256& hash)
+    {
+        std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
+        if (pos == mapMemPoolTxs.end())
+            return false;
+        pos->second.stats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex);
+        mapMemPoolTxs.erase(pos);
+        return true;
+    }
+
+    void processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry& entry)
     {
-        // Last entry records "everything else".
-        int nBlocksTruncated = min(nBlocksAgo, (int)history.size() - 1);
-        assert(nBlocksTruncated >= 0);
-
-        // We need to guess why the transaction was included in a block-- either
-        // because it is high-priority or because it has sufficient fees.
-        bool sufficientFee = (feeRate > minRelayFee);
-        bool sufficientPriority = AllowFree(dPriority);
-        const char* assignedTo = "unassigned";
-        if (sufficientFee && !sufficientPriority && CBlockAverage::AreSane(feeRate, minRelayFee)) {
-            history[nBlocksTruncated].RecordFee(feeRate);
-            assignedTo = "fee";
-        } else if (sufficientPriority && !sufficientFee && CBlockAverage::AreSane(dPriority)) {
-            history[nBlocksTruncated].RecordPriority(dPriority);
-            assignedTo = "priority";
+        // Only transactions we saw enter the mempool tell us how long they took
+        if (!removeTxInternal(entry.GetTx().GetHash()))
+            return;
+
+        // How many blocks did it take for miners to include this transaction?
+        // blocksToConfirm is 1-based, so a transaction included in the earliest
+        // possible block has confirmation count of 1
+        int blocksToConfirm = nBlockHeight - entry.GetHeight();
+        if (blocksToConfirm <= 0) {
+            // This can't happen because we don't process transactions from a block with a height
+            // lower than our greatest seen height
+            LogPrint("estimatefee", "Blockpolicy error Transaction had negative blocksToConfirm\n");
+            return;
+        }
+
+        CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+        double curPri = entry.GetPriority(entry.GetHeight());
+
+        if (entry.GetFee() == 0 || isPriDataPoint(feeRate, curPri))
+            priStats.Record(blocksToConfirm, curPri);
+        else if (isFeeDataPoint(feeRate, curPri))
+            feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    }
+
+public:
+    CMinerPolicyEstimator(const CFeeRate& _minRelayFee, unsigned int nMaxConfirms) : nBestSeenHeight(0)
+    {
+        minTrackedFee = _minRelayFee < CFeeRate(MIN_FEERATE) ? CFeeRate(MIN_FEERATE) : _minRelayFee;
+        std::vector<double> vfeelist;
+        for (double bucketBoundary = minTrackedFee.GetFeePerK(); bucketBoundary <= MAX_FEERATE; bucketBoundary *= FEE_SPACING)
+            vfeelist.push_back(bucketBoundary);
+        vfeelist.push_back(INF_FEERATE);
+        feeStats.Initialize(vfeelist, nMaxConfirms, DEFAULT_DECAY, "FeeRate");
+
+        minTrackedPriority = AllowFreeThreshold() < MIN_PRIORITY ? MIN_PRIORITY : AllowFreeThreshold();
+        std::vector<double> vprilist;
+        for (double bucketBoundary = minTrackedPriority; bucketBoundary <= MAX_PRIORITY; bucketBoundary *= PRI_SPACING)
+            vprilist.push_back(bucketBoundary);
+        vprilist.push_back(INF_PRIORITY);
+        priStats.Initialize(vprilist, nMaxConfirms, DEFAULT_DECAY, "Priority");
+    }
+
+    /** Start tracking a transaction that entered the mempool */
+    void processTransaction(const CTxMemPoolEntry& entry)
+    {
+        LOCK(cs);
+        unsigned int txHeight = entry.GetHeight();
+        uint256 hash = entry.GetTx().GetHash();
+        if (mapMemPoolTxs.count(hash)) {
+            LogPrint("estimatefee", "Blockpolicy error mempool tx %s already being tracked\n", hash.ToString());
+            return;
+        }
+
+        if (txHeight < nBestSeenHeight) {
+            // Ignore side chains and re-orgs; assuming they are random they don't
+            // affect the estimate. We'll potentially double count transactions in 1-block reorgs.
+            return;
+        }
+
+        // Fees are stored and reported as uOHMC-per-kb:
+        CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
+        // Want the priority of the tx at confirmation. However we don't know
+        // what that will be and its too hard to continue updating it
+        // so use starting priority as a proxy
+        double curPri = entry.GetPriority(txHeight);
+
+        TxStatsInfo& info = mapMemPoolTxs[hash];
+        info.blockHeight = txHeight;
+        if (entry.GetFee() == 0 || isPriDataPoint(feeRate, curPri)) {
+            info.stats = &priStats;
+            info.bucketIndex = priStats.NewTx(txHeight, curPri);
+        } else if (isFeeDataPoint(feeRate, curPri)) {
+            info.stats = &feeStats;
+            info.bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
         } else {
             // Neither or both fee and priority sufficient to get confirmed:
             // don't know why they got confirmed.
+            mapMemPoolTxs.erase(hash);
         }
-        LogPrint("estimatefee", "Seen TX confirm: %s : %s fee/%g priority, took %d blocks\n",
-            assignedTo, feeRate.ToString(), dPriority, nBlocksAgo);
     }
 
-public:
-    CMinerPolicyEstimator(int nEntries) : nBestSeenHeight(0)
+    /** Stop tracking a transaction that left the mempool without being mined */
+    void removeTx(const uint256& hash)
     {
-        history.resize(nEntries);
+        LOCK(cs);
+        removeTxInternal(hash);
     }
 
-    void seenBlock(const std::vector<CTxMemPoolEntry>& entries, int nBlockHeight, const CFeeRate minRelayFee)
+    /** Process the mempool entries of the transactions included in a new block */
+    void processBlock(unsigned int nBlockHeight, const std::vector<CTxMemPoolEntry>& entries)
     {
+        LOCK(cs);
         if (nBlockHeight <= nBestSeenHeight) {
             // Ignore side chains and re-orgs; assuming they are random
             // they don't affect the estimate.
@@ -220,155 +497,79 @@ public:
         }
         nBestSeenHeight = nBlockHeight;
 
-        // Fill up the history buckets based on how long transactions took
-        // to confirm.
-        std::vector<std::vector<const CTxMemPoolEntry*> > entriesByConfirmations;
-        entriesByConfirmations.resize(history.size());
-        for (const CTxMemPoolEntry& entry : entries) {
-            // How many blocks did it take for miners to include this transaction?
-            int delta = nBlockHeight - entry.GetHeight();
-            if (delta <= 0) {
-                // Re-org made us lose height, this should only happen if we happen
-                // to re-org on a difficulty transition point: very rare!
-                continue;
-            }
-            if ((delta - 1) >= (int)history.size())
-                delta = history.size(); // Last bucket is catch-all
-            entriesByConfirmations.at(delta - 1).push_back(&entry);
-        }
-        for (size_t i = 0; i < entriesByConfirmations.size(); i++) {
-            std::vector<const CTxMemPoolEntry*>& e = entriesByConfirmations.at(i);
-            // Insert at most 10 random entries per bucket, otherwise a single block
-            // can dominate an estimate:
-            if (e.size() > 10) {
-                std::random_shuffle(e.begin(), e.end());
-                e.resize(10);
-            }
-            for (const CTxMemPoolEntry* entry : e) {
-                // Fees are stored and reported as BTC-per-kb:
-                CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
-                double dPriority = entry->GetPriority(entry->GetHeight()); // Want priority when it went IN
-                seenTxConfirm(feeRate, minRelayFee, dPriority, i);
-            }
-        }
+        // Clear the current block states
+        feeStats.ClearCurrent(nBlockHeight);
+        priStats.ClearCurrent(nBlockHeight);
 
-        //After new samples are added, we have to clear the sorted lists,
-        //so they'll be resorted the next time someone asks for an estimate
-        sortedFeeSamples.clear();
-        sortedPrioritySamples.clear();
-
-        for (size_t i = 0; i < history.size(); i++) {
-            if (history[i].FeeSamples() + history[i].PrioritySamples() > 0)
-                LogPrint("estimatefee", "estimates: for confirming within %d blocks based on %d/%d samples, fee=%s, prio=%g\n",
-                    i,
-                    history[i].FeeSamples(), history[i].PrioritySamples(),
-                    estimateFee(i + 1).ToString(), estimatePriority(i + 1));
-        }
+        // Repopulate the current block states
+        for (const CTxMemPoolEntry& entry : entries)
+            processBlockTx(nBlockHeight, entry);
+
+        // Update all exponential averages with the current block states
+        feeStats.UpdateMovingAverages();
+        priStats.UpdateMovingAverages();
+
+        LogPrint("estimatefee", "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n",
+                 entries.size(), mapMemPoolTxs.size());
     }
 
     /**
-     * Can return CFeeRate(0) if we don't have any data for that many blocks back. nBlocksToConfirm is 1 based.
+     * Can return CFeeRate(0) if we don't have enough data for that many blocks.
+     * nBlocksToConfirm is 1 based, dConfidence the required share of transactions
+     * at the returned fee rate that confirmed within nBlocksToConfirm blocks.
      */
-    CFeeRate estimateFee(int nBlocksToConfirm)
+    CFeeRate estimateFee(int nBlocksToConfirm, double dConfidence) const
     {
-        nBlocksToConfirm--;
-
-        if (nBlocksToConfirm < 0 || nBlocksToConfirm >= (int)history.size())
+        LOCK(cs);
+        // Return failure if trying to analyze a target we're not tracking
+        if (nBlocksToConfirm <= 0 || (unsigned int)nBlocksToConfirm > feeStats.GetMaxConfirms())
             return CFeeRate(0);
 
-        if (sortedFeeSamples.size() == 0) {
-            for (size_t i = 0; i < history.size(); i++)
-                history.at(i).GetFeeSamples(sortedFeeSamples);
-            std::sort(sortedFeeSamples.begin(), sortedFeeSamples.end(),
-                std::greater<CFeeRate>());
-        }
-        if (sortedFeeSamples.size() < 11) {
-            // Eleven is Gavin's Favorite Number
-            // ... but we also take a maximum of 10 samples per block so eleven means
-            // we're getting samples from at least two different blocks
+        double median = feeStats.EstimateMedianVal(nBlocksToConfirm, SUFFICIENT_FEETXS, dConfidence, true, nBestSeenHeight);
+        if (median < 0)
             return CFeeRate(0);
-        }
 
-        int nBucketSize = history.at(nBlocksToConfirm).FeeSamples();
-
-        // Estimates should not increase as number of confirmations goes up,
-        // but the estimates are noisy because confirmations happen discretely
-        // in blocks. To smooth out the estimates, use all samples in the history
-        // and use the nth highest where n is (number of samples in previous bucket +
-        // half the samples in nBlocksToConfirm bucket):
-        size_t nPrevSize = 0;
-        for (int i = 0; i < nBlocksToConfirm; i++)
-            nPrevSize += history.at(i).FeeSamples();
-        size_t index = min(nPrevSize + nBucketSize / 2, sortedFeeSamples.size() - 1);
-        return sortedFeeSamples[index];
+        return CFeeRate(median);
     }
-    double estimatePriority(int nBlocksToConfirm)
-    {
-        nBlocksToConfirm--;
 
-        if (nBlocksToConfirm < 0 || nBlocksToConfirm >= (int)history.size())
+    /** Returns -1 if we don't have enough data for that many blocks */
+    double estimatePriority(int nBlocksToConfirm, double dConfidence) const
+    {
+        LOCK(cs);
+        // Return failure if trying to analyze a target we're not tracking
+        if (nBlocksToConfirm <= 0 || (unsigned int)nBlocksToConfirm > priStats.GetMaxConfirms())
             return -1;
 
-        if (sortedPrioritySamples.size() == 0) {
-            for (size_t i = 0; i < history.size(); i++)
-                history.at(i).GetPrioritySamples(sortedPrioritySamples);
-            std::sort(sortedPrioritySamples.begin(), sortedPrioritySamples.end(),
-                std::greater<double>());
-        }
-        if (sortedPrioritySamples.size() < 11)
-            return -1.0;
-
-        int nBucketSize = history.at(nBlocksToConfirm).PrioritySamples();
-
-        // Estimates should not increase as number of confirmations needed goes up,
-        // but the estimates are noisy because confirmations happen discretely
-        // in blocks. To smooth out the estimates, use all samples in the history
-        // and use the nth highest where n is (number of samples in previous buckets +
-        // half the samples in nBlocksToConfirm bucket).
-        size_t nPrevSize = 0;
-        for (int i = 0; i < nBlocksToConfirm; i++)
-            nPrevSize += history.at(i).PrioritySamples();
-        size_t index = min(nPrevSize + nBucketSize / 2, sortedPrioritySamples.size() - 1);
-        return sortedPrioritySamples[index];
+        return priStats.EstimateMedianVal(nBlocksToConfirm, SUFFICIENT_PRITXS, dConfidence, true, nBestSeenHeight);
     }
 
     void Write(CAutoFile& fileout) const
     {
+        LOCK(cs);
         fileout << nBestSeenHeight;
-        fileout << history.size();
-        for (const CBlockAverage& entry : history) {
-            entry.Write(fileout);
-        }
+        feeStats.Write(fileout);
+        priStats.Write(fileout);
     }
 
-    void Read(CAutoFile& filein, const CFeeRate& minRelayFee)
+    void Read(CAutoFile& filein)
     {
         int nFileBestSeenHeight;
         filein >> nFileBestSeenHeight;
-        size_t numEntries;
-        filein >> numEntries;
-        if (numEntries <= 0 || numEntries > 10000)
-            throw runtime_error("Corrupt estimates file. Must have between 1 and 10k entries.");
-
-        std::vector<CBlockAverage> fileHistory;
-
-        for (size_t i = 0; i < numEntries; i++) {
-            CBlockAverage entry;
-            entry.Read(filein, minRelayFee);
-            fileHistory.push_back(entry);
-        }
+        TxConfirmStats fileFeeStats(feeStats), filePriStats(priStats);
+        fileFeeStats.Read(filein);
+        filePriStats.Read(filein);
 
-        // Now that we've processed the entire fee estimate data file and not
-        // thrown any errors, we can copy it to our history
+        LOCK(cs);
+        feeStats = fileFeeStats;
+        priStats = filePriStats;
         nBestSeenHeight = nFileBestSeenHeight;
-        history = fileHistory;
-        assert(history.size() > 0);
     }
 };
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       nSequence(1)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -380,7 +581,7 @@ CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
     // to wait a day or two to save a fraction of a penny in fees.
     // Confirmation times for very-low-fee transactions that take more
     // than an hour or three to confirm are highly variable.
-    minerPolicyEstimator = new CMinerPolicyEstimator(25);
+    minerPolicyEstimator = new CMinerPolicyEstimator(_minRelayFee, 25);
 }
 
 CTxMemPool::~CTxMemPool()
@@ -401,6 +602,21 @@ void CTxMemPool::pruneSpent(const uint256& hashTx, CCoins& coins)
     }
 }
 
+const char* GetMemPoolRemovalReasonName(MemPoolRemovalReason reason)
+{
+    switch (reason) {
+    case MemPoolRemovalReason::UNKNOWN:
+        return "unknown";
+    case MemPoolRemovalReason::REORG:
+        return "reorg";
+    case MemPoolRemovalReason::BLOCK:
+        return "block";
+    case MemPoolRemovalReason::CONFLICT:
+        return "conflict";
+    }
+    return "unknown";
+}
+
 unsigned int CTxMemPool::GetTransactionsUpdated() const
 {
     LOCK(cs);
@@ -429,12 +645,14 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
         }
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
+        minerPolicyEstimator->processTransaction(mapTx[hash]);
+        NotifyEntryAdded(tx, nSequence++);
     }
     return true;
 }
 
 
-void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
+void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
     {
@@ -471,9 +689,11 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 mapNextTx.erase(txin.prevout);
 
             removed.push_back(tx);
+            NotifyEntryRemoved(tx, reason, nSequence++);
             totalTxSize -= mapTx[hash].GetTxSize();
             mapTx.erase(hash);
             nTransactionsUpdated++;
+            minerPolicyEstimator->removeTx(hash);
         }
     }
 }
@@ -499,7 +719,7 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
     }
     for (const CTransaction& tx : transactionsToRemove) {
         list<CTransaction> removed;
-        remove(tx, removed, true);
+        remove(tx, removed, true, MemPoolRemovalReason::REORG);
     }
 }
 
@@ -513,7 +733,7 @@ void CTxMemPool::removeConflicts(const CTransaction& tx, std::list<CTransaction>
         if (it != mapNextTx.end()) {
             const CTransaction& txConflict = *it->second;
             if (txConflict != tx) {
-                remove(txConflict, removed, true);
+                remove(txConflict, removed, true, MemPoolRemovalReason::CONFLICT);
             }
         }
     }
@@ -531,10 +751,10 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         if (mapTx.count(hash))
             entries.push_back(mapTx[hash]);
     }
-    minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
+    minerPolicyEstimator->processBlock(nBlockHeight, entries);
     for (const CTransaction& tx : vtx) {
         std::list<CTransaction> dummy;
-        remove(tx, dummy, false);
+        remove(tx, dummy, false, MemPoolRemovalReason::BLOCK);
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
@@ -651,23 +871,31 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
-CFeeRate CTxMemPool::estimateFee(int nBlocks) const
+bool CTxMemPool::lookupFeeRate(const uint256& hash, CFeeRate& feeRate, int64_t& nTime) const
 {
     LOCK(cs);
-    return minerPolicyEstimator->estimateFee(nBlocks);
+    map<uint256, CTxMemPoolEntry>::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end()) return false;
+    feeRate = CFeeRate(i->second.GetFee(), i->second.GetTxSize());
+    nTime = i->second.GetTime();
+    return true;
 }
-double CTxMemPool::estimatePriority(int nBlocks) const
+
+CFeeRate CTxMemPool::estimateFee(int nBlocks, double dConfidence) const
 {
-    LOCK(cs);
-    return minerPolicyEstimator->estimatePriority(nBlocks);
+    // The estimator has its own lock, estimates don't need the mempool lock
+    return minerPolicyEstimator->estimateFee(nBlocks, dConfidence);
+}
+double CTxMemPool::estimatePriority(int nBlocks, double dConfidence) const
+{
+    return minerPolicyEstimator->estimatePriority(nBlocks, dConfidence);
 }
 
 bool CTxMemPool::WriteFeeEstimates(CAutoFile& fileout) const
 {
     try {
-        LOCK(cs);
-        fileout << 120000;         // version required to read: 0.12.00 or later
-        fileout << CLIENT_VERSION; // version that wrote the file
+        fileout << FEE_ESTIMATES_VERSION; // version required to read
+        fileout << CLIENT_VERSION;        // version that wrote the file
         minerPolicyEstimator->Write(fileout);
     } catch (const std::exception&) {
         LogPrintf("CTxMemPool::WriteFeeEstimates() : unable to write policy estimator data (non-fatal)");
@@ -683,9 +911,13 @@ bool CTxMemPool::ReadFeeEstimates(CAutoFile& filein)
         filein >> nVersionRequired >> nVersionThatWrote;
         if (nVersionRequired > CLIENT_VERSION)
             return error("CTxMemPool::ReadFeeEstimates() : up-version (%d) fee estimate file", nVersionRequired);
+        if (nVersionRequired < FEE_ESTIMATES_VERSION) {
+            // Files written before the bucketed estimator hold raw samples we can't use
+            LogPrintf("CTxMemPool::ReadFeeEstimates() : ignoring old format fee estimate file (version %d)\n", nVersionRequired);
+            return true;
+        }
 
-        LOCK(cs);
-        minerPolicyEstimator->Read(filein, minRelayFee);
+        minerPolicyEstimator->Read(filein);
     } catch (const std::exception&) {
         LogPrintf("CTxMemPool::ReadFeeEstimates() : unable to read policy estimator data (non-fatal)");
         return false;
@@ -16,6 +16,8 @@
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <boost/signals2/signal.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -34,6 +36,12 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Version required to read fee_estimates.dat, bumped when the bucketed estimator replaced raw samples */
+static const int FEE_ESTIMATES_VERSION = 3000302;
+
+/** Default share of transactions at the estimated fee rate that confirmed in time */
+static const double FEE_ESTIMATE_CONFIDENCE_DEFAULT = .95;
+
 /**
  * CTxMemPool stores these:
  */
@@ -70,6 +78,16 @@ public:
 
 class CMinerPolicyEstimator;
 
+/** Why a transaction left the memory pool */
+enum class MemPoolRemovalReason {
+    UNKNOWN = 0, //! Removed without a reason being given
+    REORG,       //! Not valid any more after a block was disconnected
+    BLOCK,       //! Included in a connected block
+    CONFLICT,    //! Spends an input also spent by a block or a locked transaction
+};
+
+const char* GetMemPoolRemovalReasonName(MemPoolRemovalReason reason);
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -89,6 +107,7 @@ private:
 
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
+    uint64_t nSequence;   //! bumped by every transaction added or removed
 
 public:
     mutable CCriticalSection cs;
@@ -109,7 +128,7 @@ public:
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
-    void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
+    void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts);
@@ -136,6 +155,13 @@ public:
         return totalTxSize;
     }
 
+    /** Sequence number the next transaction added or removed will be announced with */
+    uint64_t GetSequence() const
+    {
+        LOCK(cs);
+        return nSequence;
+    }
+
     bool exists(uint256 hash)
     {
         LOCK(cs);
@@ -143,16 +169,29 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** Fee rate and entry time of a pool transaction, for ordering and filtering relay. */
+    bool lookupFeeRate(const uint256& hash, CFeeRate& feeRate, int64_t& nTime) const;
 
-    /** Estimate fee rate needed to get into the next nBlocks */
-    CFeeRate estimateFee(int nBlocks) const;
+    /**
+     * Estimate fee rate needed to get into the next nBlocks with the given
+     * probability. Does not take the mempool lock.
+     */
+    CFeeRate estimateFee(int nBlocks, double dConfidence = FEE_ESTIMATE_CONFIDENCE_DEFAULT) const;
 
     /** Estimate priority needed to get into the next nBlocks */
-    double estimatePriority(int nBlocks) const;
+    double estimatePriority(int nBlocks, double dConfidence = FEE_ESTIMATE_CONFIDENCE_DEFAULT) const;
 
     /** Write/Read estimates to disk */
     bool WriteFeeEstimates(CAutoFile& fileout) const;
     bool ReadFeeEstimates(CAutoFile& filein);
+
+    /**
+     * Announce each transaction entering or leaving the pool, with the
+     * sequence number of that change. Both are called with cs held, so
+     * listeners see the changes in sequence order.
+     */
+    boost::signals2::signal<void (const CTransaction&, uint64_t)> NotifyEntryAdded;
+    boost::signals2::signal<void (const CTransaction&, MemPoolRemovalReason, uint64_t)> NotifyEntryRemoved;
 };
 
 /**
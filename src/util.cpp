@@ -41,6 +41,7 @@
 #endif // __linux__
 
 #include <algorithm>
+#include <atomic>
 #include <fcntl.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
@@ -910,6 +911,35 @@ void RenameThread(const char* name)
 #endif
 }
 
+void ParallelFor(size_t nCount, int nThreads, const std::function<void(size_t)>& fn)
+{
+    nThreads = std::max(1, (int)std::min((size_t)nThreads, nCount));
+    std::atomic<size_t> nNext(0);
+    boost::mutex mutexError;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+        try {
+            for (size_t i = nNext++; i < nCount; i = nNext++)
+                fn(i);
+        } catch (...) {
+            boost::lock_guard<boost::mutex> lock(mutexError);
+            if (!error)
+                error = std::current_exception();
+            nNext = nCount;
+        }
+    };
+
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.create_thread(worker);
+    worker();
+    threads.join_all();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
 void SetupEnvironment()
 {
 // On most POSIX systems (e.g. Linux, but not BSD) the environment's locale
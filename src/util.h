@@ -21,6 +21,7 @@
 #include "utiltime.h"
 
 #include <exception>
+#include <functional>
 #include <map>
 #include <stdint.h>
 #include <string>
@@ -229,6 +230,13 @@ void TraceThread(const char* name, Callable func)
     }
 }
 
+/**
+ * Call fn(i) for every i in [0, nCount), spread over up to nThreads threads
+ * (the calling one included), and return when all calls are done. The first
+ * exception thrown by fn stops the remaining calls and is rethrown here.
+ */
+void ParallelFor(size_t nCount, int nThreads, const std::function<void(size_t)>& fn);
+
 /** Parse number as fixed point according to JSON number syntax.
  * See http://json.org/number.gif
  * @returns true on success, false on error.
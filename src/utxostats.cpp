@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "version.h"
+
+/** An unspent output as it enters the rolling hash: outpoint, height and coinbase flag, output */
+static std::vector<unsigned char> SerializeCoin(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << (uint32_t)(nHeight * 2 + (fCoinBase ? 1 : 0));
+    ss << out;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+void CUTXOStats::AddCoin(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase)
+{
+    nTransactionOutputs++;
+    nTotalAmount += out.nValue;
+    muhash.Insert(SerializeCoin(outpoint, out, nHeight, fCoinBase));
+}
+
+void CUTXOStats::RemoveCoin(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase)
+{
+    nTransactionOutputs--;
+    nTotalAmount -= out.nValue;
+    muhash.Remove(SerializeCoin(outpoint, out, nHeight, fCoinBase));
+}
+
+void CUTXOStats::AddTransaction(const CTransaction& tx, int nHeight)
+{
+    // Provably unspendable outputs never make it into the coin database
+    const uint256 hash = tx.GetHash();
+    bool fStored = false;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        if (tx.vout[i].scriptPubKey.IsUnspendable())
+            continue;
+        AddCoin(COutPoint(hash, i), tx.vout[i], nHeight, tx.IsCoinBase());
+        fStored = true;
+    }
+    if (fStored)
+        nTransactions++;
+}
+
+void CUTXOStats::RemoveTransaction(const CTransaction& tx, int nHeight)
+{
+    const uint256 hash = tx.GetHash();
+    bool fStored = false;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        if (tx.vout[i].scriptPubKey.IsUnspendable())
+            continue;
+        RemoveCoin(COutPoint(hash, i), tx.vout[i], nHeight, tx.IsCoinBase());
+        fStored = true;
+    }
+    if (fStored)
+        nTransactions--;
+}
+
+void CUTXOStats::Apply(const CUTXOStats& delta)
+{
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSTATS_H
+#define BITCOIN_UTXOSTATS_H
+
+#include "amount.h"
+#include "muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+class COutPoint;
+class CTransaction;
+class CTxOut;
+
+/**
+ * Totals and rolling hash of the UTXO set, kept up to date by ConnectBlock
+ * and DisconnectBlock and stored with the coin database, so gettxoutsetinfo
+ * doesn't have to walk the chainstate. The counts are signed so that the
+ * changes of a single block can be collected in an object of their own.
+ */
+class CUTXOStats
+{
+public:
+    uint256 hashBlock;
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    CMuHash3072 muhash;
+
+    CUTXOStats() : hashBlock(0), nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase);
+    void RemoveCoin(const COutPoint& outpoint, const CTxOut& out, int nHeight, bool fCoinBase);
+
+    //! Add or remove the outputs a transaction leaves in the UTXO set
+    void AddTransaction(const CTransaction& tx, int nHeight);
+    void RemoveTransaction(const CTransaction& tx, int nHeight);
+
+    //! Apply the changes collected for one block
+    void Apply(const CUTXOStats& delta);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+#endif // BITCOIN_UTXOSTATS_H
@@ -16,8 +16,10 @@ struct CBlockLocator;
 class CBlockIndex;
 class CReserveScript;
 class CTransaction;
+class CTxMemPool;
 class CValidationInterface;
 class uint256;
+enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
@@ -36,6 +38,10 @@ protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
+    virtual void TransactionAddedToMempool(const CTransaction &tx, uint64_t nMempoolSequence) {}
+    virtual void TransactionRemovedFromMempool(const CTransaction &tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {}
+    virtual void BlockConnected(const CBlock &block, const CBlockIndex *pindex) {}
+    virtual void BlockDisconnected(const CBlock &block, const CBlockIndex *pindex) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual bool UpdatedTransaction(const uint256 &hash) { return false;}
     virtual void Inventory(const uint256 &hash) {}
@@ -57,6 +63,14 @@ struct CMainSignals {
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
+    /** Notifies listeners of a transaction entering the mempool, with the mempool sequence number of the change. */
+    boost::signals2::signal<void (const CTransaction &, uint64_t)> TransactionAddedToMempool;
+    /** Notifies listeners of a transaction leaving the mempool, with the mempool sequence number of the change. */
+    boost::signals2::signal<void (const CTransaction &, MemPoolRemovalReason, uint64_t)> TransactionRemovedFromMempool;
+    /** Notifies listeners of a block connected to the active chain, every one of them during a reorg. */
+    boost::signals2::signal<void (const CBlock &, const CBlockIndex *)> BlockConnected;
+    /** Notifies listeners of a block disconnected from the active chain, before its transactions go back to the mempool. */
+    boost::signals2::signal<void (const CBlock &, const CBlockIndex *)> BlockDisconnected;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<bool (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -72,6 +86,10 @@ struct CMainSignals {
 // XX42    boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+
+    /** Forward the mempool's own notifications to TransactionAddedToMempool and TransactionRemovedFromMempool */
+    void RegisterWithMempoolSignals(CTxMemPool& pool);
+    void UnregisterWithMempoolSignals(CTxMemPool& pool);
 };
 
 CMainSignals& GetMainSignals();
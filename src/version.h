@@ -45,4 +45,8 @@ static const int NO_BLOOM_VERSION = 70005;
 //! In this version, the blocktime and reward structure were changed
 static const int MIN_PEER_VERSION_ADJ_BLOCKTIME = 71020;
 
+//! "feefilter" tells peers to filter invs to you by fee starts with this version;
+//! it is sent to peers that announce it and honoured from any peer
+static const int FEEFILTER_VERSION = 71026;
+
 #endif // BITCOIN_VERSION_H
@@ -0,0 +1,206 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include "random.h"
+#include "script/script.h"
+#include "script/standard.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+//! Input sizes in virtual bytes: outpoint, sequence and a typical signature
+const unsigned int P2PK_INPUT_SIZE = 114;
+const unsigned int P2PKH_INPUT_SIZE = 148;
+const unsigned int P2WPKH_INPUT_SIZE = 68;
+
+struct CompareEffectiveValue {
+    bool operator()(const CSelectionCoin& a, const CSelectionCoin& b) const
+    {
+        return a.nEffectiveValue > b.nEffectiveValue;
+    }
+};
+
+/** Sort vCoins largest first; returns how many are worth spending at all */
+size_t SortByEffectiveValue(std::vector<CSelectionCoin>& vCoins)
+{
+    std::stable_sort(vCoins.begin(), vCoins.end(), CompareEffectiveValue());
+    size_t nUsable = 0;
+    while (nUsable < vCoins.size() && vCoins[nUsable].nEffectiveValue > 0)
+        nUsable++;
+    return nUsable;
+}
+} // anon namespace
+
+unsigned int EstimateInputSize(const CScript& scriptPubKey)
+{
+    txnouttype type;
+    std::vector<std::vector<unsigned char> > vSolutions;
+    if (!Solver(scriptPubKey, type, vSolutions))
+        return P2PKH_INPUT_SIZE;
+    switch (type) {
+    case TX_PUBKEY:
+        return P2PK_INPUT_SIZE;
+    case TX_WITNESS_V0_KEYHASH:
+        return P2WPKH_INPUT_SIZE;
+    default:
+        return P2PKH_INPUT_SIZE;
+    }
+}
+
+CAmount GetCostOfChange(const CFeeRate& feeRate)
+{
+    return feeRate.GetFee(CHANGE_OUTPUT_SIZE) + feeRate.GetFee(P2PKH_INPUT_SIZE);
+}
+
+bool SelectCoinsBnB(std::vector<CSelectionCoin>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::vector<size_t>& vSelected, CAmount& nValueRet)
+{
+    vSelected.clear();
+    nValueRet = 0;
+
+    size_t nUsable = SortByEffectiveValue(vCoins);
+    CAmount nAvailable = 0;
+    for (size_t i = 0; i < nUsable; i++)
+        nAvailable += vCoins[i].nEffectiveValue;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    // Depth first search over include/exclude decisions, largest coins first.
+    // A branch is cut when it overshoots the target by more than a change
+    // output would cost, or when what is left can't reach the target.
+    CAmount nCurrentValue = 0;
+    std::vector<bool> vfCurrent;
+    vfCurrent.reserve(nUsable);
+    std::vector<bool> vfBest;
+    CAmount nBestExcess = std::numeric_limits<CAmount>::max();
+
+    for (size_t nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nCurrentValue + nAvailable < nTargetValue || nCurrentValue > nTargetValue + nCostOfChange) {
+            fBacktrack = true;
+        } else if (nCurrentValue >= nTargetValue) {
+            if (nCurrentValue - nTargetValue <= nBestExcess) {
+                vfBest = vfCurrent;
+                nBestExcess = nCurrentValue - nTargetValue;
+                if (nBestExcess == 0)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last included coin and try leaving it out
+            while (!vfCurrent.empty() && !vfCurrent.back()) {
+                vfCurrent.pop_back();
+                nAvailable += vCoins[vfCurrent.size()].nEffectiveValue;
+            }
+            if (vfCurrent.empty())
+                break;
+            vfCurrent.back() = false;
+            nCurrentValue -= vCoins[vfCurrent.size() - 1].nEffectiveValue;
+        } else {
+            const CSelectionCoin& coin = vCoins[vfCurrent.size()];
+            nAvailable -= coin.nEffectiveValue;
+            // Including a coin worth the same as one just left out leads to
+            // selections already tried
+            if (!vfCurrent.empty() && !vfCurrent.back() && coin.nEffectiveValue == vCoins[vfCurrent.size() - 1].nEffectiveValue) {
+                vfCurrent.push_back(false);
+            } else {
+                vfCurrent.push_back(true);
+                nCurrentValue += coin.nEffectiveValue;
+            }
+        }
+    }
+
+    if (vfBest.empty())
+        return false;
+    for (size_t i = 0; i < vfBest.size(); i++) {
+        if (vfBest[i]) {
+            vSelected.push_back(i);
+            nValueRet += vCoins[i].nValue;
+        }
+    }
+    return true;
+}
+
+bool SelectCoinsEffectiveValue(std::vector<CSelectionCoin>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::vector<size_t>& vSelected, CAmount& nValueRet)
+{
+    vSelected.clear();
+    nValueRet = 0;
+
+    size_t nUsable = SortByEffectiveValue(vCoins);
+    if (nUsable == 0)
+        return false;
+
+    // The smallest coin that pays for the target and a change output
+    for (size_t i = nUsable; i > 0; i--) {
+        if (vCoins[i - 1].nEffectiveValue >= nTargetValue + nCostOfChange) {
+            vSelected.push_back(i - 1);
+            nValueRet = vCoins[i - 1].nValue;
+            return true;
+        }
+    }
+
+    // Largest first, finishing with the smallest coin that reaches the target
+    CAmount nTotal = 0;
+    for (size_t i = 0; i < nUsable; i++) {
+        if (nTotal + vCoins[i].nEffectiveValue >= nTargetValue) {
+            size_t nLast = nUsable - 1;
+            while (nTotal + vCoins[nLast].nEffectiveValue < nTargetValue)
+                nLast--;
+            vSelected.push_back(nLast);
+            nValueRet += vCoins[nLast].nValue;
+            return true;
+        }
+        vSelected.push_back(i);
+        nTotal += vCoins[i].nEffectiveValue;
+        nValueRet += vCoins[i].nValue;
+    }
+
+    vSelected.clear();
+    nValueRet = 0;
+    return false;
+}
+
+void ApproximateBestSubset(const std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, std::vector<char>& vfBest, CAmount& nBest, int iterations)
+{
+    std::vector<char> vfIncluded;
+
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+
+    seed_insecure_rand();
+
+    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
+        vfIncluded.assign(vValue.size(), false);
+        CAmount nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
+            for (unsigned int i = 0; i < vValue.size(); i++) {
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng is fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
+                    nTotal += vValue[i].first;
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue) {
+                        fReachedTarget = true;
+                        if (nTotal < nBest) {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vValue[i].first;
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_COINSELECTION_H
+#define BITCOIN_WALLET_COINSELECTION_H
+
+#include "amount.h"
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+class CScript;
+class CWalletTx;
+
+//! Serialized size of a P2PKH change output
+static const unsigned int CHANGE_OUTPUT_SIZE = 34;
+//! Version, locktime and input/output counts
+static const unsigned int TX_OVERHEAD_SIZE = 10;
+//! Branch and bound gives up after visiting this many selections
+static const size_t BNB_TOTAL_TRIES = 100000;
+
+/** A coin up for selection, with its value net of the fee to spend it */
+struct CSelectionCoin {
+    CAmount nValue;
+    CAmount nEffectiveValue;
+    std::pair<const CWalletTx*, unsigned int> coin;
+
+    CSelectionCoin(CAmount nValueIn, CAmount nEffectiveValueIn, const CWalletTx* pcoin, unsigned int i) : nValue(nValueIn), nEffectiveValue(nEffectiveValueIn), coin(pcoin, i) {}
+};
+
+/** Size an input spending scriptPubKey adds to a transaction, in virtual bytes */
+unsigned int EstimateInputSize(const CScript& scriptPubKey);
+
+/** What a change output costs: creating it now and spending it later */
+CAmount GetCostOfChange(const CFeeRate& feeRate);
+
+/**
+ * Branch and bound search for a set of coins whose effective values add up to
+ * between nTargetValue and nTargetValue + nCostOfChange, so the transaction
+ * needs no change output. Among the matches found within BNB_TOTAL_TRIES, the
+ * one with the least excess wins. vCoins is sorted by effective value, largest
+ * first, and vSelected gets indexes into it; nValueRet is the sum of the
+ * values (not the effective values) of the selected coins.
+ */
+bool SelectCoinsBnB(std::vector<CSelectionCoin>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::vector<size_t>& vSelected, CAmount& nValueRet);
+
+/**
+ * Fee aware fallback for when there is no changeless match: the smallest coin
+ * covering the target and a change output on its own, or else the largest
+ * coins until the target is reached, the last one being the smallest that gets
+ * there. This keeps the number of inputs, and so the fee, down. Coins that
+ * cost more to spend than they are worth are never used. Same conventions as
+ * SelectCoinsBnB().
+ */
+bool SelectCoinsEffectiveValue(std::vector<CSelectionCoin>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange, std::vector<size_t>& vSelected, CAmount& nValueRet);
+
+/** The legacy randomized knapsack: vfBest gets the subset of vValue closest to, and not below, nTargetValue */
+void ApproximateBestSubset(const std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000);
+
+#endif // BITCOIN_WALLET_COINSELECTION_H
@@ -10,6 +10,7 @@
 #include "protocol.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "wallet/logdb.h"
 
 #include <stdint.h>
 
@@ -218,26 +219,231 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode, int nSerVersion) : pdb(NULL), activeTxn(NULL)
+namespace
+{
+/** A record cursor on a Berkeley DB database */
+class CBerkeleyCursor : public CDBCursor
+{
+private:
+    Dbc* pcursor;
+
+public:
+    explicit CBerkeleyCursor(Dbc* pcursorIn) : pcursor(pcursorIn) {}
+    ~CBerkeleyCursor() { pcursor->close(); }
+
+    int Read(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags)
+    {
+        // Read at cursor
+        Dbt datKey;
+        if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
+            datKey.set_data(&ssKey[0]);
+            datKey.set_size(ssKey.size());
+        }
+        Dbt datValue;
+        if (fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
+            datValue.set_data(&ssValue[0]);
+            datValue.set_size(ssValue.size());
+        }
+        datKey.set_flags(DB_DBT_MALLOC);
+        datValue.set_flags(DB_DBT_MALLOC);
+        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        if (ret != 0)
+            return ret;
+        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
+            return 99999;
+
+        // Convert to streams
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write((char*)datKey.get_data(), datKey.get_size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+        // Clear and free memory
+        memset(datKey.get_data(), 0, datKey.get_size());
+        memset(datValue.get_data(), 0, datValue.get_size());
+        free(datKey.get_data());
+        free(datValue.get_data());
+        return 0;
+    }
+};
+
+/** A handle on a database of bitdb; holds a use of the file while open */
+class CBerkeleyStore : public CDBStore
+{
+private:
+    Db* pdb;
+    DbTxn* activeTxn;
+    std::string strFile;
+    bool fReadOnly;
+
+public:
+    CBerkeleyStore(Db* pdbIn, const std::string& strFileIn, bool fReadOnlyIn) : pdb(pdbIn), activeTxn(NULL), strFile(strFileIn), fReadOnly(fReadOnlyIn) {}
+
+    ~CBerkeleyStore()
+    {
+        if (activeTxn)
+            activeTxn->abort();
+        activeTxn = NULL;
+
+        Flush();
+
+        LOCK(bitdb.cs_db);
+        --bitdb.mapFileUseCount[strFile];
+    }
+
+    bool Read(CDataStream& ssKey, CDataStream& ssValue)
+    {
+        Dbt datKey(&ssKey[0], ssKey.size());
+        Dbt datValue;
+        datValue.set_flags(DB_DBT_MALLOC);
+        int ret = pdb->get(activeTxn, &datKey, &datValue, 0);
+        if (datValue.get_data() == NULL)
+            return false;
+
+        ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+        // Clear and free memory
+        memset(datValue.get_data(), 0, datValue.get_size());
+        free(datValue.get_data());
+        return (ret == 0);
+    }
+
+    bool Write(CDataStream& ssKey, CDataStream& ssValue, bool fOverwrite)
+    {
+        Dbt datKey(&ssKey[0], ssKey.size());
+        Dbt datValue(&ssValue[0], ssValue.size());
+        int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        return (ret == 0);
+    }
+
+    bool Erase(CDataStream& ssKey)
+    {
+        Dbt datKey(&ssKey[0], ssKey.size());
+        int ret = pdb->del(activeTxn, &datKey, 0);
+        return (ret == 0 || ret == DB_NOTFOUND);
+    }
+
+    bool Exists(CDataStream& ssKey)
+    {
+        Dbt datKey(&ssKey[0], ssKey.size());
+        int ret = pdb->exists(activeTxn, &datKey, 0);
+        return (ret == 0);
+    }
+
+    CDBCursor* GetCursor()
+    {
+        // Inside a transaction the cursor has to be part of it, or it waits
+        // on the pages the transaction itself locked
+        Dbc* pcursor = NULL;
+        int ret = pdb->cursor(activeTxn, &pcursor, 0);
+        if (ret != 0)
+            return NULL;
+        return new CBerkeleyCursor(pcursor);
+    }
+
+    bool TxnBegin()
+    {
+        if (activeTxn)
+            return false;
+        DbTxn* ptxn = bitdb.TxnBegin();
+        if (!ptxn)
+            return false;
+        activeTxn = ptxn;
+        return true;
+    }
+
+    bool TxnCommit()
+    {
+        if (!activeTxn)
+            return false;
+        int ret = activeTxn->commit(0);
+        activeTxn = NULL;
+        return (ret == 0);
+    }
+
+    bool TxnAbort()
+    {
+        if (!activeTxn)
+            return false;
+        int ret = activeTxn->abort();
+        activeTxn = NULL;
+        return (ret == 0);
+    }
+
+    bool InTxn() const { return activeTxn != NULL; }
+
+    // A batch doesn't take a transaction here: that would hold page locks
+    // other threads' handles wait on for as long as it lasts, and commits
+    // don't sync anyway (DB_TXN_WRITE_NOSYNC). What a batch saves is the
+    // checkpoint every handle makes as it closes.
+    bool BatchBegin() { return true; }
+    bool BatchCommit() { return true; }
+
+    void Flush()
+    {
+        if (activeTxn)
+            return;
+
+        // Flush database activity from memory pool to disk log
+        unsigned int nMinutes = 0;
+        if (fReadOnly)
+            nMinutes = 1;
+
+        bitdb.dbenv.txn_checkpoint(nMinutes ? GetArg("-dblogsize", 100) * 1024 : 0, nMinutes, 0);
+    }
+};
+
+//! The open batches, by file and the thread they belong to
+CCriticalSection cs_batches;
+std::map<std::pair<std::string, boost::thread::id>, CDBStore*> mapBatches;
+
+bool UseLogDB(const std::string& strFile, bool fCreate)
+{
+    if (logdb.IsLogDB(strFile))
+        return true;
+    return fCreate && !boost::filesystem::exists(GetDataDir() / strFile) && GetArg("-walletbackend", DEFAULT_WALLET_BACKEND) == "log";
+}
+} // anon namespace
+
+CDB::CDB(const std::string& strFilename, const char* pszMode, int nSerVersion) : pstore(NULL), fBatched(false), nSerVersion(nSerVersion)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     if (strFilename.empty())
         return;
 
+    {
+        LOCK(cs_batches);
+        std::map<std::pair<std::string, boost::thread::id>, CDBStore*>::iterator it = mapBatches.find(std::make_pair(strFilename, boost::this_thread::get_id()));
+        if (it != mapBatches.end()) {
+            strFile = strFilename;
+            pstore = it->second;
+            fBatched = true;
+            return;
+        }
+    }
+
     bool fCreate = strchr(pszMode, 'c') != NULL;
-    unsigned int nFlags = DB_THREAD;
-    if (fCreate)
-        nFlags |= DB_CREATE;
+    if (UseLogDB(strFilename, fCreate)) {
+        CLogDB* plog = logdb.Open(strFilename, fCreate);
+        if (!plog)
+            throw runtime_error(strprintf("CDB : can't open log database %s", strFilename));
+        strFile = strFilename;
+        pstore = new CLogDBStore(plog);
+    } else {
+        unsigned int nFlags = DB_THREAD;
+        if (fCreate)
+            nFlags |= DB_CREATE;
 
-    {
         LOCK(bitdb.cs_db);
         if (!bitdb.Open(GetDataDir()))
             throw runtime_error("CDB : Failed to open database environment.");
 
         strFile = strFilename;
         ++bitdb.mapFileUseCount[strFile];
-        pdb = bitdb.mapDb[strFile];
+        Db* pdb = bitdb.mapDb[strFile];
         if (pdb == NULL) {
             pdb = new Db(&bitdb.dbenv, 0);
 
@@ -258,52 +464,63 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, int nSerVersion) :
 
             if (ret != 0) {
                 delete pdb;
-                pdb = NULL;
                 --bitdb.mapFileUseCount[strFile];
                 strFile = "";
                 throw runtime_error(strprintf("CDB : Error %d, can't open database %s", ret, strFile));
             }
-
-            if (fCreate && !Exists(string("version"))) {
-                bool fTmp = fReadOnly;
-                fReadOnly = false;
-                WriteVersion(CLIENT_VERSION);
-                fReadOnly = fTmp;
-            }
-
             bitdb.mapDb[strFile] = pdb;
         }
+        pstore = new CBerkeleyStore(pdb, strFile, fReadOnly);
+    }
+
+    if (fCreate && !Exists(string("version"))) {
+        bool fTmp = fReadOnly;
+        fReadOnly = false;
+        WriteVersion(CLIENT_VERSION);
+        fReadOnly = fTmp;
     }
 }
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    if (!pstore || fBatched)
         return;
-
-    // Flush database activity from memory pool to disk log
-    unsigned int nMinutes = 0;
-    if (fReadOnly)
-        nMinutes = 1;
-
-    bitdb.dbenv.txn_checkpoint(nMinutes ? GetArg("-dblogsize", 100) * 1024 : 0, nMinutes, 0);
+    pstore->Flush();
 }
 
 void CDB::Close()
 {
-    if (!pdb)
+    if (!pstore)
         return;
-    if (activeTxn)
-        activeTxn->abort();
-    activeTxn = NULL;
-    pdb = NULL;
+    if (!fBatched)
+        delete pstore;
+    pstore = NULL;
+}
 
-    Flush();
+CDBBatch::CDBBatch(const std::string& strFilename) : CDB(strFilename, "r+"), fActive(false)
+{
+    // Nested in another batch, which commits everything
+    if (!pstore || fBatched)
+        return;
+    if (!pstore->BatchBegin()) {
+        LogPrintf("CDBBatch : can't start a batch on %s, writing records one by one\n", strFile);
+        return;
+    }
+    LOCK(cs_batches);
+    mapBatches[std::make_pair(strFile, boost::this_thread::get_id())] = pstore;
+    fActive = true;
+}
 
+CDBBatch::~CDBBatch()
+{
+    if (!fActive)
+        return;
     {
-        LOCK(bitdb.cs_db);
-        --bitdb.mapFileUseCount[strFile];
+        LOCK(cs_batches);
+        mapBatches.erase(std::make_pair(strFile, boost::this_thread::get_id()));
     }
+    if (!pstore->BatchCommit())
+        LogPrintf("CDBBatch : committing the batch on %s failed\n", strFile);
 }
 
 void CDBEnv::CloseDb(const string& strFile)
@@ -331,6 +548,10 @@ bool CDBEnv::RemoveDb(const string& strFile)
 
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
+    // A log is rewritten by compacting it, which doesn't wait for its handles
+    if (logdb.IsLogDB(strFile))
+        return logdb.Rewrite(strFile, pszSkip);
+
     while (true) {
         {
             LOCK(bitdb.cs_db);
@@ -358,17 +579,17 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
                             int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
                             if (ret == DB_NOTFOUND) {
-                                pcursor->close();
+                                delete pcursor;
                                 break;
                             } else if (ret != 0) {
-                                pcursor->close();
+                                delete pcursor;
                                 fSuccess = false;
                                 break;
                             }
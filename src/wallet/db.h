@@ -93,14 +93,62 @@ public:
 extern CDBEnv bitdb;
 
 
-/** RAII class that provides access to a Berkeley database */
+//! Storage for wallet files that don't exist yet: "bdb" or "log"
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
+
+/** Cursor over the records of a database, in key order */
+class CDBCursor
+{
+public:
+    virtual ~CDBCursor() {}
+
+    /**
+     * Read the record at the first key not below ssKey (fFlags DB_SET_RANGE),
+     * or the one after the last read (DB_NEXT). Returns 0, DB_NOTFOUND past the
+     * last record, or another error.
+     */
+    virtual int Read(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags) = 0;
+};
+
+/**
+ * Storage behind a CDB handle: an ordered map from serialized keys to
+ * serialized values, with transactions. Berkeley DB is one implementation,
+ * the append-only log of wallet/logdb.h the other; which one a file uses is
+ * decided when it is created.
+ */
+class CDBStore
+{
+public:
+    virtual ~CDBStore() {}
+
+    virtual bool Read(CDataStream& ssKey, CDataStream& ssValue) = 0;
+    virtual bool Write(CDataStream& ssKey, CDataStream& ssValue, bool fOverwrite) = 0;
+    virtual bool Erase(CDataStream& ssKey) = 0;
+    virtual bool Exists(CDataStream& ssKey) = 0;
+    virtual CDBCursor* GetCursor() = 0;
+
+    virtual bool TxnBegin() = 0;
+    virtual bool TxnCommit() = 0;
+    virtual bool TxnAbort() = 0;
+    virtual bool InTxn() const = 0;
+
+    //! Start and finish a CDBBatch, by default as a transaction
+    virtual bool BatchBegin() { return TxnBegin(); }
+    virtual bool BatchCommit() { return TxnCommit(); }
+
+    //! Called as the handle closes
+    virtual void Flush() = 0;
+};
+
+/** RAII class that provides access to a wallet database, whatever its storage */
 class CDB
 {
 protected:
-    Db* pdb;
+    CDBStore* pstore;
     std::string strFile;
-    DbTxn* activeTxn;
     bool fReadOnly;
+    //! pstore belongs to the CDBBatch this handle joined
+    bool fBatched;
     int nSerVersion;
 
     explicit CDB(const std::string& strFilename, const char* pszMode = "r+", int nSerVersion = CLIENT_VERSION);
@@ -118,41 +166,32 @@ protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pstore)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, nSerVersion);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
-        Dbt datValue;
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pdb->get(activeTxn, &datKey, &datValue, 0);
-        memset(datKey.get_data(), 0, datKey.get_size());
-        if (datValue.get_data() == NULL)
+        CDataStream ssValue(SER_DISK, nSerVersion);
+        if (!pstore->Read(ssKey, ssValue))
             return false;
 
         // Unserialize value
         try {
-            CDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, nSerVersion);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
         }
-
-        // Clear and free memory
-        memset(datValue.get_data(), 0, datValue.get_size());
-        free(datValue.get_data());
-        return (ret == 0);
+        return true;
     }
 
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pstore)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -161,27 +200,20 @@ protected:
         CDataStream ssKey(SER_DISK, nSerVersion);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, nSerVersion);
         ssValue.reserve(10000);
         ssValue << value;
-        Dbt datValue(&ssValue[0], ssValue.size());
 
-        // Write
-        int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
-
-        // Clear memory in case it was a private key
-        memset(datKey.get_data(), 0, datKey.get_size());
-        memset(datValue.get_data(), 0, datValue.get_size());
-        return (ret == 0);
+        // Write; the streams clear their memory in case it was a private key
+        return pstore->Write(ssKey, ssValue, fOverwrite);
     }
 
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pstore)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -190,112 +222,58 @@ protected:
         CDataStream ssKey(SER_DISK, nSerVersion);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
-        int ret = pdb->del(activeTxn, &datKey, 0);
-
-        // Clear memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        return (ret == 0 || ret == DB_NOTFOUND);
+        return pstore->Erase(ssKey);
     }
 
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pstore)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, nSerVersion);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
-        int ret = pdb->exists(activeTxn, &datKey, 0);
-
-        // Clear memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        return (ret == 0);
+        return pstore->Exists(ssKey);
     }
 
-    Dbc* GetCursor()
+    CDBCursor* GetCursor()
     {
-        if (!pdb)
-            return NULL;
-        Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
-        if (ret != 0)
+        if (!pstore)
             return NULL;
-        return pcursor;
+        return pstore->GetCursor();
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
     {
-        // Read at cursor
-        Dbt datKey;
-        if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
-            datKey.set_data(&ssKey[0]);
-            datKey.set_size(ssKey.size());
-        }
-        Dbt datValue;
-        if (fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
-            datValue.set_data(&ssValue[0]);
-            datValue.set_size(ssValue.size());
-        }
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        memset(datValue.get_data(), 0, datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
+        return pcursor->Read(ssKey, ssValue, fFlags);
     }
 
 public:
     bool TxnBegin()
     {
-        if (!pdb || activeTxn)
+        if (!pstore)
             return false;
-        DbTxn* ptxn = bitdb.TxnBegin();
-        if (!ptxn)
-            return false;
-        activeTxn = ptxn;
-        return true;
+        return pstore->TxnBegin();
     }
 
     bool TxnCommit()
     {
-        if (!pdb || !activeTxn)
+        if (!pstore)
             return false;
-        int ret = activeTxn->commit(0);
-        activeTxn = NULL;
-        return (ret == 0);
+        return pstore->TxnCommit();
     }
 
     bool TxnAbort()
     {
-        if (!pdb || !activeTxn)
+        if (!pstore)
             return false;
-        int ret = activeTxn->abort();
-        activeTxn = NULL;
-        return (ret == 0);
+        return pstore->TxnAbort();
     }
 
     bool ReadVersion(int& nVersion)
@@ -312,4 +290,21 @@ public:
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
 };
 
+/**
+ * Groups the writes this thread makes to a database file into one commit,
+ * made when the batch goes out of scope. Every handle the thread opens on the
+ * file in the meantime writes through the batch, so bulk operations that
+ * open a handle per record (key pool top-up, rescans) don't pay for a commit
+ * and a flush each time. Batches nest; the outermost one commits.
+ */
+class CDBBatch : public CDB
+{
+private:
+    bool fActive;
+
+public:
+    explicit CDBBatch(const std::string& strFilename);
+    ~CDBBatch();
+};
+
 #endif // BITCOIN_DB_H
@@ -0,0 +1,646 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "streams.h"
+#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+
+CLogDBEnv logdb;
+
+namespace
+{
+const char LOGDB_MAGIC[8] = {'O', 'H', 'M', 'C', 'L', 'O', 'G', 0};
+const uint32_t LOGDB_VERSION = 1;
+//! Magic and version
+const uint64_t LOGDB_HEADER_SIZE = 12;
+//! Compaction writes its file in commits of about this size
+const size_t LOGDB_COMPACT_CHUNK = 1 << 20;
+
+enum LogRecordType {
+    RECORD_PUT = 1,
+    RECORD_ERASE = 2,
+    //! Followed by the first four bytes of the hash of the records since the last one
+    RECORD_COMMIT = 3,
+};
+
+uint32_t Checksum(CHashWriter& hasher)
+{
+    uint256 hash = hasher.GetHash();
+    return ReadLE32(hash.begin());
+}
+
+/** A cursor on a CLogDBStore, moving by key so it survives commits and compactions underneath */
+class CLogDBCursor : public CDBCursor
+{
+private:
+    const CLogDBStore* pstore;
+    std::vector<unsigned char> vchLast;
+    bool fStarted;
+
+public:
+    explicit CLogDBCursor(const CLogDBStore* pstoreIn) : pstore(pstoreIn), fStarted(false) {}
+
+    int Read(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags)
+    {
+        std::vector<unsigned char> vchFrom;
+        bool fAfter;
+        if (fFlags == DB_SET_RANGE) {
+            vchFrom.assign(ssKey.begin(), ssKey.end());
+            fAfter = false;
+        } else if (fFlags == DB_NEXT) {
+            vchFrom = vchLast;
+            fAfter = fStarted;
+        } else {
+            return EINVAL;
+        }
+
+        std::vector<unsigned char> vchKey;
+        CSerializeData vchValue;
+        if (!pstore->ReadNext(vchFrom, fAfter, vchKey, vchValue))
+            return DB_NOTFOUND;
+        vchLast = vchKey;
+        fStarted = true;
+
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write((const char*)vchKey.data(), vchKey.size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write(vchValue.data(), vchValue.size());
+        return 0;
+    }
+};
+} // anon namespace
+
+CLogDB::CLogDB(const boost::filesystem::path& pathIn) : path(pathIn), file(NULL), nFileSize(0), nLiveSize(0), fSynced(true), nRefCount(0)
+{
+}
+
+CLogDB::~CLogDB()
+{
+    Close();
+}
+
+bool CLogDB::Open(bool fCreate)
+{
+    LOCK(cs_log);
+    if (file)
+        return true;
+
+    bool fExists = boost::filesystem::exists(path);
+    if (!fExists && !fCreate)
+        return error("%s : %s doesn't exist", __func__, path.string());
+
+    file = fopen(path.string().c_str(), "a+b");
+    if (!file)
+        return error("%s : can't open %s", __func__, path.string());
+
+    fseek(file, 0, SEEK_END);
+    nFileSize = ftell(file);
+    if (nFileSize == 0) {
+        CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+        ssHeader.write(LOGDB_MAGIC, sizeof(LOGDB_MAGIC));
+        ssHeader << LOGDB_VERSION;
+        if (fwrite(&ssHeader[0], 1, ssHeader.size(), file) != ssHeader.size()) {
+            Close();
+            return error("%s : can't write to %s", __func__, path.string());
+        }
+        FileCommit(file);
+        nFileSize = ssHeader.size();
+        return true;
+    }
+
+    // Left behind by a compaction that didn't finish
+    boost::system::error_code ec;
+    boost::filesystem::remove(path.string() + ".compact", ec);
+
+    if (!Load()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool CLogDB::Load()
+{
+    AssertLockHeld(cs_log);
+    mapIndex.clear();
+    nLiveSize = 0;
+
+    fseek(file, 0, SEEK_SET);
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    uint64_t nGoodSize = LOGDB_HEADER_SIZE;
+    try {
+        char pchMagic[sizeof(LOGDB_MAGIC)];
+        uint32_t nVersion;
+        filein.read(pchMagic, sizeof(pchMagic));
+        filein >> nVersion;
+        if (memcmp(pchMagic, LOGDB_MAGIC, sizeof(LOGDB_MAGIC)) != 0 || nVersion > LOGDB_VERSION) {
+            filein.release();
+            return error("%s : %s is not a log database this version can read", __func__, path.string());
+        }
+
+        // Records take effect when the commit after them checks out
+        std::vector<std::pair<std::vector<unsigned char>, CRecordPos> > vGroup;
+        std::vector<bool> vfErase;
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        uint64_t nPos = LOGDB_HEADER_SIZE;
+        while (nPos < nFileSize) {
+            unsigned char nType;
+            filein >> nType;
+            if (nType == RECORD_COMMIT) {
+                uint32_t nChecksum;
+                filein >> nChecksum;
+                nPos += 1 + sizeof(nChecksum);
+                if (nChecksum != Checksum(hasher))
+                    break;
+                for (size_t i = 0; i < vGroup.size(); i++) {
+                    std::map<std::vector<unsigned char>, CRecordPos>::iterator it = mapIndex.find(vGroup[i].first);
+                    if (it != mapIndex.end()) {
+                        nLiveSize -= it->second.nRecordSize;
+                        mapIndex.erase(it);
+                    }
+                    if (!vfErase[i]) {
+                        mapIndex.insert(vGroup[i]);
+                        nLiveSize += vGroup[i].second.nRecordSize;
+                    }
+                }
+                vGroup.clear();
+                vfErase.clear();
+                hasher = CHashWriter(SER_DISK, CLIENT_VERSION);
+                nGoodSize = nPos;
+            } else if (nType == RECORD_PUT || nType == RECORD_ERASE) {
+                std::vector<unsigned char> vchKey;
+                filein >> vchKey;
+                hasher << nType << vchKey;
+                CRecordPos pos;
+                pos.nRecordSize = 1 + ::GetSerializeSize(vchKey, SER_DISK, CLIENT_VERSION);
+                pos.nPos = 0;
+                pos.nSize = 0;
+                if (nType == RECORD_PUT) {
+                    CSerializeData vchValue;
+                    filein >> vchValue;
+                    hasher << vchValue;
+                    pos.nSize = vchValue.size();
+                    pos.nRecordSize += GetSizeOfCompactSize(pos.nSize) + pos.nSize;
+                    pos.nPos = nPos + pos.nRecordSize - pos.nSize;
+                }
+                nPos += pos.nRecordSize;
+                vGroup.push_back(std::make_pair(vchKey, pos));
+                vfErase.push_back(nType == RECORD_ERASE);
+            } else {
+                break;
+            }
+        }
+    } catch (const std::exception&) {
+        // Ends in the middle of a record
+    }
+    filein.release();
+
+    if (nGoodSize < nFileSize) {
+        LogPrintf("CLogDB::Load : dropping %u bytes after the last complete commit in %s\n", nFileSize - nGoodSize, path.string());
+        if (!TruncateFile(file, nGoodSize))
+            return error("%s : can't truncate %s", __func__, path.string());
+        nFileSize = nGoodSize;
+    }
+    return true;
+}
+
+void CLogDB::Close()
+{
+    LOCK(cs_log);
+    if (!file)
+        return;
+    if (!fSynced)
+        FileCommit(file);
+    fclose(file);
+    file = NULL;
+    fSynced = true;
+    mapIndex.clear();
+}
+
+bool CLogDB::ReadValue(const CRecordPos& pos, CSerializeData& vchValue) const
+{
+    AssertLockHeld(cs_log);
+    vchValue.resize(pos.nSize);
+    if (pos.nSize == 0)
+        return true;
+    if (fseek(file, pos.nPos, SEEK_SET) != 0 || fread(&vchValue[0], 1, pos.nSize, file) != pos.nSize)
+        return error("%s : can't read %s at %u", __func__, path.string(), pos.nPos);
+    return true;
+}
+
+bool CLogDB::Read(const std::vector<unsigned char>& vchKey, CSerializeData& vchValue) const
+{
+    LOCK(cs_log);
+    std::map<std::vector<unsigned char>, CRecordPos>::const_iterator it = mapIndex.find(vchKey);
+    if (it == mapIndex.end())
+        return false;
+    return ReadValue(it->second, vchValue);
+}
+
+bool CLogDB::Exists(const std::vector<unsigned char>& vchKey) const
+{
+    LOCK(cs_log);
+    return mapIndex.count(vchKey) > 0;
+}
+
+bool CLogDB::ReadNext(const std::vector<unsigned char>& vchKey, bool fAfter, std::vector<unsigned char>& vchKeyRet, CSerializeData& vchValueRet) const
+{
+    LOCK(cs_log);
+    std::map<std::vector<unsigned char>, CRecordPos>::const_iterator it = fAfter ? mapIndex.upper_bound(vchKey) : mapIndex.lower_bound(vchKey);
+    if (it == mapIndex.end())
+        return false;
+    vchKeyRet = it->first;
+    return ReadValue(it->second, vchValueRet);
+}
+
+bool CLogDB::Append(const LogDBUpdates& updates, FILE* fileOut, uint64_t nFileSizeIn, std::map<std::vector<unsigned char>, CRecordPos>& mapIndexOut, uint64_t& nWritten) const
+{
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    uint64_t nPos = nFileSizeIn;
+    for (const std::pair<const std::vector<unsigned char>, CLogDBUpdate>& update : updates) {
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        unsigned char nType = update.second.fErase ? RECORD_ERASE : RECORD_PUT;
+        ssRecord << nType << update.first;
+        if (!update.second.fErase) {
+            ssRecord << update.second.vchValue;
+            CRecordPos& pos = mapIndexOut[update.first];
+            pos.nRecordSize = ssRecord.size();
+            pos.nSize = update.second.vchValue.size();
+            pos.nPos = nPos + pos.nRecordSize - pos.nSize;
+        }
+        hasher.write(&ssRecord[0], ssRecord.size());
+        if (fwrite(&ssRecord[0], 1, ssRecord.size(), fileOut) != ssRecord.size())
+            return false;
+        nPos += ssRecord.size();
+    }
+
+    CDataStream ssCommit(SER_DISK, CLIENT_VERSION);
+    ssCommit << (unsigned char)RECORD_COMMIT << Checksum(hasher);
+    if (fwrite(&ssCommit[0], 1, ssCommit.size(), fileOut) != ssCommit.size())
+        return false;
+    nWritten = nPos + ssCommit.size() - nFileSizeIn;
+    return true;
+}
+
+bool CLogDB::Commit(const LogDBUpdates& updates)
+{
+    LOCK(cs_log);
+    if (!file)
+        return false;
+    if (updates.empty())
+        return true;
+
+    std::map<std::vector<unsigned char>, CRecordPos> mapWritten;
+    uint64_t nWritten = 0;
+    fseek(file, 0, SEEK_END);
+    if (!Append(updates, file, nFileSize, mapWritten, nWritten) || fflush(file) != 0) {
+        // Whatever made it out would keep the next commit from counting
+        TruncateFile(file, nFileSize);
+        return error("%s : can't append to %s", __func__, path.string());
+    }
+    nFileSize += nWritten;
+    fSynced = false;
+
+    for (const std::pair<const std::vector<unsigned char>, CLogDBUpdate>& update : updates) {
+        std::map<std::vector<unsigned char>, CRecordPos>::iterator it = mapIndex.find(update.first);
+        if (it != mapIndex.end()) {
+            nLiveSize -= it->second.nRecordSize;
+            mapIndex.erase(it);
+        }
+        if (!update.second.fErase) {
+            const CRecordPos& pos = mapWritten[update.first];
+            mapIndex.insert(std::make_pair(update.first, pos));
+            nLiveSize += pos.nRecordSize;
+        }
+    }
+    return true;
+}
+
+bool CLogDB::Flush()
+{
+    LOCK(cs_log);
+    if (!file || fSynced)
+        return true;
+    FileCommit(file);
+    fSynced = true;
+    return true;
+}
+
+bool CLogDB::ShouldCompact() const
+{
+    LOCK(cs_log);
+    return nFileSize >= LOGDB_COMPACT_MIN_SIZE && nLiveSize * 2 < nFileSize;
+}
+
+bool CLogDB::Compact(const char* pszSkip)
+{
+    LOCK(cs_log);
+    if (!file)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path pathCompact = path.string() + ".compact";
+    FILE* fileCompact = fopen(pathCompact.string().c_str(), "wb");
+    if (!fileCompact)
+        return error("%s : can't create %s", __func__, pathCompact.string());
+
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader.write(LOGDB_MAGIC, sizeof(LOGDB_MAGIC));
+    ssHeader << LOGDB_VERSION;
+    bool fSuccess = fwrite(&ssHeader[0], 1, ssHeader.size(), fileCompact) == ssHeader.size();
+
+    // Copy the current records over, a chunk per commit
+    std::map<std::vector<unsigned char>, CRecordPos> mapCompact;
+    uint64_t nCompactSize = ssHeader.size();
+    LogDBUpdates chunk;
+    size_t nChunkSize = 0;
+    size_t nSkipLen = pszSkip ? strlen(pszSkip) : 0;
+    std::map<std::vector<unsigned char>, CRecordPos>::const_iterator it = mapIndex.begin();
+    while (fSuccess && (it != mapIndex.end() || !chunk.empty())) {
+        if (it != mapIndex.end() && nChunkSize < LOGDB_COMPACT_CHUNK) {
+            const std::vector<unsigned char>& vchKey = it->first;
+            if (!pszSkip || memcmp(vchKey.data(), pszSkip, std::min(vchKey.size(), nSkipLen)) != 0) {
+                CLogDBUpdate& update = chunk[vchKey];
+                fSuccess = ReadValue(it->second, update.vchValue);
+                nChunkSize += it->second.nRecordSize;
+            }
+            ++it;
+            continue;
+        }
+        uint64_t nWritten = 0;
+        fSuccess = Append(chunk, fileCompact, nCompactSize, mapCompact, nWritten);
+        nCompactSize += nWritten;
+        chunk.clear();
+        nChunkSize = 0;
+    }
+    if (fSuccess) {
+        FileCommit(fileCompact);
+        fSuccess = ferror(fileCompact) == 0;
+    }
+    fclose(fileCompact);
+
+    if (fSuccess) {
+        fclose(file);
+        fSuccess = RenameOver(pathCompact, path);
+        file = fopen(path.string().c_str(), "a+b");
+        if (!file)
+            return error("%s : can't reopen %s", __func__, path.string());
+    }
+    if (!fSuccess) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathCompact, ec);
+        return error("%s : can't compact %s", __func__, path.string());
+    }
+
+    LogPrint("db", "CLogDB::Compact : %s from %u to %u bytes in %dms\n", path.string(), nFileSize, nCompactSize, GetTimeMillis() - nStart);
+    mapIndex.swap(mapCompact);
+    nFileSize = nCompactSize;
+    nLiveSize = 0;
+    for (const std::pair<const std::vector<unsigned char>, CRecordPos>& entry : mapIndex)
+        nLiveSize += entry.second.nRecordSize;
+    fSynced = true;
+    return true;
+}
+
+uint64_t CLogDB::GetFileSize() const
+{
+    LOCK(cs_log);
+    return nFileSize;
+}
+
+uint64_t CLogDB::GetLiveSize() const
+{
+    LOCK(cs_log);
+    return nLiveSize;
+}
+
+
+CLogDBEnv::~CLogDBEnv()
+{
+    for (std::pair<const std::string, CLogDB*>& entry : mapDb)
+        delete entry.second;
+}
+
+bool CLogDBEnv::IsLogDB(const std::string& strFile)
+{
+    LOCK(cs_logdb);
+    if (mapDb.count(strFile))
+        return true;
+    std::map<std::string, bool>::const_iterator it = mapIsLog.find(strFile);
+    if (it != mapIsLog.end())
+        return it->second;
+
+    // A file that isn't there yet can still be created as either
+    FILE* file = fopen((GetDataDir() / strFile).string().c_str(), "rb");
+    if (!file)
+        return false;
+    char pchMagic[sizeof(LOGDB_MAGIC)];
+    bool fLog = fread(pchMagic, 1, sizeof(pchMagic), file) == sizeof(pchMagic) && memcmp(pchMagic, LOGDB_MAGIC, sizeof(LOGDB_MAGIC)) == 0;
+    fclose(file);
+    mapIsLog[strFile] = fLog;
+    return fLog;
+}
+
+CLogDB* CLogDBEnv::Open(const std::string& strFile, bool fCreate)
+{
+    LOCK(cs_logdb);
+    CLogDB* pdb = mapDb[strFile];
+    if (!pdb) {
+        pdb = new CLogDB(GetDataDir() / strFile);
+        if (!pdb->Open(fCreate)) {
+            delete pdb;
+            mapDb.erase(strFile);
+            return NULL;
+        }
+        mapDb[strFile] = pdb;
+        mapIsLog[strFile] = true;
+    }
+    pdb->nRefCount++;
+    return pdb;
+}
+
+void CLogDBEnv::Release(CLogDB* pdb)
+{
+    LOCK(cs_logdb);
+    pdb->nRefCount--;
+}
+
+bool CLogDBEnv::Flush(const std::string& strFile)
+{
+    LOCK(cs_logdb);
+    std::map<std::string, CLogDB*>::iterator it = mapDb.find(strFile);
+    if (it == mapDb.end())
+        return false;
+    CLogDB* pdb = it->second;
+    bool fSuccess = pdb->Flush();
+    if (pdb->ShouldCompact())
+        fSuccess = pdb->Compact() && fSuccess;
+    return fSuccess;
+}
+
+void CLogDBEnv::Flush(bool fShutdown)
+{
+    LOCK(cs_logdb);
+    std::map<std::string, CLogDB*>::iterator it = mapDb.begin();
+    while (it != mapDb.end()) {
+        CLogDB* pdb = it->second;
+        LogPrint("db", "CLogDBEnv::Flush : Flushing %s (refcount = %d)...\n", it->first, pdb->nRefCount);
+        pdb->Flush();
+        if (pdb->ShouldCompact())
+            pdb->Compact();
+        if (fShutdown && pdb->nRefCount == 0) {
+            delete pdb;
+            mapDb.erase(it++);
+        } else {
+            it++;
+        }
+    }
+}
+
+bool CLogDBEnv::Rewrite(const std::string& strFile, const char* pszSkip)
+{
+    CLogDB* pdb = Open(strFile, false);
+    if (!pdb)
+        return false;
+
+    LogPrintf("CLogDBEnv::Rewrite : Rewriting %s...\n", strFile);
+    // Same as a Berkeley DB rewrite, the copy is stamped with this version
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssKey << std::string("version");
+    ssValue << CLIENT_VERSION;
+    LogDBUpdates updates;
+    updates[std::vector<unsigned char>(ssKey.begin(), ssKey.end())].vchValue.assign(ssValue.begin(), ssValue.end());
+
+    bool fSuccess = pdb->Commit(updates) && pdb->Compact(pszSkip);
+    Release(pdb);
+    if (!fSuccess)
+        LogPrintf("CLogDBEnv::Rewrite : Failed to rewrite %s\n", strFile);
+    return fSuccess;
+}
+
+
+CLogDBStore::~CLogDBStore()
+{
+    // As with Berkeley DB, a transaction still open is lost
+    logdb.Release(pdb);
+}
+
+bool CLogDBStore::Read(CDataStream& ssKey, CDataStream& ssValue)
+{
+    std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+    LogDBUpdates::const_iterator it = mapPending.find(vchKey);
+    if (it != mapPending.end()) {
+        if (it->second.fErase)
+            return false;
+        ssValue.write(it->second.vchValue.data(), it->second.vchValue.size());
+        return true;
+    }
+
+    CSerializeData vchValue;
+    if (!pdb->Read(vchKey, vchValue))
+        return false;
+    ssValue.write(vchValue.data(), vchValue.size());
+    return true;
+}
+
+bool CLogDBStore::Write(CDataStream& ssKey, CDataStream& ssValue, bool fOverwrite)
+{
+    if (!fOverwrite && Exists(ssKey))
+        return false;
+
+    LogDBUpdates updates;
+    CLogDBUpdate& update = fTxn ? mapPending[std::vector<unsigned char>(ssKey.begin(), ssKey.end())] : updates[std::vector<unsigned char>(ssKey.begin(), ssKey.end())];
+    update.fErase = false;
+    update.vchValue.assign(ssValue.begin(), ssValue.end());
+    return fTxn || pdb->Commit(updates);
+}
+
+bool CLogDBStore::Erase(CDataStream& ssKey)
+{
+    LogDBUpdates updates;
+    CLogDBUpdate& update = fTxn ? mapPending[std::vector<unsigned char>(ssKey.begin(), ssKey.end())] : updates[std::vector<unsigned char>(ssKey.begin(), ssKey.end())];
+    update.fErase = true;
+    update.vchValue.clear();
+    return fTxn || pdb->Commit(updates);
+}
+
+bool CLogDBStore::Exists(CDataStream& ssKey)
+{
+    std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+    LogDBUpdates::const_iterator it = mapPending.find(vchKey);
+    if (it != mapPending.end())
+        return !it->second.fErase;
+    return pdb->Exists(vchKey);
+}
+
+CDBCursor* CLogDBStore::GetCursor()
+{
+    return new CLogDBCursor(this);
+}
+
+bool CLogDBStore::ReadNext(const std::vector<unsigned char>& vchKey, bool fAfter, std::vector<unsigned char>& vchKeyRet, CSerializeData& vchValueRet) const
+{
+    std::vector<unsigned char> vchFrom = vchKey;
+    while (true) {
+        std::vector<unsigned char> vchLogKey;
+        CSerializeData vchLogValue;
+        bool fLog = pdb->ReadNext(vchFrom, fAfter, vchLogKey, vchLogValue);
+        LogDBUpdates::const_iterator it = fAfter ? mapPending.upper_bound(vchFrom) : mapPending.lower_bound(vchFrom);
+        if (it != mapPending.end() && (!fLog || it->first <= vchLogKey)) {
+            if (!it->second.fErase) {
+                vchKeyRet = it->first;
+                vchValueRet = it->second.vchValue;
+                return true;
+            }
+            // Erased in this transaction, carry on after it
+            vchFrom = it->first;
+            fAfter = true;
+            continue;
+        }
+        if (!fLog)
+            return false;
+        vchKeyRet.swap(vchLogKey);
+        vchValueRet.swap(vchLogValue);
+        return true;
+    }
+}
+
+bool CLogDBStore::TxnBegin()
+{
+    if (fTxn)
+        return false;
+    fTxn = true;
+    return true;
+}
+
+bool CLogDBStore::TxnCommit()
+{
+    if (!fTxn)
+        return false;
+    fTxn = false;
+    bool fSuccess = pdb->Commit(mapPending);
+    mapPending.clear();
+    return fSuccess;
+}
+
+bool CLogDBStore::TxnAbort()
+{
+    if (!fTxn)
+        return false;
+    fTxn = false;
+    mapPending.clear();
+    return true;
+}
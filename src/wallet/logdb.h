@@ -0,0 +1,155 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_LOGDB_H
+#define BITCOIN_WALLET_LOGDB_H
+
+#include "support/allocators/zeroafterfree.h"
+#include "sync.h"
+#include "wallet/db.h"
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+//! Don't compact logs smaller than this
+static const uint64_t LOGDB_COMPACT_MIN_SIZE = 1 << 20;
+
+/** A change to one key waiting to be committed: a new value, or its removal */
+struct CLogDBUpdate {
+    bool fErase;
+    CSerializeData vchValue;
+
+    CLogDBUpdate() : fErase(false) {}
+};
+
+typedef std::map<std::vector<unsigned char>, CLogDBUpdate> LogDBUpdates;
+
+/**
+ * A database file kept as an append-only log of records. Each commit appends
+ * its records followed by a checksummed commit record, and counts only once
+ * that is complete: a commit of any size is one write, and whatever a crash
+ * leaves after the last complete commit is cut off when the file is opened.
+ * The keys are held in memory in key order, with where their current value
+ * is in the file; values are read back from the file when asked for. When
+ * most of the file is records that were overwritten or erased since, it is
+ * compacted into a new file holding only the current ones.
+ *
+ * Commits reach the operating system right away, and the disk on Flush(),
+ * the way Berkeley DB is run with DB_TXN_WRITE_NOSYNC.
+ */
+class CLogDB
+{
+private:
+    struct CRecordPos {
+        uint64_t nPos;          //!< where the value starts
+        uint32_t nSize;         //!< size of the value
+        uint32_t nRecordSize;   //!< size of the whole record
+    };
+
+    mutable CCriticalSection cs_log;
+    boost::filesystem::path path;
+    FILE* file;
+    std::map<std::vector<unsigned char>, CRecordPos> mapIndex;
+    uint64_t nFileSize;
+    //! Size of the records mapIndex points to
+    uint64_t nLiveSize;
+    bool fSynced;
+
+    bool Load();
+    bool ReadValue(const CRecordPos& pos, CSerializeData& vchValue) const;
+    bool Append(const LogDBUpdates& updates, FILE* fileOut, uint64_t nFileSizeIn, std::map<std::vector<unsigned char>, CRecordPos>& mapIndexOut, uint64_t& nWritten) const;
+
+public:
+    //! Handles open on the log
+    int nRefCount;
+
+    explicit CLogDB(const boost::filesystem::path& pathIn);
+    ~CLogDB();
+
+    /** Open the file, creating it if fCreate, and index its records */
+    bool Open(bool fCreate);
+    void Close();
+
+    bool Read(const std::vector<unsigned char>& vchKey, CSerializeData& vchValue) const;
+    bool Exists(const std::vector<unsigned char>& vchKey) const;
+    /** The first record with a key at or after vchKey (fAfter: strictly after) */
+    bool ReadNext(const std::vector<unsigned char>& vchKey, bool fAfter, std::vector<unsigned char>& vchKeyRet, CSerializeData& vchValueRet) const;
+
+    /** Apply updates as one commit */
+    bool Commit(const LogDBUpdates& updates);
+
+    /** Sync the file to disk */
+    bool Flush();
+    bool ShouldCompact() const;
+    /** Rewrite the file with only the current records, leaving out keys starting with pszSkip */
+    bool Compact(const char* pszSkip = NULL);
+
+    uint64_t GetFileSize() const;
+    uint64_t GetLiveSize() const;
+};
+
+/** The log databases of the data directory, shared by all handles on them */
+class CLogDBEnv
+{
+private:
+    CCriticalSection cs_logdb;
+    std::map<std::string, CLogDB*> mapDb;
+    //! Files found to be logs or not, so each is looked at once
+    std::map<std::string, bool> mapIsLog;
+
+public:
+    ~CLogDBEnv();
+
+    /** Whether strFile, in the data directory, is a log database */
+    bool IsLogDB(const std::string& strFile);
+    /** The log strFile, opened (or created, if fCreate) on first use; NULL on failure */
+    CLogDB* Open(const std::string& strFile, bool fCreate);
+    /** Drop a handle's use of a log */
+    void Release(CLogDB* pdb);
+
+    /** Sync strFile to disk, and compact it if that's due; false if it isn't an open log */
+    bool Flush(const std::string& strFile);
+    /** Sync every log; on shutdown also close those not in use */
+    void Flush(bool fShutdown);
+    bool Rewrite(const std::string& strFile, const char* pszSkip);
+};
+
+extern CLogDBEnv logdb;
+
+/** A CDB handle on a log database. Transactions are held back in the handle until they commit. */
+class CLogDBStore : public CDBStore
+{
+private:
+    CLogDB* pdb;
+    bool fTxn;
+    LogDBUpdates mapPending;
+
+public:
+    explicit CLogDBStore(CLogDB* pdbIn) : pdb(pdbIn), fTxn(false) {}
+    ~CLogDBStore();
+
+    bool Read(CDataStream& ssKey, CDataStream& ssValue);
+    bool Write(CDataStream& ssKey, CDataStream& ssValue, bool fOverwrite);
+    bool Erase(CDataStream& ssKey);
+    bool Exists(CDataStream& ssKey);
+    CDBCursor* GetCursor();
+
+    bool TxnBegin();
+    bool TxnCommit();
+    bool TxnAbort();
+    bool InTxn() const { return fTxn; }
+
+    void Flush() {}
+
+    /** The first key at or after vchKey (fAfter: strictly after), seeing this handle's own pending writes */
+    bool ReadNext(const std::vector<unsigned char>& vchKey, bool fAfter, std::vector<unsigned char>& vchKeyRet, CSerializeData& vchValueRet) const;
+};
+
+#endif // BITCOIN_WALLET_LOGDB_H
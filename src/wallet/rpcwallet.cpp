@@ -36,6 +36,8 @@ using namespace boost::assign;
 
 int64_t nWalletUnlockTime;
 static CCriticalSection cs_nWalletUnlockTime;
+//! Wallet entries listtransactions lists per hold of cs_wallet
+static const int LISTTRANSACTIONS_BATCH_SIZE = 100;
 
 std::string HelpRequiringPassphrase()
 {
@@ -50,7 +52,8 @@ void EnsureWalletIsUnlocked(bool fAllowAnonOnly)
 
 void WalletTxToJSON(const CWalletTx& wtx, UniValue& entry)
 {
-    int confirms = wtx.GetDepthInMainChain(false);
+    const CBlockIndex* pindex = NULL;
+    int confirms = wtx.GetDepthInMainChain(pindex, false);
     int confirmsTotal = GetIXConfirmations(wtx.GetHash()) + confirms;
     entry.push_back(Pair("confirmations", confirmsTotal));
     entry.push_back(Pair("bcconfirmations", confirms));
@@ -59,7 +62,7 @@ void WalletTxToJSON(const CWalletTx& wtx, UniValue& entry)
     if (confirms > 0) {
         entry.push_back(Pair("blockhash", wtx.hashBlock.GetHex()));
         entry.push_back(Pair("blockindex", wtx.nIndex));
-        entry.push_back(Pair("blocktime", mapBlockIndex[wtx.hashBlock]->GetBlockTime()));
+        entry.push_back(Pair("blocktime", pindex->GetBlockTime()));
     }
     uint256 hash = wtx.GetHash();
     entry.push_back(Pair("txid", hash.GetHex()));
@@ -113,7 +116,7 @@ UniValue getnewaddress(const UniValue& params, bool fHelp)
     }
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->TopUpKeyPoolInBackground();
 
     // Generate a new key that is added to wallet
     CPubKey newKey;
@@ -205,7 +208,7 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->TopUpKeyPoolInBackground();
 
     OutputType output_type = g_change_type;
     if (!params[0].isNull()) {
@@ -647,7 +650,7 @@ CAmount GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMi
     // Tally wallet transactions
     for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
         const CWalletTx& wtx = (*it).second;
-        if (!IsFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
+        if (!wtx.IsFinal() || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
             continue;
 
         CAmount nReceived, nSent, nFee;
@@ -694,11 +697,14 @@ UniValue getbalance(const UniValue& params, bool fHelp)
                 "\nThe total amount in the account named tabby with at least 6 confirmations\n" + HelpExampleCli("getbalance", "\"tabby\" 6") +
                 "\nAs a json rpc call\n" + HelpExampleRpc("getbalance", "\"tabby\", 6"));
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
+    // Served from the balance cache, which locks what it needs to catch up
     if (params.size() == 0)
         return ValueFromAmount(pwalletMain->GetBalance());
 
+    CWalletChainView view(*pwalletMain);
+    // The tally reads every transaction, so this one holds cs_wallet throughout
+    LOCK(pwalletMain->cs_wallet);
+
     int nMinDepth = 1;
     if (params.size() > 1)
         nMinDepth = params[1].get_int();
@@ -714,7 +720,7 @@ UniValue getbalance(const UniValue& params, bool fHelp)
         CAmount nBalance = 0;
         for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
             const CWalletTx& wtx = (*it).second;
-            if (!IsFinalTx(wtx) || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
+            if (!wtx.IsFinal() || wtx.GetBlocksToMaturity() > 0 || wtx.GetDepthInMainChain() < 0)
                 continue;
 
             CAmount allFee;
@@ -747,8 +753,6 @@ UniValue getunconfirmedbalance(const UniValue &params, bool fHelp)
                 "getunconfirmedbalance\n"
                 "Returns the server's total unconfirmed balance\n");
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
     return ValueFromAmount(pwalletMain->GetUnconfirmedBalance());
 }
 
@@ -1450,7 +1454,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
                 "\nList transactions 100 to 120 from the tabby account\n" + HelpExampleCli("listtransactions", "\"tabby\" 20 100") +
                 "\nAs a json rpc call\n" + HelpExampleRpc("listtransactions", "\"tabby\", 20, 100"));
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CWalletChainView view(*pwalletMain);
 
     string strAccount = "*";
     if (params.size() > 0)
@@ -1475,16 +1479,38 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
 
     const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
 
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        CAccountingEntry* const pacentry = (*it).second.second;
-        if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
-
-        if ((int)ret.size() >= (nCount + nFrom)) break;
+    // iterate backwards until we have nCount items to return, letting go of
+    // cs_wallet after every batch so block connection can sync the wallet
+    bool fDone = false;
+    bool fStarted = false;
+    int64_t nOrderPos = 0;
+    while (!fDone) {
+        LOCK(pwalletMain->cs_wallet);
+        // Carry on below the last position listed; new entries go on top
+        CWallet::TxItems::const_reverse_iterator it = fStarted ? CWallet::TxItems::const_reverse_iterator(txOrdered.lower_bound(nOrderPos)) : txOrdered.rbegin();
+        fStarted = true;
+        int nBatch = 0;
+        for (; it != txOrdered.rend(); ++it) {
+            // Entries sharing a position go in the same batch
+            if (nBatch >= LISTTRANSACTIONS_BATCH_SIZE && (*it).first != nOrderPos)
+                break;
+            nOrderPos = (*it).first;
+            nBatch++;
+
+            CWalletTx* const pwtx = (*it).second.first;
+            if (pwtx != 0)
+                ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
+            CAccountingEntry* const pacentry = (*it).second.second;
+            if (pacentry != 0)
+                AcentryToJSON(*pacentry, strAccount, ret);
+
+            if ((int)ret.size() >= (nCount + nFrom)) {
+                fDone = true;
+                break;
+            }
+        }
+        if (it == txOrdered.rend())
+            fDone = true;
     }
     // ret is newest to oldest
 
@@ -1701,7 +1727,8 @@ UniValue gettransaction(const UniValue& params, bool fHelp)
                 "\nExamples:\n" +
                 HelpExampleCli("gettransaction", "\"1075db55d416d3ca199f55b6084e2115b9345e16c5cf302fc80e9d5fbf5d48d\"") + HelpExampleCli("gettransaction", "\"1075db55d416d3ca199f55b6084e2115b9345e16c5cf302fc80e9d5fbf5d48d\" true") + HelpExampleRpc("gettransaction", "\"1075db55d416d3ca199f55b6084e2115b9345e16c5cf302fc80e9d5fbf5d48d\""));
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CWalletChainView view(*pwalletMain);
+    LOCK(pwalletMain->cs_wallet);
 
     uint256 hash;
     hash.SetHex(params[0].get_str());
@@ -1731,6 +1758,8 @@ UniValue gettransaction(const UniValue& params, bool fHelp)
     ListTransactions(wtx, "*", 0, false, details, filter);
     entry.push_back(Pair("details", details));
 
+    if (!wtx.LoadFull())
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Error reading the transaction from the wallet file");
     string strHex = EncodeHexTx(static_cast<CTransaction>(wtx), PROTOCOL_VERSION | RPCSerializationFlags());
     entry.push_back(Pair("hex", strHex));
 
@@ -1844,7 +1873,7 @@ UniValue walletpassphrase(const UniValue& params, bool fHelp)
     if (!pwalletMain->Unlock(strWalletPass, anonymizeOnly))
         throw JSONRPCError(RPC_WALLET_PASSPHRASE_INCORRECT, "Error: The wallet passphrase entered was incorrect.");
 
-    pwalletMain->TopUpKeyPool();
+    pwalletMain->TopUpKeyPoolInBackground();
 
     int64_t nSleepTime = params[1].get_int64();
     LOCK(cs_nWalletUnlockTime);
@@ -3442,42 +3471,13 @@ UniValue dzohmcstate(const UniValue& params, bool fHelp) {
 }
 
 
-void static SearchThread(CzOHMCWallet* zwallet, int nCountStart, int nCountEnd)
-{
-    LogPrintf("%s: start=%d end=%d\n", __func__, nCountStart, nCountEnd);
-    CWalletDB walletDB(pwalletMain->strWalletFile);
-    try {
-        uint256 seedMaster = zwallet->GetMasterSeed();
-        uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
-        for(int i = nCountStart; i < nCountEnd; i++) {
-            boost::this_thread::interruption_point();
-            CDataStream ss(SER_GETHASH, 0);
-            ss << seedMaster << i;
-            uint512 zerocoinSeed = Hash512(ss.begin(), ss.end());
-
-            CBigNum bnValue;
-            CBigNum bnSerial;
-            CBigNum bnRandomness;
-            CKey key;
-            zwallet->SeedToZOHMC(zerocoinSeed, bnValue, bnSerial, bnRandomness, key);
-
-            uint256 hashPubcoin = GetPubCoinHash(bnValue);
-            zwallet->AddToMintPool(make_pair(hashPubcoin, i), true);
-            walletDB.WriteMintPoolPair(hashSeed, hashPubcoin, i);
-        }
-    } catch (std::exception& e) {
-        LogPrintf("SearchThread() exception");
-    } catch (...) {
-        LogPrintf("SearchThread() exception");
-    }
-}
-
 UniValue searchdzohmc(const UniValue& params, bool fHelp)
 {
     if(fHelp || params.size() != 3)
         throw runtime_error(
                 "searchdzohmc\n"
-                "\nMake an extended search for deterministically generated zOHMC that have not yet been recognized by the wallet.\n" +
+                "\nMake an extended search for deterministically generated zOHMC that have not yet been recognized by the wallet.\n"
+                "The search runs in the background; its progress is written to debug.log.\n" +
                 HelpRequiringPassphrase() + "\n"
 
                                              "\nArguments\n"
@@ -3499,25 +3499,13 @@ UniValue searchdzohmc(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Range has to be at least 1");
 
     int nThreads = params[2].get_int();
+    if (nThreads < 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Threads has to be at least 1");
 
     CzOHMCWallet* zwallet = pwalletMain->zwalletMain;
-
-    boost::thread_group* dzohmcThreads = new boost::thread_group();
-    int nRangePerThread = nRange / nThreads;
-
-    int nPrevThreadEnd = nCount - 1;
-    for (int i = 0; i < nThreads; i++) {
-        int nStart = nPrevThreadEnd + 1;;
-        int nEnd = nStart + nRangePerThread;
-        nPrevThreadEnd = nEnd;
-        dzohmcThreads->create_thread(boost::bind(&SearchThread, zwallet, nStart, nEnd));
-    }
-
-    dzohmcThreads->join_all();
-
-    zwallet->RemoveMintsFromPool(pwalletMain->zohmcTracker->GetSerialHashes());
-    zwallet->SyncWithChain(false);
+    if (!zwallet->GenerateMintPoolInBackground(nCount, nRange, nThreads, true))
+        throw JSONRPCError(RPC_WALLET_ERROR, "A zOHMC mint pool search is running already");
 
     //todo: better response
-    return "done";
+    return "started";
 }
@@ -7,9 +7,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "wallet/wallet.h"
+#include "wallet/coinselection.h"
 
 #include "accumulators.h"
 #include "base58.h"
+#include "chainsnapshot.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
 #include "kernel.h"
@@ -48,6 +50,7 @@ bool bSpendZeroConfChange = true;
 bool bdisableSystemnotifications = false; // Those bubbles can be annoying and slow down the UI when you get lots of trx
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
+bool fCoinSelectionBnB = DEFAULT_COIN_SELECTION_BNB;
 int64_t nStartupTime = GetTime();
 OutputType g_address_type = OUTPUT_TYPE_NONE;
 OutputType g_change_type = OUTPUT_TYPE_NONE;
@@ -77,6 +80,7 @@ enum class CWallet::CoinSelectStrategy
 {
 	random,
 	descentByAmount,
+	branchAndBound, // changeless branch and bound on effective values, then the effective value fallback
 };
 
 std::string COutput::ToString() const
@@ -104,21 +108,34 @@ std::vector<CWalletTx> CWallet::getWalletTxs()
     return result;
 }
 
+/** Make a new key and its public key, checked against each other. Touches no wallet state. */
+static CPubKey MakeNewKeyPair(bool fCompressed, CKey& secret)
+{
+    secret.MakeNewKey(fCompressed);
+    CPubKey pubkey = secret.GetPubKey();
+    assert(secret.VerifyPubKey(pubkey));
+    return pubkey;
+}
+
 CPubKey CWallet::GenerateNewKey()
 {
     AssertLockHeld(cs_wallet);                                 // mapKeyMetadata
     bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
     CKey secret;
-    secret.MakeNewKey(fCompressed);
+    CPubKey pubkey = MakeNewKeyPair(fCompressed, secret);
+    AddGeneratedKey(secret, pubkey);
+    return pubkey;
+}
+
+void CWallet::AddGeneratedKey(const CKey& secret, const CPubKey& pubkey)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
 
     // Compressed public keys were introduced in version 0.6.0
-    if (fCompressed)
+    if (pubkey.IsCompressed())
         SetMinVersion(FEATURE_COMPRPUBKEY);
 
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
-
     // Create new metadata
     int64_t nCreationTime = GetTime();
     mapKeyMetadata[pubkey.GetID()] = CKeyMetadata(nCreationTime);
@@ -127,7 +144,6 @@ CPubKey CWallet::GenerateNewKey()
 
     if (!AddKeyPubKey(secret, pubkey))
         throw std::runtime_error("CWallet::GenerateNewKey() : AddKey failed");
-    return pubkey;
 }
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
@@ -135,6 +151,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    walletFilter.Insert(pubkey);
 
     // check if we need to remove from watch-only
     CScript script;
@@ -155,6 +172,7 @@ bool CWallet::AddCryptedKey(const CPubKey& vchPubKey,
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    walletFilter.Insert(vchPubKey);
     if (!fFileBacked)
         return true;
     {
@@ -179,15 +197,27 @@ bool CWallet::LoadKeyMetadata(const CPubKey& pubkey, const CKeyMetadata& meta)
     return true;
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey& pubkey)
+{
+    if (!CCryptoKeyStore::AddKeyPubKey(key, pubkey))
+        return false;
+    walletFilter.Insert(pubkey);
+    return true;
+}
+
 bool CWallet::LoadCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret)
 {
-    return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
+    if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
+        return false;
+    walletFilter.Insert(vchPubKey);
+    return true;
 }
 
 bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    walletFilter.InsertScript(redeemScript);
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -205,13 +235,18 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
-    return CCryptoKeyStore::AddCScript(redeemScript);
+    if (!CCryptoKeyStore::AddCScript(redeemScript))
+        return false;
+    walletFilter.InsertScript(redeemScript);
+    return true;
 }
 
 bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    walletFilter.InsertWatchOnly(dest);
+    MarkTxDirty();
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -224,6 +259,7 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    MarkTxDirty();
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -235,7 +271,10 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
 
 bool CWallet::LoadWatchOnly(const CScript& dest)
 {
-    return CCryptoKeyStore::AddWatchOnly(dest);
+    if (!CCryptoKeyStore::AddWatchOnly(dest))
+        return false;
+    walletFilter.InsertWatchOnly(dest);
+    return true;
 }
 
 bool CWallet::AddMultiSig(const CScript& dest)
@@ -465,6 +504,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
+    MarkTxDirty(outpoint.hash);
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
@@ -646,6 +686,7 @@ int64_t CWallet::IncOrderPosNext(CWalletDB* pwalletdb)
 
 void CWallet::MarkDirty()
 {
+    MarkTxDirty();
     {
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx> & item : mapWallet)
@@ -663,6 +704,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        walletFilter.InsertOutputs(wtx);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -678,6 +720,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
             wtx.nTimeSmart = ComputeTimeSmart(wtx);
 
             AddToSpends(hash);
+            walletFilter.InsertOutputs(wtx);
 
             // wqking -- fix a bug that listtransactions doesn't return recent transactions.
             wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
@@ -737,6 +780,8 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
         AssertLockHeld(cs_wallet);
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
+        // Most transactions are turned away here without asking the keystore
+        if (!fExisted && !walletFilter.IsRelevant(tx)) return false;
         if (fExisted || IsMine(tx) || IsFromMe(tx)) {
             CWalletTx wtx(this, tx);
             // Get merkle branch if transaction was found in a block
@@ -751,8 +796,21 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK2(cs_main, cs_wallet);
+    // Connected, disconnected or mempool mints and spends of ours have their
+    // status checked again the next time the tracker lists them
+    if (tx.ContainsZerocoins() && zohmcTracker)
+        zohmcTracker->MarkStatusDirty(tx);
+
+    // Disconnected blocks are safe to show as soon as they are: their
+    // transactions went back to the mempool before the tip moved
+    if (!pblock)
+        UpdateSyncedState();
+
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
+    // A block's transactions leave the mempool for the wallet in BlockConnected
+    if (!pblock)
+        mapWallet[tx.GetHash()].fInMempool = mempool.exists(tx.GetHash());
 
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
@@ -763,6 +821,49 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 }
 
+void CWallet::BlockConnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    LOCK2(cs_main, cs_wallet);
+    // SyncTransaction has seen every transaction of the block by now, so
+    // views can go by it
+    for (const CTransaction& tx : block.vtx) {
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(tx.GetHash());
+        if (it != mapWallet.end())
+            it->second.fInMempool = false;
+    }
+    chainSynced = GetChainSnapshot();
+}
+
+void CWallet::TransactionRemovedFromMempool(const CTransaction& tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence)
+{
+    // Called holding the mempool lock, so no cs_wallet here. Transactions
+    // confirmed in a block are left to BlockConnected.
+    if (reason == MemPoolRemovalReason::BLOCK)
+        return;
+    LOCK(cs_txcache);
+    setMempoolRemoved.insert(tx.GetHash());
+}
+
+void CWallet::UpdateSyncedState()
+{
+    AssertLockHeld(cs_wallet);
+    CChainSnapshotRef chainPublished = GetChainSnapshot();
+    const CBlockIndex* pindexPublished = chainPublished->Tip();
+    if (pindexPublished && chainSynced->Contains(pindexPublished))
+        chainSynced = chainPublished;
+
+    std::set<uint256> setRemoved;
+    {
+        LOCK(cs_txcache);
+        setRemoved.swap(setMempoolRemoved);
+    }
+    for (const uint256& hash : setRemoved) {
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end())
+            it->second.fInMempool = mempool.exists(hash);
+    }
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
@@ -771,6 +872,7 @@ void CWallet::EraseFromWallet(const uint256& hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        MarkTxDirty(hash);
     }
     return;
 }
@@ -1064,7 +1166,7 @@ CAmount CWalletTx::GetCredit(const isminefilter& filter) const
 
 CAmount CWalletTx::GetImmatureCredit(bool fUseCache) const
 {
-    LOCK(cs_main);
+    LOCK_WALLET_CHAIN();
     if ((IsCoinBase() || IsCoinStake()) && GetBlocksToMaturity() > 0 && IsInMainChain()) {
         if (fUseCache && fImmatureCreditCached)
             return nImmatureCreditCached;
@@ -1244,7 +1346,7 @@ CAmount CWalletTx::GetDenominatedCredit(bool unconfirmed, bool fUseCache) const
     int nDepth = GetDepthInMainChain(false);
     if (nDepth < 0) return 0;
 
-    bool isUnconfirmed = !IsFinalTx(*this) || (!IsTrusted() && nDepth == 0);
+    bool isUnconfirmed = !IsFinal() || (!IsTrusted() && nDepth == 0);
     if (unconfirmed != isUnconfirmed) return 0;
 
     if (fUseCache) {
@@ -1278,7 +1380,7 @@ CAmount CWalletTx::GetDenominatedCredit(bool unconfirmed, bool fUseCache) const
 
 CAmount CWalletTx::GetImmatureWatchOnlyCredit(const bool& fUseCache) const
 {
-    LOCK(cs_main);
+    LOCK_WALLET_CHAIN();
     if (IsCoinBase() && GetBlocksToMaturity() > 0 && IsInMainChain()) {
         if (fUseCache && fImmatureWatchCreditCached)
             return nImmatureWatchCreditCached;
@@ -1442,55 +1544,314 @@ bool CWalletTx::WriteToDisk()
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+bool CWalletTx::UnserializeCompact(CDataStream& s, const uint256& hashIn)
+{
+    const unsigned int nSizeBefore = s.size();
+    int32_t nTxVersion;
+    s >> nTxVersion;
+
+    // An empty vin starts the extended format, which carries witnesses
+    uint64_t nInputs = ReadCompactSize(s);
+    bool fFull = (nInputs == 0);
+    std::vector<CTxIn> vinCompact;
+    for (uint64_t i = 0; i < nInputs && !fFull; i++) {
+        CTxIn txin;
+        s >> txin.prevout;
+        unsigned int nScriptSize = ReadCompactSize(s);
+        if (nScriptSize > 0) {
+            unsigned char chOpcode;
+            s >> chOpcode;
+            fFull = (chOpcode == OP_ZEROCOINSPEND);
+            s.ignore(nScriptSize - 1);
+        }
+        s >> txin.nSequence;
+        vinCompact.push_back(txin);
+    }
+    if (fFull) {
+        s.Rewind(nSizeBefore - s.size());
+        return false;
+    }
+
+    std::vector<CTxOut> voutCompact;
+    uint32_t nTxLockTime;
+    s >> voutCompact >> nTxLockTime;
+
+    Init(NULL);
+    *const_cast<int32_t*>(&nVersion) = nTxVersion;
+    vin.swap(vinCompact);
+    vout.swap(voutCompact);
+    wit.SetNull();
+    *const_cast<uint32_t*>(&nLockTime) = nTxLockTime;
+    SetHash(hashIn);
+    s >> hashBlock >> vMerkleBranch >> nIndex;
+    SerializeWalletData(s, CSerActionUnserialize(), s.GetType(), s.GetVersion());
+    fCompact = true;
+    return true;
+}
+
+bool CWalletTx::LoadFull(CWalletDB* pwalletdb) const
+{
+    if (!fCompact)
+        return true;
+    if (!pwallet || !pwallet->fFileBacked)
+        return error("%s : no wallet file to read %s from", __func__, GetHash().ToString());
+
+    CWalletTx wtx;
+    bool fRead = pwalletdb ? pwalletdb->ReadTx(GetHash(), wtx) : CWalletDB(pwallet->strWalletFile).ReadTx(GetHash(), wtx);
+    if (!fRead || wtx.GetHash() != GetHash() || wtx.vin.size() != vin.size())
+        return error("%s : can't read %s back from the wallet file", __func__, GetHash().ToString());
+
+    CWalletTx* pwtx = const_cast<CWalletTx*>(this);
+    for (unsigned int i = 0; i < vin.size(); i++)
+        pwtx->vin[i].scriptSig.swap(wtx.vin[i].scriptSig);
+    fCompact = false;
+    return true;
+}
+
+namespace
+{
+//! Blocks added to the wallet per cs_main/cs_wallet hold during a rescan
+static const size_t RESCAN_BATCH_SIZE = 100;
+//! Blocks the rescan reader threads may read ahead of the wallet
+static const size_t RESCAN_READ_AHEAD = 4 * RESCAN_BATCH_SIZE;
+//! Seconds between two writes of the rescan progress to the wallet file
+static const int64_t RESCAN_PROGRESS_INTERVAL = 30;
+
+/** A block read and matched against the wallet's scripts by a rescan reader thread */
+struct CRescanBlock {
+    CBlockIndex* pindex;
+    bool fRead;
+    CBlock block;
+    //! Per transaction: whether one of its outputs is ours
+    std::vector<bool> vMatch;
+    //! Zerocoin mints of the block, only collected for -zapwallettxes
+    std::list<CZerocoinMint> listMints;
+};
+
+/**
+ * Reads and deserializes the blocks of a rescan on a few threads, ahead of
+ * the thread adding them to the wallet. Matching outputs against the wallet's
+ * scripts only needs the keystore lock, so this holds neither cs_main nor
+ * cs_wallet. Blocks come out of Take() in chain order.
+ */
+class CRescanReader
+{
+private:
+    const CWallet& wallet;
+    const std::vector<CBlockIndex*>& vIndex;
+    const bool fZerocoinMints;
+    std::vector<std::shared_ptr<CRescanBlock> > vSlots; //! ring buffer of RESCAN_READ_AHEAD blocks
+    boost::mutex mutex;
+    boost::condition_variable condRead;
+    boost::condition_variable condTaken;
+    size_t nNext;  //! next block to hand to a reader thread
+    size_t nTaken; //! blocks taken by the consumer
+    bool fStop;
+    boost::thread_group threads;
+
+    void Read(CBlockIndex* pindex, CRescanBlock& rescanBlock) const
+    {
+        rescanBlock.pindex = pindex;
+        rescanBlock.fRead = ReadBlockFromDisk(rescanBlock.block, pindex);
+        if (!rescanBlock.fRead)
+            return;
+        rescanBlock.vMatch.reserve(rescanBlock.block.vtx.size());
+        const CWalletFilter& filter = wallet.GetWalletFilter();
+        for (const CTransaction& tx : rescanBlock.block.vtx)
+            rescanBlock.vMatch.push_back(filter.MatchesOutputs(tx) && wallet.IsMine(tx));
+        if (fZerocoinMints && pindex->nHeight >= Params().Zerocoin_StartHeight())
+            BlockToZerocoinMintList(rescanBlock.block, rescanBlock.listMints);
+    }
+
+    void Thread()
+    {
+        RenameThread("ohmcoin-rescan");
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNext < vIndex.size() && nNext >= nTaken + RESCAN_READ_AHEAD)
+                    condTaken.wait(lock);
+                if (fStop || nNext >= vIndex.size())
+                    return;
+                i = nNext++;
+            }
+            std::shared_ptr<CRescanBlock> rescanBlock = std::make_shared<CRescanBlock>();
+            Read(vIndex[i], *rescanBlock);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vSlots[i % RESCAN_READ_AHEAD] = rescanBlock;
+            }
+            condRead.notify_all();
+        }
+    }
+
+public:
+    CRescanReader(const CWallet& walletIn, const std::vector<CBlockIndex*>& vIndexIn, bool fZerocoinMintsIn, int nThreads)
+        : wallet(walletIn), vIndex(vIndexIn), fZerocoinMints(fZerocoinMintsIn), vSlots(RESCAN_READ_AHEAD), nNext(0), nTaken(0), fStop(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CRescanReader::Thread, this));
+    }
+
+    ~CRescanReader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        condTaken.notify_all();
+        threads.join_all();
+    }
+
+    bool Done() const
+    {
+        return nTaken >= vIndex.size();
+    }
+
+    //! Next block in chain order, waiting for the reader threads if needed
+    std::shared_ptr<CRescanBlock> Take()
+    {
+        assert(!Done());
+        std::shared_ptr<CRescanBlock> ret;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            std::shared_ptr<CRescanBlock>& slot = vSlots[nTaken % RESCAN_READ_AHEAD];
+            while (!slot)
+                condRead.wait(lock);
+            ret.swap(slot);
+            nTaken++;
+        }
+        condTaken.notify_all();
+        return ret;
+    }
+};
+
+//! Whether tx spends an output of a transaction in the wallet
+static bool SpendsWalletTx(const std::map<uint256, CWalletTx>& mapWallet, const CTransaction& tx)
+{
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            return true;
+    }
+    return false;
+}
+} // anon namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against the wallet's scripts by -rescanthreads
+ * reader threads, and added to the wallet in batches, holding cs_main and
+ * cs_wallet only for the batch. The last block scanned is saved in the wallet
+ * file every RESCAN_PROGRESS_INTERVAL seconds, and a scan that was stopped
+ * by AbortRescan() or a shutdown is resumed from there on the next start.
+ *
+ * Returns the number of transactions added or updated, or -1 if the scan was
+ * stopped or another scan was already running.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool fromStartup)
 {
+    CRescanReserver reserver(*this);
+    if (!reserver.Reserve()) {
+        LogPrintf("%s : another rescan is already running\n", __func__);
+        return -1;
+    }
+    return ScanForWalletTransactions(pindexStart, reserver, fUpdate, fromStartup);
+}
+
+int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, const CRescanReserver& reserver, bool fUpdate, bool fromStartup)
+{
+    assert(reserver.IsReserved());
+    fAbortRescan = false;
+
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nProgressWritten = nNow;
+    int nThreads = std::max(1, std::min((int)GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS), MAX_RESCAN_THREADS));
 
     bool fCheckZOHMC = GetBoolArg("-zapwallettxes", false);
     if (fCheckZOHMC)
         zohmcTracker->Init();
 
-    CBlockIndex* pindex = pindexStart;
-    {
-        LOCK2(cs_main, cs_wallet);
+    // The progress of an earlier scan that was stopped is ours to keep up to
+    // date if we start below it, otherwise it is left for the next start
+    bool fOwnProgress = pindexStart != NULL;
+    if (fFileBacked && pindexStart) {
+        CBlockLocator locator;
+        if (CWalletDB(strWalletFile).ReadRescanProgress(locator)) {
+            LOCK(cs_main);
+            CBlockIndex* pindexProgress = FindForkInGlobalIndex(chainActive, locator);
+            fOwnProgress = !pindexProgress || pindexStart->nHeight <= pindexProgress->nHeight;
+        }
+    }
 
-        // no need to read and scan block, if block was created before
-        // our wallet birthday (as adjusted for block time variability)
-        while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)) && pindex->nHeight <= Params().Zerocoin_StartHeight())
-            pindex = chainActive.Next(pindex);
-
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            if (fromStartup && ShutdownRequested()) {
-                return -1;
-            }
+    CChainSnapshotRef chain = GetChainSnapshot();
+    CBlockIndex* pindex = pindexStart;
 
+    // no need to read and scan block, if block was created before
+    // our wallet birthday (as adjusted for block time variability)
+    while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)) && pindex->nHeight <= Params().Zerocoin_StartHeight())
+        pindex = chain->Next(pindex);
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+    double dProgressTip = Checkpoints::GuessVerificationProgress(chain->Tip(), false);
+    set<uint256> setAddedToWallet;
+    CBlockIndex* pindexLast = pindexStart; // resuming rescans this block again
+    bool fStopped = false;
+    while (pindex && !fStopped) {
+        // Plan the blocks up to the tip of the latest snapshot of the chain,
+        // starting over from the fork point if pindex was reorganized away
+        chain = GetChainSnapshot();
+        while (pindex && !chain->Contains(pindex))
+            pindex = pindex->pprev;
+        std::vector<CBlockIndex*> vIndex;
+        for (; pindex; pindex = chain->Next(pindex))
+            vIndex.push_back(pindex);
+        if (vIndex.empty())
+            break;
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            for (CTransaction& tx : block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
+        CRescanReader reader(*this, vIndex, fCheckZOHMC, nThreads);
+        bool fReorg = false;
+        while (!reader.Done() && !fReorg && !fStopped) {
+            std::vector<std::shared_ptr<CRescanBlock> > vBatch;
+            while (!reader.Done() && vBatch.size() < RESCAN_BATCH_SIZE)
+                vBatch.push_back(reader.Take());
+
+            LOCK2(cs_main, cs_wallet);
+            CDBBatch batch(strWalletFile);
+            for (const std::shared_ptr<CRescanBlock>& rescanBlock : vBatch) {
+                if (fAbortRescan || (fromStartup && ShutdownRequested())) {
+                    fStopped = true;
+                    break;
+                }
+                pindex = rescanBlock->pindex;
+                if (!chainActive.Contains(pindex)) {
+                    fReorg = true;
+                    break;
+                }
 
-            //If this is a zapwallettx, need to readd zohmc
-            if (fCheckZOHMC && pindex->nHeight >= Params().Zerocoin_StartHeight()) {
-                list<CZerocoinMint> listMints;
-                BlockToZerocoinMintList(block, listMints);
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                const CBlock& block = rescanBlock->block;
+                if (!rescanBlock->fRead)
+                    LogPrintf("%s : failed to read block %s at height %d\n", __func__, pindex->GetBlockHash().GetHex(), pindex->nHeight);
+                for (unsigned int i = 0; i < block.vtx.size(); i++) {
+                    // Only transactions paying one of our scripts or touching the
+                    // wallet need the full check
+                    const CTransaction& tx = block.vtx[i];
+                    if (!rescanBlock->vMatch[i] && !mapWallet.count(tx.GetHash()) && !SpendsWalletTx(mapWallet, tx))
+                        continue;
+                    if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                        ret++;
+                }
 
-                for (auto& m : listMints) {
+                //If this is a zapwallettx, need to readd zohmc
+                for (auto& m : rescanBlock->listMints) {
                     if (IsMyMint(m.GetValue())) {
                         LogPrint("zero", "%s: found mint\n", __func__);
                         pwalletMain->UpdateMint(m.GetValue(), pindex->nHeight, m.GetTxHash(), m.GetDenomination());
@@ -1529,16 +1890,37 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
                         }
                     }
                 }
+
+                pindexLast = pindex;
+                pindex = chainActive.Next(pindex);
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexLast->nHeight, Checkpoints::GuessVerificationProgress(pindexLast));
+                }
             }
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+            if (pindexLast && fFileBacked && (fStopped || GetTime() >= nProgressWritten + RESCAN_PROGRESS_INTERVAL)) {
+                // A scan on startup begins at the wallet's best block, so that
+                // moves along with it; any other scan leaves its own marker
+                CWalletDB walletdb(strWalletFile);
+                CBlockLocator locator = chainActive.GetLocator(pindexLast);
+                if (fOwnProgress)
+                    walletdb.WriteRescanProgress(locator);
+                if (fromStartup)
+                    walletdb.WriteBestBlock(locator);
+                nProgressWritten = GetTime();
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+
+    if (fStopped) {
+        LogPrintf("Rescan stopped at block %d, it will be resumed on the next start\n", pindexLast->nHeight);
+        ShowProgress(_("Rescanning..."), 100);
+        return -1;
+    }
+    if (fFileBacked && fOwnProgress)
+        CWalletDB(strWalletFile).EraseRescanProgress();
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -1552,7 +1934,7 @@ void CWallet::ReacceptWalletTransactions()
 
         int nDepth = wtx.GetDepthInMainChain();
 
-        if (!wtx.IsCoinBase() && nDepth < 0 && !wtx.IsCoinStake()) {
+        if (!wtx.IsCoinBase() && nDepth < 0 && !wtx.IsCoinStake() && wtx.LoadFull()) {
             // Try to add to memory pool
             LOCK(mempool.cs);
             wtx.AcceptToMemoryPool(false);
@@ -1569,12 +1951,25 @@ bool CWalletTx::InMempool() const
     return false;
 }
 
+bool CWalletTx::IsFinal(bool fNextBlock) const
+{
+    const CWalletChainView* pview = CWalletChainView::Current();
+    if (!pview) {
+        AssertLockHeld(cs_main);
+        return fNextBlock ? CheckFinalTx(*this) : IsFinalTx(*this);
+    }
+    int nHeight = pview->Chain().Height() + (fNextBlock ? 1 : 0);
+    return IsFinalTx(*this, nHeight, GetAdjustedTime());
+}
+
 void CWalletTx::RelayWalletTransaction(std::string strCommand)
 {
     LOCK(cs_main);
     if (!IsCoinBase()) {
         if (GetDepthInMainChain() == 0) {
             uint256 hash = GetHash();
+            if (!LoadFull())
+                return;
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if (strCommand == NetMsgType::IX) {
@@ -1638,24 +2033,205 @@ void CWallet::ResendWalletTransactions()
 /** @} */ // end of mapWallet
 
 
+static thread_local const CWalletChainView* pviewCurrent = NULL;
+
+CWalletChainView::CWalletChainView(const CWallet& wallet) : pviewPrev(pviewCurrent)
+{
+    {
+        LOCK(wallet.cs_wallet);
+        const_cast<CWallet&>(wallet).UpdateSyncedState();
+        chain = wallet.chainSynced;
+    }
+    pviewCurrent = this;
+}
+
+CWalletChainView::~CWalletChainView()
+{
+    pviewCurrent = pviewPrev;
+}
+
+const CWalletChainView* CWalletChainView::Current()
+{
+    return pviewCurrent;
+}
+
+//! The chain wallet reads on this thread go by: that of the CWalletChainView in scope, or chainActive (requires cs_main)
+static const CBlockIndex* WalletChainTip()
+{
+    const CWalletChainView* pview = CWalletChainView::Current();
+    return pview ? pview->Chain().Tip() : chainActive.Tip();
+}
+
+static int WalletChainHeight()
+{
+    const CWalletChainView* pview = CWalletChainView::Current();
+    return pview ? pview->Chain().Height() : chainActive.Height();
+}
+
+static bool WalletChainContains(const CBlockIndex* pindex)
+{
+    const CWalletChainView* pview = CWalletChainView::Current();
+    return pview ? pview->Chain().Contains(pindex) : chainActive.Contains(pindex);
+}
+
+
 /** @defgroup Actions
  *
  * @{
  */
 
-CAmount CWallet::GetBalance() const
+void CWallet::MarkTxDirty(const uint256& hash) const
 {
-    CAmount nTotal = 0;
+    LOCK(cs_txcache);
+    if (!fBalancesAllDirty)
+        setBalancesDirty.insert(hash);
+    if (!fCoinsAllDirty)
+        setCoinsDirty.insert(hash);
+}
+
+void CWallet::MarkTxDirty() const
+{
+    LOCK(cs_txcache);
+    fBalancesAllDirty = true;
+    setBalancesDirty.clear();
+    fCoinsAllDirty = true;
+    setCoinsDirty.clear();
+}
+
+CWalletBalances CWallet::GetTxBalances(const CWalletTx& wtx, bool& fVolatile) const
+{
+    AssertLockHeld(cs_wallet);
+    CWalletBalances balances;
+    int nDepth = wtx.GetDepthInMainChain();
+    bool fFinal = wtx.IsFinal();
+    bool fTrusted = wtx.IsTrusted();
+
+    if (fTrusted) {
+        balances.nTrusted = wtx.GetAvailableCredit();
+        balances.nWatchTrusted = wtx.GetAvailableWatchOnlyCredit();
+        if (!fLiteMode)
+            balances.nAnonymizable = wtx.GetAnonymizableCredit();
+    }
+    if (!fFinal || (!fTrusted && nDepth == 0)) {
+        balances.nUntrustedPending = wtx.GetAvailableCredit();
+        balances.nWatchUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchImmature = wtx.GetImmatureWatchOnlyCredit();
+    if (fTrusted && nDepth > 0 && !fLiteMode) {
+        balances.nLocked = wtx.GetLockedCredit();
+        balances.nUnlocked = wtx.GetUnlockedCredit();
+    }
+    if (fTrusted && nDepth > 0)
+        balances.nWatchLocked = wtx.GetLockedWatchOnlyCredit();
+
+    // Unconfirmed and non-final transactions depend on the mempool and the
+    // tip, immature ones on the tip
+    fVolatile = nDepth <= 0 || !fFinal || wtx.GetBlocksToMaturity() > 0;
+    return balances;
+}
+
+CWalletBalances CWallet::GetBalances() const
+{
+    // Read the mempool sequence and the tip before the cache, so anything
+    // that moves them after this point makes the next call look again
+    uint64_t nMempoolSequence = mempool.GetSequence();
+    const CBlockIndex* pindexTip = GetChainSnapshot()->Tip();
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+        LOCK(cs_txcache);
+        if (!fBalancesAllDirty && setBalancesDirty.empty() && pindexBalances == pindexTip && nBalancesMempoolSequence == nMempoolSequence)
+            return balancesTotal;
+    }
+
+    LOCK_WALLET_CHAIN();
+    LOCK(cs_wallet);
+    nMempoolSequence = mempool.GetSequence();
+    pindexTip = WalletChainTip();
+
+    bool fFull;
+    std::set<uint256> setRecompute;
+    {
+        LOCK(cs_txcache);
+        // A reorg can change the depth of anything that was confirmed
+        fFull = fBalancesAllDirty || (pindexBalances && !WalletChainContains(pindexBalances));
+        fBalancesAllDirty = false;
+        setRecompute.swap(setBalancesDirty);
+        if (!fFull && (pindexBalances != pindexTip || nBalancesMempoolSequence != nMempoolSequence))
+            setRecompute.insert(setBalancesVolatile.begin(), setBalancesVolatile.end());
+    }
+
+    if (!fFull && !setRecompute.empty()) {
+        // Whether an unconfirmed spend is conflicted changes what the
+        // outputs it spends are still worth
+        std::vector<uint256> vParents;
+        for (const uint256& hash : setRecompute) {
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end() || it->second.IsZerocoinSpend())
+                continue;
+            for (const CTxIn& txin : it->second.vin) {
+                if (mapWallet.count(txin.prevout.hash))
+                    vParents.push_back(txin.prevout.hash);
+            }
         }
+        setRecompute.insert(vParents.begin(), vParents.end());
     }
 
-    return nTotal;
+    // Work out the new shares without cs_txcache: IsTrusted() takes the
+    // mempool lock, and cs_txcache stays a leaf
+    std::vector<std::pair<uint256, CWalletBalances> > vUpdated;
+    std::vector<uint256> vVolatile, vRemoved;
+    if (fFull) {
+        vUpdated.reserve(mapWallet.size());
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+            bool fVolatile;
+            vUpdated.push_back(std::make_pair(it->first, GetTxBalances(it->second, fVolatile)));
+            if (fVolatile)
+                vVolatile.push_back(it->first);
+        }
+    } else {
+        for (const uint256& hash : setRecompute) {
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end()) {
+                vRemoved.push_back(hash);
+                continue;
+            }
+            bool fVolatile;
+            vUpdated.push_back(std::make_pair(hash, GetTxBalances(it->second, fVolatile)));
+            if (fVolatile)
+                vVolatile.push_back(hash);
+        }
+    }
+
+    LOCK(cs_txcache);
+    if (fFull) {
+        mapTxBalances.clear();
+        setBalancesVolatile.clear();
+        balancesTotal.SetNull();
+    }
+    for (const uint256& hash : vRemoved) {
+        std::map<uint256, CWalletBalances>::iterator it = mapTxBalances.find(hash);
+        if (it != mapTxBalances.end()) {
+            balancesTotal -= it->second;
+            mapTxBalances.erase(it);
+        }
+        setBalancesVolatile.erase(hash);
+    }
+    for (const std::pair<uint256, CWalletBalances>& item : vUpdated) {
+        CWalletBalances& balances = mapTxBalances[item.first];
+        balancesTotal -= balances;
+        balances = item.second;
+        balancesTotal += balances;
+        setBalancesVolatile.erase(item.first);
+    }
+    setBalancesVolatile.insert(vVolatile.begin(), vVolatile.end());
+    pindexBalances = pindexTip;
+    nBalancesMempoolSequence = nMempoolSequence;
+    return balancesTotal;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
 }
 
 std::map<libzerocoin::CoinDenomination, int> mapMintMaturity;
@@ -1692,36 +2268,14 @@ CAmount CWallet::GetUnlockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nUnlocked;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nLocked;
 }
 
 // Get a Map pairing the Denominations with the amount of Zerocoin for each Denomination
@@ -1744,18 +2298,7 @@ CAmount CWallet::GetAnonymizableBalance() const
 {
     if (fLiteMode) return 0;
 
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAnonymizableCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nAnonymizable;
 }
 
 CAmount CWallet::GetAnonymizedBalance() const
@@ -1858,165 +2401,193 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchImmature;
 }
 
 CAmount CWallet::GetLockedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchLocked;
 }
 
 /**
  * populate vCoins with vector of available COutputs.
  */
-void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const
+void CWallet::UpdateCoinIndex() const
 {
-    vCoins.clear();
+    AssertLockHeld(cs_wallet);
+    uint64_t nMempoolSequence = mempool.GetSequence();
+    const CBlockIndex* pindexTip = WalletChainTip();
 
+    bool fFull;
+    std::set<uint256> setUpdate;
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (!CheckFinalTx(*pcoin))
+        LOCK(cs_txcache);
+        // A reorg can unconfirm spends of anything
+        fFull = fCoinsAllDirty || (pindexCoins && !WalletChainContains(pindexCoins));
+        fCoinsAllDirty = false;
+        setUpdate.swap(setCoinsDirty);
+    }
+
+    if (fFull) {
+        coinIndex.Clear();
+        setCoinsVolatile.clear();
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            setUpdate.insert(it->first);
+    } else {
+        if (pindexCoins != pindexTip || nCoinsMempoolSequence != nMempoolSequence)
+            setUpdate.insert(setCoinsVolatile.begin(), setCoinsVolatile.end());
+
+        // What a transaction spends is unspent again once it is conflicted
+        std::vector<uint256> vParents;
+        for (const uint256& hash : setUpdate) {
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end() || it->second.IsCoinBase() || it->second.IsZerocoinSpend())
                 continue;
+            for (const CTxIn& txin : it->second.vin) {
+                if (mapWallet.count(txin.prevout.hash))
+                    vParents.push_back(txin.prevout.hash);
+            }
+        }
+        setUpdate.insert(vParents.begin(), vParents.end());
+    }
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+    for (const uint256& hash : setUpdate) {
+        coinIndex.RemoveTx(hash);
+        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end()) {
+            setCoinsVolatile.erase(hash);
+            continue;
+        }
 
-            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+        const CWalletTx& wtx = it->second;
+        int nDepth = wtx.GetDepthInMainChain(false);
+        if (nDepth <= 0)
+            setCoinsVolatile.insert(hash);
+        else
+            setCoinsVolatile.erase(hash);
+        int nHeight = nDepth > 0 ? pindexTip->nHeight - nDepth + 1 : -1;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            const CTxOut& txout = wtx.vout[i];
+            isminetype mine = IsMine(txout);
+            if (mine == ISMINE_NO || IsSpent(hash, i))
                 continue;
+            CTxDestination dest;
+            if (!ExtractDestination(txout.scriptPubKey, dest))
+                dest = CNoDestination();
+            coinIndex.Add(CWalletCoin(COutPoint(hash, i), txout.nValue, nHeight, mine, dest));
+        }
+    }
 
-            int nDepth = pcoin->GetDepthInMainChain(false);
-            // do not use IX for inputs that have less then 6 blockchain confirmations
-            if (fUseIX && nDepth < 6)
-                continue;
+    pindexCoins = pindexTip;
+    nCoinsMempoolSequence = nMempoolSequence;
+}
+
+void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig, int nMinDepth, CAmount nMaxValue) const
+{
+    vCoins.clear();
+
+    {
+        LOCK_WALLET_CHAIN();
+        LOCK(cs_wallet);
+        UpdateCoinIndex();
+
+        std::vector<const CWalletCoin*> vCandidates;
+        if (nMinDepth > 0)
+            coinIndex.GetByHeight(WalletChainHeight() - nMinDepth + 1, vCandidates);
+        else if (nMaxValue > 0)
+            coinIndex.GetByValue(0, nMaxValue, vCandidates);
+        else {
+            vCandidates.reserve(coinIndex.Size());
+            for (CWalletCoinIndex::CoinMap::const_iterator it = coinIndex.begin(); it != coinIndex.end(); ++it)
+                vCandidates.push_back(&it->second);
+        }
 
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
+        // The checks on the transaction only need to run once per transaction
+        std::map<uint256, std::pair<const CWalletTx*, int> > mapTxChecked;
+        for (const CWalletCoin* coin : vCandidates) {
+            const uint256& wtxid = coin->outpoint.hash;
+            unsigned int i = coin->outpoint.n;
+            if (nMaxValue > 0 && coin->nValue > nMaxValue)
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if (nCoinType == ONLY_DENOMINATED) {
-                    found = IsDenominatedAmount(pcoin->vout[i].nValue);
-                } else if (nCoinType == ONLY_NOT10000IFMN) {
-                    found = !(fMasterNode && pcoin->vout[i].nValue == MASTER_NODE_AMOUNT * COIN);
-                } else if (nCoinType == ONLY_NONDENOMINATED_NOT10000IFMN) {
-                    if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
-                    found = !IsDenominatedAmount(pcoin->vout[i].nValue);
-                    if (found && fMasterNode) found = pcoin->vout[i].nValue != MASTER_NODE_AMOUNT * COIN; // do not use Hot MN funds
-                } else if (nCoinType == ONLY_10000) {
-                    found = pcoin->vout[i].nValue == MASTER_NODE_AMOUNT * COIN;
-                } else {
-                    found = true;
-                }
-                if (!found) continue;
+            std::map<uint256, std::pair<const CWalletTx*, int> >::iterator itChecked = mapTxChecked.find(wtxid);
+            if (itChecked == mapTxChecked.end()) {
+                const CWalletTx* pcoin = &mapWallet.at(wtxid);
+                int nDepth = pcoin->GetDepthInMainChain(false);
+                bool fAvailable = pcoin->IsFinal(true) &&
+                                  !(fOnlyConfirmed && !pcoin->IsTrusted()) &&
+                                  !((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0) &&
+                                  // do not use IX for inputs that have less then 6 blockchain confirmations
+                                  !(fUseIX && nDepth < 6) &&
+                                  // We should not consider coins which aren't at least in our mempool
+                                  // It's possible for these to be conflicted via ancestors which we may never be able to detect
+                                  !(nDepth == 0 && !pcoin->InMempool());
+                itChecked = mapTxChecked.insert(std::make_pair(wtxid, std::make_pair(fAvailable ? pcoin : (const CWalletTx*)NULL, nDepth))).first;
+            }
+            const CWalletTx* pcoin = itChecked->second.first;
+            int nDepth = itChecked->second.second;
+            if (pcoin == NULL || nDepth < nMinDepth)
+                continue;
 
-                if (nCoinType == STAKABLE_COINS) {
-                    if (pcoin->vout[i].IsZerocoinMint())
-                        continue;
-                }
+            bool found = false;
+            if (nCoinType == ONLY_DENOMINATED) {
+                found = IsDenominatedAmount(pcoin->vout[i].nValue);
+            } else if (nCoinType == ONLY_NOT10000IFMN) {
+                found = !(fMasterNode && pcoin->vout[i].nValue == MASTER_NODE_AMOUNT * COIN);
+            } else if (nCoinType == ONLY_NONDENOMINATED_NOT10000IFMN) {
+                if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
+                found = !IsDenominatedAmount(pcoin->vout[i].nValue);
+                if (found && fMasterNode) found = pcoin->vout[i].nValue != MASTER_NODE_AMOUNT * COIN; // do not use Hot MN funds
+            } else if (nCoinType == ONLY_10000) {
+                found = pcoin->vout[i].nValue == MASTER_NODE_AMOUNT * COIN;
+            } else {
+                found = true;
+            }
+            if (!found) continue;
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (IsSpent(wtxid, i))
-                    continue;
-                if (mine == ISMINE_NO)
+            if (nCoinType == STAKABLE_COINS) {
+                if (pcoin->vout[i].IsZerocoinMint())
                     continue;
+            }
 
-                if (mine == ISMINE_SPENDABLE && nWatchonlyConfig == 2)
-                    continue;
+            isminetype mine = coin->mine;
+            if (mine == ISMINE_SPENDABLE && nWatchonlyConfig == 2)
+                continue;
 
-                if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
-                    continue;
+            if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
+                continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
-                    continue;
-                if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
-                    continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
-                    continue;
+            if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
+                continue;
+            if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
+                continue;
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
+                continue;
 
-                bool fIsSpendable = false;
-                if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
-                    fIsSpendable = true;
-                vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
-            }
+            bool fIsSpendable = false;
+            if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
+                fIsSpendable = true;
+            vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
         }
     }
 }
@@ -2024,12 +2595,10 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 map<CTxDestination, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue)
 {
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, fConfirmed);
+    AvailableCoins(vCoins, fConfirmed, NULL, false, ALL_COINS, false, 1, 0, maxCoinValue);
 
     map<CTxDestination, vector<COutput> > mapCoins;
     for (COutput out : vCoins) {
-        if (maxCoinValue > 0 && out.tx->vout[out.i].nValue > maxCoinValue)
-            continue;
 
         CTxDestination address;
         if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
@@ -2041,46 +2610,6 @@ map<CTxDestination, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fCon
     return mapCoins;
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
-{
-    vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    seed_insecure_rand();
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++) {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++) {
-            for (unsigned int i = 0; i < vValue.size(); i++) {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng is fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand() & 1 : !vfIncluded[i]) {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue) {
-                        fReachedTarget = true;
-                        if (nTotal < nBest) {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
-
 // TODO: find appropriate place for this sort function
 // move denoms down
 bool less_then_denom(const COutput& out1, const COutput& out2)
@@ -2103,7 +2632,7 @@ bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int
     LOCK(cs_main);
     //Add OHMC
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
+    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS, false, 1, std::min(10, Params().COINBASE_MATURITY()));
     CAmount nAmountSelected = 0;
 
     for (const COutput& out : vCoins) {
@@ -2161,11 +2690,48 @@ bool CWallet::MintableCoins()
     return false;
 }
 
+/** Fee rate coins are valued at when selecting by effective value */
+static CFeeRate GetSelectionFeeRate()
+{
+    return CFeeRate(CWallet::GetMinimumFee(1000, nTxConfirmTarget, mempool));
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, CoinSelectStrategy coinSelectStrategy) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
+    if (coinSelectStrategy == CoinSelectStrategy::branchAndBound) {
+        // Inputs pay for themselves out of their effective value, so
+        // nTargetValue only has to cover the outputs and the fixed part of the fee
+        CFeeRate feeRate = GetSelectionFeeRate();
+        CAmount nCostOfChange = GetCostOfChange(feeRate);
+        // try to find nondenom first to prevent unneeded spending of mixed coins
+        for (unsigned int tryDenom = 0; tryDenom < 2; tryDenom++) {
+            vector<CSelectionCoin> vPool;
+            for (const COutput& output : vCoins) {
+                if (!output.fSpendable)
+                    continue;
+                const CWalletTx* pcoin = output.tx;
+                if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
+                    continue;
+                const CTxOut& txout = pcoin->vout[output.i];
+                if (tryDenom == 0 && IsDenominatedAmount(txout.nValue))
+                    continue;
+                vPool.push_back(CSelectionCoin(txout.nValue, txout.nValue - feeRate.GetFee(EstimateInputSize(txout.scriptPubKey)), pcoin, output.i));
+            }
+
+            vector<size_t> vSelected;
+            if (SelectCoinsBnB(vPool, nTargetValue, nCostOfChange, vSelected, nValueRet) ||
+                SelectCoinsEffectiveValue(vPool, nTargetValue, nCostOfChange, vSelected, nValueRet)) {
+                for (size_t i : vSelected)
+                    setCoinsRet.insert(vPool[i].coin);
+                return true;
+            }
+        }
+        return false;
+    }
+
     // List of values less than target
     pair<CAmount, pair<const CWalletTx*, unsigned int> > coinLowestLarger;
     coinLowestLarger.first = std::numeric_limits<CAmount>::max();
@@ -2695,6 +3261,10 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 	ParamForCreateTransaction param = {};
 
 	param.coinSelectStrategy = CoinSelectStrategy::random;
+	// Effective value selection prices in the fee itself, which doesn't fit a
+	// fixed fee, hand picked coins or denominated spends
+	if (fCoinSelectionBnB && nFeePay == 0 && coin_type != ONLY_DENOMINATED && !(coinControl && coinControl->HasSelected()))
+		param.coinSelectStrategy = CoinSelectStrategy::branchAndBound;
 	param.error = ErrorOfCreateTransaction::other;
 	bool result = CreateTransactionHelper(
 		vecSend,
@@ -2708,6 +3278,22 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, CAmount> >& vecSend,
 		nFeePay,
 		&param
 	);
+	if(!result && param.coinSelectStrategy == CoinSelectStrategy::branchAndBound && param.error == ErrorOfCreateTransaction::other) {
+		// Not enough coins worth spending at this fee rate; the knapsack doesn't care
+		param.coinSelectStrategy = CoinSelectStrategy::random;
+		result = CreateTransactionHelper(
+			vecSend,
+			wtxNew,
+			reservekey,
+			nFeeRet,
+			strFailReason,
+			coinControl,
+			coin_type,
+			useIX,
+			nFeePay,
+			&param
+		);
+	}
 	if(result) {
 		return result;
 	}
@@ -2764,11 +3350,18 @@ bool CWallet::CreateTransactionHelper(const std::vector<std::pair<CScript, CAmou
     wtxNew.BindWallet(this);
     CMutableTransaction txNew;
 
+    // With effective value selection the fee is worked out from the inputs
+    // picked, and nFeeExtra makes up for where that estimate falls short
+    const bool fEffectiveValue = param->coinSelectStrategy == CoinSelectStrategy::branchAndBound;
+    CFeeRate feeRateSelection;
+    CAmount nFeeExtra = 0;
+
     {
         LOCK2(cs_main, cs_wallet);
         {
             nFeeRet = 0;
             if (nFeePay > 0) nFeeRet = nFeePay;
+            if (fEffectiveValue) feeRateSelection = GetSelectionFeeRate();
             while (true) {
                 txNew.vin.clear();
                 txNew.vout.clear();
@@ -2810,6 +3403,14 @@ bool CWallet::CreateTransactionHelper(const std::vector<std::pair<CScript, CAmou
                     }
                 }
 
+                if (fEffectiveValue) {
+                    unsigned int nFixedSize = TX_OVERHEAD_SIZE;
+                    for (const CTxOut& txout : txNew.vout)
+                        nFixedSize += ::GetSerializeSize(txout, SER_NETWORK, PROTOCOL_VERSION);
+                    nFeeRet = feeRateSelection.GetFee(nFixedSize) + nFeeExtra;
+                    nTotalValue = nValue + nFeeRet;
+                }
+
                 // Choose coins to use
                 set<pair<const CWalletTx*, unsigned int> > setCoins;
                 CAmount nValueIn = 0;
@@ -2846,8 +3447,19 @@ bool CWallet::CreateTransactionHelper(const std::vector<std::pair<CScript, CAmou
                     dPriority += (double)nCredit * age;
                 }
 
+                if (fEffectiveValue) {
+                    for (const std::pair<const CWalletTx*, unsigned int>& coin : setCoins)
+                        nFeeRet += feeRateSelection.GetFee(EstimateInputSize(coin.first->vout[coin.second].scriptPubKey));
+                }
+
                 CAmount nChange = nValueIn - nValue - nFeeRet;
 
+                // A change output worth less than it costs goes to the fee
+                if (fEffectiveValue && nChange > 0 && nChange <= GetCostOfChange(feeRateSelection)) {
+                    nFeeRet += nChange;
+                    nChange = 0;
+                }
+
                 //over pay for denominated transactions
                 if (coin_type == ONLY_DENOMINATED) {
                     nFeeRet += nChange;
@@ -2977,6 +3589,8 @@ bool CWallet::CreateTransactionHelper(const std::vector<std::pair<CScript, CAmou
                     break;
 
                 // Include more fee and try again.
+                if (fEffectiveValue)
+                    nFeeExtra += nFeeNeeded - nFeeRet;
                 nFeeRet = nFeeNeeded;
                 continue;
             }
@@ -3527,51 +4141,112 @@ bool CWallet::NewKeyPool()
 
         if (IsLocked())
             return false;
-
-        int64_t nKeys = max(GetArg("-keypool", 1000), (int64_t)0);
-        for (int i = 0; i < nKeys; i++) {
-            int64_t nIndex = i + 1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
-            setKeyPool.insert(nIndex);
-        }
-        LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
     }
+    if (!TopUpKeyPool())
+        return false;
+    LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", setKeyPool.size());
     return true;
 }
 
+/**
+ * Keys are made on -keypoolthreads threads a batch at a time, without holding
+ * cs_wallet; it is only taken to add each batch, with its pool entries, in one
+ * write. Unless the caller holds cs_wallet the wallet stays usable throughout.
+ */
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
-    {
-        LOCK(cs_wallet);
+    // Top up key pool
+    unsigned int nTargetSize;
+    if (kpSize > 0)
+        nTargetSize = kpSize;
+    else
+        nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
+    int nThreads = std::max(1, std::min((int)GetArg("-keypoolthreads", DEFAULT_KEYPOOL_THREADS), MAX_KEYPOOL_THREADS));
 
-        if (IsLocked())
+    while (true) {
+        if (ShutdownRequested() || fAbortKeyPool)
             return false;
 
-        CWalletDB walletdb(strWalletFile);
+        unsigned int nMissing;
+        bool fCompressed;
+        {
+            LOCK(cs_wallet);
+            if (IsLocked())
+                return false;
+            if (setKeyPool.size() >= nTargetSize + 1)
+                break;
+            nMissing = nTargetSize + 1 - setKeyPool.size();
+            fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+        }
 
-        // Top up key pool
-        unsigned int nTargetSize;
-        if (kpSize > 0)
-            nTargetSize = kpSize;
-        else
-            nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
+        std::vector<std::pair<CKey, CPubKey> > vKeys(std::min(nMissing, KEYPOOL_BATCH_SIZE));
+        ParallelFor(vKeys.size(), nThreads, [&](size_t i) {
+            vKeys[i].second = MakeNewKeyPair(fCompressed, vKeys[i].first);
+        });
 
-        while (setKeyPool.size() < (nTargetSize + 1)) {
-            int64_t nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error("TopUpKeyPool() : writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
-            double dProgress = 100.f * nEnd / (nTargetSize + 1);
-            std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
-            uiInterface.InitMessage(strMsg);
+        int64_t nEnd = 0;
+        size_t nSize;
+        {
+            LOCK(cs_wallet);
+            if (IsLocked())
+                return false;
+
+            // The keys and their pool entries are written in one go
+            CDBBatch batch(strWalletFile);
+            CWalletDB walletdb(strWalletFile);
+            for (const std::pair<CKey, CPubKey>& key : vKeys) {
+                // Someone else may have been topping up too
+                if (setKeyPool.size() >= nTargetSize + 1)
+                    break;
+                nEnd = setKeyPool.empty() ? 1 : *(--setKeyPool.end()) + 1;
+                AddGeneratedKey(key.first, key.second);
+                if (!walletdb.WritePool(nEnd, CKeyPool(key.second)))
+                    throw runtime_error("TopUpKeyPool() : writing generated key failed");
+                setKeyPool.insert(nEnd);
+            }
+            nSize = setKeyPool.size();
+            LogPrintf("keypool added keys up to %d, size=%u\n", nEnd, nSize);
         }
+        double dProgress = 100.f * nSize / (nTargetSize + 1);
+        std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
+        uiInterface.InitMessage(strMsg);
     }
     return true;
 }
 
+void CWallet::TopUpKeyPoolInBackground()
+{
+    LOCK(cs_wallet);
+    if (IsLocked() || fFillingKeyPool || fAbortKeyPool)
+        return;
+    // Wait until half the pool is used, so handing out keys doesn't start a
+    // thread for every one of them
+    unsigned int nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
+    if (setKeyPool.size() > nTargetSize / 2)
+        return;
+
+    // A previous fill has finished by now, all that's left is to reap its thread
+    if (threadKeyPool.joinable())
+        threadKeyPool.join();
+    fFillingKeyPool = true;
+    threadKeyPool = boost::thread([this]() {
+        RenameThread("ohmcoin-keypool");
+        try {
+            TopUpKeyPool();
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "TopUpKeyPoolInBackground()");
+        }
+        fFillingKeyPool = false;
+    });
+}
+
+void CWallet::StopKeyPoolFill()
+{
+    fAbortKeyPool = true;
+    if (threadKeyPool.joinable())
+        threadKeyPool.join();
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
@@ -3579,8 +4254,12 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
     {
         LOCK(cs_wallet);
 
-        if (!IsLocked())
-            TopUpKeyPool();
+        // Make a key here if there are none left, and leave the rest to a background fill
+        if (!IsLocked()) {
+            if (setKeyPool.empty())
+                TopUpKeyPool(1);
+            TopUpKeyPoolInBackground();
+        }
 
         // Get the oldest key
         if (setKeyPool.empty())
@@ -3840,6 +4519,8 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
         // Only notify UI if this transaction is in this wallet
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end()) {
+            // A completed SwiftX lock counts as confirmations
+            MarkTxDirty(hashTx);
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
             return true;
         }
@@ -3851,18 +4532,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkTxDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkTxDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkTxDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -4440,15 +5124,26 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(const CBlockIndex*& pindexRet) const
 {
     if (hashBlock == 0 || nIndex == -1)
         return 0;
-    AssertLockHeld(cs_main);
 
     // Find the block it claims to be in
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi == mapBlockIndex.end())
-        return 0;
-    CBlockIndex* pindex = (*mi).second;
-    if (!pindex || !chainActive.Contains(pindex))
-        return 0;
+    const CBlockIndex* pindex;
+    int nHeight;
+    const CWalletChainView* pview = CWalletChainView::Current();
+    if (pview) {
+        pindex = LookupBlockIndex(hashBlock);
+        if (!pindex || !pview->Chain().Contains(pindex))
+            return 0;
+        nHeight = pview->Chain().Height();
+    } else {
+        AssertLockHeld(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            return 0;
+        pindex = (*mi).second;
+        if (!pindex || !chainActive.Contains(pindex))
+            return 0;
+        nHeight = chainActive.Height();
+    }
 
     // Make sure the merkle branch connects to this block
     if (!fMerkleVerified) {
@@ -4458,14 +5153,28 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(const CBlockIndex*& pindexRet) const
     }
 
     pindexRet = pindex;
-    return chainActive.Height() - pindex->nHeight + 1;
+    return nHeight - pindex->nHeight + 1;
+}
+
+bool CMerkleTx::InMempoolINTERNAL() const
+{
+    const CWalletChainView* pview = CWalletChainView::Current();
+    if (!pview)
+        return mempool.exists(GetHash());
+    if (fInMempool)
+        return true;
+    // Confirmed in a block the wallet synced after the view started, so in
+    // the mempool as far as the view knows
+    if (hashBlock == 0)
+        return false;
+    const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+    return pindex && !pview->Chain().Contains(pindex) && GetChainSnapshot()->Contains(pindex);
 }
 
 int CMerkleTx::GetDepthInMainChain(const CBlockIndex*& pindexRet, bool enableIX) const
 {
-    AssertLockHeld(cs_main);
     int nResult = GetDepthInMainChainINTERNAL(pindexRet);
-    if (nResult == 0 && !mempool.exists(GetHash()))
+    if (nResult == 0 && !InMempoolINTERNAL())
         return -1; // Not in chain, not in mempool
 
     if (enableIX) {
@@ -4482,7 +5191,7 @@ int CMerkleTx::GetDepthInMainChain(const CBlockIndex*& pindexRet, bool enableIX)
 
 int CMerkleTx::GetBlocksToMaturity() const
 {
-    LOCK(cs_main);
+    LOCK_WALLET_CHAIN();
     if (!(IsCoinBase() || IsCoinStake()))
         return 0;
     return max(0, (Params().COINBASE_MATURITY() + 1) - GetDepthInMainChain());
@@ -10,6 +10,7 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "chainsnapshot.h"
 #include "crypter.h"
 #include "kernel.h"
 #include "key.h"
@@ -22,11 +23,14 @@
 #include "util.h"
 #include "validationinterface.h"
 #include "wallet/wallet_ismine.h"
+#include "wallet/walletcoins.h"
 #include "wallet/walletdb.h"
+#include "wallet/walletfilter.h"
 #include "zohmctracker.h"
 #include "zohmcwallet.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -35,6 +39,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread.hpp>
+
 /**
  * Settings
  */
@@ -45,6 +51,7 @@ extern bool bSpendZeroConfChange;
 extern bool bdisableSystemnotifications;
 extern bool fSendFreeTransactions;
 extern bool fPayAtLeastCustomFee;
+extern bool fCoinSelectionBnB;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
@@ -54,10 +61,24 @@ static const CAmount nHighTransactionFeeWarning = 0.1 * COIN;
 static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 //! -maxtxfee will warn if called with a higher fee than this amount (in satoshis)
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
+//! -bnbselection default
+static const bool DEFAULT_COIN_SELECTION_BNB = true;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! -rescanthreads default
+static const int DEFAULT_RESCAN_THREADS = 4;
+//! Maximum number of rescan reader threads
+static const int MAX_RESCAN_THREADS = 16;
+//! -keypoolthreads default
+static const int DEFAULT_KEYPOOL_THREADS = 4;
+//! Maximum number of key pool and zOHMC mint pool generating threads
+static const int MAX_KEYPOOL_THREADS = 16;
+//! Keys made between each write to the key pool
+static const unsigned int KEYPOOL_BATCH_SIZE = 100;
+//! -lazywallet default
+static const bool DEFAULT_LAZY_WALLET = false;
 
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
@@ -66,6 +87,7 @@ static const int ZQ_6666 = 6666;
 class CAccountingEntry;
 class CCoinControl;
 class COutput;
+class CRescanReserver;
 class CReserveKey;
 class CScript;
 class CWalletTx;
@@ -171,6 +193,61 @@ public:
     StringMap destdata;
 };
 
+/** Balances of the wallet; also what a single transaction adds to them */
+struct CWalletBalances {
+    CAmount nTrusted;          //! GetBalance()
+    CAmount nUntrustedPending; //! GetUnconfirmedBalance()
+    CAmount nImmature;         //! GetImmatureBalance()
+    CAmount nLocked;           //! GetLockedCoins()
+    CAmount nUnlocked;         //! GetUnlockedCoins()
+    CAmount nAnonymizable;     //! GetAnonymizableBalance()
+    CAmount nWatchTrusted;
+    CAmount nWatchUntrustedPending;
+    CAmount nWatchImmature;
+    CAmount nWatchLocked;
+
+    CWalletBalances()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nTrusted = nUntrustedPending = nImmature = nLocked = nUnlocked = nAnonymizable = 0;
+        nWatchTrusted = nWatchUntrustedPending = nWatchImmature = nWatchLocked = 0;
+    }
+
+    CWalletBalances& operator+=(const CWalletBalances& b)
+    {
+        nTrusted += b.nTrusted;
+        nUntrustedPending += b.nUntrustedPending;
+        nImmature += b.nImmature;
+        nLocked += b.nLocked;
+        nUnlocked += b.nUnlocked;
+        nAnonymizable += b.nAnonymizable;
+        nWatchTrusted += b.nWatchTrusted;
+        nWatchUntrustedPending += b.nWatchUntrustedPending;
+        nWatchImmature += b.nWatchImmature;
+        nWatchLocked += b.nWatchLocked;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& b)
+    {
+        nTrusted -= b.nTrusted;
+        nUntrustedPending -= b.nUntrustedPending;
+        nImmature -= b.nImmature;
+        nLocked -= b.nLocked;
+        nUnlocked -= b.nUnlocked;
+        nAnonymizable -= b.nAnonymizable;
+        nWatchTrusted -= b.nWatchTrusted;
+        nWatchUntrustedPending -= b.nWatchUntrustedPending;
+        nWatchImmature -= b.nWatchImmature;
+        nWatchLocked -= b.nWatchLocked;
+        return *this;
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -219,6 +296,68 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    std::atomic<bool> fAbortRescan;
+    std::atomic<bool> fScanningWallet;
+    //! Background key pool fill, see TopUpKeyPoolInBackground()
+    boost::thread threadKeyPool;
+    std::atomic<bool> fFillingKeyPool;
+    std::atomic<bool> fAbortKeyPool;
+
+    //! Keys, scripts and outpoints of the wallet, to reject unrelated transactions cheaply
+    CWalletFilter walletFilter;
+
+    /**
+     * Balance cache: what each transaction adds to the balances, and their
+     * sum. A transaction is recomputed when it is marked dirty. Volatile
+     * ones, whose share depends on the tip or the mempool (unconfirmed, not
+     * final or immature), are recomputed when either moved, and all of them
+     * after a reorg. Everything here is guarded by cs_txcache, which is
+     * never held while taking another lock, and so are the dirty marks of
+     * the coin index.
+     */
+    mutable CCriticalSection cs_txcache;
+    mutable std::map<uint256, CWalletBalances> mapTxBalances;
+    mutable CWalletBalances balancesTotal;
+    mutable std::set<uint256> setBalancesVolatile;
+    mutable std::set<uint256> setBalancesDirty;
+    mutable bool fBalancesAllDirty;
+    mutable const CBlockIndex* pindexBalances;
+    mutable uint64_t nBalancesMempoolSequence;
+
+    //! What wtx adds to the balances, and whether that can change with the tip or the mempool
+    CWalletBalances GetTxBalances(const CWalletTx& wtx, bool& fVolatile) const;
+
+    /**
+     * Unspent outputs paying the wallet, kept up to date the same way as the
+     * balances: dirty transactions and their parents are reindexed, and so
+     * are unconfirmed ones (whose spends may have been conflicted) when the
+     * tip or the mempool moved. The index is guarded by cs_wallet.
+     */
+    mutable CWalletCoinIndex coinIndex;
+    mutable std::set<uint256> setCoinsVolatile;
+    mutable std::set<uint256> setCoinsDirty;
+    mutable bool fCoinsAllDirty;
+    mutable const CBlockIndex* pindexCoins;
+    mutable uint64_t nCoinsMempoolSequence;
+
+    //! Bring coinIndex up to date with mapWallet, the chain and the mempool
+    void UpdateCoinIndex() const;
+
+    /**
+     * The active chain as of the last block the wallet has synced, for reads
+     * that don't hold cs_main (see CWalletChainView). ConnectTip publishes
+     * the new tip before it tells the wallet about the block's transactions,
+     * and those are out of the mempool by then. Guarded by cs_wallet.
+     */
+    CChainSnapshotRef chainSynced;
+    //! Transactions the mempool dropped other than for a block, not yet in CMerkleTx::fInMempool; guarded by cs_txcache
+    std::set<uint256> setMempoolRemoved;
+    //! Catch chainSynced up with disconnected blocks and fInMempool with setMempoolRemoved; requires cs_wallet
+    void UpdateSyncedState();
+
+    friend class CWalletChainView;
+    friend class CRescanReserver;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -313,6 +452,7 @@ public:
 
     ~CWallet()
     {
+        StopKeyPoolFill();
         delete pwalletdbEncryption;
     }
 
@@ -329,6 +469,17 @@ public:
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
+        fAbortRescan = false;
+        fScanningWallet = false;
+        fFillingKeyPool = false;
+        fAbortKeyPool = false;
+        fBalancesAllDirty = true;
+        pindexBalances = NULL;
+        nBalancesMempoolSequence = 0;
+        fCoinsAllDirty = true;
+        pindexCoins = NULL;
+        nCoinsMempoolSequence = 0;
+        chainSynced = GetChainSnapshot();
 
         // Stake Settings
         nHashDrift = 30;
@@ -415,7 +566,8 @@ public:
         return nWalletMaxVersion >= wf;
     }
 
-    void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false, int nWatchonlyConfig = 1) const;
+    //! nMinDepth and nMaxValue (if not 0) narrow down the coins looked at through the coin index
+    void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false, int nWatchonlyConfig = 1, int nMinDepth = 0, CAmount nMaxValue = 0) const;
     std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, CoinSelectStrategy coinSelectStrategy) const;
 
@@ -436,11 +588,13 @@ public:
     //  keystore implementation
     // Generate a new key
     CPubKey GenerateNewKey();
+    //! Adds a key made by GenerateNewKey() or TopUpKeyPool(), with its metadata
+    void AddGeneratedKey(const CKey& secret, const CPubKey& pubkey);
 
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey& pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey& pubkey);
     //! Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CPubKey& pubkey, const CKeyMetadata& metadata);
 
@@ -516,11 +670,24 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex);
+    void TransactionRemovedFromMempool(const CTransaction& tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool fromStartup = false);
+    //! Rescan with the rescan slot already reserved, e.g. before importing the keys it is for
+    int ScanForWalletTransactions(CBlockIndex* pindexStart, const CRescanReserver& reserver, bool fUpdate = false, bool fromStartup = false);
+    //! Stop a running ScanForWalletTransactions at the next block; it is resumed on the next start
+    void AbortRescan() { fAbortRescan = true; }
+    bool IsScanning() const { return fScanningWallet; }
+    const CWalletFilter& GetWalletFilter() const { return walletFilter; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
+    //! Have the balance cache and the coin index look at a transaction again
+    void MarkTxDirty(const uint256& hash) const;
+    void MarkTxDirty() const;
+    //! The balances of the wallet; only takes cs_main when something changed since the last call
+    CWalletBalances GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetZerocoinBalance(bool fMatureOnly) const;
     CAmount GetUnconfirmedZerocoinBalance() const;
@@ -566,6 +733,10 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    //! Top up the key pool on a thread of its own once it is down to half its size, if the wallet is unlocked and that isn't running already
+    void TopUpKeyPoolInBackground();
+    //! Stop a background key pool fill after its current batch, and wait for it
+    void StopKeyPoolFill();
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
@@ -750,6 +921,45 @@ public:
 };
 
 
+/**
+ * The wallet's single rescan slot. Reserve() it before changing what the
+ * rescan is for, so that doesn't happen when the rescan can't; it is held
+ * until this goes out of scope.
+ */
+class CRescanReserver
+{
+private:
+    CWallet& wallet;
+    bool fReserved;
+
+    CRescanReserver(const CRescanReserver&);
+    CRescanReserver& operator=(const CRescanReserver&);
+
+public:
+    explicit CRescanReserver(CWallet& walletIn) : wallet(walletIn), fReserved(false) {}
+
+    ~CRescanReserver()
+    {
+        if (fReserved)
+            wallet.fScanningWallet = false;
+    }
+
+    //! False if another rescan holds the slot
+    bool Reserve()
+    {
+        bool fExpected = false;
+        if (!fReserved)
+            fReserved = wallet.fScanningWallet.compare_exchange_strong(fExpected, true);
+        return fReserved;
+    }
+
+    bool IsReserved() const
+    {
+        return fReserved;
+    }
+};
+
+
 typedef std::map<std::string, std::string> mapValue_t;
 
 
@@ -776,11 +986,52 @@ struct COutputEntry {
     int vout;
 };
 
+/**
+ * A read of the wallet that doesn't hold cs_main, for calls that only look
+ * at it (listtransactions, gettransaction, ...), so they don't hold up block
+ * validation. It reads the chain as the wallet last synced it, not the one
+ * published since: while ConnectTip tells the wallet about a block one
+ * transaction at a time, the view still sees the block before it. While one
+ * is in scope, depth, maturity and finality of wallet transactions on the
+ * thread, and the balance cache and the coin index, are worked out from it,
+ * and whether a transaction is in the mempool from CMerkleTx::fInMempool.
+ *
+ * It only takes cs_wallet while it starts. Callers take cs_wallet as they
+ * read the wallet, and nothing that takes cs_main may be called while a
+ * view is in scope.
+ */
+class CWalletChainView
+{
+private:
+    CChainSnapshotRef chain;
+    const CWalletChainView* pviewPrev;
+
+    CWalletChainView(const CWalletChainView&);
+    CWalletChainView& operator=(const CWalletChainView&);
+
+public:
+    explicit CWalletChainView(const CWallet& wallet);
+    ~CWalletChainView();
+
+    //! The view in scope on this thread, or NULL
+    static const CWalletChainView* Current();
+
+    const CChainSnapshot& Chain() const
+    {
+        return *chain;
+    }
+};
+
+//! LOCK(cs_main) to read the chain, unless a CWalletChainView on this thread stands in for it
+#define LOCK_WALLET_CHAIN() CCriticalBlock PASTE2(criticalblock, __COUNTER__)(CWalletChainView::Current() ? NULL : &cs_main, "cs_main", __FILE__, __LINE__)
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx : public CTransaction
 {
 private:
     int GetDepthInMainChainINTERNAL(const CBlockIndex*& pindexRet) const;
+    //! Whether depth 0 means in the mempool rather than conflicted
+    bool InMempoolINTERNAL() const;
 
 public:
     uint256 hashBlock;
@@ -789,6 +1040,8 @@ public:
 
     // memory only
     mutable bool fMerkleVerified;
+    //! Whether the wallet last saw it in the mempool; what a CWalletChainView goes by
+    mutable bool fInMempool;
 
 
     CMerkleTx()
@@ -806,6 +1059,7 @@ public:
         hashBlock = 0;
         nIndex = -1;
         fMerkleVerified = false;
+        fInMempool = false;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -892,6 +1146,8 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    //! Held without its input scripts, see IsCompact()
+    mutable bool fCompact;
 
     CWalletTx()
     {
@@ -950,6 +1206,7 @@ public:
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
         nOrderPos = -1;
+        fCompact = false;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -959,6 +1216,15 @@ public:
     {
         if (ser_action.ForRead())
             Init(NULL);
+
+        READWRITE(*(CMerkleTx*)this);
+        SerializeWalletData(s, ser_action, nType, nVersion);
+    }
+
+    /** What follows the CMerkleTx in the serialization */
+    template <typename Stream, typename Operation>
+    inline void SerializeWalletData(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
         char fSpent = false;
 
         if (!ser_action.ForRead()) {
@@ -970,7 +1236,6 @@ public:
                 mapValue["timesmart"] = strprintf("%u", nTimeSmart);
         }
 
-        READWRITE(*(CMerkleTx*)this);
         std::vector<CMerkleTx> vUnused; //! Used to be vtxPrev
         READWRITE(vUnused);
         READWRITE(mapValue);
@@ -995,9 +1260,29 @@ public:
         mapValue.erase("timesmart");
     }
 
+    /**
+     * Read a serialized CWalletTx, whose hash is hashIn, leaving out its input
+     * scripts. Returns false, with the stream as it was, for transactions that
+     * can't be told apart or checked without them: zerocoin spends and those
+     * with witnesses.
+     */
+    bool UnserializeCompact(CDataStream& s, const uint256& hashIn);
+
+    /**
+     * A compact transaction has everything but the scripts of its inputs, and
+     * its hash has not been checked against its contents. That is enough for
+     * balances, spends and history; whatever needs the whole transaction,
+     * writing, relaying or showing it, reads it back first with LoadFull().
+     */
+    bool IsCompact() const { return fCompact; }
+    /** Read the input scripts of a compact transaction back from the wallet file, through pwalletdb if given */
+    bool LoadFull(CWalletDB* pwalletdb = NULL) const;
+
     //! make sure balances are recalculated
     void MarkDirty()
     {
+        if (pwallet)
+            pwallet->MarkTxDirty(GetHash());
         fCreditCached = false;
         fAvailableCreditCached = false;
         fAnonymizableCreditCached = false;
@@ -1057,11 +1342,13 @@ public:
     }
 
     bool InMempool() const;
+    //! IsFinalTx() at the tip, or in the next block if fNextBlock (as CheckFinalTx())
+    bool IsFinal(bool fNextBlock = false) const;
 
     bool IsTrusted() const
     {
         // Quick answer in most cases
-        if (!IsFinalTx(*this))
+        if (!IsFinal())
             return false;
         int nDepth = GetDepthInMainChain();
         if (nDepth >= 1)
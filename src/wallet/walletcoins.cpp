@@ -0,0 +1,83 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/walletcoins.h"
+
+#include <limits>
+
+void CWalletCoinIndex::Add(const CWalletCoin& coin)
+{
+    Remove(coin.outpoint);
+    mapCoins.insert(std::make_pair(coin.outpoint, coin));
+    setByValue.insert(std::make_pair(coin.nValue, coin.outpoint));
+    setByHeight.insert(std::make_pair(coin.nHeight, coin.outpoint));
+    mapByDestination[coin.dest].insert(coin.outpoint);
+}
+
+bool CWalletCoinIndex::Remove(const COutPoint& outpoint)
+{
+    CoinMap::iterator it = mapCoins.find(outpoint);
+    if (it == mapCoins.end())
+        return false;
+
+    const CWalletCoin& coin = it->second;
+    setByValue.erase(std::make_pair(coin.nValue, outpoint));
+    setByHeight.erase(std::make_pair(coin.nHeight, outpoint));
+    std::map<CTxDestination, std::set<COutPoint> >::iterator itDest = mapByDestination.find(coin.dest);
+    if (itDest != mapByDestination.end()) {
+        itDest->second.erase(outpoint);
+        if (itDest->second.empty())
+            mapByDestination.erase(itDest);
+    }
+    mapCoins.erase(it);
+    return true;
+}
+
+void CWalletCoinIndex::RemoveTx(const uint256& hash)
+{
+    // Outpoints sort by hash first, so the coins of a transaction are adjacent
+    std::vector<COutPoint> vRemove;
+    for (CoinMap::const_iterator it = mapCoins.lower_bound(COutPoint(hash, 0)); it != mapCoins.end() && it->first.hash == hash; ++it)
+        vRemove.push_back(it->first);
+    for (const COutPoint& outpoint : vRemove)
+        Remove(outpoint);
+}
+
+void CWalletCoinIndex::Clear()
+{
+    mapCoins.clear();
+    setByValue.clear();
+    setByHeight.clear();
+    mapByDestination.clear();
+}
+
+const CWalletCoin* CWalletCoinIndex::Get(const COutPoint& outpoint) const
+{
+    CoinMap::const_iterator it = mapCoins.find(outpoint);
+    return it == mapCoins.end() ? NULL : &it->second;
+}
+
+void CWalletCoinIndex::GetByValue(CAmount nMinValue, CAmount nMaxValue, std::vector<const CWalletCoin*>& vCoins) const
+{
+    std::set<std::pair<CAmount, COutPoint> >::const_iterator it = setByValue.lower_bound(std::make_pair(nMinValue, COutPoint(uint256(), 0)));
+    for (; it != setByValue.end() && it->first <= nMaxValue; ++it)
+        vCoins.push_back(&mapCoins.find(it->second)->second);
+}
+
+void CWalletCoinIndex::GetByHeight(int nMaxHeight, std::vector<const CWalletCoin*>& vCoins) const
+{
+    // Unconfirmed coins sort first, at height -1
+    std::set<std::pair<int, COutPoint> >::const_iterator it = setByHeight.lower_bound(std::make_pair(0, COutPoint(uint256(), 0)));
+    for (; it != setByHeight.end() && it->first <= nMaxHeight; ++it)
+        vCoins.push_back(&mapCoins.find(it->second)->second);
+}
+
+void CWalletCoinIndex::GetByDestination(const CTxDestination& dest, std::vector<const CWalletCoin*>& vCoins) const
+{
+    std::map<CTxDestination, std::set<COutPoint> >::const_iterator itDest = mapByDestination.find(dest);
+    if (itDest == mapByDestination.end())
+        return;
+    for (const COutPoint& outpoint : itDest->second)
+        vCoins.push_back(&mapCoins.find(outpoint)->second);
+}
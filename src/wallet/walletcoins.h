@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_WALLETCOINS_H
+#define BITCOIN_WALLET_WALLETCOINS_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "script/standard.h"
+#include "wallet/wallet_ismine.h"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+/** An unspent output of a wallet transaction that pays the wallet */
+struct CWalletCoin {
+    COutPoint outpoint;
+    CAmount nValue;
+    //! Height of the block the transaction is in, -1 if it isn't in the active chain
+    int nHeight;
+    isminetype mine;
+    //! Where the output pays to; CNoDestination if it has no address
+    CTxDestination dest;
+
+    CWalletCoin() : nValue(0), nHeight(-1), mine(ISMINE_NO) {}
+    CWalletCoin(const COutPoint& outpointIn, CAmount nValueIn, int nHeightIn, isminetype mineIn, const CTxDestination& destIn) : outpoint(outpointIn), nValue(nValueIn), nHeight(nHeightIn), mine(mineIn), dest(destIn) {}
+};
+
+/**
+ * The unspent outputs of the wallet, indexed by outpoint, value, height and
+ * address. CWallet keeps it in step with mapWallet, so listing spendable coins
+ * doesn't walk every transaction and run IsMine() and IsSpent() on every
+ * output. Whether a coin can be spent right now (trust, maturity, locks) is
+ * still up to the caller.
+ */
+class CWalletCoinIndex
+{
+public:
+    typedef std::map<COutPoint, CWalletCoin> CoinMap;
+
+private:
+    CoinMap mapCoins;
+    std::set<std::pair<CAmount, COutPoint> > setByValue;
+    std::set<std::pair<int, COutPoint> > setByHeight;
+    std::map<CTxDestination, std::set<COutPoint> > mapByDestination;
+
+public:
+    //! Add a coin, replacing any coin with the same outpoint
+    void Add(const CWalletCoin& coin);
+    bool Remove(const COutPoint& outpoint);
+    //! Remove all coins of a transaction
+    void RemoveTx(const uint256& hash);
+    void Clear();
+
+    const CWalletCoin* Get(const COutPoint& outpoint) const;
+    size_t Size() const { return mapCoins.size(); }
+    CoinMap::const_iterator begin() const { return mapCoins.begin(); }
+    CoinMap::const_iterator end() const { return mapCoins.end(); }
+
+    //! Coins worth between nMinValue and nMaxValue, smallest first
+    void GetByValue(CAmount nMinValue, CAmount nMaxValue, std::vector<const CWalletCoin*>& vCoins) const;
+    //! Confirmed coins in blocks up to nMaxHeight, oldest first
+    void GetByHeight(int nMaxHeight, std::vector<const CWalletCoin*>& vCoins) const;
+    void GetByDestination(const CTxDestination& dest, std::vector<const CWalletCoin*>& vCoins) const;
+};
+
+#endif // BITCOIN_WALLET_WALLETCOINS_H
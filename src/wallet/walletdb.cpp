@@ -17,6 +17,7 @@
 #include "util.h"
 #include "utiltime.h"
 #include "wallet.h"
+#include "wallet/logdb.h"
 #include "primitives/deterministicmint.h"
 
 #include <boost/filesystem.hpp>
@@ -61,10 +62,18 @@ bool CWalletDB::ErasePurpose(const string& strPurpose)
 
 bool CWalletDB::WriteTx(uint256 hash, const CWalletTx& wtx)
 {
+    // Compact transactions are written in full
+    if (!wtx.LoadFull(this))
+        return false;
     nWalletDBUpdated++;
     return Write(std::make_pair(std::string("tx"), hash), wtx);
 }
 
+bool CWalletDB::ReadTx(uint256 hash, CWalletTx& wtx)
+{
+    return Read(std::make_pair(std::string("tx"), hash), wtx);
+}
+
 bool CWalletDB::EraseTx(uint256 hash)
 {
     nWalletDBUpdated++;
@@ -155,6 +164,24 @@ bool CWalletDB::ReadBestBlock(CBlockLocator& locator)
     return Read(std::string("bestblock"), locator);
 }
 
+/** Last block scanned by a rescan that has not finished yet */
+bool CWalletDB::WriteRescanProgress(const CBlockLocator& locator)
+{
+    nWalletDBUpdated++;
+    return Write(std::string("rescanprogress"), locator);
+}
+
+bool CWalletDB::ReadRescanProgress(CBlockLocator& locator)
+{
+    return Read(std::string("rescanprogress"), locator);
+}
+
+bool CWalletDB::EraseRescanProgress()
+{
+    nWalletDBUpdated++;
+    return Erase(std::string("rescanprogress"));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext)
 {
     nWalletDBUpdated++;
@@ -299,7 +326,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error("CWalletDB::ListAccountCreditDebit() : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -314,7 +341,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         if (ret == DB_NOTFOUND)
             break;
         else if (ret != 0) {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error("CWalletDB::ListAccountCreditDebit() : error scanning DB");
         }
 
@@ -333,7 +360,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    delete pcursor;
 }
 
 DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
@@ -405,16 +432,20 @@ public:
     unsigned int nKeys;
     unsigned int nCKeys;
     unsigned int nKeyMeta;
+    unsigned int nCompactTx;
     bool fIsEncrypted;
     bool fAnyUnordered;
+    //! Load transactions without their input scripts (-lazywallet)
+    bool fCompactTx;
     int nFileVersion;
     vector<uint256> vWalletUpgrade;
 
     CWalletScanState()
     {
-        nKeys = nCKeys = nKeyMeta = 0;
+        nKeys = nCKeys = nKeyMeta = nCompactTx = 0;
         fIsEncrypted = false;
         fAnyUnordered = false;
+        fCompactTx = false;
         nFileVersion = 0;
     }
 };
@@ -438,11 +469,16 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             uint256 hash;
             ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            // false because there is no reason to go through the zerocoin checks for our own wallet
-            if (!(CheckTransaction(wtx, false, false, state, IsSporkActive(SPORK_20_SEGWIT_ACTIVATION)) && (wtx.GetHash() == hash) && state.IsValid()))
-                return false;
+            if (wss.fCompactTx && wtx.UnserializeCompact(ssValue, hash)) {
+                // Checked against its hash when it is read in full
+                wss.nCompactTx++;
+            } else {
+                ssValue >> wtx;
+                CValidationState state;
+                // false because there is no reason to go through the zerocoin checks for our own wallet
+                if (!(CheckTransaction(wtx, false, false, state, IsSporkActive(SPORK_20_SEGWIT_ACTIVATION)) && (wtx.GetHash() == hash) && state.IsValid()))
+                    return false;
+            }
 
             // Undo serialize changes in 31600
             if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
@@ -677,6 +713,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
     CWalletScanState wss;
+    wss.fCompactTx = GetBoolArg("-lazywallet", DEFAULT_LAZY_WALLET);
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
@@ -690,7 +727,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor) {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
@@ -726,7 +763,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        delete pcursor;
     } catch (boost::thread_interrupted) {
         throw;
     } catch (...) {
@@ -745,6 +782,8 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 
     LogPrintf("Keys: %u plaintext, %u encrypted, %u w/ metadata, %u total\n",
         wss.nKeys, wss.nCKeys, wss.nKeyMeta, wss.nKeys + wss.nCKeys);
+    if (wss.fCompactTx)
+        LogPrintf("Transactions: %u, %u held without input scripts\n", pwallet->mapWallet.size(), wss.nCompactTx);
 
     // nTimeFirstKey is only reliable if all keys have metadata
     if ((wss.nKeys + wss.nCKeys) != wss.nKeyMeta)
@@ -788,7 +827,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor) {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
@@ -819,7 +858,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        delete pcursor;
     } catch (boost::thread_interrupted) {
         throw;
     } catch (...) {
@@ -873,6 +912,13 @@ void ThreadFlushWalletDB(const string& strFile)
         }
 
         if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2) {
+            if (logdb.IsLogDB(strFile)) {
+                // A log is synced, and compacted when that's due, under its open handles
+                nLastFlushed = nWalletDBUpdated;
+                logdb.Flush(strFile);
+                continue;
+            }
+
             TRY_LOCK(bitdb.cs_db, lockDb);
             if (lockDb) {
                 // Don't do this if any databases are in use
@@ -937,11 +983,18 @@ bool BackupWallet(const CWallet& wallet, const filesystem::path& strDest, bool f
     while (true) {
         {
             LOCK(bitdb.cs_db);
-            if (!bitdb.mapFileUseCount.count(wallet.strWalletFile) || bitdb.mapFileUseCount[wallet.strWalletFile] == 0) {
-                // Flush log data to the dat file
-                bitdb.CloseDb(wallet.strWalletFile);
-                bitdb.CheckpointLSN(wallet.strWalletFile);
-                bitdb.mapFileUseCount.erase(wallet.strWalletFile);
+            bool fLogDB = logdb.IsLogDB(wallet.strWalletFile);
+            if (fLogDB || !bitdb.mapFileUseCount.count(wallet.strWalletFile) || bitdb.mapFileUseCount[wallet.strWalletFile] == 0) {
+                if (fLogDB) {
+                    // Handles can stay open: a copy that ends in a commit
+                    // still being written loses it when the copy is opened
+                    logdb.Flush(wallet.strWalletFile);
+                } else {
+                    // Flush log data to the dat file
+                    bitdb.CloseDb(wallet.strWalletFile);
+                    bitdb.CheckpointLSN(wallet.strWalletFile);
+                    bitdb.mapFileUseCount.erase(wallet.strWalletFile);
+                }
 
                 // Copy wallet.dat
                 filesystem::path pathDest(strDest);
@@ -1324,7 +1377,7 @@ bool CWalletDB::WriteMintPoolPair(const uint256& hashMasterSeed, const uint256&
 std::map<uint256, std::vector<pair<uint256, uint32_t> > > CWalletDB::MapMintPool()
 {
     std::map<uint256, std::vector<pair<uint256, uint32_t> > > mapPool;
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -1341,7 +1394,7 @@ std::map<uint256, std::vector<pair<uint256, uint32_t> > > CWalletDB::MapMintPool
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__)+" : error scanning DB");
         }
 
@@ -1372,7 +1425,7 @@ std::map<uint256, std::vector<pair<uint256, uint32_t> > > CWalletDB::MapMintPool
         }
     }
 
-    pcursor->close();
+    delete pcursor;
 
     return mapPool;
 }
@@ -1380,7 +1433,7 @@ std::map<uint256, std::vector<pair<uint256, uint32_t> > > CWalletDB::MapMintPool
 std::list<CDeterministicMint> CWalletDB::ListDeterministicMints()
 {
     std::list<CDeterministicMint> listMints;
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -1397,7 +1450,7 @@ std::list<CDeterministicMint> CWalletDB::ListDeterministicMints()
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__)+" : error scanning DB");
         }
 
@@ -1416,14 +1469,14 @@ std::list<CDeterministicMint> CWalletDB::ListDeterministicMints()
         listMints.emplace_back(mint);
     }
 
-    pcursor->close();
+    delete pcursor;
     return listMints;
 }
 
 std::list<CZerocoinMint> CWalletDB::ListMintedCoins()
 {
     std::list<CZerocoinMint> listPubCoin;
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -1442,7 +1495,7 @@ std::list<CZerocoinMint> CWalletDB::ListMintedCoins()
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__)+" : error scanning DB");
         }
 
@@ -1461,14 +1514,14 @@ std::list<CZerocoinMint> CWalletDB::ListMintedCoins()
         listPubCoin.emplace_back(mint);
     }
 
-    pcursor->close();
+    delete pcursor;
     return listPubCoin;
 }
 
 std::list<CZerocoinSpend> CWalletDB::ListSpentCoins()
 {
     std::list<CZerocoinSpend> listCoinSpend;
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -1485,7 +1538,7 @@ std::list<CZerocoinSpend> CWalletDB::ListSpentCoins()
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__)+" : error scanning DB");
         }
 
@@ -1504,7 +1557,7 @@ std::list<CZerocoinSpend> CWalletDB::ListSpentCoins()
         listCoinSpend.push_back(zerocoinSpendItem);
     }
 
-    pcursor->close();
+    delete pcursor;
     return listCoinSpend;
 }
 
@@ -1523,7 +1576,7 @@ std::list<CBigNum> CWalletDB::ListSpentCoinsSerial()
 std::list<CZerocoinMint> CWalletDB::ListArchivedZerocoins()
 {
     std::list<CZerocoinMint> listMints;
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -1540,7 +1593,7 @@ std::list<CZerocoinMint> CWalletDB::ListArchivedZerocoins()
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__)+" : error scanning DB");
         }
 
@@ -1559,14 +1612,14 @@ std::list<CZerocoinMint> CWalletDB::ListArchivedZerocoins()
         listMints.push_back(mint);
     }
 
-    pcursor->close();
+    delete pcursor;
     return listMints;
 }
 
 std::list<CDeterministicMint> CWalletDB::ListArchivedDeterministicMints()
 {
     std::list<CDeterministicMint> listMints;
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__)+" : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -1583,7 +1636,7 @@ std::list<CDeterministicMint> CWalletDB::ListArchivedDeterministicMints()
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__)+" : error scanning DB");
         }
 
@@ -1602,6 +1655,6 @@ std::list<CDeterministicMint> CWalletDB::ListArchivedDeterministicMints()
         listMints.emplace_back(dMint);
     }
 
-    pcursor->close();
+    delete pcursor;
     return listMints;
 }
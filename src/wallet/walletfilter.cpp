@@ -0,0 +1,202 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/walletfilter.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "version.h"
+
+#include <limits>
+
+CWalletFilter::CWalletFilter() : nCapacity(MIN_ELEMENTS), nTweak(GetRand(std::numeric_limits<unsigned int>::max()))
+{
+    vData.resize(nCapacity * BITS_PER_ELEMENT / 8);
+}
+
+uint64_t CWalletFilter::HashElement(const std::vector<unsigned char>& vKey) const
+{
+    // Both halves seed the bit positions (double hashing), and together
+    // they are the key of the element set
+    uint64_t nHigh = MurmurHash3(nTweak, vKey);
+    uint64_t nLow = MurmurHash3(nTweak ^ 0xfba4c795, vKey);
+    return (nHigh << 32) | nLow;
+}
+
+void CWalletFilter::SetBits(uint64_t nHash)
+{
+    uint32_t h1 = nHash >> 32, h2 = (uint32_t)nHash;
+    uint32_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < HASH_FUNCS; i++) {
+        uint32_t nIndex = (h1 + i * h2) % nBits;
+        vData[nIndex >> 3] |= (1 << (7 & nIndex));
+    }
+}
+
+bool CWalletFilter::HaveBits(uint64_t nHash) const
+{
+    uint32_t h1 = nHash >> 32, h2 = (uint32_t)nHash;
+    uint32_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < HASH_FUNCS; i++) {
+        uint32_t nIndex = (h1 + i * h2) % nBits;
+        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+            return false;
+    }
+    return true;
+}
+
+void CWalletFilter::InsertHash(uint64_t nHash)
+{
+    AssertLockHeld(cs);
+    if (!setElements.insert(nHash).second)
+        return;
+    if (setElements.size() <= nCapacity) {
+        SetBits(nHash);
+        return;
+    }
+
+    // Grow the bloom filter so the false positive rate stays put, and
+    // rebuild it from the element hashes
+    nCapacity *= 2;
+    vData.assign(nCapacity * BITS_PER_ELEMENT / 8, 0);
+    for (uint64_t n : setElements)
+        SetBits(n);
+}
+
+bool CWalletFilter::ContainsHash(uint64_t nHash) const
+{
+    AssertLockHeld(cs);
+    return HaveBits(nHash) && setElements.count(nHash);
+}
+
+void CWalletFilter::Insert(const std::vector<unsigned char>& vKey)
+{
+    uint64_t nHash = HashElement(vKey);
+    LOCK(cs);
+    InsertHash(nHash);
+}
+
+void CWalletFilter::Insert(const COutPoint& outpoint)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << outpoint;
+    Insert(std::vector<unsigned char>(stream.begin(), stream.end()));
+}
+
+void CWalletFilter::Insert(const CPubKey& pubkey)
+{
+    // P2PK and bare multisig push the public key, P2PKH and P2WPKH its ID
+    CKeyID keyID = pubkey.GetID();
+    Insert(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+    Insert(std::vector<unsigned char>(keyID.begin(), keyID.end()));
+}
+
+void CWalletFilter::InsertScript(const CScript& script)
+{
+    // P2SH pushes the script ID, P2WSH the SHA256 of the witness script
+    CScriptID scriptID(script);
+    std::vector<unsigned char> vHash(CSHA256::OUTPUT_SIZE);
+    CSHA256().Write(script.data(), script.size()).Finalize(vHash.data());
+    Insert(std::vector<unsigned char>(scriptID.begin(), scriptID.end()));
+    Insert(vHash);
+}
+
+void CWalletFilter::InsertWatchOnly(const CScript& script)
+{
+    Insert(std::vector<unsigned char>(script.begin(), script.end()));
+}
+
+void CWalletFilter::InsertOutputs(const CTransaction& tx)
+{
+    uint256 hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        Insert(COutPoint(hash, i));
+}
+
+bool CWalletFilter::Contains(const std::vector<unsigned char>& vKey) const
+{
+    uint64_t nHash = HashElement(vKey);
+    LOCK(cs);
+    return ContainsHash(nHash);
+}
+
+bool CWalletFilter::Contains(const COutPoint& outpoint) const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << outpoint;
+    return Contains(std::vector<unsigned char>(stream.begin(), stream.end()));
+}
+
+bool CWalletFilter::MatchesScriptLocked(const CScript& script) const
+{
+    AssertLockHeld(cs);
+    if (ContainsHash(HashElement(std::vector<unsigned char>(script.begin(), script.end()))))
+        return true;
+
+    // Key IDs, script IDs, public keys and witness script hashes
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> vPush;
+    while (pc < script.end()) {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, vPush))
+            break;
+        if ((vPush.size() == 20 || vPush.size() == 32 || vPush.size() == 33 || vPush.size() == 65) && ContainsHash(HashElement(vPush)))
+            return true;
+    }
+    return false;
+}
+
+bool CWalletFilter::MatchesScript(const CScript& script) const
+{
+    LOCK(cs);
+    return MatchesScriptLocked(script);
+}
+
+bool CWalletFilter::MatchesOutputs(const CTransaction& tx) const
+{
+    LOCK(cs);
+    for (const CTxOut& txout : tx.vout) {
+        if (MatchesScriptLocked(txout.scriptPubKey))
+            return true;
+    }
+    return false;
+}
+
+bool CWalletFilter::IsRelevant(const CTransaction& tx) const
+{
+    LOCK(cs);
+    for (const CTxOut& txout : tx.vout) {
+        if (MatchesScriptLocked(txout.scriptPubKey))
+            return true;
+    }
+    if (tx.IsCoinBase() || tx.IsZerocoinSpend())
+        return false;
+    for (const CTxIn& txin : tx.vin) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << txin.prevout;
+        if (ContainsHash(HashElement(std::vector<unsigned char>(stream.begin(), stream.end()))))
+            return true;
+    }
+    return false;
+}
+
+size_t CWalletFilter::Size() const
+{
+    LOCK(cs);
+    return setElements.size();
+}
+
+void CWalletFilter::Clear()
+{
+    LOCK(cs);
+    setElements.clear();
+    nCapacity = MIN_ELEMENTS;
+    vData.assign(nCapacity * BITS_PER_ELEMENT / 8, 0);
+}
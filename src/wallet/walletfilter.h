@@ -0,0 +1,84 @@
+// Copyright (c) 2019 The Ohmcoin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_WALLETFILTER_H
+#define BITCOIN_WALLET_WALLETFILTER_H
+
+#include "sync.h"
+
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+
+class COutPoint;
+class CPubKey;
+class CScript;
+class CTransaction;
+
+/**
+ * Compact membership filter over everything that can make a transaction
+ * relevant to the wallet: the public keys, key IDs, script IDs and witness
+ * script hashes of the keystore, the watch-only scripts, and the outpoints of
+ * the wallet's transactions.
+ *
+ * An output matches if its script, or one of the data pushes in it, is in the
+ * filter, the same way CBloomFilter matches for SPV peers; this covers every
+ * script ::IsMine() can return anything but ISMINE_NO for. An input matches if
+ * the outpoint it spends is in the filter. Elements are checked against a bloom
+ * filter first, and the few hits against a set of 64-bit element hashes, so
+ * most transactions are rejected without touching the keystore or mapWallet.
+ *
+ * A match doesn't mean the transaction is ours (elements are never removed,
+ * and the hashes can collide), but a transaction that is ours always matches.
+ */
+class CWalletFilter
+{
+private:
+    //! Bits per element and hash functions for a false positive rate below 1%
+    static const unsigned int BITS_PER_ELEMENT = 10;
+    static const unsigned int HASH_FUNCS = 7;
+    static const unsigned int MIN_ELEMENTS = 1024;
+
+    mutable CCriticalSection cs;
+    std::vector<unsigned char> vData;
+    unsigned int nCapacity;
+    std::unordered_set<uint64_t> setElements;
+    const unsigned int nTweak;
+
+    uint64_t HashElement(const std::vector<unsigned char>& vKey) const;
+    void SetBits(uint64_t nHash);
+    bool HaveBits(uint64_t nHash) const;
+    void InsertHash(uint64_t nHash);
+    bool ContainsHash(uint64_t nHash) const;
+    bool MatchesScriptLocked(const CScript& script) const;
+
+public:
+    CWalletFilter();
+
+    void Insert(const std::vector<unsigned char>& vKey);
+    void Insert(const COutPoint& outpoint);
+    //! A key of the wallet: its public key and key ID
+    void Insert(const CPubKey& pubkey);
+    //! A redeem or witness script of the wallet: its script ID and witness script hash
+    void InsertScript(const CScript& script);
+    //! A watch-only script: the script itself
+    void InsertWatchOnly(const CScript& script);
+    //! The outpoints of a wallet transaction, so inputs spending them match
+    void InsertOutputs(const CTransaction& tx);
+
+    bool Contains(const std::vector<unsigned char>& vKey) const;
+    bool Contains(const COutPoint& outpoint) const;
+
+    //! Whether the output script may pay the wallet
+    bool MatchesScript(const CScript& script) const;
+    //! Whether any output of tx may pay the wallet
+    bool MatchesOutputs(const CTransaction& tx) const;
+    //! Whether tx may pay the wallet or spend from it; false only if it does neither
+    bool IsRelevant(const CTransaction& tx) const;
+
+    size_t Size() const;
+    void Clear();
+};
+
+#endif // BITCOIN_WALLET_WALLETFILTER_H
@@ -7,15 +7,21 @@
 
 #include "zmqconfig.h"
 
+class CBlock;
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+//! Outbound messages a subscriber may fall behind by before ZeroMQ drops them
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+//! Notifications sent as one multipart message; 1 sends each one on its own
+static const int DEFAULT_ZMQ_BATCH_SIZE = 1;
+
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), nHighWaterMark(DEFAULT_ZMQ_SNDHWM), nBatchSize(DEFAULT_ZMQ_BATCH_SIZE) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,18 +34,34 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetHighWaterMark() const { return nHighWaterMark; }
+    void SetHighWaterMark(int n) { nHighWaterMark = n; }
+    int GetBatchSize() const { return nBatchSize; }
+    void SetBatchSize(int n) { nBatchSize = n; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    //! pblock is the block read from disk if a notifier wants it (see WantsBlock()), otherwise NULL
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
+    //! Whether NotifyBlock() needs the whole block
+    virtual bool WantsBlock() const { return false; }
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    virtual bool NotifyBlockConnect(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence);
+
+    /** Send the notifications held back for batching */
+    virtual bool Flush();
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int nHighWaterMark;
+    int nBatchSize;
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
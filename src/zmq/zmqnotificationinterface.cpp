@@ -8,8 +8,11 @@
 #include "version.h"
 #include "main.h"
 #include "streams.h"
+#include "txmempool.h"
 #include "util.h"
 
+#include <boost/bind/bind.hpp>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
@@ -41,17 +44,36 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
         std::map<std::string, std::string>::const_iterator j = args.find("-zmq" + i->first);
         if (j!=args.end())
         {
+            int nHighWaterMark = DEFAULT_ZMQ_SNDHWM;
+            int nBatchSize = DEFAULT_ZMQ_BATCH_SIZE;
+            std::map<std::string, std::string>::const_iterator k = args.find("-zmq" + i->first + "hwm");
+            if (k != args.end())
+                nHighWaterMark = atoi(k->second);
+            k = args.find("-zmq" + i->first + "batch");
+            if (k != args.end())
+                nBatchSize = atoi(k->second);
+            if (nHighWaterMark < 0 || nBatchSize < 1)
+            {
+                LogPrintf("zmq: Invalid high water mark or batch size for %s\n", i->first);
+                for (std::list<CZMQAbstractNotifier*>::iterator n = notifiers.begin(); n != notifiers.end(); ++n)
+                    delete *n;
+                return NULL;
+            }
+
             CZMQNotifierFactory factory = i->second;
             std::string address = j->second;
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            notifier->SetHighWaterMark(nHighWaterMark);
+            notifier->SetBatchSize(nBatchSize);
             notifiers.push_back(notifier);
         }
     }
@@ -112,12 +134,14 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    LOCK(cs);
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
             LogPrint("zmq", "   Shutdown notifier %s at %s\n", notifier->GetType(), notifier->GetAddress());
+            notifier->Flush();
             notifier->Shutdown();
         }
         zmq_ctx_destroy(pcontext);
@@ -126,12 +150,13 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::ForEachNotifier(const boost::function<bool(CZMQAbstractNotifier*)>& func)
 {
+    LOCK(cs);
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        if (func(notifier))
         {
             i++;
         }
@@ -143,36 +168,69 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+void CZMQNotificationInterface::FlushBatches()
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::Flush, boost::placeholders::_1));
+}
+
+bool CZMQNotificationInterface::WantsBlock()
+{
+    LOCK(cs);
+    for (std::list<CZMQAbstractNotifier*>::const_iterator i = notifiers.begin(); i != notifiers.end(); ++i)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        if ((*i)->WantsBlock())
+            return true;
     }
+    return false;
 }
 
-void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    // This comes without cs_main, while the other signals come holding it
+    // and take cs after it, so the block is read before cs is taken
+    CBlock block;
+    bool fHaveBlock = false;
+    if (WantsBlock())
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        LOCK(cs_main);
+        fHaveBlock = ReadBlockFromDisk(block, pindex);
     }
+
+    // Held back transactions go out before the block that may include them
+    FlushBatches();
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyBlock, boost::placeholders::_1, pindex, fHaveBlock ? &block : NULL));
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyTransaction, boost::placeholders::_1, boost::cref(tx)));
+}
+
+void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+{
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyTransactionLock, boost::placeholders::_1, boost::cref(tx)));
+}
+
+void CZMQNotificationInterface::TransactionAddedToMempool(const CTransaction &tx, uint64_t nMempoolSequence)
+{
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyTransactionAcceptance, boost::placeholders::_1, boost::cref(tx), nMempoolSequence));
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(const CTransaction &tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence)
+{
+    // Transactions leaving the pool for a block are covered by the block connect
+    if (reason == MemPoolRemovalReason::BLOCK)
+        return;
+    LogPrint("zmq", "zmq: Transaction %s left the mempool (%s)\n", tx.GetHash().GetHex(), GetMemPoolRemovalReasonName(reason));
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyTransactionRemoval, boost::placeholders::_1, boost::cref(tx), nMempoolSequence));
+}
+
+void CZMQNotificationInterface::BlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyBlockConnect, boost::placeholders::_1, pindex));
+}
+
+void CZMQNotificationInterface::BlockDisconnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    ForEachNotifier(boost::bind(&CZMQAbstractNotifier::NotifyBlockDisconnect, boost::placeholders::_1, pindex));
 }
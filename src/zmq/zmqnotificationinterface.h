@@ -5,13 +5,19 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
 
+#include <boost/function.hpp>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+//! Seconds a batched notification is held back at most
+static const int ZMQ_BATCH_FLUSH_INTERVAL = 1;
+
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -19,6 +25,9 @@ public:
 
     static CZMQNotificationInterface* CreateWithArguments(const std::map<std::string, std::string> &args);
 
+    /** Send what the notifiers hold back for batching; run every ZMQ_BATCH_FLUSH_INTERVAL seconds */
+    void FlushBatches();
+
 protected:
     bool Initialize();
     void Shutdown();
@@ -27,10 +36,21 @@ protected:
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void NotifyTransactionLock(const CTransaction &tx);
+    void TransactionAddedToMempool(const CTransaction &tx, uint64_t nMempoolSequence);
+    void TransactionRemovedFromMempool(const CTransaction &tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence);
+    void BlockConnected(const CBlock &block, const CBlockIndex *pindex);
+    void BlockDisconnected(const CBlock &block, const CBlockIndex *pindex);
 
 private:
     CZMQNotificationInterface();
 
+    /** Call func on every notifier, shutting down and dropping the ones it fails for */
+    void ForEachNotifier(const boost::function<bool(CZMQAbstractNotifier*)>& func);
+    //! Whether a notifier needs whole blocks, which are read before cs is taken
+    bool WantsBlock();
+
+    //! Notifications arrive from the validation code and the scheduler; ZeroMQ sockets are not thread safe
+    CCriticalSection cs;
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
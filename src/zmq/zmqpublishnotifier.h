@@ -7,22 +7,31 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <vector>
+
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence; // upcounting per message sequence number
+    const char *batchCommand; // command of the notifications held back in vBatch
+    std::vector<std::vector<unsigned char> > vBatch;
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0), batchCommand(NULL) { }
 
     /* send zmq multipart message
        parts:
           * command
           * data
           * message sequence number
+       With a batch size above one, the data of up to that many
+       notifications is collected and sent as consecutive data parts
+       of one message.
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    bool Flush();
 
     bool Initialize(void *pcontext);
     void Shutdown();
@@ -31,7 +40,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -49,7 +58,8 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
+    bool WantsBlock() const { return true; }
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -64,4 +74,20 @@ public:
     bool NotifyTransactionLock(const CTransaction &transaction);
 };
 
+/* Publishes the order in which blocks are connected and disconnected and
+   transactions enter and leave the mempool. The data is the hash followed
+   by a one character label, C or D for a block connected or disconnected,
+   A or R for a transaction added to or removed from the mempool. A and R
+   are followed by the mempool sequence number of the change (LE 8 byte),
+   which getrawmempool can return with its snapshot of the pool.
+*/
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const CBlockIndex *pindex);
+    bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence);
+    bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -17,8 +17,10 @@ CzOHMCTracker::CzOHMCTracker(std::string strWalletFile)
 {
     this->strWalletFile = strWalletFile;
     mapSerialHashes.clear();
+    mapPubcoinHashes.clear();
     mapPendingSpends.clear();
     fInitialized = false;
+    fStatusChecked = false;
 }
 
 CzOHMCTracker::~CzOHMCTracker()
@@ -88,13 +90,11 @@ CMintMeta CzOHMCTracker::Get(const uint256 &hashSerial)
 
 CMintMeta CzOHMCTracker::GetMetaFromPubcoin(const uint256& hashPubcoin)
 {
-    for (auto it : mapSerialHashes) {
-        CMintMeta meta = it.second;
-        if (meta.hashPubcoin == hashPubcoin)
-            return meta;
-    }
+    auto it = mapPubcoinHashes.find(hashPubcoin);
+    if (it == mapPubcoinHashes.end())
+        return CMintMeta();
 
-    return CMintMeta();
+    return Get(it->second);
 }
 
 bool CzOHMCTracker::GetMetaFromStakeHash(const uint256& hashStake, CMintMeta& meta) const
@@ -199,12 +199,7 @@ bool CzOHMCTracker::HasPubcoin(const CBigNum &bnValue) const
 
 bool CzOHMCTracker::HasPubcoinHash(const uint256& hashPubcoin) const
 {
-    for (auto it : mapSerialHashes) {
-        CMintMeta meta = it.second;
-        if (meta.hashPubcoin == hashPubcoin)
-            return true;
-    }
-    return false;
+    return mapPubcoinHashes.count(hashPubcoin) > 0;
 }
 
 bool CzOHMCTracker::HasSerial(const CBigNum& bnSerial) const
@@ -275,11 +270,17 @@ bool CzOHMCTracker::UpdateState(const CMintMeta& meta)
             return error("%s: failed to write mint to database", __func__);
     }
 
-    mapSerialHashes[meta.hashSerial] = meta;
+    SetMeta(meta);
 
     return true;
 }
 
+void CzOHMCTracker::SetMeta(const CMintMeta& meta)
+{
+    mapSerialHashes[meta.hashSerial] = meta;
+    mapPubcoinHashes[meta.hashPubcoin] = meta.hashSerial;
+}
+
 void CzOHMCTracker::Add(const CDeterministicMint& dMint, bool isNew, bool isArchived)
 {
     CMintMeta meta;
@@ -293,7 +294,7 @@ void CzOHMCTracker::Add(const CDeterministicMint& dMint, bool isNew, bool isArch
     meta.denom = dMint.GetDenomination();
     meta.isArchived = isArchived;
     meta.isDeterministic = true;
-    mapSerialHashes[meta.hashSerial] = meta;
+    SetMeta(meta);
 
     if (isNew)
         CWalletDB(strWalletFile).WriteDeterministicMint(dMint);
@@ -313,7 +314,7 @@ void CzOHMCTracker::Add(const CZerocoinMint& mint, bool isNew, bool isArchived)
     meta.denom = mint.GetDenomination();
     meta.isArchived = isArchived;
     meta.isDeterministic = false;
-    mapSerialHashes[meta.hashSerial] = meta;
+    SetMeta(meta);
 
     if (isNew)
         CWalletDB(strWalletFile).WriteZerocoinMint(mint);
@@ -356,7 +357,7 @@ void CzOHMCTracker::RemovePending(const uint256& txid)
         mapPendingSpends.erase(hashSerial);
 }
 
-bool CzOHMCTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CMintMeta& mint)
+bool CzOHMCTracker::UpdateStatusInternal(CMintMeta& mint)
 {
     //! Check whether this mint has been spent and is considered 'pending' or 'confirmed'
     // If there is not a record of the block height, then look it up and assign it
@@ -373,7 +374,7 @@ bool CzOHMCTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CM
     // Double check the mempool for pending spend
     if (isPendingSpend) {
         uint256 txidPendingSpend = mapPendingSpends.at(mint.hashSerial);
-        if (!setMempool.count(txidPendingSpend) || isConfirmedSpend) {
+        if (!mempool.exists(txidPendingSpend) || isConfirmedSpend) {
             RemovePending(txidPendingSpend);
             isPendingSpend = false;
             LogPrintf("%s : Pending txid %s removed because not in mempool\n", __func__, txidPendingSpend.GetHex());
@@ -397,7 +398,7 @@ bool CzOHMCTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CM
             mint.txid = txidMint;
         }
 
-        if (setMempool.count(mint.txid))
+        if (mempool.exists(mint.txid))
             return true;
 
         // Check the transaction associated with this mint
@@ -432,10 +433,52 @@ bool CzOHMCTracker::UpdateStatusInternal(const std::set<uint256>& setMempool, CM
     return false;
 }
 
+bool CzOHMCTracker::NeedsStatusUpdate(const CMintMeta& mint) const
+{
+    // Unconfirmed mints and pending spends can change without a transaction
+    // of ours being connected, by leaving the mempool
+    return !fStatusChecked || setStatusDirty.count(mint.hashSerial) || !mint.nHeight || mint.txid == 0 ||
+           mapPendingSpends.count(mint.hashSerial);
+}
+
+void CzOHMCTracker::MarkStatusDirty(const CTransaction& tx)
+{
+    for (const CTxOut& out : tx.vout) {
+        if (!out.scriptPubKey.IsZerocoinMint())
+            continue;
+
+        libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params());
+        CValidationState state;
+        if (!TxOutToPublicCoin(out, pubcoin, state))
+            continue;
+        auto it = mapPubcoinHashes.find(GetPubCoinHash(pubcoin.getValue()));
+        if (it != mapPubcoinHashes.end())
+            setStatusDirty.insert(it->second);
+    }
+
+    if (!tx.IsZerocoinSpend())
+        return;
+    for (const CTxIn& txin : tx.vin) {
+        if (!txin.scriptSig.IsZerocoinSpend())
+            continue;
+
+        try {
+            libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
+            uint256 hashSerial = GetSerialHash(spend.getCoinSerialNumber());
+            if (mapSerialHashes.count(hashSerial))
+                setStatusDirty.insert(hashSerial);
+        } catch (const std::exception& e) {
+            LogPrint("zero", "%s : failed to read spend in %s: %s\n", __func__, tx.GetHash().GetHex(), e.what());
+        }
+    }
+}
+
 std::set<CMintMeta> CzOHMCTracker::ListMints(bool fUnusedOnly, bool fMatureOnly, bool fUpdateStatus)
 {
     CWalletDB walletdb(strWalletFile);
-    if (fUpdateStatus) {
+    // Every later change goes through the tracker, so the mints are read
+    // from the database until their status has been checked once
+    if (fUpdateStatus && !fStatusChecked) {
         std::list<CZerocoinMint> listMintsDB = walletdb.ListMintedCoins();
         for (auto& mint : listMintsDB)
             Add(mint);
@@ -449,11 +492,6 @@ std::set<CMintMeta> CzOHMCTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
 
     std::vector<CMintMeta> vOverWrite;
     std::set<CMintMeta> setMints;
-    std::set<uint256> setMempool;
-    {
-        LOCK(mempool.cs);
-        mempool.getTransactions(setMempool);
-    }
 
     std::map<libzerocoin::CoinDenomination, int> mapMaturity = GetMintMaturityHeight();
     for (auto& it : mapSerialHashes) {
@@ -463,8 +501,9 @@ std::set<CMintMeta> CzOHMCTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
         if (mint.isArchived)
             continue;
 
-        // Update the metadata of the mints if requested
-        if (fUpdateStatus && UpdateStatusInternal(setMempool, mint)) {
+        // Update the metadata of the mints if requested, and if anything
+        // may have changed since they were last looked at
+        if (fUpdateStatus && NeedsStatusUpdate(mint) && UpdateStatusInternal(mint)) {
             if (mint.isArchived)
                 continue;
 
@@ -489,10 +528,18 @@ std::set<CMintMeta> CzOHMCTracker::ListMints(bool fUnusedOnly, bool fMatureOnly,
     for (CMintMeta& meta : vOverWrite)
         UpdateState(meta);
 
+    if (fUpdateStatus) {
+        fStatusChecked = true;
+        setStatusDirty.clear();
+    }
+
     return setMints;
 }
 
 void CzOHMCTracker::Clear()
 {
     mapSerialHashes.clear();
+    mapPubcoinHashes.clear();
+    setStatusDirty.clear();
+    fStatusChecked = false;
 }
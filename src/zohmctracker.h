@@ -7,8 +7,10 @@
 
 #include "primitives/zerocoin.h"
 #include <list>
+#include <set>
 
 class CDeterministicMint;
+class CTransaction;
 
 class CzOHMCTracker
 {
@@ -16,8 +18,14 @@ private:
     bool fInitialized;
     std::string strWalletFile;
     std::map<uint256, CMintMeta> mapSerialHashes;
+    std::map<uint256, uint256> mapPubcoinHashes; //pubcoinhash, serialhash
     std::map<uint256, uint256> mapPendingSpends; //serialhash, txid of spend
-    bool UpdateStatusInternal(const std::set<uint256>& setMempool, CMintMeta& mint);
+    //! Whether every mint's status has been checked, after which only those in setStatusDirty and unconfirmed ones are
+    bool fStatusChecked;
+    std::set<uint256> setStatusDirty; //serialhashes of mints with transactions seen since their status was checked
+    void SetMeta(const CMintMeta& meta);
+    bool NeedsStatusUpdate(const CMintMeta& mint) const;
+    bool UpdateStatusInternal(CMintMeta& mint);
 public:
     CzOHMCTracker(std::string strWalletFile);
     ~CzOHMCTracker();
@@ -39,6 +47,8 @@ public:
     std::vector<CMintMeta> GetMints(bool fConfirmedOnly) const;
     CAmount GetUnconfirmedBalance() const;
     std::set<CMintMeta> ListMints(bool fUnusedOnly, bool fMatureOnly, bool fUpdateStatus);
+    //! Have the status of the mints a block or mempool transaction mints or spends checked on the next ListMints()
+    void MarkStatusDirty(const CTransaction& tx);
     void RemovePending(const uint256& txid);
     void SetPubcoinUsed(const uint256& hashPubcoin, const uint256& txid);
     void SetPubcoinNotUsed(const uint256& hashPubcoin);
@@ -10,9 +10,12 @@
 #include "wallet/wallet.h"
 #include "primitives/deterministicmint.h"
 
+#include <algorithm>
+#include <functional>
+
 using namespace libzerocoin;
 
-CzOHMCWallet::CzOHMCWallet(std::string strWalletFile)
+CzOHMCWallet::CzOHMCWallet(std::string strWalletFile) : fFillingMintPool(false), fAbortMintPool(false)
 {
     this->strWalletFile = strWalletFile;
     CWalletDB walletdb(strWalletFile);
@@ -87,7 +90,12 @@ bool CzOHMCWallet::SetMasterSeed(const uint256& seedMaster, bool fResetCount)
     else if (!walletdb.ReadZOHMCCount(nCountLastUsed))
         nCountLastUsed = 0;
 
-    mintPool.Reset();
+    // Unlocking again with the same seed keeps the pool derived from it, and
+    // with it what has been synced already
+    uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
+    if (fResetCount || hashSeed != hashSeedPool || seedMaster == 0)
+        mintPool.Reset();
+    hashSeedPool = hashSeed;
 
     return true;
 }
@@ -102,55 +110,123 @@ void CzOHMCWallet::AddToMintPool(const std::pair<uint256, uint32_t>& pMint, bool
     mintPool.Add(pMint, fVerbose);
 }
 
-//Add the next 20 mints to the mint pool
-void CzOHMCWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd)
+static uint512 GetZerocoinSeed(const uint256& seedMaster, uint32_t n)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << seedMaster << n;
+    uint512 zerocoinSeed = Hash512(ss.begin(), ss.end());
+    return zerocoinSeed;
+}
+
+/**
+ * Add the next 20 mints to the mint pool. They are derived without holding
+ * cs_wallet, from a copy of the seed; it is only taken to add each batch, so
+ * unless the caller holds cs_wallet the wallet stays usable throughout.
+ */
+void CzOHMCWallet::GenerateMintPool(uint32_t nCountStart, uint32_t nCountEnd, int nThreads)
 {
+    uint256 seed;
+    uint32_t n;
+    uint32_t nStop;
+    std::vector<uint32_t> vCounts;
+    {
+        LOCK(pwalletMain->cs_wallet);
+
+        //Is locked
+        if (seedMaster == 0)
+            return;
+        seed = seedMaster;
 
-    //Is locked
-    if (seedMaster == 0)
-        return;
+        n = nCountLastUsed + 1;
+
+        if (nCountStart > 0)
+            n = nCountStart;
 
-    uint32_t n = nCountLastUsed + 1;
+        nStop = n + 20;
+        if (nCountEnd > 0)
+            nStop = std::max(n, n + nCountEnd);
 
-    if (nCountStart > 0)
-        n = nCountStart;
+        // Prevent unnecessary repeated minted
+        std::set<uint32_t> setCounts;
+        for (auto& pair : mintPool)
+            setCounts.insert(pair.second);
+        for (uint32_t i = n; i < nStop; ++i) {
+            if (!setCounts.count(i))
+                vCounts.push_back(i);
+        }
+    }
 
-    uint32_t nStop = n + 20;
-    if (nCountEnd > 0)
-        nStop = std::max(n, n + nCountEnd);
+    if (nThreads <= 0)
+        nThreads = GetArg("-keypoolthreads", DEFAULT_KEYPOOL_THREADS);
+    nThreads = std::max(1, std::min(nThreads, MAX_KEYPOOL_THREADS));
 
-    bool fFound;
+    uint256 hashSeed = Hash(seed.begin(), seed.end());
+    LogPrintf("%s : n=%d nStop=%d new=%d threads=%d\n", __func__, n, nStop - 1, vCounts.size(), nThreads);
 
-    uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
-    LogPrintf("%s : n=%d nStop=%d\n", __func__, n, nStop - 1);
-    for (uint32_t i = n; i < nStop; ++i) {
-        if (ShutdownRequested())
+    // The mints are derived on nThreads threads a batch at a time, then added
+    // to the pool and written, a batch per write, in count order
+    const size_t nBatchSize = MINTPOOL_BATCH_SIZE;
+    for (size_t nBatchStart = 0; nBatchStart < vCounts.size(); nBatchStart += nBatchSize) {
+        if (ShutdownRequested() || fAbortMintPool)
             return;
 
-        fFound = false;
-
-        // Prevent unnecessary repeated minted
-        for (auto& pair : mintPool) {
-            if(pair.second == i) {
-                fFound = true;
-                break;
-            }
+        size_t nBatch = std::min(nBatchSize, vCounts.size() - nBatchStart);
+        std::vector<CBigNum> vValues(nBatch);
+        ParallelFor(nBatch, nThreads, [&](size_t i) {
+            CBigNum bnSerial;
+            CBigNum bnRandomness;
+            CKey key;
+            SeedToZOHMC(::GetZerocoinSeed(seed, vCounts[nBatchStart + i]), vValues[i], bnSerial, bnRandomness, key);
+        });
+
+        LOCK(pwalletMain->cs_wallet);
+        // The wallet was locked or given another seed meanwhile
+        if (seedMaster != seed)
+            return;
+        CDBBatch batch(strWalletFile);
+        CWalletDB walletdb(strWalletFile);
+        for (size_t i = 0; i < nBatch; i++) {
+            uint32_t nCount = vCounts[nBatchStart + i];
+            mintPool.Add(vValues[i], nCount);
+            walletdb.WriteMintPoolPair(hashSeed, GetPubCoinHash(vValues[i]), nCount);
+            LogPrint("zero", "%s : %s count=%d\n", __func__, vValues[i].GetHex().substr(0, 6), nCount);
         }
+        LogPrintf("%s : added %d of %d mints to the pool\n", __func__, nBatchStart + nBatch, vCounts.size());
+    }
+}
 
-        if(fFound)
-            continue;
+bool CzOHMCWallet::GenerateMintPoolInBackground(uint32_t nCountStart, uint32_t nCountEnd, int nThreads, bool fSync)
+{
+    LOCK(pwalletMain->cs_wallet);
+    if (seedMaster == 0 || fFillingMintPool || fAbortMintPool)
+        return false;
 
-        uint512 seedZerocoin = GetZerocoinSeed(i);
-        CBigNum bnValue;
-        CBigNum bnSerial;
-        CBigNum bnRandomness;
-        CKey key;
-        SeedToZOHMC(seedZerocoin, bnValue, bnSerial, bnRandomness, key);
+    // A previous fill has finished by now, all that's left is to reap its thread
+    if (threadMintPool.joinable())
+        threadMintPool.join();
+    fFillingMintPool = true;
+    threadMintPool = boost::thread([this, nCountStart, nCountEnd, nThreads, fSync]() {
+        RenameThread("ohmcoin-mintpool");
+        try {
+            GenerateMintPool(nCountStart, nCountEnd, nThreads);
+            if (fSync && !ShutdownRequested() && !fAbortMintPool) {
+                LOCK2(cs_main, pwalletMain->cs_wallet);
+                RemoveMintsFromPool(pwalletMain->zohmcTracker->GetSerialHashes());
+                SyncWithChain(false);
+            }
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "GenerateMintPoolInBackground()");
+        }
+        fFillingMintPool = false;
+    });
+    return true;
+}
 
-        mintPool.Add(bnValue, i);
-        CWalletDB(strWalletFile).WriteMintPoolPair(hashSeed, GetPubCoinHash(bnValue), i);
-        LogPrintf("%s : %s count=%d\n", __func__, bnValue.GetHex().substr(0, 6), i);
-    }
+void CzOHMCWallet::StopMintPoolFill()
+{
+    fAbortMintPool = true;
+    if (threadMintPool.joinable())
+        threadMintPool.join();
 }
 
 // pubcoin hashes are stored to db so that a full accounting of mints belonging to the seed can be tracked without regenerating
@@ -177,49 +253,137 @@ void CzOHMCWallet::GetState(int& nCount, int& nLastGenerated)
     nLastGenerated = mintPool.CountOfLastGenerated();
 }
 
-//Catch the counter up with the chain
-void CzOHMCWallet::SyncWithChain(bool fGenerateMintPool)
+/**
+ * Call fn for each of the transactions, with the block it is in, reading each
+ * block from disk once: the transactions in the transaction index in the order
+ * their blocks are on disk, then any others one at a time. ptx is NULL for a
+ * transaction that isn't found, pblock and pindex when its block isn't.
+ */
+static void ReadTransactions(const std::set<uint256>& setTxHashes, const std::function<void(const uint256& txid, const CTransaction* ptx, const CBlock* pblock, CBlockIndex* pindex)>& fn)
 {
-    uint32_t nLastCountUsed = 0;
-    bool found = true;
-    CWalletDB walletdb(strWalletFile);
+    AssertLockHeld(cs_main);
+
+    std::vector<std::pair<std::pair<int, unsigned int>, uint256> > vPos;
+    std::vector<uint256> vNotIndexed;
+    for (const uint256& txid : setTxHashes) {
+        CDiskTxPos postx;
+        if (fTxIndex && pblocktree->ReadTxIndex(txid, postx))
+            vPos.push_back(make_pair(make_pair(postx.nFile, postx.nPos), txid));
+        else
+            vNotIndexed.push_back(txid);
+    }
+    std::sort(vPos.begin(), vPos.end());
+
+    CBlock block;
+    bool fBlock = false;
+    CBlockIndex* pindex = nullptr;
+    std::pair<int, unsigned int> posBlock(-1, 0);
+    for (const auto& it : vPos) {
+        if (it.first != posBlock) {
+            posBlock = it.first;
+            fBlock = ReadBlockFromDisk(block, CDiskBlockPos(posBlock.first, posBlock.second));
+            pindex = nullptr;
+            if (fBlock && mapBlockIndex.count(block.GetHash()))
+                pindex = mapBlockIndex.at(block.GetHash());
+        }
 
+        const CTransaction* ptx = nullptr;
+        if (fBlock) {
+            for (const CTransaction& tx : block.vtx) {
+                if (tx.GetHash() == it.second) {
+                    ptx = &tx;
+                    break;
+                }
+            }
+        }
+        if (ptx)
+            fn(it.second, ptx, &block, pindex);
+        else
+            vNotIndexed.push_back(it.second);
+    }
+
+    for (const uint256& txid : vNotIndexed) {
+        CTransaction tx;
+        uint256 hashBlock;
+        if (!GetTransaction(txid, tx, hashBlock, true)) {
+            fn(txid, nullptr, nullptr, nullptr);
+            continue;
+        }
+
+        CBlock blockTx;
+        CBlockIndex* pindexTx = nullptr;
+        if (mapBlockIndex.count(hashBlock))
+            pindexTx = mapBlockIndex.at(hashBlock);
+        if (pindexTx && ReadBlockFromDisk(blockTx, pindexTx))
+            fn(txid, &tx, &blockTx, pindexTx);
+        else
+            fn(txid, &tx, nullptr, pindexTx);
+    }
+}
+
+/**
+ * Catch the counter up with the chain. Each round looks up all of the pool's
+ * pubcoins in one pass over the zerocoin database, then reads the blocks of
+ * the mints found, and of the spends of those, once each.
+ */
+void CzOHMCWallet::SyncWithChain(bool fGenerateMintPool)
+{
     set<uint256> setAddedTx;
+    auto AddTxToWallet = [&setAddedTx](const CTransaction& tx, const CBlock* pblock, const CBlockIndex* pindex) {
+        if (!setAddedTx.insert(tx.GetHash()).second)
+            return;
+
+        //Fill out wtx so that a transaction record can be created
+        CWalletTx wtx(pwalletMain, tx);
+        if (pblock)
+            wtx.SetMerkleBranch(*pblock);
+        if (pindex)
+            wtx.nTimeReceived = pindex->GetBlockTime();
+        pwalletMain->AddToWallet(wtx);
+    };
+
+    bool found = true;
     while (found) {
         found = false;
         if (fGenerateMintPool)
             GenerateMintPool();
         LogPrintf("%s: Mintpool size=%d\n", __func__, mintPool.size());
 
-        std::set<uint256> setChecked;
-        list<pair<uint256,uint32_t> > listMints = mintPool.List();
-        for (pair<uint256, uint32_t> pMint : listMints) {
-            LOCK(cs_main);
-            if (setChecked.count(pMint.first))
-                return;
-            setChecked.insert(pMint.first);
-
-            if (ShutdownRequested())
-                return;
+        if (ShutdownRequested() || fAbortMintPool)
+            return;
 
-            if (pwalletMain->zohmcTracker->HasPubcoinHash(pMint.first)) {
+        // The pool's mints the tracker doesn't know yet
+        std::vector<uint256> vHashPubcoin;
+        for (const pair<uint256, uint32_t>& pMint : mintPool.List()) {
+            if (pwalletMain->zohmcTracker->HasPubcoinHash(pMint.first))
                 mintPool.Remove(pMint.first);
-                continue;
-            }
+            else
+                vHashPubcoin.push_back(pMint.first);
+        }
 
-            uint256 txHash;
-            CZerocoinMint mint;
-            if (zerocoinDB->ReadCoinMint(pMint.first, txHash)) {
-                //this mint has already occurred on the chain, increment counter's state to reflect this
-                LogPrintf("%s : Found wallet coin mint=%s count=%d tx=%s\n", __func__, pMint.first.GetHex(), pMint.second, txHash.GetHex());
-                found = true;
-
-                uint256 hashBlock;
-                CTransaction tx;
-                if (!GetTransaction(txHash, tx, hashBlock, true)) {
-                    LogPrintf("%s : failed to get transaction for mint %s!\n", __func__, pMint.first.GetHex());
-                    found = false;
-                    nLastCountUsed = std::max(pMint.second, nLastCountUsed);
+        std::map<uint256, uint256> mapMintTx;
+        if (!zerocoinDB->ReadCoinMints(vHashPubcoin, mapMintTx)) {
+            LogPrintf("%s : failed to read mints from the zerocoin database\n", __func__);
+            return;
+        }
+        if (mapMintTx.empty())
+            break;
+
+        LOCK(cs_main);
+        std::map<uint256, std::vector<uint256> > mapTxMints;
+        std::set<uint256> setTxHashes;
+        for (const auto& it : mapMintTx) {
+            //this mint has already occurred on the chain, increment counter's state to reflect this
+            LogPrintf("%s : Found wallet coin mint=%s tx=%s\n", __func__, it.first.GetHex(), it.second.GetHex());
+            mapTxMints[it.second].push_back(it.first);
+            setTxHashes.insert(it.second);
+        }
+
+        std::vector<CDeterministicMint> vMints;
+        ReadTransactions(setTxHashes, [&](const uint256& txid, const CTransaction* ptx, const CBlock* pblock, CBlockIndex* pindex) {
+            for (const uint256& hashPubcoin : mapTxMints[txid]) {
+                if (!ptx || !pindex) {
+                    LogPrintf("%s : failed to get transaction for mint %s!\n", __func__, hashPubcoin.GetHex());
                     continue;
                 }
 
@@ -227,20 +391,19 @@ void CzOHMCWallet::SyncWithChain(bool fGenerateMintPool)
                 CoinDenomination denomination = CoinDenomination::ZQ_ERROR;
                 bool fFoundMint = false;
                 CBigNum bnValue = 0;
-                for (const CTxOut& out : tx.vout) {
+                for (const CTxOut& out : ptx->vout) {
                     if (!out.scriptPubKey.IsZerocoinMint())
                         continue;
 
                     PublicCoin pubcoin(Params().Zerocoin_Params());
                     CValidationState state;
                     if (!TxOutToPublicCoin(out, pubcoin, state)) {
-                        LogPrintf("%s : failed to get mint from txout for %s!\n", __func__, pMint.first.GetHex());
+                        LogPrintf("%s : failed to get mint from txout for %s!\n", __func__, hashPubcoin.GetHex());
                         continue;
                     }
 
                     // See if this is the mint that we are looking for
-                    uint256 hashPubcoin = GetPubCoinHash(pubcoin.getValue());
-                    if (pMint.first == hashPubcoin) {
+                    if (hashPubcoin == GetPubCoinHash(pubcoin.getValue())) {
                         denomination = pubcoin.getDenomination();
                         bnValue = pubcoin.getValue();
                         fFoundMint = true;
@@ -249,37 +412,50 @@ void CzOHMCWallet::SyncWithChain(bool fGenerateMintPool)
                 }
 
                 if (!fFoundMint || denomination == ZQ_ERROR) {
-                    LogPrintf("%s : failed to get mint %s from tx %s!\n", __func__, pMint.first.GetHex(), tx.GetHash().GetHex());
-                    found = false;
-                    break;
+                    LogPrintf("%s : failed to get mint %s from tx %s!\n", __func__, hashPubcoin.GetHex(), txid.GetHex());
+                    continue;
                 }
 
-                CBlockIndex* pindex = nullptr;
-                if (mapBlockIndex.count(hashBlock))
-                    pindex = mapBlockIndex.at(hashBlock);
-
-                if (!setAddedTx.count(txHash)) {
-                    CBlock block;
-                    CWalletTx wtx(pwalletMain, tx);
-                    if (pindex && ReadBlockFromDisk(block, pindex))
-                        wtx.SetMerkleBranch(block);
-
-                    //Fill out wtx so that a transaction record can be created
-                    wtx.nTimeReceived = pindex->GetBlockTime();
-                    pwalletMain->AddToWallet(wtx);
-                    setAddedTx.insert(txHash);
-                }
+                AddTxToWallet(*ptx, pblock, pindex);
 
-                SetMintSeen(bnValue, pindex->nHeight, txHash, denomination);
-                nLastCountUsed = std::max(pMint.second, nLastCountUsed);
-                nCountLastUsed = std::max(nLastCountUsed, nCountLastUsed);
-                LogPrint("zero", "%s: updated count to %d\n", __func__, nCountLastUsed);
+                CDeterministicMint dMint;
+                if (RegenerateSeenMint(bnValue, pindex->nHeight, txid, denomination, dMint))
+                    vMints.push_back(dMint);
             }
+        });
+
+        // Which of them have been spent, looked up the same way
+        std::vector<uint256> vHashSerial;
+        for (const CDeterministicMint& dMint : vMints)
+            vHashSerial.push_back(dMint.GetSerialHash());
+        std::map<uint256, uint256> mapSpendTx;
+        zerocoinDB->ReadCoinSpends(vHashSerial, mapSpendTx);
+
+        std::set<uint256> setSpendTxHashes;
+        for (const auto& it : mapSpendTx)
+            setSpendTxHashes.insert(it.second);
+        std::set<uint256> setSpentInChain;
+        ReadTransactions(setSpendTxHashes, [&](const uint256& txid, const CTransaction* ptx, const CBlock* pblock, CBlockIndex* pindex) {
+            if (!ptx || !pindex || !chainActive.Contains(pindex))
+                return;
+
+            //Find transaction details and make a wallettx and add to wallet
+            AddTxToWallet(*ptx, pblock, pindex);
+            setSpentInChain.insert(txid);
+        });
+
+        for (CDeterministicMint& dMint : vMints) {
+            auto it = mapSpendTx.find(dMint.GetSerialHash());
+            if (it != mapSpendTx.end() && setSpentInChain.count(it->second))
+                dMint.SetUsed(true);
+            AddSeenMint(dMint);
+            found = true;
         }
+        LogPrint("zero", "%s: updated count to %d\n", __func__, nCountLastUsed);
     }
 }
 
-bool CzOHMCWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const CoinDenomination& denom)
+bool CzOHMCWallet::RegenerateSeenMint(const CBigNum& bnValue, int nHeight, const uint256& txid, const CoinDenomination& denom, CDeterministicMint& dMint)
 {
     if (!mintPool.Has(bnValue))
         return error("%s: value not in pool", __func__);
@@ -297,22 +473,47 @@ bool CzOHMCWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const
     if (bnValueGen != bnValue)
         return error("%s: generated pubcoin and expected value do not match!", __func__);
 
-    // Create mint object and database it
+    // Create mint object
     uint256 hashSeed = Hash(seedMaster.begin(), seedMaster.end());
     uint256 hashSerial = GetSerialHash(bnSerial);
     uint256 hashPubcoin = GetPubCoinHash(bnValue);
     uint256 nSerial = bnSerial.getuint256();
     uint256 hashStake = Hash(nSerial.begin(), nSerial.end());
-    CDeterministicMint dMint(PrivateCoin::CURRENT_VERSION, pMint.second, hashSeed, hashSerial, hashPubcoin, hashStake);
+    dMint = CDeterministicMint(PrivateCoin::CURRENT_VERSION, pMint.second, hashSeed, hashSerial, hashPubcoin, hashStake);
     dMint.SetDenomination(denom);
     dMint.SetHeight(nHeight);
     dMint.SetTxHash(txid);
 
+    return true;
+}
+
+void CzOHMCWallet::AddSeenMint(const CDeterministicMint& dMint)
+{
+    // Add to zohmcTracker which also adds to database
+    pwalletMain->zohmcTracker->Add(dMint, true);
+
+    //Update the count if it is less than the mint's count
+    if (nCountLastUsed < dMint.GetCount()) {
+        CWalletDB walletdb(strWalletFile);
+        nCountLastUsed = dMint.GetCount();
+        walletdb.WriteZOHMCCount(nCountLastUsed);
+    }
+
+    //remove from the pool
+    mintPool.Remove(dMint.GetPubcoinHash());
+}
+
+bool CzOHMCWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const CoinDenomination& denom)
+{
+    CDeterministicMint dMint;
+    if (!RegenerateSeenMint(bnValue, nHeight, txid, denom, dMint))
+        return false;
+
     // Check if this is also already spent
     int nHeightTx;
     uint256 txidSpend;
     CTransaction txSpend;
-    if (IsSerialInBlockchain(hashSerial, nHeightTx, txidSpend, txSpend)) {
+    if (IsSerialInBlockchain(dMint.GetSerialHash(), nHeightTx, txidSpend, txSpend)) {
         //Find transaction details and make a wallettx and add to wallet
         dMint.SetUsed(true);
         CWalletTx wtx(pwalletMain, txSpend);
@@ -325,18 +526,7 @@ bool CzOHMCWallet::SetMintSeen(const CBigNum& bnValue, const int& nHeight, const
         pwalletMain->AddToWallet(wtx);
     }
 
-    // Add to zohmcTracker which also adds to database
-    pwalletMain->zohmcTracker->Add(dMint, true);
-
-    //Update the count if it is less than the mint's count
-    if (nCountLastUsed < pMint.second) {
-        CWalletDB walletdb(strWalletFile);
-        nCountLastUsed = pMint.second;
-        walletdb.WriteZOHMCCount(nCountLastUsed);
-    }
-
-    //remove from the pool
-    mintPool.Remove(dMint.GetPubcoinHash());
+    AddSeenMint(dMint);
 
     return true;
 }
@@ -400,10 +590,7 @@ void CzOHMCWallet::SeedToZOHMC(const uint512& seedZerocoin, CBigNum& bnValue, CB
 
 uint512 CzOHMCWallet::GetZerocoinSeed(uint32_t n)
 {
-    CDataStream ss(SER_GETHASH, 0);
-    ss << seedMaster << n;
-    uint512 zerocoinSeed = Hash512(ss.begin(), ss.end());
-    return zerocoinSeed;
+    return ::GetZerocoinSeed(seedMaster, n);
 }
 
 void CzOHMCWallet::UpdateCount()
@@ -5,24 +5,36 @@
 #ifndef OHMCOIN_ZOHMCWALLET_H
 #define OHMCOIN_ZOHMCWALLET_H
 
+#include <atomic>
 #include <map>
+#include <boost/thread.hpp>
 #include "libzerocoin/Coin.h"
 #include "mintpool.h"
 #include "uint256.h"
 #include "primitives/zerocoin.h"
 
+//! Mints derived between each write to the mint pool
+static const unsigned int MINTPOOL_BATCH_SIZE = 100;
+
 class CDeterministicMint;
 
 class CzOHMCWallet
 {
 private:
     uint256 seedMaster;
+    //! Hash of the seed the mint pool was derived from, kept while the wallet is locked
+    uint256 hashSeedPool;
     uint32_t nCountLastUsed;
     std::string strWalletFile;
     CMintPool mintPool;
+    //! Background mint pool fill, see GenerateMintPoolInBackground()
+    boost::thread threadMintPool;
+    std::atomic<bool> fFillingMintPool;
+    std::atomic<bool> fAbortMintPool;
 
 public:
     CzOHMCWallet(std::string strWalletFile);
+    ~CzOHMCWallet() { StopMintPoolFill(); }
 
     void AddToMintPool(const std::pair<uint256, uint32_t>& pMint, bool fVerbose);
     bool SetMasterSeed(const uint256& seedMaster, bool fResetCount = false);
@@ -32,7 +44,12 @@ public:
     void GenerateMint(const uint32_t& nCount, const libzerocoin::CoinDenomination denom, libzerocoin::PrivateCoin& coin, CDeterministicMint& dMint);
     void GetState(int& nCount, int& nLastGenerated);
     bool RegenerateMint(const CDeterministicMint& dMint, CZerocoinMint& mint);
-    void GenerateMintPool(uint32_t nCountStart = 0, uint32_t nCountEnd = 0);
+    //! Derive the mints with counts from nCountStart on, nCountEnd of them, on nThreads threads (default: -keypoolthreads)
+    void GenerateMintPool(uint32_t nCountStart = 0, uint32_t nCountEnd = 0, int nThreads = 0);
+    //! GenerateMintPool on a thread of its own, then SyncWithChain(false) if fSync; false if the wallet is locked or that is running already
+    bool GenerateMintPoolInBackground(uint32_t nCountStart = 0, uint32_t nCountEnd = 0, int nThreads = 0, bool fSync = false);
+    //! Stop a background mint pool fill after its current batch, and wait for it
+    void StopMintPoolFill();
     bool LoadMintPoolFromDB();
     void RemoveMintsFromPool(const std::vector<uint256>& vPubcoinHashes);
     bool SetMintSeen(const CBigNum& bnValue, const int& nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom);
@@ -43,6 +60,8 @@ public:
 
 private:
     uint512 GetZerocoinSeed(uint32_t n);
+    bool RegenerateSeenMint(const CBigNum& bnValue, int nHeight, const uint256& txid, const libzerocoin::CoinDenomination& denom, CDeterministicMint& dMint);
+    void AddSeenMint(const CDeterministicMint& dMint);
 };
 
 #endif //OHMCOIN_ZOHMCWALLET_H
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the HTTP worker pools set with -rpcpool:
+#   a) gethttpserverinfo reports the default pool and each -rpcpool as given
+#   b) the node runs the number of worker threads the pools ask for
+#   c) requests are served, and counted, by the pool of their prefix
+#
+
+import http.client
+import os
+import time
+
+from test_framework.util import *
+from test_case_base import TestCaseBase
+
+RPC_THREADS = 3
+RPC_WORKQUEUE = 8
+REST_THREADS = 2
+REST_WORKQUEUE = 5
+
+class HTTPServerTest(TestCaseBase):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir, [
+            "-rpcthreads=%d" % RPC_THREADS,
+            "-rpcworkqueue=%d" % RPC_WORKQUEUE,
+            "-rpcpool=/rest/:%d:%d" % (REST_THREADS, REST_WORKQUEUE),
+        ])]
+        self.is_network_split = False
+
+    def rest_get(self, uri):
+        conn = http.client.HTTPConnection("127.0.0.1", rpc_port(0))
+        conn.request("GET", uri)
+        resp = conn.getresponse()
+        resp.read()
+        conn.close()
+        return resp.status
+
+    def get_pool(self, info, prefix):
+        pools = [pool for pool in info["pools"] if pool["prefix"] == prefix]
+        assert_equal(len(pools), 1)
+        return pools[0]
+
+    def test_pools_reported(self):
+        info = self.nodes[0].gethttpserverinfo()
+        assert_equal(len(info["pools"]), 2)
+        # The default pool comes first
+        assert_equal(info["pools"][0]["prefix"], "")
+
+        default = self.get_pool(info, "")
+        assert_equal(default["threads"], RPC_THREADS)
+        assert_equal(default["max_queue_depth"], RPC_WORKQUEUE)
+        rest = self.get_pool(info, "/rest/")
+        assert_equal(rest["threads"], REST_THREADS)
+        assert_equal(rest["max_queue_depth"], REST_WORKQUEUE)
+
+    def test_worker_threads(self):
+        # Thread names are only visible through /proc
+        taskdir = "/proc/%d/task" % ohmcoind_processes[0].pid
+        if not os.path.isdir(taskdir):
+            return
+        nWorkers = 0
+        for task in os.listdir(taskdir):
+            with open(os.path.join(taskdir, task, "comm")) as f:
+                # Linux cuts thread names to 15 characters
+                if f.read().strip() == "bitcoin-httpworker"[:15]:
+                    nWorkers += 1
+        assert_equal(nWorkers, RPC_THREADS + REST_THREADS)
+
+    def test_requests_counted_per_pool(self):
+        before = self.nodes[0].gethttpserverinfo()
+        for i in range(4):
+            assert_equal(self.rest_get("/rest/chaininfo.json"), 200)
+
+        # A request is counted just after its reply goes out
+        nRestExpected = self.get_pool(before, "/rest/")["processed"] + 4
+        for i in range(50):
+            after = self.nodes[0].gethttpserverinfo()
+            if self.get_pool(after, "/rest/")["processed"] >= nRestExpected:
+                break
+            time.sleep(0.1)
+        assert_equal(self.get_pool(after, "/rest/")["processed"], nRestExpected)
+        assert_equal(self.get_pool(after, "/rest/")["rejected"], 0)
+        # The default pool only served the gethttpserverinfo calls
+        assert_greater_than(self.get_pool(before, "")["processed"] + i + 3, self.get_pool(after, "")["processed"])
+
+        endpoints = [e for e in after["endpoints"] if e["prefix"] == "/rest/chaininfo"]
+        assert_equal(len(endpoints), 1)
+        assert_equal(endpoints[0]["pool"], "/rest/")
+        assert_greater_than(endpoints[0]["requests"], 3)
+
+
+if __name__ == '__main__':
+    HTTPServerTest().main()
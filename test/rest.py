@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014 The Bitcoin Core developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the REST block range and transaction batch interfaces:
+#   a) /rest/blockrange streams the same bytes as /rest/block, block by block
+#   b) /rest/blockrange and /rest/txs enforce their range and count limits
+#   c) invalid ranges and hashes are rejected before anything is streamed
+#
+
+import http.client
+
+from test_framework.util import *
+from test_case_base import TestCaseBase
+
+MAX_REST_BLOCKRANGE = 1000
+MAX_REST_TXS = 100
+
+class RESTTest(TestCaseBase):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir, ["-txindex"])]
+        self.is_network_split = False
+
+    def rest_get(self, uri):
+        conn = http.client.HTTPConnection("127.0.0.1", rpc_port(0))
+        conn.request("GET", uri)
+        resp = conn.getresponse()
+        body = resp.read()
+        conn.close()
+        return resp, body
+
+    def rest_ok(self, uri):
+        resp, body = self.rest_get(uri)
+        assert_equal(resp.status, 200)
+        return body
+
+    def initialize(self):
+        self.nodes[0].setgenerate(True, 20)
+        self.height = self.nodes[0].getblockcount()
+        self.hashes = [self.nodes[0].getblockhash(h) for h in range(self.height + 1)]
+
+    def test_blockrange_matches_block(self):
+        resp, body = self.rest_get("/rest/blockrange/0/%d.bin" % (self.height + 1))
+        assert_equal(resp.status, 200)
+        assert_equal(resp.getheader("Transfer-Encoding"), "chunked")
+        assert_equal(body, b"".join(self.rest_ok("/rest/block/%s.bin" % h) for h in self.hashes))
+
+        body = self.rest_ok("/rest/blockrange/3/5.hex")
+        assert_equal(body, b"".join(self.rest_ok("/rest/block/%s.hex" % h) for h in self.hashes[3:8]))
+
+    def test_blockrange_limits(self):
+        # A range past the tip ends at the tip
+        body = self.rest_ok("/rest/blockrange/%d/%d.hex" % (self.height - 1, MAX_REST_BLOCKRANGE))
+        assert_equal(body.decode().split(), [self.rest_ok("/rest/block/%s.hex" % h).decode().strip() for h in self.hashes[-2:]])
+
+        assert_equal(self.rest_get("/rest/blockrange/0/%d.bin" % MAX_REST_BLOCKRANGE)[0].status, 200)
+        assert_equal(self.rest_get("/rest/blockrange/0/%d.bin" % (MAX_REST_BLOCKRANGE + 1))[0].status, 400)
+        assert_equal(self.rest_get("/rest/blockrange/0/0.bin")[0].status, 400)
+        assert_equal(self.rest_get("/rest/blockrange/%d/1.bin" % (self.height + 1))[0].status, 404)
+
+    def test_blockrange_invalid(self):
+        assert_equal(self.rest_get("/rest/blockrange/-1/1.bin")[0].status, 400)
+        assert_equal(self.rest_get("/rest/blockrange/0/-1.bin")[0].status, 400)
+        assert_equal(self.rest_get("/rest/blockrange/a/1.bin")[0].status, 400)
+        assert_equal(self.rest_get("/rest/blockrange/0.bin")[0].status, 400)
+        assert_equal(self.rest_get("/rest/blockrange/0/1/2.bin")[0].status, 400)
+        # Only the raw formats can be streamed
+        assert_equal(self.rest_get("/rest/blockrange/0/1.json")[0].status, 404)
+
+    def test_txs(self):
+        txids = [self.nodes[0].getblock(h)["tx"][0] for h in self.hashes[1:6]]
+
+        body = self.rest_ok("/rest/txs/%s.hex" % ",".join(txids))
+        assert_equal(body, b"".join(self.rest_ok("/rest/tx/%s.hex" % txid) for txid in txids))
+        body = self.rest_ok("/rest/txs/%s.bin" % ",".join(txids))
+        assert_equal(body, b"".join(self.rest_ok("/rest/tx/%s.bin" % txid) for txid in txids))
+
+        assert_equal(self.rest_get("/rest/txs/%s.hex" % ",".join([txids[0]] * MAX_REST_TXS))[0].status, 200)
+        assert_equal(self.rest_get("/rest/txs/%s.hex" % ",".join([txids[0]] * (MAX_REST_TXS + 1)))[0].status, 400)
+        assert_equal(self.rest_get("/rest/txs/%s,xyz.hex" % txids[0])[0].status, 400)
+        assert_equal(self.rest_get("/rest/txs/%s,%s.hex" % (txids[0], "00" * 32))[0].status, 404)
+        assert_equal(self.rest_get("/rest/txs/%s.json" % txids[0])[0].status, 404)
+
+
+if __name__ == '__main__':
+    RESTTest().main()